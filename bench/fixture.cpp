@@ -0,0 +1,337 @@
+#include "fixture.h"
+
+#include <common/filesystem.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace Bench
+{
+  const char FIXTURE_NEEDLE[] = "zyxneedle";
+  const char FIXTURE_MARKER[] = ".tf-bench-fixture";
+
+  namespace
+  {
+    const char* const WORDS[] = {
+      "alpha", "beta", "gamma", "delta", "return", "const", "struct", "value",
+      "buffer", "size", "offset", "count", "index", "path", "name", "file",
+      "error", "result", "while", "for", "if", "else", "switch", "case",
+      "class", "public", "private", "static", "void", "int", "char", "double",
+      "the", "of", "and", "to", "in", "is", "that", "with",
+      "directory", "search", "match", "content", "stream", "archive", "thread", "pool",
+      "Lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+      "{", "}", "(", ")", "=", "+", ";", "//"
+    };
+    const std::size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    const char* const TEXT_EXTENSIONS[] = { ".txt", ".cpp", ".h", ".md" };
+    const char* const BINARY_EXTENSIONS[] = { ".bin", ".dat", ".o" };
+
+    const char* const SIZE_DISTRIBUTION_NAMES[] = { "fixed", "uniform", "log-uniform" };
+
+    // splitmix64: tiny, fast and gives the same sequence on every platform,
+    // unlike std:: distributions whose output is implementation defined
+    class Random
+    {
+    public:
+      explicit Random(std::uint64_t seed)
+        : State(seed)
+      {
+      }
+
+      std::uint64_t Next()
+      {
+        std::uint64_t z = (State += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+      }
+
+      std::size_t Below(std::size_t bound)
+      {
+        return bound ? static_cast<std::size_t>(Next() % bound) : 0;
+      }
+
+      // [0, 1)
+      double Real()
+      {
+        return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0);
+      }
+
+    private:
+      std::uint64_t State;
+    };
+
+    Common::Error MakeOsError(const std::string& path)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(path + ": " + strerror(errno)));
+    }
+
+    Common::Error WriteFile(const std::string& path, const std::string& data)
+    {
+      const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0)
+      {
+        return MakeOsError(path);
+      }
+      std::size_t written = 0;
+      while (written < data.size())
+      {
+        const ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          const Common::Error error = MakeOsError(path);
+          close(fd);
+          return error;
+        }
+        written += result;
+      }
+      close(fd);
+      return Common::Success;
+    }
+
+    class Generator
+    {
+    public:
+      Generator(const FixtureSpec& spec, FixtureStats& stats)
+        : Spec(spec)
+        , Stats(stats)
+        , Rng(spec.Seed)
+        , NeedleLength(strlen(FIXTURE_NEEDLE))
+        , NeedleChance(0)
+      {
+        std::size_t totalLength = 0;
+        for (const char* word: WORDS)
+        {
+          totalLength += strlen(word) + 1;
+        }
+        // a word is replaced by the needle with the chance that gives NeedleRate per MiB
+        NeedleChance = Spec.NeedleRate * totalLength / WORD_COUNT / (1024.0 * 1024.0);
+      }
+
+      Common::Error CreateLevel(const std::string& path, unsigned level)
+      {
+        if (mkdir(path.c_str(), 0755) < 0)
+        {
+          return MakeOsError(path);
+        }
+        ++Stats.Dirs;
+
+        for (unsigned i = 0; i < Spec.FilesPerDir; ++i)
+        {
+          const bool text = Rng.Real() < Spec.TextRatio;
+          const std::size_t size = PickSize();
+          std::string name = "f" + Common::ToString<unsigned, std::string>(i);
+          if (text)
+          {
+            name += TEXT_EXTENSIONS[Rng.Below(sizeof(TEXT_EXTENSIONS) / sizeof(TEXT_EXTENSIONS[0]))];
+            MakeText(size);
+            ++Stats.TextFiles;
+          }
+          else
+          {
+            name += BINARY_EXTENSIONS[Rng.Below(sizeof(BINARY_EXTENSIONS) / sizeof(BINARY_EXTENSIONS[0]))];
+            MakeBinary(size);
+          }
+          RETURN_IF_FAILED(WriteFile(path + "/" + name, Buffer));
+          ++Stats.Files;
+          Stats.Bytes += Buffer.size();
+        }
+
+        if (level < Spec.Depth)
+        {
+          for (unsigned i = 0; i < Spec.FanOut; ++i)
+          {
+            RETURN_IF_FAILED(CreateLevel(path + "/d" + Common::ToString<unsigned, std::string>(i), level + 1));
+          }
+        }
+        return Common::Success;
+      }
+
+    private:
+      std::size_t PickSize()
+      {
+        const std::size_t low = Spec.MinFileSize;
+        const std::size_t high = std::max(Spec.MinFileSize, Spec.MaxFileSize);
+        switch (Spec.Sizes)
+        {
+        case SIZE_FIXED:
+          return low;
+        case SIZE_UNIFORM:
+          return low + Rng.Below(high - low + 1);
+        case SIZE_LOG_UNIFORM:
+          {
+            const double logLow = std::log(static_cast<double>(std::max<std::size_t>(low, 1)));
+            const double logHigh = std::log(static_cast<double>(std::max<std::size_t>(high, 1)));
+            const double size = std::exp(logLow + Rng.Real() * (logHigh - logLow));
+            return std::min(high, std::max(low, static_cast<std::size_t>(size)));
+          }
+        }
+        return low;
+      }
+
+      // Lines of 4-15 words; the last word that doesn't fit is replaced by line breaks,
+      // so every planted needle is complete
+      void MakeText(std::size_t size)
+      {
+        Buffer.clear();
+        Buffer.reserve(size);
+        std::size_t wordsLeft = 4 + Rng.Below(12);
+        while (true)
+        {
+          const bool needle = Rng.Real() < NeedleChance;
+          const char* word = needle ? FIXTURE_NEEDLE : WORDS[Rng.Below(WORD_COUNT)];
+          const std::size_t length = needle ? NeedleLength : strlen(word);
+          if (Buffer.size() + length + 1 > size)
+          {
+            break;
+          }
+          Buffer.append(word, length);
+          Stats.Needles += needle;
+          if (--wordsLeft == 0)
+          {
+            Buffer += '\n';
+            wordsLeft = 4 + Rng.Below(12);
+          }
+          else
+          {
+            Buffer += ' ';
+          }
+        }
+        Buffer.append(size - Buffer.size(), '\n');
+      }
+
+      void MakeBinary(std::size_t size)
+      {
+        Buffer.resize(size);
+        for (std::size_t i = 0; i < size; i += 8)
+        {
+          const std::uint64_t value = Rng.Next();
+          memcpy(&Buffer[i], &value, std::min<std::size_t>(8, size - i));
+        }
+        // NUL in the sample makes it binary regardless of what random bytes came out
+        if (size > 1)
+        {
+          Buffer[1] = '\0';
+        }
+      }
+
+      const FixtureSpec& Spec;
+      FixtureStats& Stats;
+      Random Rng;
+      std::string Buffer;
+      const std::size_t NeedleLength;
+      double NeedleChance;
+    };
+
+    Common::Error EvictFile(const std::string& path)
+    {
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        return MakeOsError(path);
+      }
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+#if defined(__APPLE__)
+        // no fadvise on macOS; invalidating a mapping drops the clean pages behind it
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+        {
+          msync(data, st.st_size, MS_INVALIDATE);
+          munmap(data, st.st_size);
+        }
+#else
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+      }
+      close(fd);
+      return Common::Success;
+    }
+
+    bool EvictEntry(Common::Error& result, const std::string& path, Filesys::FileObjectType type)
+    {
+      if (type == Filesys::FILE_REGULAR)
+      {
+        const Common::Error error = EvictFile(path);
+        if (error && !result)
+        {
+          result = error;
+        }
+      }
+      return true;
+    }
+  } // namespace
+
+  const char* GetSizeDistributionName(SizeDistribution sizes)
+  {
+    return SIZE_DISTRIBUTION_NAMES[sizes];
+  }
+
+  bool ParseSizeDistribution(const std::string& name, SizeDistribution& result)
+  {
+    for (std::size_t i = 0; i < sizeof(SIZE_DISTRIBUTION_NAMES) / sizeof(SIZE_DISTRIBUTION_NAMES[0]); ++i)
+    {
+      if (name == SIZE_DISTRIBUTION_NAMES[i])
+      {
+        result = static_cast<SizeDistribution>(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool IsFixture(const std::string& root)
+  {
+    struct stat st;
+    return stat((root + "/" + FIXTURE_MARKER).c_str(), &st) == 0;
+  }
+
+  Common::Error GenerateFixture(const std::string& root, const FixtureSpec& spec, FixtureStats& stats)
+  {
+    struct stat st;
+    if (lstat(root.c_str(), &st) == 0)
+    {
+      if (!IsFixture(root))
+      {
+        return MAKE_ERROR(
+          MAKE_MODULE_ERROR(Common::MODULE_OS, EEXIST),
+          Common::StringToWideString(root + ": exists and is not a benchmark fixture")
+        );
+      }
+      RETURN_IF_FAILED(Filesys::RemoveDirRecursive(Filesys::Dir(Common::StringToWideString(root))));
+    }
+
+    stats = FixtureStats();
+    Generator generator(spec, stats);
+    RETURN_IF_FAILED(generator.CreateLevel(root, 0));
+    return WriteFile(root + "/" + FIXTURE_MARKER, std::string());
+  }
+
+  Common::Error EvictFromCache(const std::string& root)
+  {
+    Common::Error result;
+    RETURN_IF_FAILED(Filesys::WalkDir(
+      Filesys::Dir(Common::StringToWideString(root)),
+      std::bind(EvictEntry, std::ref(result), std::placeholders::_1, std::placeholders::_2)
+    ));
+    return result;
+  }
+} // namespace Bench
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <common/error.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Bench
+{
+  enum SizeDistribution
+  {
+    SIZE_FIXED,      // every file is MinFileSize
+    SIZE_UNIFORM,
+    SIZE_LOG_UNIFORM // as many files of 1-10 KB as of 10-100 KB, close to real source trees
+  };
+
+  // Shape of a generated tree; the same spec always produces the same bytes
+  struct FixtureSpec
+  {
+    FixtureSpec()
+      : Seed(1)
+      , Depth(3)
+      , FanOut(4)
+      , FilesPerDir(16)
+      , MinFileSize(512)
+      , MaxFileSize(256 * 1024)
+      , Sizes(SIZE_LOG_UNIFORM)
+      , TextRatio(0.8)
+      , NeedleRate(4.0)
+    {
+    }
+
+    std::uint64_t Seed;
+    unsigned Depth;          // directory levels below the root
+    unsigned FanOut;         // subdirectories per directory
+    unsigned FilesPerDir;
+    std::size_t MinFileSize;
+    std::size_t MaxFileSize;
+    SizeDistribution Sizes;
+    double TextRatio;        // share of text files, the rest is random binary data
+    double NeedleRate;       // expected occurrences of FIXTURE_NEEDLE per MiB of text
+  };
+
+  struct FixtureStats
+  {
+    FixtureStats()
+      : Dirs(0)
+      , Files(0)
+      , TextFiles(0)
+      , Bytes(0)
+      , Needles(0)
+    {
+    }
+
+    std::size_t Dirs;
+    std::size_t Files;
+    std::size_t TextFiles;
+    std::uint64_t Bytes;
+    std::size_t Needles; // exact number of FIXTURE_NEEDLE occurrences in text files
+  };
+
+  // Word planted into text files, never produced by the word generator
+  extern const char FIXTURE_NEEDLE[];
+
+  // Empty file at the fixture root; trees without it are never reused or removed
+  extern const char FIXTURE_MARKER[];
+
+  const char* GetSizeDistributionName(SizeDistribution sizes);
+  bool ParseSizeDistribution(const std::string& name, SizeDistribution& result);
+
+  // Creates the tree at root, which must not exist or be a previously generated fixture
+  Common::Error GenerateFixture(const std::string& root, const FixtureSpec& spec, FixtureStats& stats);
+
+  bool IsFixture(const std::string& root);
+
+  // Drops cached pages of every file below root, so the next read goes to the disk
+  Common::Error EvictFromCache(const std::string& root);
+} // namespace Bench
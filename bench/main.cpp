@@ -0,0 +1,514 @@
+#include "fixture.h"
+#include "report.h"
+
+#include <common/filesystem.h>
+#include <common/hash.h>
+#include <common/job_control.h>
+#include <common/search.h>
+#include <common/string_utils.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <set>
+
+#include <sys/stat.h>
+
+namespace Bench
+{
+  namespace
+  {
+    struct Options
+    {
+      Options()
+        : Iterations(5)
+        , Tolerance(0.1)
+        , Keep(false)
+        , SelfTestOnly(false)
+      {
+      }
+
+      std::string Root;
+      FixtureSpec Spec;
+      unsigned Iterations;
+      std::set<std::string> Only;
+      std::string Output;   // JSON report, stdout when empty
+      std::string Baseline;
+      double Tolerance;
+      bool Keep;            // leave the fixture on disk for inspection
+      bool SelfTestOnly;
+    };
+
+    struct Context
+    {
+      std::string Root;
+      std::string CopyRoot;
+      unsigned Iterations;
+      FixtureStats Stats;
+    };
+
+    typedef std::function<Common::Error ()> Step;
+    typedef std::function<Common::Error (const Context&, Result&)> Benchmark;
+
+    const char USAGE[] =
+      "usage: tf-bench [options]\n"
+      "fixture:\n"
+      "  --root PATH          where the tree is generated, default $TMPDIR/tf-bench-fixture\n"
+      "  --seed N             generator seed, default 1\n"
+      "  --depth N            directory levels below the root, default 3\n"
+      "  --fan-out N          subdirectories per directory, default 4\n"
+      "  --files N            files per directory, default 16\n"
+      "  --min-size BYTES     default 512\n"
+      "  --max-size BYTES     default 262144\n"
+      "  --sizes fixed|uniform|log-uniform   file size distribution, default log-uniform\n"
+      "  --text-ratio X       share of text files, default 0.8\n"
+      "  --needle-rate X      needles per MiB of text, default 4\n"
+      "  --keep               don't remove the fixture at exit\n"
+      "run:\n"
+      "  --iterations N       timed runs per benchmark, default 5\n"
+      "  --only NAME[,NAME]   run selected benchmarks\n"
+      "  --output FILE        write JSON report to the file instead of stdout\n"
+      "  --baseline FILE      compare with a previous report, exit code 2 on regression\n"
+      "  --tolerance X        allowed slowdown of the median, default 0.1 (10%)\n"
+      "  --self-test          only check the engines against reference values, they are checked before every run\n";
+
+    bool PathExists(const std::string& path)
+    {
+      struct stat st;
+      return lstat(path.c_str(), &st) == 0;
+    }
+
+    double Now()
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Runs setup untimed before every timed body call
+    Common::Error Measure(unsigned iterations, Result& result, Step setup, Step body)
+    {
+      for (unsigned i = 0; i < iterations; ++i)
+      {
+        if (setup)
+        {
+          RETURN_IF_FAILED(setup());
+        }
+        const double start = Now();
+        RETURN_IF_FAILED(body());
+        result.Samples.push_back(Now() - start);
+      }
+      Summarize(result);
+      return Common::Success;
+    }
+
+    Filesys::Dir MakeDir(const std::string& path)
+    {
+      return Filesys::Dir(Common::StringToWideString(path));
+    }
+
+    Common::Error RemoveCopy(const Context& context)
+    {
+      if (!PathExists(context.CopyRoot))
+      {
+        return Common::Success;
+      }
+      return Filesys::RemoveDirRecursive(MakeDir(context.CopyRoot));
+    }
+
+    Common::Error MakeCopy(const Context& context)
+    {
+      RETURN_IF_FAILED(RemoveCopy(context));
+      return Filesys::Copy(
+        Filesys::FileInfo(Common::StringToWideString(context.Root)),
+        Filesys::FileInfo(Common::StringToWideString(context.CopyRoot))
+      );
+    }
+
+    bool CountEntry(std::uint64_t& count, const std::string& /*path*/, Filesys::FileObjectType /*type*/)
+    {
+      ++count;
+      return true;
+    }
+
+    Common::Error RunSearch(const Search::Query& query, std::uint64_t& matches)
+    {
+      matches = 0;
+      Search::Callbacks callbacks;
+      callbacks.OnMatch = [&matches](const Search::Match&)
+      {
+        ++matches;
+        return true;
+      };
+      Common::JobControl control;
+      return Search::Run(query, callbacks, control);
+    }
+
+    Search::Query MakeContentQuery(const Context& context)
+    {
+      Search::Query query;
+      query.Root = context.Root;
+      query.Content = FIXTURE_NEEDLE;
+      return query;
+    }
+
+    Common::Error BenchWalkDir(const Context& context, Result& result)
+    {
+      return Measure(context.Iterations, result, Step(), [&]()
+      {
+        result.Items = 0;
+        return Filesys::WalkDir(MakeDir(context.Root), std::bind(CountEntry, std::ref(result.Items), std::placeholders::_1, std::placeholders::_2));
+      });
+    }
+
+    Common::Error BenchCountFiles(const Context& context, Result& result)
+    {
+      return Measure(context.Iterations, result, Step(), [&]()
+      {
+        result.Items = Filesys::CountFiles(MakeDir(context.Root));
+        return Common::Error();
+      });
+    }
+
+    Common::Error BenchSearchName(const Context& context, Result& result)
+    {
+      Search::Query query;
+      query.Root = context.Root;
+      query.NameMask = "*.txt";
+      return Measure(context.Iterations, result, Step(), [&]()
+      {
+        return RunSearch(query, result.Items);
+      });
+    }
+
+    Common::Error BenchSearchContentWarm(const Context& context, Result& result)
+    {
+      const Search::Query query = MakeContentQuery(context);
+      result.Bytes = context.Stats.Bytes;
+      // the first pass brings the whole tree into the page cache
+      RETURN_IF_FAILED(RunSearch(query, result.Items));
+      return Measure(context.Iterations, result, Step(), [&]()
+      {
+        return RunSearch(query, result.Items);
+      });
+    }
+
+    Common::Error BenchSearchContentCold(const Context& context, Result& result)
+    {
+      const Search::Query query = MakeContentQuery(context);
+      result.Bytes = context.Stats.Bytes;
+      return Measure(context.Iterations, result, std::bind(EvictFromCache, context.Root), [&]()
+      {
+        return RunSearch(query, result.Items);
+      });
+    }
+
+    Common::Error BenchCopy(const Context& context, Result& result)
+    {
+      result.Items = context.Stats.Files;
+      result.Bytes = context.Stats.Bytes;
+      return Measure(context.Iterations, result, std::bind(RemoveCopy, std::cref(context)), std::bind(MakeCopy, std::cref(context)));
+    }
+
+    Common::Error BenchRemoveDirRecursive(const Context& context, Result& result)
+    {
+      result.Items = context.Stats.Files + context.Stats.Dirs;
+      return Measure(context.Iterations, result, std::bind(MakeCopy, std::cref(context)), [&]()
+      {
+        return Filesys::RemoveDirRecursive(MakeDir(context.CopyRoot));
+      });
+    }
+
+    struct HashVector
+    {
+      const char* Text;
+      std::uint64_t Seed;
+      std::uint64_t Digest;
+    };
+
+    // published XXH64 digests; the last one is longer than a 32 byte stripe
+    const HashVector XXH64_VECTORS[] = {
+      { "", 0, 0xef46db3751d8e999ULL },
+      { "a", 0, 0xd24ec4f1a98c6e5bULL },
+      { "abc", 0, 0x44bc2cf5ad770999ULL },
+      { "Nobody inspects the spammish repetition", 0, 0xfbcea83c8a378bf1ULL },
+    };
+
+    // Timings of a wrong engine are worthless, and duplicates found with a wrong hash are worse
+    bool RunSelfTest()
+    {
+      bool passed = true;
+      for (const HashVector& vector: XXH64_VECTORS)
+      {
+        const std::size_t size = strlen(vector.Text);
+        if (Hash::Compute(vector.Text, size, vector.Seed) != vector.Digest)
+        {
+          std::cerr << "self-test: XXH64 of \"" << vector.Text << "\" differs from the reference\n";
+          passed = false;
+          continue;
+        }
+        // streaming in single bytes takes the buffering path for every stripe
+        Hash::Xxh64 state(vector.Seed);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+          state.Update(vector.Text + i, 1);
+        }
+        if (state.Digest() != vector.Digest)
+        {
+          std::cerr << "self-test: streamed XXH64 of \"" << vector.Text << "\" differs from the reference\n";
+          passed = false;
+        }
+      }
+      return passed;
+    }
+
+    struct BenchmarkInfo
+    {
+      const char* Name;
+      Benchmark Run;
+    };
+
+    const BenchmarkInfo BENCHMARKS[] = {
+      { "walk_dir", BenchWalkDir },
+      { "count_files", BenchCountFiles },
+      { "search_name", BenchSearchName },
+      { "search_content_warm", BenchSearchContentWarm },
+      { "search_content_cold", BenchSearchContentCold },
+      { "copy", BenchCopy },
+      { "remove_dir_recursive", BenchRemoveDirRecursive },
+    };
+
+    bool ParseUnsigned(const char* text, std::uint64_t& value)
+    {
+      char* end = nullptr;
+      value = strtoull(text, &end, 10);
+      return *text && !*end;
+    }
+
+    bool ParseDouble(const char* text, double& value)
+    {
+      char* end = nullptr;
+      value = strtod(text, &end);
+      return *text && !*end && value >= 0;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+      for (int i = 1; i < argc; ++i)
+      {
+        const std::string name = argv[i];
+        if (name == "--keep")
+        {
+          options.Keep = true;
+          continue;
+        }
+        if (name == "--self-test")
+        {
+          options.SelfTestOnly = true;
+          continue;
+        }
+        if (name == "--help" || name == "-h" || i + 1 == argc)
+        {
+          return false;
+        }
+        const char* value = argv[++i];
+        std::uint64_t number = 0;
+        bool valid = true;
+        if (name == "--root")
+        {
+          options.Root = value;
+        }
+        else if (name == "--output")
+        {
+          options.Output = value;
+        }
+        else if (name == "--baseline")
+        {
+          options.Baseline = value;
+        }
+        else if (name == "--only")
+        {
+          for (const std::string& benchmark: Common::SplitString(value, ','))
+          {
+            options.Only.insert(benchmark);
+          }
+        }
+        else if (name == "--sizes")
+        {
+          valid = ParseSizeDistribution(value, options.Spec.Sizes);
+        }
+        else if (name == "--text-ratio")
+        {
+          valid = ParseDouble(value, options.Spec.TextRatio) && options.Spec.TextRatio <= 1;
+        }
+        else if (name == "--needle-rate")
+        {
+          valid = ParseDouble(value, options.Spec.NeedleRate);
+        }
+        else if (name == "--tolerance")
+        {
+          valid = ParseDouble(value, options.Tolerance);
+        }
+        else if (ParseUnsigned(value, number))
+        {
+          if (name == "--seed")
+          {
+            options.Spec.Seed = number;
+          }
+          else if (name == "--depth")
+          {
+            options.Spec.Depth = number;
+          }
+          else if (name == "--fan-out")
+          {
+            options.Spec.FanOut = number;
+          }
+          else if (name == "--files")
+          {
+            options.Spec.FilesPerDir = number;
+          }
+          else if (name == "--min-size")
+          {
+            options.Spec.MinFileSize = number;
+          }
+          else if (name == "--max-size")
+          {
+            options.Spec.MaxFileSize = number;
+          }
+          else if (name == "--iterations" && number > 0)
+          {
+            options.Iterations = number;
+          }
+          else
+          {
+            valid = false;
+          }
+        }
+        else
+        {
+          valid = false;
+        }
+        if (!valid)
+        {
+          std::cerr << "tf-bench: invalid option " << name << " " << value << "\n";
+          return false;
+        }
+      }
+      if (options.Root.empty())
+      {
+        const char* tmp = getenv("TMPDIR");
+        options.Root = std::string(tmp && *tmp ? tmp : "/tmp") + "/tf-bench-fixture";
+      }
+      while (options.Root.size() > 1 && options.Root[options.Root.size() - 1] == '/')
+      {
+        options.Root.erase(options.Root.size() - 1);
+      }
+      return true;
+    }
+
+    int Fail(const Common::Error& error)
+    {
+      std::wcerr << L"tf-bench: " << Common::Error::Format(error) << std::endl;
+      return 1;
+    }
+  } // namespace
+} // namespace Bench
+
+int main(int argc, char** argv)
+{
+  using namespace Bench;
+
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    std::cerr << USAGE;
+    return 1;
+  }
+  if (!RunSelfTest())
+  {
+    return 1;
+  }
+  if (options.SelfTestOnly)
+  {
+    std::cerr << "self-test passed\n";
+    return 0;
+  }
+
+  Context context;
+  context.Root = options.Root;
+  context.CopyRoot = options.Root + ".copy";
+  context.Iterations = options.Iterations;
+  if (PathExists(context.CopyRoot) && !IsFixture(context.CopyRoot))
+  {
+    std::cerr << "tf-bench: " << context.CopyRoot << " exists and is not a benchmark fixture\n";
+    return 1;
+  }
+
+  Baseline baseline;
+  if (!options.Baseline.empty())
+  {
+    const Common::Error error = LoadBaseline(options.Baseline, baseline);
+    if (error)
+    {
+      return Fail(error);
+    }
+  }
+
+  std::cerr << "generating fixture in " << context.Root << "\n";
+  Common::Error error = GenerateFixture(context.Root, options.Spec, context.Stats);
+  if (error)
+  {
+    return Fail(error);
+  }
+  std::cerr << context.Stats.Dirs << " dirs, " << context.Stats.Files << " files, "
+    << context.Stats.Bytes << " bytes, " << context.Stats.Needles << " needles\n";
+
+  std::vector<Result> results;
+  for (const BenchmarkInfo& benchmark: BENCHMARKS)
+  {
+    if (!options.Only.empty() && !options.Only.count(benchmark.Name))
+    {
+      continue;
+    }
+    std::cerr << benchmark.Name << "...\n";
+    Result result;
+    result.Name = benchmark.Name;
+    error = benchmark.Run(context, result);
+    if (error)
+    {
+      break;
+    }
+    if (result.Name.compare(0, 15, "search_content_") == 0 && result.Items != context.Stats.Needles)
+    {
+      std::cerr << "warning: " << result.Name << " found " << result.Items << " of " << context.Stats.Needles << " needles\n";
+    }
+    results.push_back(result);
+  }
+
+  RemoveCopy(context);
+  if (!options.Keep)
+  {
+    Filesys::RemoveDirRecursive(MakeDir(context.Root));
+  }
+  if (error)
+  {
+    return Fail(error);
+  }
+
+  if (options.Output.empty())
+  {
+    WriteJson(std::cout, options.Spec, context.Stats, results);
+  }
+  else
+  {
+    std::ofstream out(options.Output.c_str());
+    WriteJson(out, options.Spec, context.Stats, results);
+  }
+
+  if (!options.Baseline.empty() && CompareWithBaseline(std::cerr, baseline, context.Stats, results, options.Tolerance) > 0)
+  {
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,219 @@
+#include "report.h"
+
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+#include <errno.h>
+
+namespace Bench
+{
+  namespace
+  {
+    const int REPORT_VERSION = 1;
+
+    Common::Error MakeBaselineError(const std::string& path, const std::string& message)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, EINVAL), Common::StringToWideString(path + ": " + message));
+    }
+
+    // Locates "key": inside [begin, end) and returns position of the value, or npos
+    std::size_t FindValue(const std::string& text, std::size_t begin, std::size_t end, const char* key)
+    {
+      const std::string quoted = std::string("\"") + key + "\"";
+      std::size_t pos = text.find(quoted, begin);
+      if (pos == std::string::npos || pos >= end)
+      {
+        return std::string::npos;
+      }
+      pos += quoted.size();
+      while (pos < end && (text[pos] == ' ' || text[pos] == ':' || text[pos] == '\n'))
+      {
+        ++pos;
+      }
+      return pos < end ? pos : std::string::npos;
+    }
+
+    bool FindNumber(const std::string& text, std::size_t begin, std::size_t end, const char* key, double& value)
+    {
+      const std::size_t pos = FindValue(text, begin, end, key);
+      if (pos == std::string::npos)
+      {
+        return false;
+      }
+      char* parsed = nullptr;
+      value = strtod(text.c_str() + pos, &parsed);
+      return parsed != text.c_str() + pos;
+    }
+
+    // Names are written without escapes, so the value ends at the next quote
+    bool FindString(const std::string& text, std::size_t begin, std::size_t end, const char* key, std::string& value)
+    {
+      const std::size_t pos = FindValue(text, begin, end, key);
+      if (pos == std::string::npos || text[pos] != '"')
+      {
+        return false;
+      }
+      const std::size_t close = text.find('"', pos + 1);
+      if (close == std::string::npos || close >= end)
+      {
+        return false;
+      }
+      value = text.substr(pos + 1, close - pos - 1);
+      return true;
+    }
+  } // namespace
+
+  void Summarize(Result& result)
+  {
+    if (result.Samples.empty())
+    {
+      return;
+    }
+    std::vector<double> sorted = result.Samples;
+    std::sort(sorted.begin(), sorted.end());
+    result.MinSeconds = sorted.front();
+    const std::size_t middle = sorted.size() / 2;
+    result.MedianSeconds = sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+    result.MeanSeconds = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+  }
+
+  void WriteJson(std::ostream& out, const FixtureSpec& spec, const FixtureStats& stats, const std::vector<Result>& results)
+  {
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"version\": " << REPORT_VERSION << ",\n";
+    out << "  \"fixture\": {\n";
+    out << "    \"seed\": " << spec.Seed << ",\n";
+    out << "    \"depth\": " << spec.Depth << ",\n";
+    out << "    \"fan_out\": " << spec.FanOut << ",\n";
+    out << "    \"files_per_dir\": " << spec.FilesPerDir << ",\n";
+    out << "    \"min_file_size\": " << spec.MinFileSize << ",\n";
+    out << "    \"max_file_size\": " << spec.MaxFileSize << ",\n";
+    out << "    \"size_distribution\": \"" << GetSizeDistributionName(spec.Sizes) << "\",\n";
+    out << "    \"text_ratio\": " << spec.TextRatio << ",\n";
+    out << "    \"needle_rate\": " << spec.NeedleRate << ",\n";
+    out << "    \"dirs\": " << stats.Dirs << ",\n";
+    out << "    \"files\": " << stats.Files << ",\n";
+    out << "    \"text_files\": " << stats.TextFiles << ",\n";
+    out << "    \"bytes\": " << stats.Bytes << ",\n";
+    out << "    \"needles\": " << stats.Needles << "\n";
+    out << "  },\n";
+    out << "  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const Result& result = results[i];
+      out << (i ? ",\n" : "\n");
+      out << "    {\n";
+      out << "      \"name\": \"" << result.Name << "\",\n";
+      out << "      \"iterations\": " << result.Samples.size() << ",\n";
+      out << "      \"min_seconds\": " << result.MinSeconds << ",\n";
+      out << "      \"median_seconds\": " << result.MedianSeconds << ",\n";
+      out << "      \"mean_seconds\": " << result.MeanSeconds << ",\n";
+      out << "      \"items\": " << result.Items << ",\n";
+      out << "      \"bytes\": " << result.Bytes << ",\n";
+      out << "      \"samples\": [";
+      for (std::size_t j = 0; j < result.Samples.size(); ++j)
+      {
+        out << (j ? ", " : "") << result.Samples[j];
+      }
+      out << "]\n";
+      out << "    }";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+  }
+
+  Common::Error LoadBaseline(const std::string& path, Baseline& result)
+  {
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, ENOENT), Common::StringToWideString(path + ": cannot open"));
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string text = buffer.str();
+
+    const std::size_t fixture = text.find("\"fixture\"");
+    const std::size_t fixtureEnd = fixture == std::string::npos ? std::string::npos : text.find('}', fixture);
+    double files = 0;
+    double bytes = 0;
+    if (fixtureEnd == std::string::npos
+      || !FindNumber(text, fixture, fixtureEnd, "files", files)
+      || !FindNumber(text, fixture, fixtureEnd, "bytes", bytes))
+    {
+      return MakeBaselineError(path, "no fixture description");
+    }
+    result.Files = static_cast<std::uint64_t>(files);
+    result.Bytes = static_cast<std::uint64_t>(bytes);
+    result.MedianSeconds.clear();
+
+    std::size_t pos = text.find("\"results\"");
+    if (pos == std::string::npos)
+    {
+      return MakeBaselineError(path, "no results");
+    }
+    // result objects have no nested objects, so each one ends at the first closing brace
+    while ((pos = text.find('{', pos)) != std::string::npos)
+    {
+      const std::size_t end = text.find('}', pos);
+      if (end == std::string::npos)
+      {
+        return MakeBaselineError(path, "unterminated result");
+      }
+      std::string name;
+      double median = 0;
+      if (!FindString(text, pos, end, "name", name) || !FindNumber(text, pos, end, "median_seconds", median))
+      {
+        return MakeBaselineError(path, "result without name or median");
+      }
+      result.MedianSeconds[name] = median;
+      pos = end;
+    }
+    return Common::Success;
+  }
+
+  std::size_t CompareWithBaseline(std::ostream& out, const Baseline& baseline, const FixtureStats& stats, const std::vector<Result>& results, double tolerance)
+  {
+    if (baseline.Files != stats.Files || baseline.Bytes != stats.Bytes)
+    {
+      out << "warning: baseline was recorded on a different fixture ("
+        << baseline.Files << " files, " << baseline.Bytes << " bytes), timings are not comparable\n";
+    }
+
+    std::size_t regressions = 0;
+    out << std::left << std::setw(24) << "benchmark"
+      << std::right << std::setw(14) << "baseline, s"
+      << std::setw(14) << "current, s"
+      << std::setw(10) << "change" << "\n";
+    for (const Result& result: results)
+    {
+      out << std::left << std::setw(24) << result.Name << std::right << std::fixed << std::setprecision(6);
+      const auto found = baseline.MedianSeconds.find(result.Name);
+      if (found == baseline.MedianSeconds.end() || found->second <= 0)
+      {
+        out << std::setw(14) << "-" << std::setw(14) << result.MedianSeconds << std::setw(10) << "new" << "\n";
+        continue;
+      }
+      const double change = result.MedianSeconds / found->second - 1;
+      out << std::setw(14) << found->second << std::setw(14) << result.MedianSeconds
+        << std::setw(9) << std::setprecision(1) << change * 100 << "%";
+      if (change > tolerance)
+      {
+        out << "  REGRESSION";
+        ++regressions;
+      }
+      out << "\n";
+    }
+    out.unsetf(std::ios::fixed);
+    return regressions;
+  }
+} // namespace Bench
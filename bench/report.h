@@ -0,0 +1,53 @@
+#pragma once
+
+#include "fixture.h"
+
+#include <common/error.h>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+  struct Result
+  {
+    Result()
+      : MinSeconds(0)
+      , MedianSeconds(0)
+      , MeanSeconds(0)
+      , Items(0)
+      , Bytes(0)
+    {
+    }
+
+    std::string Name;
+    std::vector<double> Samples; // seconds, one per iteration
+    double MinSeconds;
+    double MedianSeconds;
+    double MeanSeconds;
+    std::uint64_t Items;  // entries visited or matches found in one iteration
+    std::uint64_t Bytes;  // payload processed in one iteration, 0 if not meaningful
+  };
+
+  // Fills min, median and mean from the samples
+  void Summarize(Result& result);
+
+  void WriteJson(std::ostream& out, const FixtureSpec& spec, const FixtureStats& stats, const std::vector<Result>& results);
+
+  struct Baseline
+  {
+    std::uint64_t Files;
+    std::uint64_t Bytes;
+    std::map<std::string, double> MedianSeconds; // by benchmark name
+  };
+
+  // Reads a file written by WriteJson; other JSON layouts are not supported
+  Common::Error LoadBaseline(const std::string& path, Baseline& result);
+
+  // Prints a table of median changes; returns the number of benchmarks that got slower
+  // than the baseline by more than tolerance (0.1 - 10%)
+  std::size_t CompareWithBaseline(std::ostream& out, const Baseline& baseline, const FixtureStats& stats, const std::vector<Result>& results, double tolerance);
+} // namespace Bench
@@ -0,0 +1,108 @@
+#include "arguments.h"
+
+#include <cstdlib>
+
+namespace Cli
+{
+  Arguments::Arguments(const std::vector<std::string>& args, const std::set<std::string>& flags, const std::set<std::string>& options)
+  {
+    bool optionsEnded = false;
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+      const std::string& arg = args[i];
+      if (optionsEnded || arg.size() < 2 || arg[0] != '-')
+      {
+        Positional.push_back(arg);
+      }
+      else if (arg == "--")
+      {
+        optionsEnded = true;
+      }
+      else if (flags.count(arg))
+      {
+        Flags.insert(arg);
+      }
+      else if (options.count(arg))
+      {
+        if (i + 1 == args.size())
+        {
+          Error = "option " + arg + " needs a value";
+          return;
+        }
+        Options.insert(std::make_pair(arg, args[++i]));
+      }
+      else
+      {
+        Error = "unknown option " + arg;
+        return;
+      }
+    }
+  }
+
+  const std::string& Arguments::GetError() const
+  {
+    return Error;
+  }
+
+  bool Arguments::Has(const std::string& flag) const
+  {
+    return Flags.count(flag) != 0;
+  }
+
+  std::string Arguments::Get(const std::string& option, const std::string& fallback) const
+  {
+    // the last occurrence wins, like in most tools
+    const auto range = Options.equal_range(option);
+    if (range.first == range.second)
+    {
+      return fallback;
+    }
+    auto last = range.second;
+    return (--last)->second;
+  }
+
+  std::vector<std::string> Arguments::GetAll(const std::string& option) const
+  {
+    std::vector<std::string> result;
+    const auto range = Options.equal_range(option);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+      result.push_back(it->second);
+    }
+    return result;
+  }
+
+  const std::vector<std::string>& Arguments::GetPositional() const
+  {
+    return Positional;
+  }
+
+  bool ParseSize(const std::string& text, unsigned long long& result)
+  {
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+    {
+      return false;
+    }
+    char* end = nullptr;
+    result = strtoull(text.c_str(), &end, 10);
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+      result *= 1024;
+      // fall through
+    case 'M':
+    case 'm':
+      result *= 1024;
+      // fall through
+    case 'K':
+    case 'k':
+      result *= 1024;
+      ++end;
+      break;
+    default:
+      break;
+    }
+    return *end == '\0';
+  }
+} // namespace Cli
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Cli
+{
+  // Command line of one subcommand: flags, options with a value and positional arguments.
+  // Options may repeat; "--" ends options
+  class Arguments
+  {
+  public:
+    Arguments(const std::vector<std::string>& args, const std::set<std::string>& flags, const std::set<std::string>& options);
+
+    // Empty when the command line is well formed
+    const std::string& GetError() const;
+
+    bool Has(const std::string& flag) const;
+    std::string Get(const std::string& option, const std::string& fallback = std::string()) const;
+    std::vector<std::string> GetAll(const std::string& option) const;
+    const std::vector<std::string>& GetPositional() const;
+
+  private:
+    std::set<std::string> Flags;
+    std::multimap<std::string, std::string> Options;
+    std::vector<std::string> Positional;
+    std::string Error;
+  };
+
+  // Parses a non-negative number with an optional K, M or G suffix
+  bool ParseSize(const std::string& text, unsigned long long& result);
+} // namespace Cli
@@ -0,0 +1,392 @@
+#include "commands.h"
+#include "arguments.h"
+
+#include <common/duplicates.h>
+#include <common/filesystem.h>
+#include <common/search.h>
+#include <common/string_utils.h>
+#include <common/sync.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+namespace Cli
+{
+  namespace
+  {
+    const char SEARCH_USAGE[] =
+      "tf search [options] ROOT\n"
+      "  --name MASK          shell wildcard matched against entry names\n"
+      "  --content TEXT       text to look for inside files\n"
+      "  --case-sensitive     match content case sensitively\n"
+      "  --no-hidden          don't descend into directories starting with a dot\n"
+      "  --archives           look inside zip, tar, gz, xz and zst files\n"
+      "  --ignore-files       skip entries excluded by .gitignore and .ignore\n"
+      "  --exclude PATTERN    gitignore style pattern to skip, may repeat\n"
+      "  --binary search|first|skip   how to treat binary files, default search\n"
+      "  --max-per-file N     stop reporting a file after N matches\n";
+
+    const char DU_USAGE[] =
+      "tf du [options] [PATH...]\n"
+      "  -h, --human          print sizes in K, M and G\n"
+      "  --apparent           file sizes instead of space taken on disk\n";
+
+    const char COPY_USAGE[] =
+      "tf copy [options] SOURCE... DESTINATION\n"
+      "  -v, --verbose        print every copied source\n";
+
+    const char RM_USAGE[] =
+      "tf rm [options] PATH...\n"
+      "  -v, --verbose        print every removed path\n";
+
+    const char DUPES_USAGE[] =
+      "tf dupes [options] PATH...\n"
+      "  --min-size SIZE      ignore smaller files, K, M and G suffixes allowed, default 1\n"
+      "  --no-hidden          skip entries starting with a dot\n";
+
+    const char SYNC_USAGE[] =
+      "tf sync [options] SOURCE DESTINATION\n"
+      "  --delete             remove destination entries missing in source\n"
+      "  --dry-run            print what would be done and change nothing\n"
+      "  -v, --verbose        print every action\n";
+
+    int ReportError(const Common::Error& error)
+    {
+      std::wcerr << L"tf: " << error.GetMessage() << std::endl;
+      return RESULT_ERROR;
+    }
+
+    int ReportUsage(const std::string& message, const char* usage)
+    {
+      if (!message.empty())
+      {
+        std::cerr << "tf: " << message << "\n";
+      }
+      std::cerr << "usage: " << usage;
+      return RESULT_USAGE;
+    }
+
+    int GetResult(const Common::JobControl& control, bool failed)
+    {
+      if (control.IsCancelled())
+      {
+        return RESULT_INTERRUPTED;
+      }
+      return failed ? RESULT_ERROR : RESULT_OK;
+    }
+
+    std::string FormatSize(unsigned long long bytes, bool human)
+    {
+      if (!human || bytes < 1024)
+      {
+        return Common::ToString<unsigned long long, std::string>(bytes) + (human ? "B" : "");
+      }
+      const char* const UNITS = "KMGTP";
+      double value = bytes / 1024.0;
+      std::size_t unit = 0;
+      while (value >= 1024 && unit + 1 < strlen(UNITS))
+      {
+        value /= 1024;
+        ++unit;
+      }
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), value < 10 ? "%.1f%c" : "%.0f%c", value, UNITS[unit]);
+      return buffer;
+    }
+
+    bool IsDirectory(const std::string& path)
+    {
+      struct stat st;
+      return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    bool PathExists(const std::string& path)
+    {
+      struct stat st;
+      return lstat(path.c_str(), &st) == 0;
+    }
+
+    std::string GetBaseName(std::string path)
+    {
+      while (path.size() > 1 && path[path.size() - 1] == Filesys::PATH_SEPARATOR)
+      {
+        path.erase(path.size() - 1);
+      }
+      const std::size_t slash = path.rfind(Filesys::PATH_SEPARATOR);
+      return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    int RunSearch(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(
+        args,
+        { "--case-sensitive", "--no-hidden", "--archives", "--ignore-files" },
+        { "--name", "--content", "--exclude", "--binary", "--max-per-file" }
+      );
+      if (!arguments.GetError().empty() || arguments.GetPositional().size() != 1)
+      {
+        return ReportUsage(arguments.GetError(), SEARCH_USAGE);
+      }
+
+      Search::Query query;
+      query.Root = arguments.GetPositional().front();
+      query.NameMask = arguments.Get("--name");
+      query.Content = arguments.Get("--content");
+      query.CaseSensitive = arguments.Has("--case-sensitive");
+      query.IncludeHidden = !arguments.Has("--no-hidden");
+      query.SearchArchives = arguments.Has("--archives");
+      query.UseIgnoreFiles = arguments.Has("--ignore-files");
+      query.ExcludePatterns = arguments.GetAll("--exclude");
+      const std::string binary = arguments.Get("--binary", "search");
+      if (binary == "first")
+      {
+        query.BinaryFiles = Search::BINARY_FIRST_MATCH;
+      }
+      else if (binary == "skip")
+      {
+        query.BinaryFiles = Search::BINARY_SKIP;
+      }
+      else if (binary != "search")
+      {
+        return ReportUsage("unknown binary mode " + binary, SEARCH_USAGE);
+      }
+      unsigned long long maxHits = 0;
+      if (!ParseSize(arguments.Get("--max-per-file", "0"), maxHits))
+      {
+        return ReportUsage("invalid --max-per-file", SEARCH_USAGE);
+      }
+      query.MaxHitsPerFile = maxHits;
+
+      Search::Callbacks callbacks;
+      callbacks.OnMatch = [](const Search::Match& match)
+      {
+        std::string line = match.Path;
+        if (!match.Member.empty())
+        {
+          line += Filesys::PATH_SEPARATOR + match.Member;
+        }
+        if (match.Line)
+        {
+          line += ":" + Common::ToString<std::size_t, std::string>(match.Line);
+        }
+        std::cout << line << "\n";
+        return true;
+      };
+      const Common::Error error = Search::Run(query, callbacks, control);
+      std::cout.flush();
+      if (error)
+      {
+        ReportError(error);
+      }
+      return GetResult(control, error);
+    }
+
+    int RunDiskUsage(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(args, { "-h", "--human", "--apparent" }, {});
+      if (!arguments.GetError().empty())
+      {
+        return ReportUsage(arguments.GetError(), DU_USAGE);
+      }
+      std::vector<std::string> paths = arguments.GetPositional();
+      if (paths.empty())
+      {
+        paths.push_back(".");
+      }
+      const bool human = arguments.Has("-h") || arguments.Has("--human");
+      bool failed = false;
+      for (const std::string& path: paths)
+      {
+        Filesys::DiskUsage usage;
+        const Common::Error error = Filesys::GetDiskUsage(Filesys::Dir(Common::StringToWideString(path)), usage, control.AsStopCallback());
+        if (control.IsCancelled())
+        {
+          break;
+        }
+        if (error)
+        {
+          ReportError(error);
+          failed = true;
+          continue;
+        }
+        const unsigned long long size = arguments.Has("--apparent") ? usage.Bytes : usage.Allocated;
+        std::cout << FormatSize(size, human) << "\t" << usage.Files << "\t" << path << "\n";
+      }
+      return GetResult(control, failed);
+    }
+
+    int RunCopy(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(args, { "-v", "--verbose" }, {});
+      std::vector<std::string> paths = arguments.GetPositional();
+      if (!arguments.GetError().empty() || paths.size() < 2)
+      {
+        return ReportUsage(arguments.GetError(), COPY_USAGE);
+      }
+      const std::string destination = paths.back();
+      paths.pop_back();
+      const bool intoDirectory = IsDirectory(destination);
+      if (paths.size() > 1 && !intoDirectory)
+      {
+        return ReportUsage(destination + " is not a directory", COPY_USAGE);
+      }
+
+      bool failed = false;
+      for (const std::string& source: paths)
+      {
+        if (!control.Checkpoint())
+        {
+          break;
+        }
+        const std::string target = intoDirectory ? destination + Filesys::PATH_SEPARATOR + GetBaseName(source) : destination;
+        if (arguments.Has("-v") || arguments.Has("--verbose"))
+        {
+          std::cout << source << " -> " << target << std::endl;
+        }
+        const Common::Error error = Filesys::Copy(
+          Filesys::FileInfo(Common::StringToWideString(source)),
+          Filesys::FileInfo(Common::StringToWideString(target))
+        );
+        if (error)
+        {
+          ReportError(error);
+          failed = true;
+        }
+      }
+      return GetResult(control, failed);
+    }
+
+    int RunRemove(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(args, { "-v", "--verbose" }, {});
+      if (!arguments.GetError().empty() || arguments.GetPositional().empty())
+      {
+        return ReportUsage(arguments.GetError(), RM_USAGE);
+      }
+
+      bool failed = false;
+      for (const std::string& path: arguments.GetPositional())
+      {
+        if (!control.Checkpoint())
+        {
+          break;
+        }
+        if (!PathExists(path))
+        {
+          std::cerr << "tf: " << path << ": no such file or directory\n";
+          failed = true;
+          continue;
+        }
+        // works for single files too, the traversal just has one entry
+        const Common::Error error = Filesys::RemoveDirRecursive(Filesys::Dir(Common::StringToWideString(path)));
+        if (error)
+        {
+          ReportError(error);
+          failed = true;
+        }
+        else if (PathExists(path))
+        {
+          // entries that could not be removed are skipped by the traversal
+          std::cerr << "tf: " << path << ": not removed completely\n";
+          failed = true;
+        }
+        else if (arguments.Has("-v") || arguments.Has("--verbose"))
+        {
+          std::cout << path << std::endl;
+        }
+      }
+      return GetResult(control, failed);
+    }
+
+    int RunDupes(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(args, { "--no-hidden" }, { "--min-size" });
+      if (!arguments.GetError().empty() || arguments.GetPositional().empty())
+      {
+        return ReportUsage(arguments.GetError(), DUPES_USAGE);
+      }
+      Filesys::DuplicateQuery query;
+      query.Roots = arguments.GetPositional();
+      query.IncludeHidden = !arguments.Has("--no-hidden");
+      unsigned long long minSize = 1;
+      if (!ParseSize(arguments.Get("--min-size", "1"), minSize))
+      {
+        return ReportUsage("invalid --min-size", DUPES_USAGE);
+      }
+      query.MinSize = minSize;
+
+      std::size_t groups = 0;
+      unsigned long long wasted = 0;
+      const Common::Error error = Filesys::FindDuplicates(query, [&](const Filesys::DuplicateGroup& group)
+      {
+        std::cout << (groups++ ? "\n" : "") << group.Size << " bytes, " << group.Paths.size() << " copies\n";
+        for (const std::string& path: group.Paths)
+        {
+          std::cout << path << "\n";
+        }
+        wasted += group.Size * (group.Paths.size() - 1);
+      }, control);
+      std::cout.flush();
+      if (error)
+      {
+        ReportError(error);
+      }
+      std::cerr << "duplicate groups: " << groups << ", " << FormatSize(wasted, true) << " in redundant copies\n";
+      return GetResult(control, error);
+    }
+
+    int RunSync(const std::vector<std::string>& args, Common::JobControl& control)
+    {
+      const Arguments arguments(args, { "--delete", "--dry-run", "-v", "--verbose" }, {});
+      if (!arguments.GetError().empty() || arguments.GetPositional().size() != 2)
+      {
+        return ReportUsage(arguments.GetError(), SYNC_USAGE);
+      }
+      Filesys::SyncOptions options;
+      options.DeleteExtra = arguments.Has("--delete");
+      options.DryRun = arguments.Has("--dry-run");
+
+      Filesys::SyncCallback callback;
+      if (options.DryRun || arguments.Has("-v") || arguments.Has("--verbose"))
+      {
+        callback = [](Filesys::SyncAction action, const std::string& path)
+        {
+          static const char* const ACTION_NAMES[] = { "mkdir", "copy", "update", "delete" };
+          std::cout << ACTION_NAMES[action] << " " << path << "\n";
+        };
+      }
+      Filesys::SyncStats stats;
+      const Common::Error error = Filesys::SyncDirs(
+        arguments.GetPositional()[0],
+        arguments.GetPositional()[1],
+        options,
+        callback,
+        stats,
+        control
+      );
+      std::cout.flush();
+      if (error)
+      {
+        ReportError(error);
+      }
+      std::cerr << stats.Copied << " copied, " << stats.Updated << " updated, " << stats.Deleted << " deleted, "
+        << stats.Unchanged << " unchanged, " << FormatSize(stats.Bytes, true) << " transferred"
+        << (options.DryRun ? " (dry run)" : "") << "\n";
+      return GetResult(control, error);
+    }
+  } // namespace
+
+  const CommandInfo COMMANDS[] = {
+    { "search", SEARCH_USAGE, RunSearch },
+    { "du", DU_USAGE, RunDiskUsage },
+    { "copy", COPY_USAGE, RunCopy },
+    { "rm", RM_USAGE, RunRemove },
+    { "dupes", DUPES_USAGE, RunDupes },
+    { "sync", SYNC_USAGE, RunSync },
+  };
+
+  const std::size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+} // namespace Cli
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <common/job_control.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Cli
+{
+  enum ResultCode
+  {
+    RESULT_OK = 0,
+    RESULT_ERROR = 1,
+    RESULT_USAGE = 2,
+    RESULT_INTERRUPTED = 130
+  };
+
+  // Receives arguments following the command name; cancelled on SIGINT and SIGTERM
+  typedef int (*Command)(const std::vector<std::string>& args, Common::JobControl& control);
+
+  struct CommandInfo
+  {
+    const char* Name;
+    const char* Usage;
+    Command Run;
+  };
+
+  extern const CommandInfo COMMANDS[];
+  extern const std::size_t COMMAND_COUNT;
+} // namespace Cli
@@ -0,0 +1,73 @@
+#include "commands.h"
+
+#include <common/job_control.h>
+
+#include <iostream>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+
+namespace
+{
+  void PrintUsage()
+  {
+    std::cerr << "usage: tf COMMAND [options] [arguments]\ncommands:";
+    for (std::size_t i = 0; i < Cli::COMMAND_COUNT; ++i)
+    {
+      std::cerr << " " << Cli::COMMANDS[i].Name;
+    }
+    std::cerr << "\nrun tf COMMAND --help for its options\n";
+  }
+
+  // Signals are blocked before any thread starts, so only this one receives them.
+  // First one cancels the job, engines stop at the next checkpoint; the second one kills
+  void WatchInterrupts(Common::JobControl& control)
+  {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([&control, signals]()
+    {
+      int signal = 0;
+      sigwait(&signals, &signal);
+      control.Cancel();
+      sigwait(&signals, &signal);
+      _exit(Cli::RESULT_INTERRUPTED);
+    }).detach();
+  }
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    PrintUsage();
+    return Cli::RESULT_USAGE;
+  }
+  const std::string name = argv[1];
+  const std::vector<std::string> args(argv + 2, argv + argc);
+  for (std::size_t i = 0; i < Cli::COMMAND_COUNT; ++i)
+  {
+    if (name == Cli::COMMANDS[i].Name)
+    {
+      if (args.size() == 1 && args[0] == "--help")
+      {
+        std::cout << "usage: " << Cli::COMMANDS[i].Usage;
+        return Cli::RESULT_OK;
+      }
+      static Common::JobControl control;
+      WatchInterrupts(control);
+      return Cli::COMMANDS[i].Run(args, control);
+    }
+  }
+  if (name != "help" && name != "--help" && name != "-h")
+  {
+    std::cerr << "tf: unknown command " << name << "\n";
+  }
+  PrintUsage();
+  return Cli::RESULT_USAGE;
+}
@@ -0,0 +1,521 @@
+#include <common/archive.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include "streams.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Archive
+{
+  namespace
+  {
+    const std::size_t MEMBER_BUFFER_SIZE = 256 * 1024;
+    const std::size_t TAR_BLOCK_SIZE = 512;
+
+    const std::uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+    const std::uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+    const std::uint32_t ZIP_END_SIGNATURE = 0x06054b50;
+    const std::uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+    const std::uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+    const std::size_t ZIP_END_SIZE = 22;
+    const std::size_t ZIP_MAX_COMMENT_SIZE = 0xffff;
+    const std::uint16_t ZIP_METHOD_STORED = 0;
+    const std::uint16_t ZIP_METHOD_DEFLATED = 8;
+    const std::uint16_t ZIP_FLAG_ENCRYPTED = 1;
+
+    bool EndsWith(const std::string& value, const char* suffix)
+    {
+      const std::size_t len = strlen(suffix);
+      return value.size() > len && value.compare(value.size() - len, len, suffix) == 0;
+    }
+
+    std::uint16_t ReadLe16(const unsigned char* p)
+    {
+      return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    std::uint32_t ReadLe32(const unsigned char* p)
+    {
+      return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8)
+        | (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    std::uint64_t ReadLe64(const unsigned char* p)
+    {
+      return static_cast<std::uint64_t>(ReadLe32(p)) | (static_cast<std::uint64_t>(ReadLe32(p + 4)) << 32);
+    }
+
+    Common::Error PreadFull(int fd, void* buffer, std::size_t size, std::uint64_t offset)
+    {
+      InputStreamPtr stream = CreateFileRangeStream(fd, offset, size);
+      std::size_t read = 0;
+      RETURN_IF_FAILED(ReadFull(*stream, static_cast<char*>(buffer), size, read));
+      if (read != size)
+      {
+        return MakeArchiveError("unexpected end of archive");
+      }
+      return Common::Success;
+    }
+
+    class FileDescriptor
+    {
+    public:
+      explicit FileDescriptor(int fd)
+        : Fd(fd)
+      {
+      }
+
+      ~FileDescriptor()
+      {
+        if (Fd >= 0)
+        {
+          close(Fd);
+        }
+      }
+
+      int Get() const
+      {
+        return Fd;
+      }
+
+    private:
+      FileDescriptor(const FileDescriptor&);
+      FileDescriptor& operator=(const FileDescriptor&);
+
+      int Fd;
+    };
+
+    // Feeds the member stream to the data callback chunk by chunk
+    Common::Error PumpMember(InputStream& stream, DataCallback onData, std::uint64_t limit, Common::StopCallback stop)
+    {
+      std::vector<char> buffer(MEMBER_BUFFER_SIZE);
+      std::uint64_t total = 0;
+      while (total < limit)
+      {
+        if (stop && stop())
+        {
+          return Common::Success;
+        }
+        const std::size_t toRead = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), limit - total));
+        std::size_t read = 0;
+        RETURN_IF_FAILED(ReadFull(stream, &buffer.front(), toRead, read));
+        if (read == 0)
+        {
+          break;
+        }
+        total += read;
+        if (!onData(&buffer.front(), read))
+        {
+          break;
+        }
+      }
+      return Common::Success;
+    }
+
+    Common::Error ReadZip(const std::string& path, MemberCallback onMember, Common::StopCallback stop)
+    {
+      FileDescriptor file(open(path.c_str(), O_RDONLY));
+      if (file.Get() < 0)
+      {
+        return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(path + ": " + strerror(errno)));
+      }
+      struct stat st;
+      if (fstat(file.Get(), &st) != 0 || static_cast<std::uint64_t>(st.st_size) < ZIP_END_SIZE)
+      {
+        return MakeArchiveError("not a zip archive: " + path);
+      }
+      const std::uint64_t fileSize = st.st_size;
+
+      // end of central directory record is followed only by an optional comment
+      const std::size_t tailSize = static_cast<std::size_t>(std::min<std::uint64_t>(fileSize, ZIP_END_SIZE + ZIP_MAX_COMMENT_SIZE));
+      std::vector<unsigned char> tail(tailSize);
+      RETURN_IF_FAILED(PreadFull(file.Get(), &tail.front(), tailSize, fileSize - tailSize));
+      std::size_t endPos = tailSize - ZIP_END_SIZE + 1;
+      do
+      {
+        --endPos;
+        if (ReadLe32(&tail[endPos]) == ZIP_END_SIGNATURE)
+        {
+          break;
+        }
+      }
+      while (endPos > 0);
+      if (ReadLe32(&tail[endPos]) != ZIP_END_SIGNATURE)
+      {
+        return MakeArchiveError("zip central directory not found: " + path);
+      }
+
+      std::uint64_t entryCount = ReadLe16(&tail[endPos + 10]);
+      std::uint64_t directorySize = ReadLe32(&tail[endPos + 12]);
+      std::uint64_t directoryOffset = ReadLe32(&tail[endPos + 16]);
+      const std::uint64_t endOffset = fileSize - tailSize + endPos;
+      if (endOffset >= 20 && (directoryOffset == 0xffffffff || entryCount == 0xffff))
+      {
+        unsigned char locator[20];
+        RETURN_IF_FAILED(PreadFull(file.Get(), locator, sizeof(locator), endOffset - sizeof(locator)));
+        if (ReadLe32(locator) == ZIP64_LOCATOR_SIGNATURE)
+        {
+          unsigned char end64[56];
+          RETURN_IF_FAILED(PreadFull(file.Get(), end64, sizeof(end64), ReadLe64(locator + 8)));
+          if (ReadLe32(end64) != ZIP64_END_SIGNATURE)
+          {
+            return MakeArchiveError("broken zip64 end of central directory: " + path);
+          }
+          entryCount = ReadLe64(end64 + 32);
+          directorySize = ReadLe64(end64 + 40);
+          directoryOffset = ReadLe64(end64 + 48);
+        }
+      }
+      if (directoryOffset + directorySize > fileSize)
+      {
+        return MakeArchiveError("broken zip central directory: " + path);
+      }
+
+      std::vector<unsigned char> directory(static_cast<std::size_t>(directorySize));
+      if (!directory.empty())
+      {
+        RETURN_IF_FAILED(PreadFull(file.Get(), &directory.front(), directory.size(), directoryOffset));
+      }
+
+      std::size_t pos = 0;
+      for (std::uint64_t i = 0; i < entryCount; ++i)
+      {
+        if (stop && stop())
+        {
+          return Common::Success;
+        }
+        if (pos + 46 > directory.size() || ReadLe32(&directory[pos]) != ZIP_CENTRAL_HEADER_SIGNATURE)
+        {
+          return MakeArchiveError("broken zip central directory entry: " + path);
+        }
+        const unsigned char* header = &directory[pos];
+        const std::uint16_t flags = ReadLe16(header + 8);
+        const std::uint16_t method = ReadLe16(header + 10);
+        std::uint64_t compressedSize = ReadLe32(header + 20);
+        std::uint64_t uncompressedSize = ReadLe32(header + 24);
+        const std::uint16_t nameLength = ReadLe16(header + 28);
+        const std::uint16_t extraLength = ReadLe16(header + 30);
+        const std::uint16_t commentLength = ReadLe16(header + 32);
+        std::uint64_t localOffset = ReadLe32(header + 42);
+        if (pos + 46 + nameLength + extraLength + commentLength > directory.size())
+        {
+          return MakeArchiveError("broken zip central directory entry: " + path);
+        }
+        const std::string name(reinterpret_cast<const char*>(header + 46), nameLength);
+
+        // zip64 extended information carries only the fields saturated in the header, in fixed order
+        const unsigned char* extra = header + 46 + nameLength;
+        for (std::size_t e = 0; e + 4 <= extraLength;)
+        {
+          const std::uint16_t id = ReadLe16(extra + e);
+          const std::uint16_t size = ReadLe16(extra + e + 2);
+          if (id == 0x0001)
+          {
+            const unsigned char* field = extra + e + 4;
+            const unsigned char* fieldEnd = field + std::min<std::size_t>(size, extraLength - e - 4);
+            if (uncompressedSize == 0xffffffff && field + 8 <= fieldEnd)
+            {
+              uncompressedSize = ReadLe64(field);
+              field += 8;
+            }
+            if (compressedSize == 0xffffffff && field + 8 <= fieldEnd)
+            {
+              compressedSize = ReadLe64(field);
+              field += 8;
+            }
+            if (localOffset == 0xffffffff && field + 8 <= fieldEnd)
+            {
+              localOffset = ReadLe64(field);
+            }
+          }
+          e += 4 + size;
+        }
+        pos += 46 + nameLength + extraLength + commentLength;
+
+        const bool isDirectory = !name.empty() && name[name.size() - 1] == '/';
+        const bool supported = (method == ZIP_METHOD_STORED || method == ZIP_METHOD_DEFLATED) && !(flags & ZIP_FLAG_ENCRYPTED);
+        if (isDirectory || !supported)
+        {
+          continue;
+        }
+        DataCallback onData = onMember(name);
+        if (!onData)
+        {
+          continue;
+        }
+
+        unsigned char local[30];
+        RETURN_IF_FAILED(PreadFull(file.Get(), local, sizeof(local), localOffset));
+        if (ReadLe32(local) != ZIP_LOCAL_HEADER_SIGNATURE)
+        {
+          return MakeArchiveError("broken zip local header: " + path + "/" + name);
+        }
+        const std::uint64_t dataOffset = localOffset + sizeof(local) + ReadLe16(local + 26) + ReadLe16(local + 28);
+        if (dataOffset + compressedSize > fileSize)
+        {
+          return MakeArchiveError("zip entry exceeds archive size: " + path + "/" + name);
+        }
+        InputStreamPtr stream = CreateFileRangeStream(file.Get(), dataOffset, compressedSize);
+        if (method == ZIP_METHOD_DEFLATED)
+        {
+          stream = CreateDecompressStream(std::move(stream), CODEC_RAW_DEFLATE);
+        }
+        RETURN_IF_FAILED(PumpMember(*stream, onData, uncompressedSize, stop));
+      }
+      return Common::Success;
+    }
+
+    std::uint64_t ParseTarNumber(const char* field, std::size_t size)
+    {
+      // GNU base-256 encoding for values that don't fit octal field
+      if (static_cast<unsigned char>(field[0]) & 0x80)
+      {
+        std::uint64_t value = static_cast<unsigned char>(field[0]) & 0x7f;
+        for (std::size_t i = 1; i < size; ++i)
+        {
+          value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+      }
+      std::uint64_t value = 0;
+      for (std::size_t i = 0; i < size && field[i]; ++i)
+      {
+        if (field[i] >= '0' && field[i] <= '7')
+        {
+          value = value * 8 + (field[i] - '0');
+        }
+      }
+      return value;
+    }
+
+    std::string ParseTarString(const char* field, std::size_t size)
+    {
+      return std::string(field, strnlen(field, size));
+    }
+
+    // Extracts "path" record from pax extended header
+    std::string ParsePaxPath(const std::string& data)
+    {
+      std::size_t pos = 0;
+      while (pos < data.size())
+      {
+        const std::size_t space = data.find(' ', pos);
+        if (space == std::string::npos)
+        {
+          break;
+        }
+        const std::size_t length = static_cast<std::size_t>(strtoull(data.c_str() + pos, nullptr, 10));
+        if (length == 0 || pos + length > data.size())
+        {
+          break;
+        }
+        const std::string record = data.substr(space + 1, pos + length - space - 2); // without trailing newline
+        if (record.compare(0, 5, "path=") == 0)
+        {
+          return record.substr(5);
+        }
+        pos += length;
+      }
+      return std::string();
+    }
+
+    Common::Error ReadTar(InputStream& stream, MemberCallback onMember, Common::StopCallback stop)
+    {
+      char header[TAR_BLOCK_SIZE];
+      std::string longName;
+      for (;;)
+      {
+        if (stop && stop())
+        {
+          return Common::Success;
+        }
+        std::size_t read = 0;
+        RETURN_IF_FAILED(ReadFull(stream, header, sizeof(header), read));
+        if (read < sizeof(header) || header[0] == '\0')
+        {
+          // end of archive marker is a zero block
+          return Common::Success;
+        }
+
+        const std::uint64_t size = ParseTarNumber(header + 124, 12);
+        const std::uint64_t padded = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        const char type = header[156];
+
+        if (type == 'L' || type == 'x')
+        {
+          // GNU long name or pax extended header, both describe the next entry
+          std::string data(static_cast<std::size_t>(size), '\0');
+          if (size > 0)
+          {
+            RETURN_IF_FAILED(ReadFull(stream, &data[0], data.size(), read));
+          }
+          RETURN_IF_FAILED(Skip(stream, padded - size));
+          longName = type == 'L' ? ParseTarString(data.data(), data.size()) : ParsePaxPath(data);
+          continue;
+        }
+
+        std::string name = longName;
+        longName.clear();
+        if (name.empty())
+        {
+          name = ParseTarString(header, 100);
+          const std::string prefix = ParseTarString(header + 345, 155);
+          if (memcmp(header + 257, "ustar", 5) == 0 && !prefix.empty())
+          {
+            name = prefix + "/" + name;
+          }
+        }
+
+        const bool regular = type == '0' || type == '\0' || type == '7';
+        DataCallback onData = regular ? onMember(name) : DataCallback();
+        if (!onData)
+        {
+          RETURN_IF_FAILED(Skip(stream, padded));
+          continue;
+        }
+
+        // member callback may stop early, the rest of the member is skipped then
+        std::vector<char> buffer(MEMBER_BUFFER_SIZE);
+        std::uint64_t left = size;
+        bool wanted = true;
+        while (left > 0)
+        {
+          if (stop && stop())
+          {
+            return Common::Success;
+          }
+          const std::size_t toRead = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), left));
+          RETURN_IF_FAILED(ReadFull(stream, &buffer.front(), toRead, read));
+          if (read != toRead)
+          {
+            return MakeArchiveError("unexpected end of tar archive");
+          }
+          left -= read;
+          if (wanted)
+          {
+            wanted = onData(&buffer.front(), read);
+          }
+        }
+        RETURN_IF_FAILED(Skip(stream, padded - size));
+      }
+    }
+
+    std::string StripCompressedSuffix(const std::string& fileName)
+    {
+      const std::size_t dot = fileName.rfind('.');
+      return dot == std::string::npos ? fileName : fileName.substr(0, dot);
+    }
+  } // namespace
+
+  Format DetectFormat(const std::string& fileName)
+  {
+    std::string name = fileName.substr(fileName.rfind('/') == std::string::npos ? 0 : fileName.rfind('/') + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+    Format format = FORMAT_NONE;
+    if (EndsWith(name, ".zip") || EndsWith(name, ".jar"))
+    {
+      format = FORMAT_ZIP;
+    }
+    else if (EndsWith(name, ".tar"))
+    {
+      format = FORMAT_TAR;
+    }
+    else if (EndsWith(name, ".tar.gz") || EndsWith(name, ".tgz"))
+    {
+      format = FORMAT_TAR_GZIP;
+    }
+    else if (EndsWith(name, ".tar.xz") || EndsWith(name, ".txz"))
+    {
+      format = FORMAT_TAR_XZ;
+    }
+    else if (EndsWith(name, ".tar.zst") || EndsWith(name, ".tzst"))
+    {
+      format = FORMAT_TAR_ZSTD;
+    }
+    else if (EndsWith(name, ".gz"))
+    {
+      format = FORMAT_GZIP;
+    }
+    else if (EndsWith(name, ".xz"))
+    {
+      format = FORMAT_XZ;
+    }
+    else if (EndsWith(name, ".zst"))
+    {
+      format = FORMAT_ZSTD;
+    }
+
+    if ((format == FORMAT_TAR_XZ || format == FORMAT_XZ) && !IsCodecAvailable(CODEC_XZ))
+    {
+      return FORMAT_NONE;
+    }
+    if ((format == FORMAT_TAR_ZSTD || format == FORMAT_ZSTD) && !IsCodecAvailable(CODEC_ZSTD))
+    {
+      return FORMAT_NONE;
+    }
+    return format;
+  }
+
+  Common::Error ReadMembers(const std::string& path, Format format, MemberCallback onMember, Common::StopCallback stop)
+  {
+    if (format == FORMAT_ZIP)
+    {
+      return ReadZip(path, onMember, stop);
+    }
+    if (format == FORMAT_NONE)
+    {
+      return MakeArchiveError("unsupported archive format: " + path);
+    }
+
+    FileDescriptor file(open(path.c_str(), O_RDONLY));
+    struct stat st;
+    if (file.Get() < 0 || fstat(file.Get(), &st) != 0)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(path + ": " + strerror(errno)));
+    }
+    InputStreamPtr stream = CreateFileRangeStream(file.Get(), 0, st.st_size);
+
+    switch (format)
+    {
+    case FORMAT_TAR_GZIP:
+    case FORMAT_GZIP:
+      stream = CreateDecompressStream(std::move(stream), CODEC_GZIP);
+      break;
+    case FORMAT_TAR_XZ:
+    case FORMAT_XZ:
+      stream = CreateDecompressStream(std::move(stream), CODEC_XZ);
+      break;
+    case FORMAT_TAR_ZSTD:
+    case FORMAT_ZSTD:
+      stream = CreateDecompressStream(std::move(stream), CODEC_ZSTD);
+      break;
+    default:
+      break;
+    }
+    if (!stream)
+    {
+      return MakeArchiveError("decompressor is not available: " + path);
+    }
+
+    if (format == FORMAT_GZIP || format == FORMAT_XZ || format == FORMAT_ZSTD)
+    {
+      const std::size_t sep = path.rfind('/');
+      DataCallback onData = onMember(StripCompressedSuffix(sep == std::string::npos ? path : path.substr(sep + 1)));
+      if (!onData)
+      {
+        return Common::Success;
+      }
+      return PumpMember(*stream, onData, UINT64_MAX, stop);
+    }
+    return ReadTar(*stream, onMember, stop);
+  }
+} // namespace Archive
@@ -0,0 +1,364 @@
+#include "streams.h"
+
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#if defined(TF_WITH_LZMA)
+#include <lzma.h>
+#endif
+
+#if defined(TF_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace Archive
+{
+  namespace
+  {
+    const std::size_t COMPRESSED_BUFFER_SIZE = 256 * 1024;
+
+    class FileRangeStream: public InputStream
+    {
+    public:
+      FileRangeStream(int fd, std::uint64_t offset, std::uint64_t length)
+        : Fd(fd)
+        , Position(offset)
+        , End(offset + length)
+      {
+      }
+
+      Common::Error Read(char* buffer, std::size_t size, std::size_t& read) override
+      {
+        read = 0;
+        const std::size_t toRead = static_cast<std::size_t>(std::min<std::uint64_t>(size, End - Position));
+        if (toRead == 0)
+        {
+          return Common::Success;
+        }
+        ssize_t result;
+        do
+        {
+          result = pread(Fd, buffer, toRead, static_cast<off_t>(Position));
+        }
+        while (result < 0 && errno == EINTR);
+        if (result < 0)
+        {
+          return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(strerror(errno)));
+        }
+        read = static_cast<std::size_t>(result);
+        Position += read;
+        return Common::Success;
+      }
+
+    private:
+      int Fd;
+      std::uint64_t Position;
+      std::uint64_t End;
+    };
+
+    // Common buffering of the compressed side
+    class DecompressStream: public InputStream
+    {
+    public:
+      explicit DecompressStream(InputStreamPtr source)
+        : Source(std::move(source))
+        , Input(COMPRESSED_BUFFER_SIZE)
+        , InputPos(0)
+        , InputSize(0)
+        , SourceEnded(false)
+      {
+      }
+
+    protected:
+      Common::Error FillInput()
+      {
+        if (InputPos < InputSize || SourceEnded)
+        {
+          return Common::Success;
+        }
+        InputPos = 0;
+        RETURN_IF_FAILED(Source->Read(&Input.front(), Input.size(), InputSize));
+        SourceEnded = InputSize == 0;
+        return Common::Success;
+      }
+
+      InputStreamPtr Source;
+      std::vector<char> Input;
+      std::size_t InputPos;
+      std::size_t InputSize;
+      bool SourceEnded;
+    };
+
+    class ZlibStream: public DecompressStream
+    {
+    public:
+      ZlibStream(InputStreamPtr source, int windowBits)
+        : DecompressStream(std::move(source))
+        , Ended(false)
+      {
+        memset(&Stream, 0, sizeof(Stream));
+        Initialized = inflateInit2(&Stream, windowBits) == Z_OK;
+      }
+
+      ~ZlibStream()
+      {
+        if (Initialized)
+        {
+          inflateEnd(&Stream);
+        }
+      }
+
+      Common::Error Read(char* buffer, std::size_t size, std::size_t& read) override
+      {
+        read = 0;
+        if (!Initialized)
+        {
+          return MakeArchiveError("zlib initialization failed");
+        }
+        while (read == 0 && !Ended)
+        {
+          RETURN_IF_FAILED(FillInput());
+          if (SourceEnded && InputPos == InputSize)
+          {
+            Ended = true;
+            break;
+          }
+          Stream.next_in = reinterpret_cast<Bytef*>(&Input[InputPos]);
+          Stream.avail_in = static_cast<uInt>(InputSize - InputPos);
+          Stream.next_out = reinterpret_cast<Bytef*>(buffer);
+          Stream.avail_out = static_cast<uInt>(size);
+          const int ret = inflate(&Stream, Z_NO_FLUSH);
+          InputPos = InputSize - Stream.avail_in;
+          read = size - Stream.avail_out;
+          if (ret == Z_STREAM_END)
+          {
+            RETURN_IF_FAILED(FillInput());
+            if (InputPos == InputSize)
+            {
+              Ended = true;
+            }
+            else
+            {
+              // next member of a concatenated gzip file
+              inflateReset(&Stream);
+            }
+          }
+          else if (ret != Z_OK && ret != Z_BUF_ERROR)
+          {
+            return MakeArchiveError(std::string("inflate failed: ") + (Stream.msg ? Stream.msg : "unknown error"));
+          }
+          else if (ret == Z_BUF_ERROR && read == 0 && SourceEnded)
+          {
+            return MakeArchiveError("truncated compressed stream");
+          }
+        }
+        return Common::Success;
+      }
+
+    private:
+      z_stream Stream;
+      bool Initialized;
+      bool Ended;
+    };
+
+#if defined(TF_WITH_LZMA)
+    class XzStream: public DecompressStream
+    {
+    public:
+      explicit XzStream(InputStreamPtr source)
+        : DecompressStream(std::move(source))
+        , Stream(LZMA_STREAM_INIT)
+        , Ended(false)
+      {
+        Initialized = lzma_stream_decoder(&Stream, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+      }
+
+      ~XzStream()
+      {
+        lzma_end(&Stream);
+      }
+
+      Common::Error Read(char* buffer, std::size_t size, std::size_t& read) override
+      {
+        read = 0;
+        if (!Initialized)
+        {
+          return MakeArchiveError("lzma initialization failed");
+        }
+        while (read == 0 && !Ended)
+        {
+          RETURN_IF_FAILED(FillInput());
+          Stream.next_in = reinterpret_cast<const uint8_t*>(&Input[InputPos]);
+          Stream.avail_in = InputSize - InputPos;
+          Stream.next_out = reinterpret_cast<uint8_t*>(buffer);
+          Stream.avail_out = size;
+          const lzma_ret ret = lzma_code(&Stream, SourceEnded ? LZMA_FINISH : LZMA_RUN);
+          InputPos = InputSize - Stream.avail_in;
+          read = size - Stream.avail_out;
+          if (ret == LZMA_STREAM_END)
+          {
+            Ended = true;
+          }
+          else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR)
+          {
+            return MakeArchiveError("xz stream is corrupted");
+          }
+          else if (SourceEnded && read == 0)
+          {
+            return MakeArchiveError("truncated xz stream");
+          }
+        }
+        return Common::Success;
+      }
+
+    private:
+      lzma_stream Stream;
+      bool Initialized;
+      bool Ended;
+    };
+#endif
+
+#if defined(TF_WITH_ZSTD)
+    class ZstdStream: public DecompressStream
+    {
+    public:
+      explicit ZstdStream(InputStreamPtr source)
+        : DecompressStream(std::move(source))
+        , Context(ZSTD_createDStream())
+        , Ended(false)
+      {
+        ZSTD_initDStream(Context);
+      }
+
+      ~ZstdStream()
+      {
+        ZSTD_freeDStream(Context);
+      }
+
+      Common::Error Read(char* buffer, std::size_t size, std::size_t& read) override
+      {
+        read = 0;
+        while (read == 0 && !Ended)
+        {
+          RETURN_IF_FAILED(FillInput());
+          if (SourceEnded && InputPos == InputSize)
+          {
+            Ended = true;
+            break;
+          }
+          ZSTD_inBuffer in = { &Input[InputPos], InputSize - InputPos, 0 };
+          ZSTD_outBuffer out = { buffer, size, 0 };
+          const std::size_t ret = ZSTD_decompressStream(Context, &out, &in);
+          if (ZSTD_isError(ret))
+          {
+            return MakeArchiveError(std::string("zstd: ") + ZSTD_getErrorName(ret));
+          }
+          InputPos += in.pos;
+          read = out.pos;
+        }
+        return Common::Success;
+      }
+
+    private:
+      ZSTD_DStream* Context;
+      bool Ended;
+    };
+#endif
+  } // namespace
+
+  InputStreamPtr CreateFileRangeStream(int fd, std::uint64_t offset, std::uint64_t length)
+  {
+    return InputStreamPtr(new FileRangeStream(fd, offset, length));
+  }
+
+  InputStreamPtr CreateDecompressStream(InputStreamPtr source, Codec codec)
+  {
+    switch (codec)
+    {
+    case CODEC_GZIP:
+      return InputStreamPtr(new ZlibStream(std::move(source), 15 + 32));
+    case CODEC_RAW_DEFLATE:
+      return InputStreamPtr(new ZlibStream(std::move(source), -15));
+    case CODEC_XZ:
+#if defined(TF_WITH_LZMA)
+      return InputStreamPtr(new XzStream(std::move(source)));
+#else
+      return InputStreamPtr();
+#endif
+    case CODEC_ZSTD:
+#if defined(TF_WITH_ZSTD)
+      return InputStreamPtr(new ZstdStream(std::move(source)));
+#else
+      return InputStreamPtr();
+#endif
+    }
+    return InputStreamPtr();
+  }
+
+  bool IsCodecAvailable(Codec codec)
+  {
+    switch (codec)
+    {
+    case CODEC_GZIP:
+    case CODEC_RAW_DEFLATE:
+      return true;
+    case CODEC_XZ:
+#if defined(TF_WITH_LZMA)
+      return true;
+#else
+      return false;
+#endif
+    case CODEC_ZSTD:
+#if defined(TF_WITH_ZSTD)
+      return true;
+#else
+      return false;
+#endif
+    }
+    return false;
+  }
+
+  Common::Error ReadFull(InputStream& stream, char* buffer, std::size_t size, std::size_t& read)
+  {
+    read = 0;
+    while (read < size)
+    {
+      std::size_t chunk = 0;
+      RETURN_IF_FAILED(stream.Read(buffer + read, size - read, chunk));
+      if (chunk == 0)
+      {
+        break;
+      }
+      read += chunk;
+    }
+    return Common::Success;
+  }
+
+  Common::Error Skip(InputStream& stream, std::uint64_t size)
+  {
+    char buffer[64 * 1024];
+    while (size > 0)
+    {
+      std::size_t chunk = 0;
+      RETURN_IF_FAILED(stream.Read(buffer, static_cast<std::size_t>(std::min<std::uint64_t>(size, sizeof(buffer))), chunk));
+      if (chunk == 0)
+      {
+        return MakeArchiveError("unexpected end of archive");
+      }
+      size -= chunk;
+    }
+    return Common::Success;
+  }
+
+  Common::Error MakeArchiveError(const std::string& message)
+  {
+    return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_COMMON, 2), Common::StringToWideString(message));
+  }
+} // namespace Archive
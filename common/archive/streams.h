@@ -0,0 +1,41 @@
+#pragma once
+
+#include <common/error.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Archive
+{
+  class InputStream
+  {
+  public:
+    virtual ~InputStream() {}
+    // Zero bytes read without an error means end of stream
+    virtual Common::Error Read(char* buffer, std::size_t size, std::size_t& read) = 0;
+  };
+
+  typedef std::unique_ptr<InputStream> InputStreamPtr;
+
+  enum Codec
+  {
+    CODEC_GZIP,        // gzip or zlib framing, concatenated members are supported
+    CODEC_RAW_DEFLATE, // zip entries
+    CODEC_XZ,
+    CODEC_ZSTD
+  };
+
+  // Reads [offset, offset + length) of a file descriptor which stays owned by the caller
+  InputStreamPtr CreateFileRangeStream(int fd, std::uint64_t offset, std::uint64_t length);
+  // Returns null when the codec is not available in this build
+  InputStreamPtr CreateDecompressStream(InputStreamPtr source, Codec codec);
+  bool IsCodecAvailable(Codec codec);
+
+  // Reads until buffer is full or stream ends
+  Common::Error ReadFull(InputStream& stream, char* buffer, std::size_t size, std::size_t& read);
+  Common::Error Skip(InputStream& stream, std::uint64_t size);
+
+  Common::Error MakeArchiveError(const std::string& message);
+} // namespace Archive
@@ -0,0 +1,197 @@
+#include <common/duplicates.h>
+#include <common/filesystem.h>
+#include <common/hash.h>
+#include <common/string_utils.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <utility>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace Filesys
+{
+  namespace
+  {
+    // Files that differ usually differ early, one block of the head rules out most of them
+    const std::uint64_t HEAD_SIZE = 64 * 1024;
+
+    struct Candidate
+    {
+      std::string Path;
+      std::uint64_t Size;
+      std::uint64_t Hash;
+      bool Valid;
+    };
+
+    typedef std::vector<Candidate> CandidateList;
+
+    bool IsHidden(const std::string& path)
+    {
+      const std::size_t slash = path.rfind(PATH_SEPARATOR);
+      const std::size_t start = slash == std::string::npos ? 0 : slash + 1;
+      return start < path.size() && path[start] == '.';
+    }
+
+    // Groups regular files of all roots by size
+    class Collector
+    {
+    public:
+      explicit Collector(const DuplicateQuery& query)
+        : Query(query)
+      {
+      }
+
+      Common::Error Walk(const std::string& root, Common::JobControl& control)
+      {
+        Root = root;
+        return WalkDir(
+          Dir(Common::StringToWideString(root)),
+          std::bind(&Collector::OnEntry, this, std::placeholders::_1, std::placeholders::_2),
+          false,
+          control.AsStopCallback()
+        );
+      }
+
+      std::map<std::uint64_t, CandidateList> BySize;
+
+    private:
+      bool OnEntry(const std::string& path, FileObjectType type)
+      {
+        if (!Query.IncludeHidden && path != Root && IsHidden(path))
+        {
+          // skips the whole subtree when it's a directory
+          return false;
+        }
+        if (type != FILE_REGULAR)
+        {
+          return true;
+        }
+        struct stat st;
+        if (lstat(path.c_str(), &st) < 0 || static_cast<std::uint64_t>(st.st_size) < Query.MinSize)
+        {
+          return true;
+        }
+        if (!Inodes.insert(std::make_pair(st.st_dev, st.st_ino)).second)
+        {
+          return true;
+        }
+        const Candidate candidate = { path, static_cast<std::uint64_t>(st.st_size), 0, true };
+        BySize[candidate.Size].push_back(candidate);
+        return true;
+      }
+
+      const DuplicateQuery& Query;
+      std::string Root;
+      std::set<std::pair<dev_t, ino_t> > Inodes;
+    };
+
+    // Replaces Hash of every candidate with the hash of its first limit bytes (0 - whole file);
+    // unreadable files are marked invalid and drop out
+    void HashCandidates(CandidateList& candidates, std::uint64_t limit, Common::JobControl& control)
+    {
+      Common::TaskGroup tasks(Common::ThreadPool::Io());
+      for (Candidate& candidate: candidates)
+      {
+        Candidate* target = &candidate;
+        tasks.Run([target, limit, &control]()
+        {
+          if (!control.Checkpoint())
+          {
+            target->Valid = false;
+            return;
+          }
+          target->Valid = !Hash::HashFile(target->Path, target->Hash, limit, control.AsStopCallback());
+        });
+      }
+      tasks.Wait();
+    }
+
+    // Splits candidates of one size into groups of equal hashes, keeps groups of two and more
+    void SplitByHash(const CandidateList& candidates, std::vector<CandidateList>& groups)
+    {
+      std::map<std::uint64_t, CandidateList> byHash;
+      for (const Candidate& candidate: candidates)
+      {
+        if (candidate.Valid)
+        {
+          byHash[candidate.Hash].push_back(candidate);
+        }
+      }
+      for (auto& entry: byHash)
+      {
+        if (entry.second.size() > 1)
+        {
+          groups.push_back(entry.second);
+        }
+      }
+    }
+  } // namespace
+
+  Common::Error FindDuplicates(const DuplicateQuery& query, DuplicateCallback callback, Common::JobControl& control)
+  {
+    Collector collector(query);
+    for (const std::string& root: query.Roots)
+    {
+      RETURN_IF_FAILED(collector.Walk(root, control));
+    }
+    std::map<std::uint64_t, CandidateList>& bySize = collector.BySize;
+
+    // largest files first, they waste the most space
+    for (auto size = bySize.rbegin(); size != bySize.rend(); ++size)
+    {
+      if (size->second.size() < 2)
+      {
+        continue;
+      }
+      if (!control.Checkpoint())
+      {
+        break;
+      }
+
+      HashCandidates(size->second, HEAD_SIZE, control);
+      std::vector<CandidateList> groups;
+      SplitByHash(size->second, groups);
+      if (size->first > HEAD_SIZE)
+      {
+        std::vector<CandidateList> sameHead;
+        sameHead.swap(groups);
+        for (CandidateList& group: sameHead)
+        {
+          HashCandidates(group, 0, control);
+          SplitByHash(group, groups);
+        }
+      }
+      if (control.IsCancelled())
+      {
+        break;
+      }
+
+      std::vector<DuplicateGroup> results;
+      for (const CandidateList& group: groups)
+      {
+        DuplicateGroup result;
+        result.Size = size->first;
+        for (const Candidate& candidate: group)
+        {
+          result.Paths.push_back(candidate.Path);
+        }
+        std::sort(result.Paths.begin(), result.Paths.end());
+        results.push_back(result);
+      }
+      std::sort(results.begin(), results.end(), [](const DuplicateGroup& left, const DuplicateGroup& right)
+      {
+        return left.Paths.front() < right.Paths.front();
+      });
+      for (const DuplicateGroup& result: results)
+      {
+        callback(result);
+      }
+    }
+    return Common::Success;
+  }
+} // namespace Filesys
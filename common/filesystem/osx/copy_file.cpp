@@ -1,7 +1,11 @@
 #include <common/filesystem.h>
+#include <common/module.h>
 #include <common/string_utils.h>
 
+#include <cstring>
+
 #include <copyfile.h>
+#include <errno.h>
 
 namespace Filesys
 {
@@ -10,8 +14,13 @@ namespace Filesys
     const std::vector<char>& src = Common::WideStringToCStr(source.GetPath());
     const std::vector<char>& dst = Common::WideStringToCStr(destination.GetPath());
 
-    copyfile(&src.front(), &dst.front(), NULL, COPYFILE_ALL | COPYFILE_RECURSIVE | COPYFILE_NOFOLLOW);
-
+    if (copyfile(&src.front(), &dst.front(), NULL, COPYFILE_ALL | COPYFILE_RECURSIVE | COPYFILE_NOFOLLOW) < 0)
+    {
+      return MAKE_ERROR(
+        MAKE_MODULE_ERROR(Common::MODULE_OS, errno),
+        Common::StringToWideString(std::string(&src.front()) + ": " + strerror(errno))
+      );
+    }
     return Common::Success;
   }
 } // namespace Filesys
@@ -2,6 +2,9 @@
 #include <common/string_utils.h>
 #include <common/trace.h>
 
+#include <cstring>
+#include <set>
+#include <utility>
 #include <vector>
 
 #include <errno.h>
@@ -15,11 +18,38 @@ namespace Filesys
 
   namespace
   {
+    class FtsHandle
+    {
+    public:
+      explicit FtsHandle(FTS* handle)
+        : Handle(handle)
+      {
+      }
+
+      ~FtsHandle()
+      {
+        if (Handle)
+        {
+          fts_close(Handle);
+        }
+      }
+
+    private:
+      FtsHandle(const FtsHandle&);
+      FtsHandle& operator=(const FtsHandle&);
+
+      FTS* Handle;
+    };
+
     typedef std::function<bool(FTSENT*)> TraverseCallbackFunction;
-    Common::Error TraverseDirectoryTree(const Dir& dir, TraverseCallbackFunction traverseCallback, bool depthFirst = true)
+    Common::Error TraverseDirectoryTree(
+      const Dir& dir,
+      TraverseCallbackFunction traverseCallback,
+      bool depthFirst = true,
+      Common::StopCallback stop = Common::StopCallback()
+    )
     {
       std::vector<char> buffer = Common::WideStringToCStr(dir.GetPath());
-      int ret = 0;
 
       FTS* ftsp = NULL;
       FTSENT* curr;
@@ -35,12 +65,19 @@ namespace Filesys
       if (!ftsp)
       {
         fprintf(stderr, "%s: fts_open failed: %s\n", &buffer.front(), strerror(errno));
-        ret = -1;
-        goto finish;
+        return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(strerror(errno)));
       }
 
+      const FtsHandle ftsGuard(ftsp);
       while ((curr = fts_read(ftsp)))
       {
+        if (stop && stop())
+        {
+          // handle is closed by the guard, no need to drain the traversal
+          errno = 0;
+          break;
+        }
+
         switch (curr->fts_info)
         {
         case FTS_NS:
@@ -64,6 +101,9 @@ namespace Filesys
         case FTS_SL:
         case FTS_SLNONE:
         case FTS_DEFAULT:
+          // non-directories are visited once, so they are reported in either order
+          traverseCallback(curr);
+          break;
 
         case FTS_D:
           if (depthFirst)
@@ -88,13 +128,6 @@ namespace Filesys
         }
       }
 
-      finish:
-      if (ftsp)
-      {
-        // TODO: use RAII
-        fts_close(ftsp);
-      }
-
       if (errno != 0)
       {
         return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(strerror(errno)));
@@ -123,6 +156,28 @@ namespace Filesys
       return true;
     }
 
+    typedef std::set<std::pair<dev_t, ino_t> > InodeSet;
+
+    bool AddUsage(DiskUsage& usage, InodeSet& linked, FTSENT* curr)
+    {
+      const struct stat* st = curr->fts_statp;
+      if (curr->fts_info == FTS_DP)
+      {
+        ++usage.Dirs;
+      }
+      else
+      {
+        if (st->st_nlink > 1 && !linked.insert(std::make_pair(st->st_dev, st->st_ino)).second)
+        {
+          return true;
+        }
+        ++usage.Files;
+      }
+      usage.Bytes += st->st_size;
+      usage.Allocated += static_cast<std::uint64_t>(st->st_blocks) * 512;
+      return true;
+    }
+
     bool ProcessEntry(WalkCallback callback, FTSENT* curr)
     {
       FileObjectType fileType = FILE_OTHER;
@@ -175,6 +230,13 @@ namespace Filesys
     return entries;
   }
 
+  Common::Error GetDiskUsage(const Dir& dir, DiskUsage& result, Common::StopCallback stop)
+  {
+    result = DiskUsage();
+    InodeSet linked;
+    return TraverseDirectoryTree(dir, std::bind(AddUsage, std::ref(result), std::ref(linked), std::placeholders::_1), true, stop);
+  }
+
   Common::Error CreateDir(const std::wstring& path)
   {
     DEBUG(Common::MODULE_COMMON, L"CreateDir: " + path);
@@ -182,8 +244,8 @@ namespace Filesys
     return Common::Success;
   }
 
-  Common::Error WalkDir(const Dir& dir, WalkCallback callback, bool depthFirst)
+  Common::Error WalkDir(const Dir& dir, WalkCallback callback, bool depthFirst, Common::StopCallback stop)
   {
-    return TraverseDirectoryTree(dir, std::bind(ProcessEntry, callback, std::placeholders::_1), depthFirst);
+    return TraverseDirectoryTree(dir, std::bind(ProcessEntry, callback, std::placeholders::_1), depthFirst, stop);
   }
 } // namespace Filesys
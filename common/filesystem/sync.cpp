@@ -0,0 +1,230 @@
+#include <common/sync.h>
+#include <common/filesystem.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace Filesys
+{
+  namespace
+  {
+    Common::Error MakeOsError(const std::string& path, int code)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, code), Common::StringToWideString(path + ": " + strerror(code)));
+    }
+
+    std::string JoinPath(const std::string& dir, const std::string& name)
+    {
+      if (!dir.empty() && dir[dir.size() - 1] == PATH_SEPARATOR)
+      {
+        return dir + name;
+      }
+      return dir + PATH_SEPARATOR + name;
+    }
+
+    // Sorted, so that actions are reported in a stable order
+    Common::Error ReadNames(const std::string& path, std::vector<std::string>& names)
+    {
+      names.clear();
+      DIR* dir = opendir(path.c_str());
+      if (!dir)
+      {
+        return MakeOsError(path, errno);
+      }
+      while (const dirent* entry = readdir(dir))
+      {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+          names.push_back(entry->d_name);
+        }
+      }
+      closedir(dir);
+      std::sort(names.begin(), names.end());
+      return Common::Success;
+    }
+
+    class Syncer
+    {
+    public:
+      Syncer(const SyncOptions& options, SyncCallback callback, SyncStats& stats, Common::JobControl& control)
+        : Options(options)
+        , Callback(callback)
+        , Stats(stats)
+        , Control(control)
+      {
+      }
+
+      Common::Error MakeDir(const std::string& path, mode_t mode)
+      {
+        Report(SYNC_CREATE_DIR, path);
+        if (!Options.DryRun && mkdir(path.c_str(), mode & 07777) < 0)
+        {
+          return MakeOsError(path, errno);
+        }
+        return Common::Success;
+      }
+
+      // destinationExists is false when the directory is yet to be created by a dry run
+      Common::Error SyncDir(const std::string& source, const std::string& destination, bool destinationExists)
+      {
+        std::vector<std::string> names;
+        RETURN_IF_FAILED(ReadNames(source, names));
+        for (const std::string& name: names)
+        {
+          if (!Control.Checkpoint())
+          {
+            return Common::Success;
+          }
+          const std::string sourcePath = JoinPath(source, name);
+          const std::string destinationPath = JoinPath(destination, name);
+          struct stat sourceSt;
+          if (lstat(sourcePath.c_str(), &sourceSt) < 0)
+          {
+            // vanished since listing
+            continue;
+          }
+          struct stat destinationSt;
+          bool exists = destinationExists && lstat(destinationPath.c_str(), &destinationSt) == 0;
+          const bool isDir = S_ISDIR(sourceSt.st_mode);
+          if (exists && S_ISDIR(destinationSt.st_mode) != isDir)
+          {
+            RETURN_IF_FAILED(Remove(destinationPath, destinationSt));
+            exists = false;
+          }
+
+          if (isDir)
+          {
+            if (!exists)
+            {
+              RETURN_IF_FAILED(MakeDir(destinationPath, sourceSt.st_mode));
+            }
+            RETURN_IF_FAILED(SyncDir(sourcePath, destinationPath, exists || !Options.DryRun));
+          }
+          else if (!exists)
+          {
+            RETURN_IF_FAILED(CopyEntry(sourcePath, destinationPath, sourceSt, SYNC_COPY));
+          }
+          else if (sourceSt.st_size != destinationSt.st_size || sourceSt.st_mtime != destinationSt.st_mtime)
+          {
+            RETURN_IF_FAILED(CopyEntry(sourcePath, destinationPath, sourceSt, SYNC_UPDATE));
+          }
+          else
+          {
+            ++Stats.Unchanged;
+          }
+        }
+
+        if (!Options.DeleteExtra || !destinationExists)
+        {
+          return Common::Success;
+        }
+        const std::set<std::string> sourceNames(names.begin(), names.end());
+        RETURN_IF_FAILED(ReadNames(destination, names));
+        for (const std::string& name: names)
+        {
+          const std::string path = JoinPath(destination, name);
+          struct stat st;
+          if (!sourceNames.count(name) && lstat(path.c_str(), &st) == 0)
+          {
+            RETURN_IF_FAILED(Remove(path, st));
+          }
+        }
+        return Common::Success;
+      }
+
+    private:
+      void Report(SyncAction action, const std::string& path)
+      {
+        if (Callback)
+        {
+          Callback(action, path);
+        }
+      }
+
+      Common::Error CopyEntry(const std::string& source, const std::string& destination, const struct stat& st, SyncAction action)
+      {
+        Report(action, destination);
+        ++(action == SYNC_COPY ? Stats.Copied : Stats.Updated);
+        Stats.Bytes += st.st_size;
+        if (Options.DryRun)
+        {
+          return Common::Success;
+        }
+        // copyfile doesn't replace symlinks, so the old entry goes first
+        if (action == SYNC_UPDATE && unlink(destination.c_str()) < 0)
+        {
+          return MakeOsError(destination, errno);
+        }
+        return Copy(FileInfo(Common::StringToWideString(source)), FileInfo(Common::StringToWideString(destination)));
+      }
+
+      Common::Error Remove(const std::string& path, const struct stat& st)
+      {
+        Report(SYNC_DELETE, path);
+        ++Stats.Deleted;
+        if (Options.DryRun)
+        {
+          return Common::Success;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+          return RemoveDirRecursive(Dir(Common::StringToWideString(path)));
+        }
+        if (unlink(path.c_str()) < 0)
+        {
+          return MakeOsError(path, errno);
+        }
+        return Common::Success;
+      }
+
+      const SyncOptions& Options;
+      SyncCallback Callback;
+      SyncStats& Stats;
+      Common::JobControl& Control;
+    };
+  } // namespace
+
+  Common::Error SyncDirs(
+    const std::string& source,
+    const std::string& destination,
+    const SyncOptions& options,
+    SyncCallback callback,
+    SyncStats& stats,
+    Common::JobControl& control
+  )
+  {
+    struct stat sourceSt;
+    if (stat(source.c_str(), &sourceSt) < 0)
+    {
+      return MakeOsError(source, errno);
+    }
+    if (!S_ISDIR(sourceSt.st_mode))
+    {
+      return MakeOsError(source, ENOTDIR);
+    }
+
+    Syncer syncer(options, callback, stats, control);
+    struct stat destinationSt;
+    bool exists = stat(destination.c_str(), &destinationSt) == 0;
+    if (exists && !S_ISDIR(destinationSt.st_mode))
+    {
+      // never replace whatever the user pointed at with a directory
+      return MakeOsError(destination, ENOTDIR);
+    }
+    if (!exists)
+    {
+      RETURN_IF_FAILED(syncer.MakeDir(destination, sourceSt.st_mode));
+    }
+    return syncer.SyncDir(source, destination, exists || !options.DryRun);
+  }
+} // namespace Filesys
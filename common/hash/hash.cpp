@@ -0,0 +1,216 @@
+#include <common/hash.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Hash
+{
+  namespace
+  {
+    const std::uint64_t PRIME1 = 11400714785074694791ULL;
+    const std::uint64_t PRIME2 = 14029467366897019727ULL;
+    const std::uint64_t PRIME3 = 1609587929392839161ULL;
+    const std::uint64_t PRIME4 = 9650029242287828579ULL;
+    const std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+    const std::size_t READ_BUFFER_SIZE = 256 * 1024;
+
+    inline std::uint64_t RotateLeft(std::uint64_t value, unsigned bits)
+    {
+      return (value << bits) | (value >> (64 - bits));
+    }
+
+    // XXH64 is defined over little endian words, which is what all supported CPUs use
+    inline std::uint64_t Read64(const unsigned char* p)
+    {
+      std::uint64_t value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+
+    inline std::uint32_t Read32(const unsigned char* p)
+    {
+      std::uint32_t value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+
+    inline std::uint64_t Round(std::uint64_t acc, std::uint64_t input)
+    {
+      acc += input * PRIME2;
+      acc = RotateLeft(acc, 31);
+      return acc * PRIME1;
+    }
+
+    inline std::uint64_t MergeRound(std::uint64_t acc, std::uint64_t value)
+    {
+      acc ^= Round(0, value);
+      return acc * PRIME1 + PRIME4;
+    }
+
+    // Consumes whole 32 byte stripes, returns pointer past the last one
+    const unsigned char* ProcessStripes(std::uint64_t* acc, const unsigned char* p, const unsigned char* end)
+    {
+      std::uint64_t v1 = acc[0];
+      std::uint64_t v2 = acc[1];
+      std::uint64_t v3 = acc[2];
+      std::uint64_t v4 = acc[3];
+      for (; end - p >= 32; p += 32)
+      {
+        v1 = Round(v1, Read64(p));
+        v2 = Round(v2, Read64(p + 8));
+        v3 = Round(v3, Read64(p + 16));
+        v4 = Round(v4, Read64(p + 24));
+      }
+      acc[0] = v1;
+      acc[1] = v2;
+      acc[2] = v3;
+      acc[3] = v4;
+      return p;
+    }
+  } // namespace
+
+  Xxh64::Xxh64(std::uint64_t seed)
+    : Buffered(0)
+    , TotalSize(0)
+    , Seed(seed)
+  {
+    Acc[0] = seed + PRIME1 + PRIME2;
+    Acc[1] = seed + PRIME2;
+    Acc[2] = seed;
+    Acc[3] = seed - PRIME1;
+  }
+
+  void Xxh64::Update(const void* data, std::size_t size)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    TotalSize += size;
+
+    if (Buffered)
+    {
+      const std::size_t take = std::min(size, sizeof(Buffer) - Buffered);
+      memcpy(Buffer + Buffered, p, take);
+      Buffered += take;
+      p += take;
+      if (Buffered < sizeof(Buffer))
+      {
+        return;
+      }
+      ProcessStripes(Acc, Buffer, Buffer + sizeof(Buffer));
+      Buffered = 0;
+    }
+    p = ProcessStripes(Acc, p, end);
+    memcpy(Buffer, p, end - p);
+    Buffered = end - p;
+  }
+
+  std::uint64_t Xxh64::Digest() const
+  {
+    std::uint64_t result;
+    if (TotalSize >= 32)
+    {
+      result = RotateLeft(Acc[0], 1) + RotateLeft(Acc[1], 7) + RotateLeft(Acc[2], 12) + RotateLeft(Acc[3], 18);
+      for (std::uint64_t acc: Acc)
+      {
+        result = MergeRound(result, acc);
+      }
+    }
+    else
+    {
+      result = Seed + PRIME5;
+    }
+    result += TotalSize;
+
+    const unsigned char* p = Buffer;
+    const unsigned char* end = Buffer + Buffered;
+    for (; end - p >= 8; p += 8)
+    {
+      result ^= Round(0, Read64(p));
+      result = RotateLeft(result, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4)
+    {
+      result ^= Read32(p) * PRIME1;
+      result = RotateLeft(result, 23) * PRIME2 + PRIME3;
+      p += 4;
+    }
+    for (; p < end; ++p)
+    {
+      result ^= *p * PRIME5;
+      result = RotateLeft(result, 11) * PRIME1;
+    }
+
+    result ^= result >> 33;
+    result *= PRIME2;
+    result ^= result >> 29;
+    result *= PRIME3;
+    result ^= result >> 32;
+    return result;
+  }
+
+  std::uint64_t Compute(const void* data, std::size_t size, std::uint64_t seed)
+  {
+    Xxh64 state(seed);
+    state.Update(data, size);
+    return state.Digest();
+  }
+
+  Common::Error HashFile(const std::string& path, std::uint64_t& result, std::uint64_t limit, Common::StopCallback stop)
+  {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(path + ": " + strerror(errno)));
+    }
+#if defined(__APPLE__)
+    fcntl(fd, F_RDAHEAD, 1);
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    Xxh64 state;
+    std::uint64_t total = 0;
+    while (!limit || total < limit)
+    {
+      if (stop && stop())
+      {
+        close(fd);
+        return MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, ECANCELED), L"Cancelled");
+      }
+      std::size_t want = buffer.size();
+      if (limit)
+      {
+        want = static_cast<std::size_t>(std::min<std::uint64_t>(want, limit - total));
+      }
+      const ssize_t got = read(fd, &buffer.front(), want);
+      if (got < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        const Common::Error error = MAKE_ERROR(MAKE_MODULE_ERROR(Common::MODULE_OS, errno), Common::StringToWideString(path + ": " + strerror(errno)));
+        close(fd);
+        return error;
+      }
+      if (got == 0)
+      {
+        break;
+      }
+      state.Update(&buffer.front(), got);
+      total += got;
+    }
+    close(fd);
+    result = state.Digest();
+    return Common::Success;
+  }
+} // namespace Hash
@@ -0,0 +1,88 @@
+#include <common/job_control.h>
+
+namespace Common
+{
+  JobControl::JobControl()
+    : CurrentState(RUNNING)
+    , Finished(false)
+  {
+  }
+
+  void JobControl::Pause()
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    int expected = RUNNING;
+    CurrentState.compare_exchange_strong(expected, PAUSED);
+  }
+
+  void JobControl::Resume()
+  {
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      int expected = PAUSED;
+      CurrentState.compare_exchange_strong(expected, RUNNING);
+    }
+    StateChanged.notify_all();
+  }
+
+  void JobControl::Cancel()
+  {
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      CurrentState = CANCELLED;
+    }
+    StateChanged.notify_all();
+  }
+
+  bool JobControl::IsPaused() const
+  {
+    return CurrentState == PAUSED;
+  }
+
+  bool JobControl::IsCancelled() const
+  {
+    return CurrentState == CANCELLED;
+  }
+
+  bool JobControl::Checkpoint()
+  {
+    // fast path without locking, it's called for every walked entry
+    const int state = CurrentState;
+    if (state == RUNNING)
+    {
+      return true;
+    }
+    if (state == CANCELLED)
+    {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(Lock);
+    StateChanged.wait(lock, [this] { return CurrentState != PAUSED; });
+    return CurrentState != CANCELLED;
+  }
+
+  StopCallback JobControl::AsStopCallback()
+  {
+    return [this] { return !Checkpoint(); };
+  }
+
+  void JobControl::Finish()
+  {
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      Finished = true;
+    }
+    StateChanged.notify_all();
+  }
+
+  bool JobControl::IsFinished() const
+  {
+    return Finished;
+  }
+
+  void JobControl::WaitFinished()
+  {
+    std::unique_lock<std::mutex> lock(Lock);
+    StateChanged.wait(lock, [this] { return Finished.load(); });
+  }
+} // namespace Common
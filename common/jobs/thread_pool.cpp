@@ -0,0 +1,130 @@
+#include <common/thread_pool.h>
+
+#include <algorithm>
+
+namespace Common
+{
+  namespace
+  {
+    // IO bound work benefits from more threads than cores, especially on network mounts
+    const std::size_t IO_POOL_THREADS_PER_CORE = 2;
+    const std::size_t MIN_IO_POOL_THREADS = 4;
+  } // namespace
+
+  ThreadPool::ThreadPool(std::size_t threadCount)
+    : Shared(std::make_shared<State>())
+  {
+    if (threadCount == 0)
+    {
+      threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < threadCount; ++i)
+    {
+      Workers.push_back(std::thread(&ThreadPool::WorkerLoop, Shared));
+    }
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    // destroyed outside the lock, captures of the tasks may be anything
+    std::deque<Task> dropped;
+    {
+      std::lock_guard<std::mutex> lock(Shared->Lock);
+      Shared->Stopping = true;
+      dropped.swap(Shared->Queue);
+    }
+    Shared->HasWork.notify_all();
+    for (auto& worker: Workers)
+    {
+      worker.detach();
+    }
+  }
+
+  void ThreadPool::Submit(Task task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(Shared->Lock);
+      Shared->Queue.push_back(std::move(task));
+    }
+    Shared->HasWork.notify_one();
+  }
+
+  std::size_t ThreadPool::GetThreadCount() const
+  {
+    return Workers.size();
+  }
+
+  void ThreadPool::WorkerLoop(std::shared_ptr<State> state)
+  {
+    for (;;)
+    {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(state->Lock);
+        state->HasWork.wait(lock, [&state] { return state->Stopping || !state->Queue.empty(); });
+        if (state->Stopping)
+        {
+          return;
+        }
+        task = std::move(state->Queue.front());
+        state->Queue.pop_front();
+      }
+      task();
+    }
+  }
+
+  ThreadPool& ThreadPool::Io()
+  {
+    static ThreadPool pool(
+      std::max(MIN_IO_POOL_THREADS, IO_POOL_THREADS_PER_CORE * std::thread::hardware_concurrency())
+    );
+    return pool;
+  }
+
+  ThreadPool& ThreadPool::Cpu()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  ThreadPool& ThreadPool::Sort()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  TaskGroup::TaskGroup(ThreadPool& pool)
+    : Pool(pool)
+    , Pending(0)
+  {
+  }
+
+  TaskGroup::~TaskGroup()
+  {
+    Wait();
+  }
+
+  void TaskGroup::Run(ThreadPool::Task task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      ++Pending;
+    }
+    Pool.Submit([this, task]()
+    {
+      task();
+      // notify under the lock, waiter may destroy the group as soon as it sees zero
+      std::lock_guard<std::mutex> lock(Lock);
+      if (--Pending == 0)
+      {
+        AllDone.notify_all();
+      }
+    });
+  }
+
+  void TaskGroup::Wait()
+  {
+    std::unique_lock<std::mutex> lock(Lock);
+    AllDone.wait(lock, [this] { return Pending == 0; });
+  }
+} // namespace Common
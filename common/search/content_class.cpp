@@ -0,0 +1,100 @@
+#include <common/content_class.h>
+#include <common/text_encoding.h>
+
+#include <cstring>
+
+namespace Search
+{
+  namespace
+  {
+    // Cache is dropped as a whole when it grows that large, it refills from the next searches
+    const std::size_t MAX_CACHED_CLASSES = 1000000;
+
+    struct Magic
+    {
+      std::size_t Offset;
+      const char* Bytes;
+      std::size_t Size;
+    };
+
+#define MAGIC(offset, bytes) { offset, bytes, sizeof(bytes) - 1 }
+    const Magic BINARY_MAGICS[] = {
+      MAGIC(0, "\x7f" "ELF"),
+      MAGIC(0, "\xfe\xed\xfa\xce"),     // Mach-O
+      MAGIC(0, "\xfe\xed\xfa\xcf"),
+      MAGIC(0, "\xce\xfa\xed\xfe"),
+      MAGIC(0, "\xcf\xfa\xed\xfe"),
+      MAGIC(0, "\xca\xfe\xba\xbe"),     // universal binary, Java class
+      MAGIC(0, "!<arch>\n"),            // static library
+      MAGIC(0, "\x89PNG"),
+      MAGIC(0, "\xff\xd8\xff"),         // JPEG
+      MAGIC(0, "GIF8"),
+      MAGIC(0, "%PDF-"),
+      MAGIC(0, "SQLite format 3"),
+      MAGIC(0, "PK\x03\x04"),
+      MAGIC(0, "\x1f\x8b"),             // gzip
+      MAGIC(0, "\xfd" "7zXZ"),          // xz
+      MAGIC(0, "\x28\xb5\x2f\xfd"),     // zstd
+      MAGIC(0, "7z\xbc\xaf\x27\x1c"),
+      MAGIC(0, "Rar!"),
+      MAGIC(0, "OggS"),
+      MAGIC(0, "RIFF"),
+      MAGIC(0, "ID3"),                  // mp3
+      MAGIC(0, "\0asm"),                // WebAssembly
+      MAGIC(4, "ftyp"),                 // mp4, mov, heic
+    };
+#undef MAGIC
+  } // namespace
+
+  ContentClass ClassifyContent(const char* data, std::size_t size)
+  {
+    if (size == 0)
+    {
+      return CONTENT_TEXT;
+    }
+    for (const Magic& magic: BINARY_MAGICS)
+    {
+      if (size >= magic.Offset + magic.Size && memcmp(data + magic.Offset, magic.Bytes, magic.Size) == 0)
+      {
+        return CONTENT_BINARY;
+      }
+    }
+    const std::size_t sample = size < CONTENT_SAMPLE_SIZE ? size : CONTENT_SAMPLE_SIZE;
+    if (GetUnitSize(DetectEncoding(data, sample)) == 2)
+    {
+      return CONTENT_TEXT;
+    }
+    return memchr(data, '\0', sample) ? CONTENT_BINARY : CONTENT_TEXT;
+  }
+
+  ContentClassCache::ContentClassCache()
+  {
+  }
+
+  ContentClassCache& ContentClassCache::Instance()
+  {
+    static ContentClassCache cache;
+    return cache;
+  }
+
+  ContentClass ContentClassCache::Find(std::uint64_t device, std::uint64_t inode, std::uint64_t size, std::int64_t mtime)
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    const auto found = Records.find(Key{device, inode});
+    if (found == Records.end() || found->second.Size != size || found->second.Mtime != mtime)
+    {
+      return CONTENT_UNKNOWN;
+    }
+    return found->second.Value;
+  }
+
+  void ContentClassCache::Store(std::uint64_t device, std::uint64_t inode, std::uint64_t size, std::int64_t mtime, ContentClass value)
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    if (Records.size() >= MAX_CACHED_CLASSES)
+    {
+      Records.clear();
+    }
+    Records[Key{device, inode}] = Record{size, mtime, value};
+  }
+} // namespace Search
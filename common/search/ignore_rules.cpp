@@ -0,0 +1,342 @@
+#include <common/ignore_rules.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+#include <common/trace.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <errno.h>
+
+namespace Search
+{
+  const char* const IGNORE_FILE_NAMES[2] = { ".gitignore", ".ignore" };
+
+  namespace
+  {
+    const char WILDCARD_CHARS[] = "*?[\\";
+
+    // Matches bracket expression at pattern against c; returns pointer past the closing
+    // bracket or nullptr if the expression is not terminated
+    const char* MatchClass(const char* pattern, char c, bool& matched)
+    {
+      const char* p = pattern + 1;
+      bool negate = false;
+      if (*p == '!' || *p == '^')
+      {
+        negate = true;
+        ++p;
+      }
+      matched = false;
+      // closing bracket right after the opening one is a literal
+      do
+      {
+        if (!*p)
+        {
+          return nullptr;
+        }
+        char low = *p;
+        if (low == '\\' && p[1])
+        {
+          low = *++p;
+        }
+        char high = low;
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+          p += 2;
+          if (*p == '\\' && p[1])
+          {
+            ++p;
+          }
+          high = *p;
+        }
+        if (c >= low && c <= high)
+        {
+          matched = true;
+        }
+        ++p;
+      }
+      while (*p != ']');
+      matched = matched != negate;
+      return p + 1;
+    }
+
+    // Shell glob where wildcards never match '/', plus "**" segments matching any number of directories
+    bool MatchGlob(const char* begin, const char* p, const char* s)
+    {
+      while (*p)
+      {
+        if (*p == '*')
+        {
+          const bool segmentStart = p == begin || p[-1] == '/';
+          if (p[1] == '*' && segmentStart && (p[2] == '/' || p[2] == '\0'))
+          {
+            if (p[2] == '\0')
+            {
+              // trailing "/**" matches everything inside
+              return true;
+            }
+            for (const char* t = s; t; t = strchr(t, '/') ? strchr(t, '/') + 1 : nullptr)
+            {
+              if (MatchGlob(begin, p + 3, t))
+              {
+                return true;
+              }
+            }
+            return false;
+          }
+          while (*p == '*')
+          {
+            ++p;
+          }
+          for (const char* t = s;; ++t)
+          {
+            if (MatchGlob(begin, p, t))
+            {
+              return true;
+            }
+            if (!*t || *t == '/')
+            {
+              return false;
+            }
+          }
+        }
+        if (!*s)
+        {
+          return false;
+        }
+        if (*p == '?')
+        {
+          if (*s == '/')
+          {
+            return false;
+          }
+          ++p;
+          ++s;
+          continue;
+        }
+        if (*p == '[')
+        {
+          bool matched = false;
+          const char* next = MatchClass(p, *s, matched);
+          if (next)
+          {
+            if (!matched || *s == '/')
+            {
+              return false;
+            }
+            p = next;
+            ++s;
+            continue;
+          }
+          // unterminated bracket is an ordinary character
+        }
+        if (*p == '\\' && p[1])
+        {
+          ++p;
+        }
+        if (*p != *s)
+        {
+          return false;
+        }
+        ++p;
+        ++s;
+      }
+      return *s == '\0';
+    }
+
+    bool EndsWith(const std::string& value, const char* suffix, std::size_t suffixLength)
+    {
+      return value.size() >= suffixLength && value.compare(value.size() - suffixLength, suffixLength, suffix) == 0;
+    }
+  } // namespace
+
+  void IgnoreRules::AddPattern(const std::string& line)
+  {
+    std::string pattern = line;
+    if (!pattern.empty() && pattern[pattern.size() - 1] == '\r')
+    {
+      pattern.erase(pattern.size() - 1);
+    }
+    // trailing spaces are ignored unless escaped
+    while (!pattern.empty() && pattern[pattern.size() - 1] == ' '
+      && !(pattern.size() > 1 && pattern[pattern.size() - 2] == '\\'))
+    {
+      pattern.erase(pattern.size() - 1);
+    }
+    if (pattern.empty() || pattern[0] == '#')
+    {
+      return;
+    }
+
+    Rule rule;
+    rule.Negated = pattern[0] == '!';
+    if (rule.Negated)
+    {
+      pattern.erase(0, 1);
+    }
+    else if (pattern[0] == '\\' && pattern.size() > 1 && (pattern[1] == '!' || pattern[1] == '#'))
+    {
+      pattern.erase(0, 1);
+    }
+    rule.DirectoryOnly = !pattern.empty() && pattern[pattern.size() - 1] == '/';
+    if (rule.DirectoryOnly)
+    {
+      pattern.erase(pattern.size() - 1);
+    }
+    rule.Anchored = pattern.find('/') != std::string::npos;
+    if (!pattern.empty() && pattern[0] == '/')
+    {
+      pattern.erase(0, 1);
+    }
+    if (pattern.empty())
+    {
+      return;
+    }
+
+    if (pattern.find_first_of(WILDCARD_CHARS) == std::string::npos)
+    {
+      rule.Type = KIND_LITERAL;
+    }
+    else if (!rule.Anchored && pattern[0] == '*' && pattern.find_first_of(WILDCARD_CHARS, 1) == std::string::npos)
+    {
+      rule.Type = KIND_SUFFIX;
+      pattern.erase(0, 1);
+    }
+    else
+    {
+      rule.Type = KIND_GLOB;
+    }
+    rule.Pattern = pattern;
+    Rules.push_back(rule);
+  }
+
+  Common::Error IgnoreRules::LoadFile(const std::string& path)
+  {
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+      const int code = errno;
+      return MAKE_ERROR(
+        MAKE_MODULE_ERROR(Common::MODULE_OS, code),
+        Common::StringToWideString(path + ": " + strerror(code))
+      );
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+      AddPattern(line);
+    }
+    return Common::Success;
+  }
+
+  bool IgnoreRules::Empty() const
+  {
+    return Rules.empty();
+  }
+
+  IgnoreRules::Verdict IgnoreRules::Match(const std::string& relativePath, bool isDir) const
+  {
+    const std::size_t slash = relativePath.rfind('/');
+    const char* baseName = relativePath.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    for (auto rule = Rules.rbegin(); rule != Rules.rend(); ++rule)
+    {
+      if (rule->DirectoryOnly && !isDir)
+      {
+        continue;
+      }
+      bool matched = false;
+      switch (rule->Type)
+      {
+      case KIND_LITERAL:
+        matched = rule->Anchored ? relativePath == rule->Pattern : rule->Pattern == baseName;
+        break;
+      case KIND_SUFFIX:
+        matched = EndsWith(relativePath, rule->Pattern.c_str(), rule->Pattern.size());
+        break;
+      case KIND_GLOB:
+        {
+          const char* subject = rule->Anchored ? relativePath.c_str() : baseName;
+          matched = MatchGlob(rule->Pattern.c_str(), rule->Pattern.c_str(), subject);
+        }
+        break;
+      }
+      if (matched)
+      {
+        return rule->Negated ? INCLUDED : IGNORED;
+      }
+    }
+    return NOT_MATCHED;
+  }
+
+  IgnoreScope::IgnoreScope(const Ptr& parent, const std::string& dirPath, const IgnoreRules& rules)
+    : Parent(parent)
+    , DirPath(dirPath)
+    , Rules(rules)
+  {
+    if (DirPath.empty() || DirPath[DirPath.size() - 1] != '/')
+    {
+      DirPath += '/';
+    }
+  }
+
+  IgnoreScope::Ptr IgnoreScope::Enter(const Ptr& parent, const std::string& dirPath, bool hasIgnoreFiles)
+  {
+    if (!hasIgnoreFiles)
+    {
+      return parent;
+    }
+    IgnoreRules rules;
+    for (const char* name: IGNORE_FILE_NAMES)
+    {
+      const Common::Error err = rules.LoadFile(dirPath + "/" + name);
+      if (err && !IsMissingFileError(err))
+      {
+        // an unreadable ignore file shouldn't stop the search, its directory is just searched as is
+        Common::Event(err);
+      }
+    }
+    if (rules.Empty())
+    {
+      return parent;
+    }
+    return std::make_shared<IgnoreScope>(parent, dirPath, rules);
+  }
+
+  bool IgnoreScope::IsIgnored(const std::string& entryPath, bool isDir) const
+  {
+    return Match(entryPath, isDir) == IgnoreRules::IGNORED;
+  }
+
+  IgnoreRules::Verdict IgnoreScope::Match(const std::string& entryPath, bool isDir) const
+  {
+    if (entryPath.compare(0, DirPath.size(), DirPath) == 0)
+    {
+      const IgnoreRules::Verdict verdict = Rules.Match(entryPath.substr(DirPath.size()), isDir);
+      if (verdict != IgnoreRules::NOT_MATCHED)
+      {
+        return verdict;
+      }
+    }
+    return Parent ? Parent->Match(entryPath, isDir) : IgnoreRules::NOT_MATCHED;
+  }
+
+  std::string GetGlobalExcludesPath()
+  {
+    const char* configHome = getenv("XDG_CONFIG_HOME");
+    if (configHome && *configHome)
+    {
+      return std::string(configHome) + "/git/ignore";
+    }
+    const char* home = getenv("HOME");
+    return home ? std::string(home) + "/.config/git/ignore" : std::string();
+  }
+
+  bool IsMissingFileError(const Common::Error& error)
+  {
+    const unsigned code = error.GetCode();
+    return code == static_cast<unsigned>(MAKE_MODULE_ERROR(Common::MODULE_OS, ENOENT))
+      || code == static_cast<unsigned>(MAKE_MODULE_ERROR(Common::MODULE_OS, ENOTDIR));
+  }
+} // namespace Search
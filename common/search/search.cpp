@@ -0,0 +1,620 @@
+#include <common/search.h>
+#include <common/search_cache.h>
+#include <common/archive.h>
+#include <common/filesystem.h>
+#include <common/ignore_rules.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+#include <common/thread_pool.h>
+#include <common/trace.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace Search
+{
+  namespace
+  {
+    Timestamp GetMtime(const struct stat& st)
+    {
+      Timestamp result;
+#if defined(__APPLE__)
+      result.Seconds = st.st_mtimespec.tv_sec;
+      result.Nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+      result.Seconds = st.st_mtim.tv_sec;
+      result.Nanoseconds = st.st_mtim.tv_nsec;
+#endif
+      return result;
+    }
+
+    ResultCache::EntryType GetEntryType(mode_t mode)
+    {
+      if (S_ISDIR(mode))
+      {
+        return ResultCache::ENTRY_DIRECTORY;
+      }
+      if (S_ISREG(mode))
+      {
+        return ResultCache::ENTRY_REGULAR;
+      }
+      return ResultCache::ENTRY_OTHER;
+    }
+
+    std::string JoinPath(const std::string& dir, const std::string& name)
+    {
+      if (!dir.empty() && dir[dir.size() - 1] == Filesys::PATH_SEPARATOR)
+      {
+        return dir + name;
+      }
+      return dir + Filesys::PATH_SEPARATOR + name;
+    }
+
+    const char GIT_DIR_NAME[] = ".git";
+
+    std::string GetParentPath(const std::string& path)
+    {
+      const std::size_t slash = path.rfind('/');
+      if (slash == std::string::npos)
+      {
+        return std::string();
+      }
+      return slash == 0 ? std::string("/") : path.substr(0, slash);
+    }
+
+    bool PathExists(const std::string& path)
+    {
+      struct stat st;
+      return lstat(path.c_str(), &st) == 0;
+    }
+
+    std::string GetBaseName(const std::string& path)
+    {
+      const std::size_t slash = path.rfind('/');
+      return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    // Archives are decompressed on the CPU pool while the walker goes on listing directories.
+    // Cache and match callback are shared with these tasks and are accessed under ResultLock
+    class Walker
+    {
+    public:
+      Walker(const Query& query, const Callbacks& callbacks, Common::JobControl& control, ResultCache* cache)
+        : CurrentQuery(query)
+        , Notify(callbacks)
+        , Control(control)
+        , Cache(cache)
+        , ContentNeedles(query.Content, query.CaseSensitive)
+        , RootDevice(0)
+        , ArchiveTasks(Common::ThreadPool::Cpu())
+      {
+      }
+
+      Common::Error Run()
+      {
+        struct stat st;
+        if (lstat(CurrentQuery.Root.c_str(), &st) != 0)
+        {
+          return MAKE_ERROR(
+            MAKE_MODULE_ERROR(Common::MODULE_OS, errno),
+            Common::StringToWideString(CurrentQuery.Root + ": " + strerror(errno))
+          );
+        }
+        RootDevice = st.st_dev;
+        IgnoreScope::Ptr scope;
+        if (CurrentQuery.UseIgnoreFiles)
+        {
+          scope = CreateRootScope();
+        }
+        VisitDir(CurrentQuery.Root, st, scope);
+        ArchiveTasks.Wait();
+        return Common::Success;
+      }
+
+    private:
+      bool NameMatches(const std::string& name) const
+      {
+        return CurrentQuery.NameMask.empty() || fnmatch(CurrentQuery.NameMask.c_str(), name.c_str(), FNM_CASEFOLD) == 0;
+      }
+
+      void ReadEntries(const std::string& path, std::vector<ResultCache::Entry>& entries)
+      {
+        DIR* dir = opendir(path.c_str());
+        if (!dir)
+        {
+          DEBUG(Common::MODULE_COMMON, L"opendir failed: " + Common::StringToWideString(path));
+          return;
+        }
+        while (struct dirent* ent = readdir(dir))
+        {
+          if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+          {
+            continue;
+          }
+          ResultCache::Entry entry;
+          entry.Name = ent->d_name;
+          switch (ent->d_type)
+          {
+          case DT_DIR:
+            entry.Type = ResultCache::ENTRY_DIRECTORY;
+            break;
+          case DT_REG:
+            entry.Type = ResultCache::ENTRY_REGULAR;
+            break;
+          case DT_UNKNOWN:
+            {
+              // some network filesystems don't fill d_type
+              struct stat st;
+              const std::string entryPath = JoinPath(path, entry.Name);
+              entry.Type = lstat(entryPath.c_str(), &st) == 0 ? GetEntryType(st.st_mode) : ResultCache::ENTRY_OTHER;
+            }
+            break;
+          default:
+            entry.Type = ResultCache::ENTRY_OTHER;
+          }
+          entries.push_back(entry);
+        }
+        closedir(dir);
+      }
+
+      // Global excludes, then ignore files of the directories above the root when the search
+      // starts inside a repository, since they still apply to what's below
+      IgnoreScope::Ptr CreateRootScope() const
+      {
+        std::string root = CurrentQuery.Root;
+        while (root.size() > 1 && root[root.size() - 1] == '/')
+        {
+          root.erase(root.size() - 1);
+        }
+        std::vector<std::string> ancestors;
+        std::string top;
+        for (std::string dir = root; !dir.empty(); dir = dir == "/" ? std::string() : GetParentPath(dir))
+        {
+          if (PathExists(JoinPath(dir, GIT_DIR_NAME)))
+          {
+            top = dir;
+            break;
+          }
+          ancestors.push_back(dir);
+        }
+
+        IgnoreRules global;
+        const Common::Error err = global.LoadFile(GetGlobalExcludesPath());
+        if (err && !IsMissingFileError(err))
+        {
+          Common::Event(err);
+        }
+        for (const auto& pattern: CurrentQuery.ExcludePatterns)
+        {
+          global.AddPattern(pattern);
+        }
+        IgnoreScope::Ptr scope;
+        if (!global.Empty())
+        {
+          scope = std::make_shared<IgnoreScope>(nullptr, top.empty() ? root : top, global);
+        }
+        if (!top.empty() && top != root)
+        {
+          // ancestors[0] is the root itself, its ignore files are loaded on visit
+          scope = IgnoreScope::Enter(scope, top, true);
+          for (std::size_t i = ancestors.size() - 1; i > 0; --i)
+          {
+            scope = IgnoreScope::Enter(scope, ancestors[i], true);
+          }
+        }
+        return scope;
+      }
+
+      bool IsIgnored(const IgnoreScope::Ptr& scope, const ResultCache::Entry& entry, const std::string& entryPath) const
+      {
+        if (!CurrentQuery.UseIgnoreFiles)
+        {
+          return false;
+        }
+        if (entry.Name == GIT_DIR_NAME)
+        {
+          return true;
+        }
+        return scope && scope->IsIgnored(entryPath, entry.Type == ResultCache::ENTRY_DIRECTORY);
+      }
+
+      static bool HasIgnoreFiles(const std::vector<ResultCache::Entry>& entries)
+      {
+        for (const auto& entry: entries)
+        {
+          for (const char* name: IGNORE_FILE_NAMES)
+          {
+            if (entry.Type == ResultCache::ENTRY_REGULAR && entry.Name == name)
+            {
+              return true;
+            }
+          }
+        }
+        return false;
+      }
+
+      void VisitDir(const std::string& path, const struct stat& st, IgnoreScope::Ptr scope)
+      {
+        if (Notify.OnDirectory)
+        {
+          Notify.OnDirectory(path);
+        }
+
+        const Timestamp mtime = GetMtime(st);
+        std::vector<ResultCache::Entry> entries;
+        bool cached = false;
+        if (Cache)
+        {
+          std::lock_guard<std::mutex> lock(ResultLock);
+          if (const ResultCache::DirRecord* record = Cache->FindDir(path, st.st_ino, mtime))
+          {
+            entries = record->Entries;
+            cached = true;
+          }
+        }
+        if (!cached)
+        {
+          ReadEntries(path, entries);
+          if (Cache)
+          {
+            ResultCache::DirRecord record;
+            record.Inode = st.st_ino;
+            record.Mtime = mtime;
+            record.Entries = entries;
+            std::lock_guard<std::mutex> lock(ResultLock);
+            Cache->StoreDir(path, record);
+          }
+        }
+
+        if (CurrentQuery.UseIgnoreFiles)
+        {
+          scope = IgnoreScope::Enter(scope, path, HasIgnoreFiles(entries));
+        }
+
+        for (const auto& entry: entries)
+        {
+          if (!Control.Checkpoint())
+          {
+            return;
+          }
+          const std::string entryPath = JoinPath(path, entry.Name);
+          if (IsIgnored(scope, entry, entryPath))
+          {
+            // whole subtree is pruned before it's listed
+            continue;
+          }
+          const bool nameMatches = NameMatches(entry.Name);
+
+          if (entry.Type == ResultCache::ENTRY_DIRECTORY)
+          {
+            // TODO: use actual file attributes
+            if (!CurrentQuery.IncludeHidden && entry.Name[0] == '.')
+            {
+              continue;
+            }
+            if (nameMatches && CurrentQuery.Content.empty())
+            {
+              ReportName(entryPath);
+            }
+            struct stat dirStat;
+            if (lstat(entryPath.c_str(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode) || dirStat.st_dev != RootDevice)
+            {
+              // gone since listing was taken, or it's a mount point of another filesystem
+              continue;
+            }
+            VisitDir(entryPath, dirStat, scope);
+          }
+          else if (entry.Type == ResultCache::ENTRY_REGULAR && IsArchive(entry.Name))
+          {
+            if (nameMatches && CurrentQuery.Content.empty())
+            {
+              ReportName(entryPath);
+            }
+            VisitArchive(entryPath);
+          }
+          else if (nameMatches)
+          {
+            if (CurrentQuery.Content.empty())
+            {
+              ReportName(entryPath);
+            }
+            else if (entry.Type == ResultCache::ENTRY_REGULAR)
+            {
+              VisitFile(entryPath);
+            }
+          }
+        }
+      }
+
+      void VisitFile(const std::string& path)
+      {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+          return;
+        }
+        const Timestamp mtime = GetMtime(st);
+        if (ReplayCachedHits(path, st.st_size, mtime))
+        {
+          return;
+        }
+
+        ResultCache::FileRecord record;
+        record.Size = st.st_size;
+        record.Mtime = mtime;
+        // classification survives between queries, so known binaries aren't even opened
+        ContentClassCache& classes = ContentClassCache::Instance();
+        const std::int64_t mtimeNanoseconds = mtime.Seconds * 1000000000LL + mtime.Nanoseconds;
+        ContentClass contentClass = classes.Find(st.st_dev, st.st_ino, st.st_size, mtimeNanoseconds);
+        if (contentClass == CONTENT_BINARY && CurrentQuery.BinaryFiles == BINARY_SKIP)
+        {
+          StoreFileRecord(path, record);
+          return;
+        }
+        const ContentClass knownClass = contentClass;
+        bool complete = true;
+        const Common::Error err = SearchFile(
+          path,
+          ContentNeedles,
+          [this, &record, &complete](const Match& found)
+          {
+            record.Hits.push_back(ResultCache::FileHit{found.Offset, found.Line, std::string()});
+            if (!Report(found) || !Control.Checkpoint())
+            {
+              complete = false;
+              return false;
+            }
+            return CurrentQuery.MaxHitsPerFile == 0 || record.Hits.size() < CurrentQuery.MaxHitsPerFile;
+          },
+          Control.AsStopCallback(),
+          CurrentQuery.BinaryFiles,
+          &contentClass
+        );
+        if (contentClass != knownClass)
+        {
+          classes.Store(st.st_dev, st.st_ino, st.st_size, mtimeNanoseconds, contentClass);
+        }
+        if (err)
+        {
+          Common::Event(err);
+          return;
+        }
+        if (complete && !Control.IsCancelled())
+        {
+          StoreFileRecord(path, record);
+        }
+      }
+
+      void StoreFileRecord(const std::string& path, const ResultCache::FileRecord& record)
+      {
+        if (Cache)
+        {
+          std::lock_guard<std::mutex> lock(ResultLock);
+          Cache->StoreFile(path, record);
+        }
+      }
+
+      bool IsArchive(const std::string& name) const
+      {
+        return CurrentQuery.SearchArchives && Archive::DetectFormat(name) != Archive::FORMAT_NONE;
+      }
+
+      void VisitArchive(const std::string& path)
+      {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+          return;
+        }
+        const Timestamp mtime = GetMtime(st);
+        if (ReplayCachedHits(path, st.st_size, mtime))
+        {
+          return;
+        }
+        ArchiveTasks.Run(std::bind(&Walker::SearchArchive, this, path, st.st_size, mtime));
+      }
+
+      // Runs on the CPU pool, so it never waits in Checkpoint: a paused search would hold the pool's
+      // threads. Pausing is left to the walker, which stops handing out archives
+      void SearchArchive(const std::string& path, std::uint64_t size, const Timestamp& mtime)
+      {
+        if (Control.IsCancelled())
+        {
+          return;
+        }
+        ResultCache::FileRecord record;
+        record.Size = size;
+        record.Mtime = mtime;
+        bool complete = true;
+        const Common::Error err = Archive::ReadMembers(
+          path,
+          Archive::DetectFormat(path),
+          [this, &path, &record, &complete](const std::string& member) -> Archive::DataCallback
+          {
+            if (!complete || !NameMatches(GetBaseName(member)))
+            {
+              return Archive::DataCallback();
+            }
+            Match match;
+            match.Path = path;
+            match.Member = member;
+            if (CurrentQuery.Content.empty())
+            {
+              record.Hits.push_back(ResultCache::FileHit{0, 0, member});
+              complete = Report(match);
+              return Archive::DataCallback();
+            }
+
+            std::shared_ptr<std::size_t> memberHits = std::make_shared<std::size_t>(0);
+            std::shared_ptr<StreamMatcher> matcher = std::make_shared<StreamMatcher>(
+              ContentNeedles,
+              match,
+              [this, &record, &complete, memberHits](const Match& found)
+              {
+                record.Hits.push_back(ResultCache::FileHit{found.Offset, found.Line, found.Member});
+                if (!Report(found) || Control.IsCancelled())
+                {
+                  complete = false;
+                  return false;
+                }
+                return CurrentQuery.MaxHitsPerFile == 0 || ++*memberHits < CurrentQuery.MaxHitsPerFile;
+              },
+              CurrentQuery.BinaryFiles
+            );
+            return [matcher](const char* data, std::size_t dataSize) { return matcher->Feed(data, dataSize); };
+          },
+          [this] { return Control.IsCancelled(); }
+        );
+        if (err)
+        {
+          Common::Event(err);
+          return;
+        }
+        if (complete && !Control.IsCancelled())
+        {
+          StoreFileRecord(path, record);
+        }
+      }
+
+      // Reports hits of the previous run if the file hasn't changed since then
+      bool ReplayCachedHits(const std::string& path, std::uint64_t size, const Timestamp& mtime)
+      {
+        std::vector<ResultCache::FileHit> hits;
+        {
+          std::lock_guard<std::mutex> lock(ResultLock);
+          const ResultCache::FileRecord* cached = Cache ? Cache->FindFile(path, size, mtime) : nullptr;
+          if (!cached)
+          {
+            return false;
+          }
+          hits = cached->Hits;
+        }
+        Match match;
+        match.Path = path;
+        std::size_t memberHits = 0;
+        for (const auto& hit: hits)
+        {
+          // the limit is part of the cache key as well, a replay never reports more than a search would
+          memberHits = hit.Member == match.Member ? memberHits + 1 : 1;
+          match.Member = hit.Member;
+          if (CurrentQuery.MaxHitsPerFile != 0 && memberHits > CurrentQuery.MaxHitsPerFile)
+          {
+            continue;
+          }
+          match.Offset = hit.Offset;
+          match.Line = hit.Line;
+          if (!Report(match))
+          {
+            break;
+          }
+        }
+        return true;
+      }
+
+      bool Report(const Match& match)
+      {
+        std::lock_guard<std::mutex> lock(ResultLock);
+        return Notify.OnMatch(match);
+      }
+
+      void ReportName(const std::string& path)
+      {
+        Match match;
+        match.Path = path;
+        Report(match);
+      }
+
+      const Query& CurrentQuery;
+      const Callbacks& Notify;
+      Common::JobControl& Control;
+      ResultCache* Cache;
+      NeedleSet ContentNeedles;
+      dev_t RootDevice;
+      std::mutex ResultLock;
+      // declared last, so pending archive tasks are waited for before anything they use is destroyed
+      Common::TaskGroup ArchiveTasks;
+    };
+  } // namespace
+
+  Common::Error Run(const Query& query, const Callbacks& callbacks, Common::JobControl& control, ResultCache* cache)
+  {
+    Walker walker(query, callbacks, control, cache);
+    return walker.Run();
+  }
+
+  Common::Error ReadMatchContext(const Match& match, std::size_t before, std::size_t after, LineContext& result)
+  {
+    if (match.Member.empty())
+    {
+      return ReadLineContext(match.Path, match.Offset, match.Line, before, after, result);
+    }
+
+    // member is decompressed again up to the context window, one byte past it tells the data goes on
+    result = LineContext();
+    const std::uint64_t window = GetContextWindow(before, after) * 2;
+    const std::uint64_t first = match.Offset > window ? (match.Offset - window) & ~static_cast<std::uint64_t>(1) : 0;
+    const std::uint64_t last = match.Offset + window + 1;
+    std::string head; // encoding is detected from the beginning of the member
+    std::string data;
+    std::uint64_t position = 0;
+    bool found = false;
+    bool done = false;
+    RETURN_IF_FAILED(Archive::ReadMembers(
+      match.Path,
+      Archive::DetectFormat(match.Path),
+      [&](const std::string& member) -> Archive::DataCallback
+      {
+        if (found)
+        {
+          done = true;
+        }
+        if (found || member != match.Member)
+        {
+          return Archive::DataCallback();
+        }
+        found = true;
+        return [&](const char* chunk, std::size_t size)
+        {
+          const std::uint64_t chunkEnd = position + size;
+          if (head.size() < ENCODING_SAMPLE_SIZE)
+          {
+            head.append(chunk, std::min(size, ENCODING_SAMPLE_SIZE - head.size()));
+          }
+          if (chunkEnd > first)
+          {
+            const std::uint64_t from = std::max(first, position) - position;
+            const std::uint64_t to = std::min(last, chunkEnd) - position;
+            data.append(chunk + from, static_cast<std::size_t>(to - from));
+          }
+          position = chunkEnd;
+          done = position >= last;
+          return !done;
+        };
+      },
+      [&done]() { return done; }
+    ));
+    if (match.Offset >= first + data.size())
+    {
+      return Common::Success;
+    }
+    ExtractLineContext(
+      data.data(),
+      data.size(),
+      static_cast<std::size_t>(match.Offset - first),
+      match.Line,
+      before,
+      after,
+      DetectEncoding(head.data(), head.size()),
+      result
+    );
+    return Common::Success;
+  }
+} // namespace Search
@@ -0,0 +1,281 @@
+#include <common/search_cache.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace Search
+{
+  namespace
+  {
+    const char CACHE_MAGIC[4] = { 'T', 'F', 'S', 'C' };
+    const std::uint32_t CACHE_VERSION = 3;
+
+    std::uint64_t Fnv1a(const std::string& data, std::uint64_t hash = 14695981039346656037ULL)
+    {
+      for (unsigned char c: data)
+      {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    template <typename T>
+    void WritePod(std::ostream& out, T value)
+    {
+      out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool ReadPod(std::istream& in, T& value)
+    {
+      return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    void WriteString(std::ostream& out, const std::string& value)
+    {
+      WritePod<std::uint32_t>(out, static_cast<std::uint32_t>(value.size()));
+      out.write(value.data(), value.size());
+    }
+
+    bool ReadString(std::istream& in, std::string& value)
+    {
+      std::uint32_t size = 0;
+      if (!ReadPod(in, size))
+      {
+        return false;
+      }
+      value.resize(size);
+      return size == 0 || static_cast<bool>(in.read(&value[0], size));
+    }
+
+    void WriteTimestamp(std::ostream& out, const Timestamp& value)
+    {
+      WritePod(out, value.Seconds);
+      WritePod(out, value.Nanoseconds);
+    }
+
+    bool ReadTimestamp(std::istream& in, Timestamp& value)
+    {
+      return ReadPod(in, value.Seconds) && ReadPod(in, value.Nanoseconds);
+    }
+
+    Common::Error MakeCacheError(const std::string& message, const std::string& path)
+    {
+      return MAKE_ERROR(
+        MAKE_MODULE_ERROR(Common::MODULE_COMMON, 1),
+        Common::StringToWideString(message + ": " + path)
+      );
+    }
+  } // namespace
+
+  std::string ResultCache::MakeKey(const Query& query)
+  {
+    std::uint64_t hash = Fnv1a(query.Root);
+    hash = Fnv1a(std::string(1, '\0') + query.NameMask, hash);
+    hash = Fnv1a(std::string(1, '\0') + query.Content, hash);
+    hash = Fnv1a(std::string(1, query.CaseSensitive ? 'C' : 'c') + (query.IncludeHidden ? 'H' : 'h')
+      + (query.SearchArchives ? 'A' : 'a') + static_cast<char>('0' + query.BinaryFiles), hash);
+    // stored hit lists are cut at the limit, so they only fit runs with the same one
+    hash = Fnv1a(std::string(1, '\0') + std::to_string(query.MaxHitsPerFile), hash);
+
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+  }
+
+  Common::Error ResultCache::Load(const std::string& path)
+  {
+    Dirs.clear();
+    Files.clear();
+
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in)
+    {
+      // first run of the query
+      return Common::Success;
+    }
+
+    char magic[sizeof(CACHE_MAGIC)];
+    std::uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), CACHE_MAGIC)
+      || !ReadPod(in, version) || version != CACHE_VERSION)
+    {
+      return MakeCacheError("Unsupported search cache format", path);
+    }
+
+    std::uint64_t dirCount = 0;
+    if (!ReadPod(in, dirCount))
+    {
+      return MakeCacheError("Truncated search cache", path);
+    }
+    for (std::uint64_t i = 0; i < dirCount; ++i)
+    {
+      std::string dirPath;
+      DirRecord record;
+      std::uint64_t entryCount = 0;
+      if (!ReadString(in, dirPath) || !ReadPod(in, record.Inode) || !ReadTimestamp(in, record.Mtime)
+        || !ReadPod(in, entryCount))
+      {
+        Dirs.clear();
+        return MakeCacheError("Truncated search cache", path);
+      }
+      record.Entries.resize(entryCount);
+      for (auto& entry: record.Entries)
+      {
+        std::uint8_t type = 0;
+        if (!ReadString(in, entry.Name) || !ReadPod(in, type))
+        {
+          Dirs.clear();
+          return MakeCacheError("Truncated search cache", path);
+        }
+        entry.Type = static_cast<EntryType>(type);
+      }
+      Dirs[dirPath] = record;
+    }
+
+    std::uint64_t fileCount = 0;
+    if (!ReadPod(in, fileCount))
+    {
+      Dirs.clear();
+      return MakeCacheError("Truncated search cache", path);
+    }
+    for (std::uint64_t i = 0; i < fileCount; ++i)
+    {
+      std::string filePath;
+      FileRecord record;
+      std::uint64_t hitCount = 0;
+      if (!ReadString(in, filePath) || !ReadPod(in, record.Size) || !ReadTimestamp(in, record.Mtime)
+        || !ReadPod(in, hitCount))
+      {
+        Dirs.clear();
+        Files.clear();
+        return MakeCacheError("Truncated search cache", path);
+      }
+      record.Hits.resize(hitCount);
+      for (auto& hit: record.Hits)
+      {
+        if (!ReadString(in, hit.Member) || !ReadPod(in, hit.Offset) || !ReadPod(in, hit.Line))
+        {
+          Dirs.clear();
+          Files.clear();
+          return MakeCacheError("Truncated search cache", path);
+        }
+      }
+      Files[filePath] = record;
+    }
+    return Common::Success;
+  }
+
+  Common::Error ResultCache::Save(const std::string& path) const
+  {
+    // write aside and rename, so interrupted save never leaves a broken cache behind
+    const std::string tmpPath = path + ".tmp";
+    {
+      std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+      if (!out)
+      {
+        return MakeCacheError("Failed to create search cache", tmpPath);
+      }
+      out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+      WritePod(out, CACHE_VERSION);
+
+      std::uint64_t dirCount = 0;
+      for (const auto& dir: Dirs)
+      {
+        dirCount += dir.second.Visited ? 1 : 0;
+      }
+      WritePod(out, dirCount);
+      for (const auto& dir: Dirs)
+      {
+        if (!dir.second.Visited)
+        {
+          continue;
+        }
+        WriteString(out, dir.first);
+        WritePod(out, dir.second.Inode);
+        WriteTimestamp(out, dir.second.Mtime);
+        WritePod<std::uint64_t>(out, dir.second.Entries.size());
+        for (const auto& entry: dir.second.Entries)
+        {
+          WriteString(out, entry.Name);
+          WritePod<std::uint8_t>(out, static_cast<std::uint8_t>(entry.Type));
+        }
+      }
+
+      std::uint64_t fileCount = 0;
+      for (const auto& file: Files)
+      {
+        fileCount += file.second.Visited ? 1 : 0;
+      }
+      WritePod(out, fileCount);
+      for (const auto& file: Files)
+      {
+        if (!file.second.Visited)
+        {
+          continue;
+        }
+        WriteString(out, file.first);
+        WritePod(out, file.second.Size);
+        WriteTimestamp(out, file.second.Mtime);
+        WritePod<std::uint64_t>(out, file.second.Hits.size());
+        for (const auto& hit: file.second.Hits)
+        {
+          WriteString(out, hit.Member);
+          WritePod(out, hit.Offset);
+          WritePod(out, hit.Line);
+        }
+      }
+      if (!out)
+      {
+        return MakeCacheError("Failed to write search cache", tmpPath);
+      }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+      return MakeCacheError("Failed to replace search cache", path);
+    }
+    return Common::Success;
+  }
+
+  const ResultCache::DirRecord* ResultCache::FindDir(const std::string& path, std::uint64_t inode, const Timestamp& mtime)
+  {
+    auto it = Dirs.find(path);
+    if (it == Dirs.end() || it->second.Inode != inode || !(it->second.Mtime == mtime))
+    {
+      return nullptr;
+    }
+    it->second.Visited = true;
+    return &it->second;
+  }
+
+  const ResultCache::FileRecord* ResultCache::FindFile(const std::string& path, std::uint64_t size, const Timestamp& mtime)
+  {
+    auto it = Files.find(path);
+    if (it == Files.end() || it->second.Size != size || !(it->second.Mtime == mtime))
+    {
+      return nullptr;
+    }
+    it->second.Visited = true;
+    return &it->second;
+  }
+
+  void ResultCache::StoreDir(const std::string& path, const DirRecord& record)
+  {
+    DirRecord& stored = Dirs[path];
+    stored = record;
+    stored.Visited = true;
+  }
+
+  void ResultCache::StoreFile(const std::string& path, const FileRecord& record)
+  {
+    FileRecord& stored = Files[path];
+    stored = record;
+    stored.Visited = true;
+  }
+} // namespace Search
@@ -0,0 +1,304 @@
+#include <common/text_encoding.h>
+#include <common/text_search.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Search
+{
+  namespace
+  {
+    const std::uint32_t REPLACEMENT_CHARACTER = 0xfffd;
+    const std::uint32_t INVALID_CODE_POINT = 0xffffffff;
+
+    // Decodes one UTF-8 sequence at p and advances it; returns INVALID_CODE_POINT
+    // and advances by one byte on a malformed or truncated sequence
+    std::uint32_t DecodeUtf8(const unsigned char*& p, const unsigned char* end)
+    {
+      const unsigned char lead = *p;
+      std::size_t length = 0;
+      std::uint32_t cp = 0;
+      if (lead < 0x80)
+      {
+        ++p;
+        return lead;
+      }
+      else if ((lead & 0xe0) == 0xc0)
+      {
+        length = 2;
+        cp = lead & 0x1f;
+      }
+      else if ((lead & 0xf0) == 0xe0)
+      {
+        length = 3;
+        cp = lead & 0x0f;
+      }
+      else if ((lead & 0xf8) == 0xf0)
+      {
+        length = 4;
+        cp = lead & 0x07;
+      }
+      else
+      {
+        ++p;
+        return INVALID_CODE_POINT;
+      }
+      if (static_cast<std::size_t>(end - p) < length)
+      {
+        ++p;
+        return INVALID_CODE_POINT;
+      }
+      for (std::size_t i = 1; i < length; ++i)
+      {
+        if ((p[i] & 0xc0) != 0x80)
+        {
+          ++p;
+          return INVALID_CODE_POINT;
+        }
+        cp = (cp << 6) | (p[i] & 0x3f);
+      }
+      static const std::uint32_t MIN_CODE_POINT[] = { 0, 0, 0x80, 0x800, 0x10000 };
+      if (cp < MIN_CODE_POINT[length] || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+      {
+        ++p;
+        return INVALID_CODE_POINT;
+      }
+      p += length;
+      return cp;
+    }
+
+    void AppendUtf8(std::string& out, std::uint32_t cp)
+    {
+      if (cp < 0x80)
+      {
+        out += static_cast<char>(cp);
+      }
+      else if (cp < 0x800)
+      {
+        out += static_cast<char>(0xc0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+      }
+      else if (cp < 0x10000)
+      {
+        out += static_cast<char>(0xe0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+      }
+      else
+      {
+        out += static_cast<char>(0xf0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+      }
+    }
+
+    void AppendUtf16Unit(std::string& out, std::uint32_t unit, bool bigEndian)
+    {
+      const char high = static_cast<char>(unit >> 8);
+      const char low = static_cast<char>(unit & 0xff);
+      out += bigEndian ? high : low;
+      out += bigEndian ? low : high;
+    }
+
+    std::uint32_t ReadUtf16Unit(const char* data, bool bigEndian)
+    {
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+      return bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+    }
+
+    // Sequence cut by the end of the sample is not considered an error
+    bool IsValidUtf8(const char* data, std::size_t size, bool truncated)
+    {
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+      const unsigned char* end = p + size;
+      while (p < end)
+      {
+        const unsigned char* start = p;
+        if (DecodeUtf8(p, end) == INVALID_CODE_POINT)
+        {
+          return truncated && end - start < 4 && (*start & 0xc0) == 0xc0;
+        }
+      }
+      return true;
+    }
+
+    std::size_t CountUtf16LineBreaks(const char* data, std::size_t size, bool bigEndian)
+    {
+      std::size_t count = 0;
+      std::size_t i = 0;
+#if defined(__SSE2__)
+      // units are compared as loaded by this little endian CPU
+      const __m128i newline = _mm_set1_epi16(bigEndian ? 0x0a00 : 0x000a);
+      while (i + 16 <= size)
+      {
+        // matching unit sets both of its bytes, so byte counters grow by 2 per line break
+        __m128i counters = _mm_setzero_si128();
+        const std::size_t blockEnd = std::min(size - size % 16, i + 255 * 16);
+        for (; i < blockEnd; i += 16)
+        {
+          const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+          counters = _mm_sub_epi8(counters, _mm_cmpeq_epi16(chunk, newline));
+        }
+        const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        count += (static_cast<std::size_t>(_mm_cvtsi128_si32(sums)) + static_cast<std::size_t>(_mm_extract_epi16(sums, 4))) / 2;
+      }
+#endif
+      for (; i + 2 <= size; i += 2)
+      {
+        count += ReadUtf16Unit(data + i, bigEndian) == '\n';
+      }
+      return count;
+    }
+  } // namespace
+
+  Encoding DetectEncoding(const char* data, std::size_t size)
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf)
+    {
+      return ENCODING_UTF8;
+    }
+    if (size >= 2 && bytes[0] == 0xff && bytes[1] == 0xfe)
+    {
+      return ENCODING_UTF16LE;
+    }
+    if (size >= 2 && bytes[0] == 0xfe && bytes[1] == 0xff)
+    {
+      return ENCODING_UTF16BE;
+    }
+
+    const std::size_t sample = std::min(size, ENCODING_SAMPLE_SIZE);
+    const std::size_t pairs = sample / 2;
+    std::size_t evenZeros = 0;
+    std::size_t oddZeros = 0;
+    for (std::size_t i = 0; i < pairs * 2; i += 2)
+    {
+      evenZeros += bytes[i] == 0;
+      oddZeros += bytes[i + 1] == 0;
+    }
+    // mostly ASCII text in UTF-16 has every other byte zero, binary data has zeros everywhere
+    if (pairs >= 2 && oddZeros * 10 > pairs * 3 && evenZeros * 10 < pairs)
+    {
+      return ENCODING_UTF16LE;
+    }
+    if (pairs >= 2 && evenZeros * 10 > pairs * 3 && oddZeros * 10 < pairs)
+    {
+      return ENCODING_UTF16BE;
+    }
+    return IsValidUtf8(data, sample, sample < size) ? ENCODING_UTF8 : ENCODING_LATIN1;
+  }
+
+  std::size_t GetUnitSize(Encoding encoding)
+  {
+    return encoding == ENCODING_UTF16LE || encoding == ENCODING_UTF16BE ? 2 : 1;
+  }
+
+  bool EncodeText(const std::string& utf8, Encoding encoding, std::string& result)
+  {
+    result.clear();
+    if (encoding == ENCODING_UTF8)
+    {
+      result = utf8;
+      return true;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(utf8.data());
+    const unsigned char* end = p + utf8.size();
+    while (p < end)
+    {
+      const unsigned char byte = *p;
+      std::uint32_t cp = DecodeUtf8(p, end);
+      if (cp == INVALID_CODE_POINT)
+      {
+        // not UTF-8 at all, take the byte for what it is
+        cp = byte;
+      }
+      switch (encoding)
+      {
+      case ENCODING_LATIN1:
+        if (cp > 0xff)
+        {
+          return false;
+        }
+        result += static_cast<char>(cp);
+        break;
+      case ENCODING_UTF16LE:
+      case ENCODING_UTF16BE:
+        if (cp >= 0x10000)
+        {
+          cp -= 0x10000;
+          AppendUtf16Unit(result, 0xd800 | (cp >> 10), encoding == ENCODING_UTF16BE);
+          AppendUtf16Unit(result, 0xdc00 | (cp & 0x3ff), encoding == ENCODING_UTF16BE);
+        }
+        else
+        {
+          AppendUtf16Unit(result, cp, encoding == ENCODING_UTF16BE);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return true;
+  }
+
+  std::string DecodeText(const char* data, std::size_t size, Encoding encoding)
+  {
+    std::string result;
+    switch (encoding)
+    {
+    case ENCODING_UTF8:
+      result.assign(data, size);
+      break;
+    case ENCODING_LATIN1:
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        AppendUtf8(result, static_cast<unsigned char>(data[i]));
+      }
+      break;
+    case ENCODING_UTF16LE:
+    case ENCODING_UTF16BE:
+      {
+        const bool bigEndian = encoding == ENCODING_UTF16BE;
+        for (std::size_t i = 0; i + 2 <= size; i += 2)
+        {
+          std::uint32_t cp = ReadUtf16Unit(data + i, bigEndian);
+          if (cp >= 0xd800 && cp <= 0xdbff && i + 4 <= size)
+          {
+            const std::uint32_t low = ReadUtf16Unit(data + i + 2, bigEndian);
+            if (low >= 0xdc00 && low <= 0xdfff)
+            {
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+              i += 2;
+            }
+          }
+          AppendUtf8(result, cp >= 0xd800 && cp <= 0xdfff ? REPLACEMENT_CHARACTER : cp);
+        }
+      }
+      break;
+    }
+    return result;
+  }
+
+  std::size_t CountLineBreaks(const char* data, std::size_t size, Encoding encoding)
+  {
+    if (GetUnitSize(encoding) == 1)
+    {
+      return CountNewlines(data, size);
+    }
+    return CountUtf16LineBreaks(data, size, encoding == ENCODING_UTF16BE);
+  }
+
+  bool IsLineBreakAt(const char* data, Encoding encoding)
+  {
+    if (GetUnitSize(encoding) == 1)
+    {
+      return *data == '\n';
+    }
+    return ReadUtf16Unit(data, encoding == ENCODING_UTF16BE) == '\n';
+  }
+} // namespace Search
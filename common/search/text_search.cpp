@@ -0,0 +1,1034 @@
+#include <common/text_search.h>
+#include <common/text_encoding.h>
+#include <common/module.h>
+#include <common/string_utils.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Search
+{
+  namespace
+  {
+    // Cancellation is checked between blocks of that size
+    const std::size_t SCAN_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    // Files at least that large are split into chunks scanned on the CPU pool
+    const std::size_t PARALLEL_SEARCH_MIN_FILE_SIZE = 64 * 1024 * 1024;
+    const std::size_t PARALLEL_CHUNK_SIZE = 8 * 1024 * 1024;
+    // Chunks are scanned in waves, so matches of early chunks are reported (and the
+    // caller may stop) before the rest of the file is read and memory stays bounded
+    const std::size_t PARALLEL_CHUNKS_PER_THREAD = 2;
+
+    // Lines longer than that are cut when extracting context
+    const std::size_t MAX_CONTEXT_LINE_LENGTH = 4096;
+
+    inline unsigned char FoldCase(unsigned char c)
+    {
+      return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+    }
+
+    inline unsigned char OtherCase(unsigned char c)
+    {
+      if (c >= 'a' && c <= 'z')
+      {
+        return static_cast<unsigned char>(c - ('a' - 'A'));
+      }
+      return c;
+    }
+
+    // two byte sequences are the only non-ASCII ones FoldCodepoint changes
+    inline bool IsTwoByteLead(unsigned char c)
+    {
+      return (c & 0xe0) == 0xc0;
+    }
+
+    inline bool IsContinuation(unsigned char c)
+    {
+      return (c & 0xc0) == 0x80;
+    }
+
+    inline std::uint32_t DecodeTwoBytes(unsigned char lead, unsigned char next)
+    {
+      return (static_cast<std::uint32_t>(lead & 0x1f) << 6) | (next & 0x3f);
+    }
+
+    void AppendTwoBytes(std::uint32_t c, std::string& result)
+    {
+      result += static_cast<char>(0xc0 | (c >> 6));
+      result += static_cast<char>(0x80 | (c & 0x3f));
+    }
+
+    inline std::uint32_t ReadUnit(const char* data, bool bigEndian)
+    {
+      const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+      return bigEndian ? (bytes[0] << 8) | bytes[1] : bytes[0] | (bytes[1] << 8);
+    }
+
+    void AppendUnit(std::uint32_t unit, bool bigEndian, std::string& result)
+    {
+      const char high = static_cast<char>(unit >> 8);
+      const char low = static_cast<char>(unit & 0xff);
+      result += bigEndian ? high : low;
+      result += bigEndian ? low : high;
+    }
+
+    // Latin-1 and UTF-16 are folded unit by unit. Surrogates are left as they are by FoldCodepoint,
+    // so characters outside of the BMP only ever match exactly
+    std::string FoldUnits(const std::string& text, Encoding encoding)
+    {
+      std::string result;
+      result.reserve(text.size());
+      if (encoding == ENCODING_LATIN1)
+      {
+        for (const char c: text)
+        {
+          result += static_cast<char>(FoldCodepoint(static_cast<unsigned char>(c)));
+        }
+        return result;
+      }
+      const bool bigEndian = encoding == ENCODING_UTF16BE;
+      for (std::size_t i = 0; i + 1 < text.size(); i += 2)
+      {
+        AppendUnit(FoldCodepoint(ReadUnit(&text[i], bigEndian)), bigEndian, result);
+      }
+      return result;
+    }
+
+    std::string FoldUtf8(const std::string& text)
+    {
+      std::string result;
+      result.reserve(text.size());
+      for (std::size_t i = 0; i < text.size();)
+      {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (IsTwoByteLead(c) && i + 1 < text.size() && IsContinuation(static_cast<unsigned char>(text[i + 1])))
+        {
+          AppendTwoBytes(FoldCodepoint(DecodeTwoBytes(c, static_cast<unsigned char>(text[i + 1]))), result);
+          i += 2;
+          continue;
+        }
+        result += static_cast<char>(FoldCase(c));
+        ++i;
+      }
+      return result;
+    }
+
+    // Encodings of every character folding to the first character of the folded text
+    std::vector<std::string> GetFirstCharVariants(const std::string& folded, Encoding encoding)
+    {
+      std::vector<std::string> result;
+      if (encoding != ENCODING_UTF8)
+      {
+        const bool bigEndian = encoding == ENCODING_UTF16BE;
+        const std::uint32_t target = encoding == ENCODING_LATIN1
+          ? static_cast<unsigned char>(folded[0])
+          : ReadUnit(folded.data(), bigEndian);
+        const std::uint32_t unitCount = encoding == ENCODING_LATIN1 ? 0x100 : 0x10000;
+        for (std::uint32_t other = 0; other < unitCount; ++other)
+        {
+          if (FoldCodepoint(other) != target)
+          {
+            continue;
+          }
+          std::string variant;
+          if (encoding == ENCODING_LATIN1)
+          {
+            variant += static_cast<char>(other);
+          }
+          else
+          {
+            AppendUnit(other, bigEndian, variant);
+          }
+          result.push_back(variant);
+        }
+        return result;
+      }
+      const unsigned char c = static_cast<unsigned char>(folded[0]);
+      if (IsTwoByteLead(c) && folded.size() > 1 && IsContinuation(static_cast<unsigned char>(folded[1])))
+      {
+        const std::uint32_t target = DecodeTwoBytes(c, static_cast<unsigned char>(folded[1]));
+        for (std::uint32_t other = 0x80; other < 0x800; ++other)
+        {
+          if (FoldCodepoint(other) == target)
+          {
+            std::string variant;
+            AppendTwoBytes(other, variant);
+            result.push_back(variant);
+          }
+        }
+        return result;
+      }
+      result.push_back(std::string(1, static_cast<char>(c)));
+      if (OtherCase(c) != c)
+      {
+        result.push_back(std::string(1, static_cast<char>(OtherCase(c))));
+      }
+      return result;
+    }
+
+    // Position of the first byte equal to a or b, size if there is no such byte
+    std::size_t FindFirstOf2(const char* data, std::size_t size, char a, char b)
+    {
+      std::size_t i = 0;
+#if defined(__SSE2__)
+      const __m128i va = _mm_set1_epi8(a);
+      const __m128i vb = _mm_set1_epi8(b);
+      for (; i + 16 <= size; i += 16)
+      {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+        if (mask != 0)
+        {
+          return i + __builtin_ctz(mask);
+        }
+      }
+#endif
+      for (; i < size; ++i)
+      {
+        if (data[i] == a || data[i] == b)
+        {
+          return i;
+        }
+      }
+      return size;
+    }
+
+    Common::Error MakeOsError(const std::string& what, const std::string& path)
+    {
+      const int code = errno;
+      return MAKE_ERROR(
+        MAKE_MODULE_ERROR(Common::MODULE_OS, code),
+        Common::StringToWideString(what + " " + path + ": " + strerror(code))
+      );
+    }
+
+    // reads up to size bytes at the offset, less at the end of the file
+    Common::Error ReadAt(int fd, std::uint64_t offset, std::size_t size, std::string& data, const std::string& path)
+    {
+      data.resize(size);
+      std::size_t done = 0;
+      while (done < size)
+      {
+        const ssize_t count = pread(fd, &data[done], size - done, static_cast<off_t>(offset + done));
+        if (count < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          return MakeOsError("read", path);
+        }
+        if (count == 0)
+        {
+          break;
+        }
+        done += static_cast<std::size_t>(count);
+      }
+      data.resize(done);
+      return Common::Success;
+    }
+
+    std::size_t GetByteOrderMarkSize(const char* data, std::size_t size, Encoding encoding)
+    {
+      const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+      switch (encoding)
+      {
+      case ENCODING_UTF8:
+        return size >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf ? 3 : 0;
+      case ENCODING_UTF16LE:
+        return size >= 2 && bytes[0] == 0xff && bytes[1] == 0xfe ? 2 : 0;
+      case ENCODING_UTF16BE:
+        return size >= 2 && bytes[0] == 0xfe && bytes[1] == 0xff ? 2 : 0;
+      default:
+        return 0;
+      }
+    }
+
+    // Read-only private mapping of a whole file, unmapped on destruction
+    class MappedFile
+    {
+    public:
+      MappedFile()
+        : Data(nullptr)
+        , Size(0)
+      {
+      }
+
+      ~MappedFile()
+      {
+        if (Data)
+        {
+          munmap(const_cast<char*>(Data), Size);
+        }
+      }
+
+      Common::Error Open(const std::string& path)
+      {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+          return MakeOsError("open", path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+          Common::Error err = MakeOsError("fstat", path);
+          close(fd);
+          return err;
+        }
+        Size = static_cast<std::size_t>(st.st_size);
+        if (Size == 0)
+        {
+          close(fd);
+          return Common::Success;
+        }
+        void* addr = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+          Common::Error err = MakeOsError("mmap", path);
+          close(fd);
+          Size = 0;
+          return err;
+        }
+        close(fd);
+        Data = static_cast<const char*>(addr);
+        return Common::Success;
+      }
+
+      const char* Data;
+      std::size_t Size;
+
+    private:
+      MappedFile(const MappedFile&);
+      MappedFile& operator=(const MappedFile&);
+    };
+  } // namespace
+
+  std::size_t CountNewlines(const char* data, std::size_t size)
+  {
+    std::size_t count = 0;
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (i + 16 <= size)
+    {
+      // byte counters overflow after 255 iterations, so flush them in blocks
+      __m128i counters = _mm_setzero_si128();
+      const std::size_t blockEnd = std::min(size - size % 16, i + 255 * 16);
+      for (; i < blockEnd; i += 16)
+      {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(chunk, newline));
+      }
+      const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+      count += static_cast<std::size_t>(_mm_cvtsi128_si32(sums)) + static_cast<std::size_t>(_mm_extract_epi16(sums, 4));
+    }
+#endif
+    for (; i < size; ++i)
+    {
+      count += data[i] == '\n';
+    }
+    return count;
+  }
+
+  void FindNewlines(const char* data, std::size_t size, std::uint64_t base, std::vector<std::uint64_t>& offsets)
+  {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16)
+    {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+      while (mask != 0)
+      {
+        offsets.push_back(base + i + __builtin_ctz(mask));
+        mask &= mask - 1;
+      }
+    }
+#endif
+    for (; i < size; ++i)
+    {
+      if (data[i] == '\n')
+      {
+        offsets.push_back(base + i);
+      }
+    }
+  }
+
+  std::uint32_t FoldCodepoint(std::uint32_t c)
+  {
+    if (c < 0x80)
+    {
+      return FoldCase(static_cast<unsigned char>(c));
+    }
+    // Latin-1 Supplement, without the multiplication sign
+    if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+    {
+      return c + 0x20;
+    }
+    // Latin Extended-A: pairs with the upper case letter first, shifted by one in 0139-0148 and 0179-017E
+    if (c >= 0x100 && c <= 0x17f)
+    {
+      if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149 || c == 0x17f)
+      {
+        return c;
+      }
+      if (c == 0x178)
+      {
+        return 0xff;
+      }
+      const bool shifted = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e);
+      return c % 2 == (shifted ? 1u : 0u) ? c + 1 : c;
+    }
+    // Greek
+    if (c >= 0x391 && c <= 0x3ab && c != 0x3a2)
+    {
+      return c + 0x20;
+    }
+    if (c == 0x386)
+    {
+      return 0x3ac;
+    }
+    if (c >= 0x388 && c <= 0x38a)
+    {
+      return c + 0x25;
+    }
+    if (c == 0x38c)
+    {
+      return 0x3cc;
+    }
+    if (c == 0x38e || c == 0x38f)
+    {
+      return c + 0x3f;
+    }
+    if (c == 0x3c2)
+    {
+      return 0x3c3; // final sigma
+    }
+    // Cyrillic
+    if (c >= 0x410 && c <= 0x42f)
+    {
+      return c + 0x20;
+    }
+    if (c >= 0x400 && c <= 0x40f)
+    {
+      return c + 0x50;
+    }
+    if (c == 0x4c0)
+    {
+      return 0x4cf;
+    }
+    if (c >= 0x4c1 && c <= 0x4ce)
+    {
+      return c % 2 == 1 ? c + 1 : c;
+    }
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48a && c <= 0x4bf) || (c >= 0x4d0 && c <= 0x4ff))
+    {
+      return c % 2 == 0 ? c + 1 : c;
+    }
+    return c;
+  }
+
+  Needle::Needle(const std::string& text, bool caseSensitive, Encoding encoding)
+    : Text(caseSensitive ? text : encoding == ENCODING_UTF8 ? FoldUtf8(text) : FoldUnits(text, encoding))
+    , CaseSensitive(caseSensitive)
+    , TextEncoding(encoding)
+    , Unit(GetUnitSize(encoding))
+    , Anchor(0)
+    , First(0)
+    , Alt(0)
+    , ScanAll(false)
+  {
+    if (Text.empty())
+    {
+      return;
+    }
+    if (CaseSensitive)
+    {
+      // the low byte of a UTF-16 big endian unit, its high byte is zero for all of ASCII
+      Anchor = Unit == 2 && Text[0] == 0 ? 1 : 0;
+      First = Alt = Text[Anchor];
+      return;
+    }
+    // lead bytes of Cyrillic or Greek variants may differ where their second bytes don't, and the other way round.
+    // Zero bytes are avoided where possible, they are the high half of every ASCII character in UTF-16
+    const std::vector<std::string> variants = GetFirstCharVariants(Text, TextEncoding);
+    ScanAll = true;
+    for (std::size_t index = 0; index < variants.front().size(); ++index)
+    {
+      std::string values;
+      for (const std::string& variant: variants)
+      {
+        if (values.find(variant[index]) == std::string::npos)
+        {
+          values += variant[index];
+        }
+      }
+      if (values.size() <= 2 && (ScanAll || First == 0 || Alt == 0))
+      {
+        Anchor = index;
+        First = values[0];
+        Alt = values[values.size() - 1];
+        ScanAll = false;
+      }
+    }
+  }
+
+  std::size_t Needle::Size() const
+  {
+    return Text.size();
+  }
+
+  bool Needle::Empty() const
+  {
+    return Text.empty();
+  }
+
+  bool Needle::Equals(const char* data) const
+  {
+    if (CaseSensitive)
+    {
+      return memcmp(data, Text.data(), Text.size()) == 0;
+    }
+    if (TextEncoding == ENCODING_LATIN1)
+    {
+      for (std::size_t i = 0; i < Text.size(); ++i)
+      {
+        if (FoldCodepoint(static_cast<unsigned char>(data[i])) != static_cast<unsigned char>(Text[i]))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+    if (TextEncoding != ENCODING_UTF8)
+    {
+      // whole code units are folded, a byte of one unit never decides the case of another
+      const bool bigEndian = TextEncoding == ENCODING_UTF16BE;
+      for (std::size_t i = 0; i + 1 < Text.size(); i += 2)
+      {
+        if (FoldCodepoint(ReadUnit(data + i, bigEndian)) != ReadUnit(Text.data() + i, bigEndian))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+    for (std::size_t i = 0; i < Text.size();)
+    {
+      const unsigned char expected = static_cast<unsigned char>(Text[i]);
+      const unsigned char actual = static_cast<unsigned char>(data[i]);
+      if (IsTwoByteLead(expected) && i + 1 < Text.size())
+      {
+        // folding keeps the length, so the data has a two byte character here as well
+        const unsigned char next = static_cast<unsigned char>(data[i + 1]);
+        if (!IsTwoByteLead(actual) || !IsContinuation(next)
+          || FoldCodepoint(DecodeTwoBytes(actual, next)) != DecodeTwoBytes(expected, static_cast<unsigned char>(Text[i + 1])))
+        {
+          return false;
+        }
+        i += 2;
+        continue;
+      }
+      if (FoldCase(actual) != expected)
+      {
+        return false;
+      }
+      ++i;
+    }
+    return true;
+  }
+
+  std::size_t Needle::FindIn(const char* data, std::size_t size) const
+  {
+    const std::size_t n = Text.size();
+    if (n == 0 || size < n)
+    {
+      return npos;
+    }
+    const std::size_t last = size - n + 1; // candidates are in [0, last)
+    std::size_t pos = 0;
+    while (pos < last)
+    {
+      if (!ScanAll)
+      {
+        // the anchor is inside the needle, so the scan stays inside the data
+        pos += FindFirstOf2(data + pos + Anchor, last - pos, First, Alt);
+        if (pos >= last)
+        {
+          break;
+        }
+        if (pos % Unit != 0)
+        {
+          // anchor byte found in the other half of a UTF-16 code unit
+          ++pos;
+          continue;
+        }
+      }
+      if (Equals(data + pos))
+      {
+        return pos;
+      }
+      pos += Unit;
+    }
+    return npos;
+  }
+
+  NeedleSet::NeedleSet(const std::string& utf8Text, bool caseSensitive)
+    : Needles(ENCODING_COUNT)
+  {
+    for (std::size_t i = 0; i < ENCODING_COUNT; ++i)
+    {
+      std::string encoded;
+      if (EncodeText(utf8Text, static_cast<Encoding>(i), encoded) && !encoded.empty())
+      {
+        Needles[i] = std::make_shared<const Needle>(encoded, caseSensitive, static_cast<Encoding>(i));
+      }
+    }
+  }
+
+  bool NeedleSet::Empty() const
+  {
+    return !Needles[ENCODING_UTF8];
+  }
+
+  const Needle* NeedleSet::Get(Encoding encoding) const
+  {
+    return Needles[encoding].get();
+  }
+
+  namespace
+  {
+    // Next match at or after pos whose start is in [pos, limit) and aligned to the code unit,
+    // npos if there is none. Data is scanned up to end, so matches may cross the limit
+    std::size_t FindAligned(const Needle& needle, std::size_t unit, const char* data, std::size_t pos, std::size_t limit, std::size_t end)
+    {
+      // data starts at a code unit boundary, the needle keeps its candidates aligned from there
+      pos = (pos + unit - 1) / unit * unit;
+      if (pos >= limit)
+      {
+        return Needle::npos;
+      }
+      const std::size_t found = needle.FindIn(data + pos, end - pos);
+      if (found == Needle::npos || pos + found >= limit)
+      {
+        return Needle::npos;
+      }
+      return pos + found;
+    }
+
+    void SearchMapped(const MappedFile& file, const Needle& needle, Encoding encoding, MatchCallback callback, Common::StopCallback stop, Match& match)
+    {
+      const std::size_t unit = GetUnitSize(encoding);
+      std::uint64_t line = 1;
+      std::size_t counted = 0; // line breaks are counted in [0, counted)
+      std::size_t pos = 0;
+      while (pos < file.Size)
+      {
+        if (stop && stop())
+        {
+          break;
+        }
+        const std::size_t blockLimit = std::min(file.Size, pos + SCAN_BLOCK_SIZE);
+        const std::size_t blockEnd = std::min(file.Size, blockLimit + needle.Size() - 1);
+        // next block overlaps this one, so matches crossing the boundary are not lost
+        const std::size_t offset = FindAligned(needle, unit, file.Data, pos, blockLimit, blockEnd);
+        if (offset == Needle::npos)
+        {
+          pos = blockLimit;
+          continue;
+        }
+        line += CountLineBreaks(file.Data + counted, offset - counted, encoding);
+        counted = offset;
+
+        match.Offset = offset;
+        match.Line = line;
+        if (!callback(match))
+        {
+          break;
+        }
+        pos = offset + 1;
+      }
+    }
+
+    struct ChunkMatches
+    {
+      ChunkMatches()
+        : Newlines(0)
+      {
+      }
+
+      std::vector<std::uint64_t> Offsets;
+      std::vector<std::uint64_t> LineDeltas; // line breaks between chunk start and the match
+      std::uint64_t Newlines;                // line breaks in the whole chunk
+    };
+
+    // Matches starting in [begin, end); the scanned range extends needle size - 1 bytes past
+    // the end, so matches crossing into the next chunk are found exactly once
+    void ScanChunk(
+      const MappedFile& file,
+      const Needle& needle,
+      Encoding encoding,
+      std::size_t begin,
+      std::size_t end,
+      ChunkMatches& result
+    )
+    {
+      madvise(const_cast<char*>(file.Data + begin), end - begin, MADV_WILLNEED);
+      const std::size_t unit = GetUnitSize(encoding);
+      const std::size_t scanEnd = std::min(file.Size, end + needle.Size() - 1);
+      std::size_t counted = begin;
+      std::uint64_t newlines = 0;
+      std::size_t pos = begin;
+      for (;;)
+      {
+        const std::size_t offset = FindAligned(needle, unit, file.Data, pos, end, scanEnd);
+        if (offset == Needle::npos)
+        {
+          break;
+        }
+        newlines += CountLineBreaks(file.Data + counted, offset - counted, encoding);
+        counted = offset;
+        result.Offsets.push_back(offset);
+        result.LineDeltas.push_back(newlines);
+        pos = offset + 1;
+      }
+      // line numbers of later chunks depend on it, so line breaks are always counted to the end
+      result.Newlines = newlines + CountLineBreaks(file.Data + counted, end - counted, encoding);
+    }
+
+    // Scans the file on the CPU pool and reports matches in offset order. Must not be called
+    // from the CPU pool itself, it would wait for tasks queued behind it
+    void SearchMappedParallel(
+      const MappedFile& file,
+      const Needle& needle,
+      Encoding encoding,
+      MatchCallback callback,
+      Common::StopCallback stop,
+      Match& match
+    )
+    {
+      Common::ThreadPool& pool = Common::ThreadPool::Cpu();
+      // even size keeps chunks aligned to UTF-16 code units
+      const std::size_t chunkSize = std::max(PARALLEL_CHUNK_SIZE, needle.Size() * 64) & ~static_cast<std::size_t>(1);
+      const std::size_t chunkCount = (file.Size + chunkSize - 1) / chunkSize;
+      const std::size_t chunksPerWave = pool.GetThreadCount() * PARALLEL_CHUNKS_PER_THREAD;
+      std::uint64_t line = 1;
+      for (std::size_t waveBegin = 0; waveBegin < chunkCount; waveBegin += chunksPerWave)
+      {
+        if (stop && stop())
+        {
+          return;
+        }
+        const std::size_t waveEnd = std::min(chunkCount, waveBegin + chunksPerWave);
+        std::vector<ChunkMatches> results(waveEnd - waveBegin);
+        {
+          Common::TaskGroup group(pool);
+          for (std::size_t chunk = waveBegin; chunk < waveEnd; ++chunk)
+          {
+            ChunkMatches* result = &results[chunk - waveBegin];
+            const std::size_t begin = chunk * chunkSize;
+            const std::size_t end = std::min(file.Size, begin + chunkSize);
+            group.Run([&file, &needle, encoding, begin, end, result]()
+            {
+              ScanChunk(file, needle, encoding, begin, end, *result);
+            });
+          }
+        }
+
+        for (const ChunkMatches& result: results)
+        {
+          for (std::size_t i = 0; i < result.Offsets.size(); ++i)
+          {
+            match.Offset = result.Offsets[i];
+            match.Line = line + result.LineDeltas[i];
+            if (!callback(match))
+            {
+              return;
+            }
+          }
+          line += result.Newlines;
+        }
+      }
+    }
+  } // namespace
+
+  Common::Error SearchFile(
+    const std::string& path,
+    const NeedleSet& needles,
+    MatchCallback callback,
+    Common::StopCallback stop,
+    BinaryMode binaryMode,
+    ContentClass* contentClass
+  )
+  {
+    if (needles.Empty())
+    {
+      return Common::Success;
+    }
+    MappedFile file;
+    RETURN_IF_FAILED(file.Open(path));
+    if (file.Size == 0)
+    {
+      return Common::Success;
+    }
+
+    ContentClass detected = contentClass ? *contentClass : CONTENT_UNKNOWN;
+    if (detected == CONTENT_UNKNOWN)
+    {
+      // only the first page is touched, so skipped binaries cost a single read
+      detected = ClassifyContent(file.Data, file.Size);
+      if (contentClass)
+      {
+        *contentClass = detected;
+      }
+    }
+    if (detected == CONTENT_BINARY)
+    {
+      if (binaryMode == BINARY_SKIP)
+      {
+        return Common::Success;
+      }
+      if (binaryMode == BINARY_FIRST_MATCH)
+      {
+        MatchCallback original = callback;
+        callback = [original](const Match& found) { original(found); return false; };
+      }
+    }
+
+    // the needle is matched in the encoding of the file, contents are never decoded
+    const Encoding encoding = DetectEncoding(file.Data, file.Size);
+    const Needle* needle = needles.Get(encoding);
+    if (!needle)
+    {
+      return Common::Success;
+    }
+
+    Match match;
+    match.Path = path;
+    if (file.Size >= PARALLEL_SEARCH_MIN_FILE_SIZE && Common::ThreadPool::Cpu().GetThreadCount() > 1)
+    {
+      SearchMappedParallel(file, *needle, encoding, callback, stop, match);
+    }
+    else
+    {
+      madvise(const_cast<char*>(file.Data), file.Size, MADV_SEQUENTIAL);
+      SearchMapped(file, *needle, encoding, callback, stop, match);
+    }
+    return Common::Success;
+  }
+
+  StreamMatcher::StreamMatcher(const NeedleSet& needles, const Match& base, MatchCallback callback, BinaryMode binaryMode)
+    : Needles(needles)
+    , Pattern(nullptr)
+    , StreamEncoding(ENCODING_UTF8)
+    , Binary(binaryMode)
+    , FirstMatchOnly(false)
+    , Callback(callback)
+    , Current(base)
+    , WindowOffset(0)
+    , Counted(0)
+    , Stopped(needles.Empty())
+  {
+    Current.Line = 1;
+  }
+
+  bool StreamMatcher::Feed(const char* data, std::size_t size)
+  {
+    if (Stopped)
+    {
+      return false;
+    }
+    if (!Pattern)
+    {
+      // encoding is detected from the first chunk, decompressors produce far more than a sample
+      if (Binary != BINARY_SEARCH && ClassifyContent(data, size) == CONTENT_BINARY)
+      {
+        FirstMatchOnly = true;
+        Stopped = Binary == BINARY_SKIP;
+      }
+      StreamEncoding = DetectEncoding(data, size);
+      Pattern = Needles.Get(StreamEncoding);
+      if (!Pattern || Stopped)
+      {
+        Stopped = true;
+        return false;
+      }
+    }
+    const std::size_t unit = GetUnitSize(StreamEncoding);
+    Window.insert(Window.end(), data, data + size);
+
+    // candidates starting in the last needle size - 1 bytes are completed by the next chunk
+    const std::size_t limit = Window.size() >= Pattern->Size() ? Window.size() - Pattern->Size() + 1 : 0;
+    // window always starts at a code unit boundary
+    std::size_t pos = 0;
+    for (;;)
+    {
+      const std::size_t offset = FindAligned(*Pattern, unit, &Window.front(), pos, limit, Window.size());
+      if (offset == Needle::npos)
+      {
+        break;
+      }
+      const std::size_t counted = static_cast<std::size_t>(Counted - WindowOffset);
+      Current.Line += CountLineBreaks(&Window.front() + counted, offset - counted, StreamEncoding);
+      Counted = WindowOffset + offset;
+      Current.Offset = Counted;
+      if (!Callback(Current) || FirstMatchOnly)
+      {
+        Stopped = true;
+        return false;
+      }
+      pos = offset + 1;
+    }
+
+    // keep only the tail a match may start in, its line breaks are not counted yet
+    std::size_t drop = limit;
+    if ((WindowOffset + drop) % unit != 0)
+    {
+      --drop;
+    }
+    const std::size_t counted = static_cast<std::size_t>(Counted - WindowOffset);
+    if (counted < drop)
+    {
+      Current.Line += CountLineBreaks(&Window.front() + counted, drop - counted, StreamEncoding);
+      Counted = WindowOffset + drop;
+    }
+    Window.erase(Window.begin(), Window.begin() + drop);
+    WindowOffset += drop;
+    return true;
+  }
+
+  Common::Error ReadLineContext(
+    const std::string& path,
+    std::uint64_t offset,
+    std::uint64_t line,
+    std::size_t before,
+    std::size_t after,
+    LineContext& result
+  )
+  {
+    result = LineContext();
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return MakeOsError("open", path);
+    }
+    // only the window around the offset is read, never mapped: the file may be truncated meanwhile
+    std::string head;
+    Common::Error err = ReadAt(fd, 0, ENCODING_SAMPLE_SIZE, head, path);
+    const std::uint64_t window = GetContextWindow(before, after) * 2;
+    const std::uint64_t first = offset > window ? (offset - window) & ~static_cast<std::uint64_t>(1) : 0;
+    std::string data;
+    if (!err)
+    {
+      // one byte past the window tells the data goes on
+      err = ReadAt(fd, first, static_cast<std::size_t>(offset + window + 1 - first), data, path);
+    }
+    close(fd);
+    RETURN_IF_FAILED(err);
+    if (offset >= first + data.size())
+    {
+      return Common::Success;
+    }
+    const Encoding encoding = DetectEncoding(head.data(), head.size());
+    ExtractLineContext(
+      data.data(), data.size(), static_cast<std::size_t>(offset - first), line, before, after, encoding, result
+    );
+    return Common::Success;
+  }
+
+  std::size_t GetContextWindow(std::size_t before, std::size_t after)
+  {
+    return (before + after + 1) * MAX_CONTEXT_LINE_LENGTH;
+  }
+
+  void ExtractLineContext(
+    const char* data,
+    std::size_t size,
+    std::size_t offset,
+    std::uint64_t line,
+    std::size_t before,
+    std::size_t after,
+    Encoding encoding,
+    LineContext& result
+  )
+  {
+    result = LineContext();
+    const std::size_t unit = GetUnitSize(encoding);
+    size -= size % unit;
+    offset -= offset % unit;
+    if (offset >= size)
+    {
+      return;
+    }
+
+    const std::size_t windowLimit = GetContextWindow(before, after) * unit;
+    const std::size_t lowest = offset > windowLimit ? offset - windowLimit : 0;
+    const std::size_t highest = std::min(size, offset + windowLimit);
+
+    // step back to the beginning of the match line, then over preceding lines
+    std::size_t begin = offset;
+    std::size_t linesBack = 0;
+    while (begin > lowest)
+    {
+      if (IsLineBreakAt(data + begin - unit, encoding))
+      {
+        if (linesBack == before)
+        {
+          break;
+        }
+        ++linesBack;
+      }
+      begin -= unit;
+    }
+
+    std::size_t end = offset;
+    std::size_t linesForward = 0;
+    while (end < highest)
+    {
+      if (IsLineBreakAt(data + end, encoding))
+      {
+        if (linesForward == after)
+        {
+          break;
+        }
+        ++linesForward;
+      }
+      end += unit;
+    }
+
+    result.FirstLine = line > linesBack ? line - linesBack : 1;
+    std::size_t lineStart = begin;
+    if (begin == 0)
+    {
+      lineStart = std::min(end, GetByteOrderMarkSize(data, size, encoding));
+    }
+    for (std::size_t i = begin; i <= end; i += unit)
+    {
+      if (i == end || IsLineBreakAt(data + i, encoding))
+      {
+        const std::size_t length = std::min(i - lineStart, MAX_CONTEXT_LINE_LENGTH * unit);
+        result.Lines.push_back(DecodeText(data + lineStart, length, encoding));
+        lineStart = i + unit;
+      }
+    }
+    if (end == size && !result.Lines.empty() && result.Lines.back().empty())
+    {
+      // file ends with a newline, there is no line after it
+      result.Lines.pop_back();
+    }
+  }
+} // namespace Search
@@ -1,6 +1,7 @@
 #include <common/string_utils.h>
 
-#include <codecvt>
+#include <codecvt>
+#include <locale>
 
 namespace Common
 {
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/job_control.h>
+
+#include <functional>
+#include <string>
+
+namespace Archive
+{
+  enum Format
+  {
+    FORMAT_NONE,
+    FORMAT_ZIP,
+    FORMAT_TAR,
+    FORMAT_TAR_GZIP,
+    FORMAT_TAR_XZ,
+    FORMAT_TAR_ZSTD,
+    FORMAT_GZIP,   // single compressed file
+    FORMAT_XZ,
+    FORMAT_ZSTD
+  };
+
+  // Detects format by file name; formats this build has no decoder for are reported as FORMAT_NONE
+  Format DetectFormat(const std::string& fileName);
+
+  typedef std::function<bool (const char* data, std::size_t size)> DataCallback; // return false to skip rest of the member
+  typedef std::function<DataCallback (const std::string& memberPath)> MemberCallback; // return empty callback to skip member
+
+  // Streams regular members of an archive through the callbacks without extracting anything to disk
+  Common::Error ReadMembers(
+    const std::string& path,
+    Format format,
+    MemberCallback onMember,
+    Common::StopCallback stop = Common::StopCallback()
+  );
+} // namespace Archive
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace Search
+{
+  enum ContentClass
+  {
+    CONTENT_UNKNOWN,
+    CONTENT_TEXT,
+    CONTENT_BINARY
+  };
+
+  // How content search treats files classified as binary
+  enum BinaryMode
+  {
+    BINARY_SEARCH,      // same as text
+    BINARY_FIRST_MATCH, // stop at the first match, enough to tell the file contains the text
+    BINARY_SKIP
+  };
+
+  // Bytes examined by ClassifyContent, callers pass at least that much when available
+  const std::size_t CONTENT_SAMPLE_SIZE = 8192;
+
+  // Known magic numbers and NUL bytes mean binary; UTF-16 text is recognized before the NUL check
+  ContentClass ClassifyContent(const char* data, std::size_t size);
+
+  // Process-wide classification results, valid while file size and mtime are unchanged
+  class ContentClassCache
+  {
+  public:
+    static ContentClassCache& Instance();
+
+    ContentClass Find(std::uint64_t device, std::uint64_t inode, std::uint64_t size, std::int64_t mtime);
+    void Store(std::uint64_t device, std::uint64_t inode, std::uint64_t size, std::int64_t mtime, ContentClass value);
+
+  private:
+    ContentClassCache();
+    ContentClassCache(const ContentClassCache&);
+    ContentClassCache& operator=(const ContentClassCache&);
+
+    struct Key
+    {
+      std::uint64_t Device;
+      std::uint64_t Inode;
+
+      bool operator==(const Key& other) const
+      {
+        return Device == other.Device && Inode == other.Inode;
+      }
+    };
+
+    struct KeyHash
+    {
+      std::size_t operator()(const Key& key) const
+      {
+        return std::hash<std::uint64_t>()(key.Inode * 31 + key.Device);
+      }
+    };
+
+    struct Record
+    {
+      std::uint64_t Size;
+      std::int64_t Mtime; // nanoseconds
+      ContentClass Value;
+    };
+
+    std::mutex Lock;
+    std::unordered_map<Key, Record, KeyHash> Records;
+  };
+} // namespace Search
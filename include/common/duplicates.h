@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/job_control.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Filesys
+{
+  struct DuplicateQuery
+  {
+    DuplicateQuery()
+      : MinSize(1)
+      , IncludeHidden(true)
+    {
+    }
+
+    std::vector<std::string> Roots;
+    std::uint64_t MinSize; // smaller files are not compared, empty files are all equal anyway
+    bool IncludeHidden;    // look into entries starting with a dot
+  };
+
+  struct DuplicateGroup
+  {
+    std::uint64_t Size;
+    std::vector<std::string> Paths; // sorted, at least two
+  };
+
+  typedef std::function<void (const DuplicateGroup&)> DuplicateCallback;
+
+  // Finds files with equal content. Candidates are narrowed by size, then by hash of the
+  // first block, then by hash of the whole file, so most files are never read completely.
+  // Hard links to the same inode count as one file. Groups are reported largest first
+  Common::Error FindDuplicates(const DuplicateQuery& query, DuplicateCallback callback, Common::JobControl& control);
+} // namespace Filesys
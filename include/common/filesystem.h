@@ -1,7 +1,9 @@
 #pragma once
 
 #include <common/error.h>
+#include <common/job_control.h>
 
+#include <cstdint>
 #include <functional>
 
 namespace Filesys
@@ -36,6 +38,26 @@ namespace Filesys
 
   int CountFiles(const Dir& dir);
 
+  struct DiskUsage
+  {
+    DiskUsage()
+      : Files(0)
+      , Dirs(0)
+      , Bytes(0)
+      , Allocated(0)
+    {
+    }
+
+    std::uint64_t Files;     // everything that is not a directory
+    std::uint64_t Dirs;      // including the starting one
+    std::uint64_t Bytes;     // apparent size
+    std::uint64_t Allocated; // space taken on disk
+  };
+
+  // Sums sizes of everything below dir, or of dir itself if it's a file.
+  // Files with several hard links are counted once
+  Common::Error GetDiskUsage(const Dir& dir, DiskUsage& result, Common::StopCallback stop = Common::StopCallback());
+
   enum FileObjectType
   {
     FILE_REGULAR,
@@ -44,5 +66,10 @@ namespace Filesys
   };
 
   typedef std::function<bool (const std::string&, FileObjectType)> WalkCallback;
-  Common::Error WalkDir(const Dir& dir, WalkCallback callback, bool depthFirst = true);
+  Common::Error WalkDir(
+    const Dir& dir,
+    WalkCallback callback,
+    bool depthFirst = true,
+    Common::StopCallback stop = Common::StopCallback()
+  );
 } // namespace Platform
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/job_control.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Hash
+{
+  // Streaming XXH64: non-cryptographic, several GB/s, good enough to tell different files apart
+  class Xxh64
+  {
+  public:
+    explicit Xxh64(std::uint64_t seed = 0);
+
+    void Update(const void* data, std::size_t size);
+    std::uint64_t Digest() const;
+
+  private:
+    std::uint64_t Acc[4];
+    unsigned char Buffer[32];
+    std::size_t Buffered;
+    std::uint64_t TotalSize;
+    std::uint64_t Seed;
+  };
+
+  std::uint64_t Compute(const void* data, std::size_t size, std::uint64_t seed = 0);
+
+  // Hashes the first limit bytes of the file, the whole file when limit is 0
+  Common::Error HashFile(const std::string& path, std::uint64_t& result, std::uint64_t limit = 0, Common::StopCallback stop = Common::StopCallback());
+} // namespace Hash
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <common/error.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Search
+{
+  // Compiled gitignore-style patterns of a single source, like one .gitignore file
+  class IgnoreRules
+  {
+  public:
+    enum Verdict
+    {
+      NOT_MATCHED,
+      IGNORED,
+      INCLUDED // matched by a negated pattern
+    };
+
+    // Adds one line in gitignore syntax; comments and blank lines are skipped
+    void AddPattern(const std::string& line);
+    // Fails with the error of opening the file, IsMissingFileError tells which of them to ignore
+    Common::Error LoadFile(const std::string& path);
+    bool Empty() const;
+
+    // Path is relative to the directory rules came from; the last matching pattern wins
+    Verdict Match(const std::string& relativePath, bool isDir) const;
+
+  private:
+    enum Kind
+    {
+      KIND_LITERAL, // no wildcards, compared as is
+      KIND_SUFFIX,  // '*' followed by a literal, e.g. *.o
+      KIND_GLOB
+    };
+
+    struct Rule
+    {
+      std::string Pattern;
+      Kind Type;
+      bool Negated;
+      bool DirectoryOnly;
+      bool Anchored; // contains a slash, so matched against the whole relative path
+    };
+
+    std::vector<Rule> Rules;
+  };
+
+  // Ignore rules in effect inside one directory: rules of the nearest directories
+  // that have ignore files, chained up to the search root. Deeper rules take precedence
+  class IgnoreScope
+  {
+  public:
+    typedef std::shared_ptr<const IgnoreScope> Ptr;
+
+    IgnoreScope(const Ptr& parent, const std::string& dirPath, const IgnoreRules& rules);
+
+    // Returns scope for a subdirectory, loading its .gitignore and .ignore if it has them
+    static Ptr Enter(const Ptr& parent, const std::string& dirPath, bool hasIgnoreFiles);
+
+    // Entry path is absolute and lies below the directory of this scope
+    bool IsIgnored(const std::string& entryPath, bool isDir) const;
+
+  private:
+    IgnoreRules::Verdict Match(const std::string& entryPath, bool isDir) const;
+
+    Ptr Parent;
+    std::string DirPath;
+    IgnoreRules Rules;
+  };
+
+  // Names of per-directory ignore files, in order of increasing precedence
+  extern const char* const IGNORE_FILE_NAMES[2];
+
+  // Global git excludes file: $XDG_CONFIG_HOME/git/ignore or ~/.config/git/ignore
+  std::string GetGlobalExcludesPath();
+
+  // True if LoadFile failed only because there is no such file, which is the usual case
+  bool IsMissingFileError(const Common::Error& error);
+} // namespace Search
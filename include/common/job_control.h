@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace Common
+{
+  typedef std::function<bool ()> StopCallback; // returns true when current operation has to be abandoned
+
+  // Shared state between a background job and whoever controls it.
+  // Worker side polls Checkpoint() at safe points, so job is never interrupted mid-syscall
+  class JobControl
+  {
+  public:
+    JobControl();
+
+    void Pause();
+    void Resume();
+    void Cancel();
+    bool IsPaused() const;
+    bool IsCancelled() const;
+
+    // Blocks while the job is paused; returns false if the job has been cancelled
+    bool Checkpoint();
+    StopCallback AsStopCallback();
+
+    // Worker side reports that it has released all its resources
+    void Finish();
+    bool IsFinished() const;
+    void WaitFinished();
+
+  private:
+    JobControl(const JobControl&);
+    JobControl& operator=(const JobControl&);
+
+    enum State
+    {
+      RUNNING,
+      PAUSED,
+      CANCELLED
+    };
+
+    std::atomic<int> CurrentState;
+    std::atomic<bool> Finished;
+    std::mutex Lock;
+    std::condition_variable StateChanged;
+  };
+} // namespace Common
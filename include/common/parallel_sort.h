@@ -0,0 +1,53 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace Common
+{
+  // smaller inputs are sorted on the calling thread
+  const std::size_t MIN_PARALLEL_SORT_PART = 32 * 1024;
+
+  // Sorts parts of the range on the pool, then merges neighbouring runs pairwise.
+  // Blocks the caller, so it must not be called from a task of the same pool
+  template<class Iterator, class Compare>
+  void ParallelSort(Iterator first, Iterator last, Compare less, ThreadPool& pool = ThreadPool::Sort())
+  {
+    const std::size_t size = last - first;
+    const std::size_t parts = std::min(pool.GetThreadCount(), size / MIN_PARALLEL_SORT_PART);
+    if (parts < 2)
+    {
+      std::sort(first, last, less);
+      return;
+    }
+
+    std::vector<Iterator> bounds;
+    for (std::size_t i = 0; i <= parts; ++i)
+    {
+      bounds.push_back(first + size * i / parts);
+    }
+    {
+      TaskGroup group(pool);
+      for (std::size_t i = 0; i < parts; ++i)
+      {
+        const Iterator begin = bounds[i];
+        const Iterator end = bounds[i + 1];
+        group.Run([begin, end, less]() { std::sort(begin, end, less); });
+      }
+    }
+    for (std::size_t step = 1; step < parts; step *= 2)
+    {
+      TaskGroup group(pool);
+      for (std::size_t i = 0; i + step < parts; i += 2 * step)
+      {
+        const Iterator begin = bounds[i];
+        const Iterator middle = bounds[i + step];
+        const Iterator end = bounds[std::min(i + 2 * step, parts)];
+        group.Run([begin, middle, end, less]() { std::inplace_merge(begin, middle, end, less); });
+      }
+    }
+  }
+} // namespace Common
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/job_control.h>
+#include <common/text_search.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Search
+{
+  class ResultCache;
+
+  struct Query
+  {
+    Query()
+      : CaseSensitive(false)
+      , IncludeHidden(true)
+      , MaxHitsPerFile(0)
+      , SearchArchives(false)
+      , UseIgnoreFiles(false)
+      , BinaryFiles(BINARY_SEARCH)
+    {
+    }
+
+    std::string Root;
+    std::string NameMask;  // shell wildcard matched against entry names, empty matches everything
+    std::string Content;   // empty means search by name only
+    bool CaseSensitive;    // applies to content only, names are always matched case insensitively
+    bool IncludeHidden;    // descend into directories starting with a dot
+    std::size_t MaxHitsPerFile; // 0 - unlimited, counted per archive member for archives
+    bool SearchArchives;   // match archive members instead of the archive bytes, off as it decompresses every archive met
+    bool UseIgnoreFiles;   // prune entries excluded by .gitignore, .ignore and global excludes, skip .git
+    std::vector<std::string> ExcludePatterns; // gitignore syntax, added to global excludes when UseIgnoreFiles is on
+    BinaryMode BinaryFiles; // content search of files classified as binary
+  };
+
+  struct Callbacks
+  {
+    MatchCallback OnMatch; // Match::Line is 0 for hits by name only; calls are serialized
+    std::function<void (const std::string&)> OnDirectory;
+  };
+
+  // Walks query root and reports matching entries. When cache is given, directory
+  // listings and per-file matches are reused for entries unchanged since the cached run
+  Common::Error Run(const Query& query, const Callbacks& callbacks, Common::JobControl& control, ResultCache* cache = nullptr);
+
+  // Reads lines around a reported match, decompressing the archive member if there is one
+  Common::Error ReadMatchContext(const Match& match, std::size_t before, std::size_t after, LineContext& result);
+} // namespace Search
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/search.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Search
+{
+  struct Timestamp
+  {
+    Timestamp()
+      : Seconds(0)
+      , Nanoseconds(0)
+    {
+    }
+
+    bool operator==(const Timestamp& other) const
+    {
+      return Seconds == other.Seconds && Nanoseconds == other.Nanoseconds;
+    }
+
+    std::int64_t Seconds;
+    std::int64_t Nanoseconds;
+  };
+
+  // Results of a previous run of the same query, persisted between runs.
+  // Directory listing is valid while directory (inode, mtime) is unchanged,
+  // file matches are valid while file (size, mtime) is unchanged.
+  // Not thread safe, callers serialize access
+  class ResultCache
+  {
+  public:
+    enum EntryType
+    {
+      ENTRY_DIRECTORY,
+      ENTRY_REGULAR,
+      ENTRY_OTHER
+    };
+
+    struct Entry
+    {
+      std::string Name;
+      EntryType Type;
+    };
+
+    struct DirRecord
+    {
+      DirRecord()
+        : Inode(0)
+        , Visited(false)
+      {
+      }
+
+      std::uint64_t Inode;
+      Timestamp Mtime;
+      std::vector<Entry> Entries;
+      bool Visited;
+    };
+
+    struct FileHit
+    {
+      std::uint64_t Offset;
+      std::uint64_t Line;
+      std::string Member; // path inside archive, empty for plain files
+    };
+
+    struct FileRecord
+    {
+      FileRecord()
+        : Size(0)
+        , Visited(false)
+      {
+      }
+
+      std::uint64_t Size;
+      Timestamp Mtime;
+      std::vector<FileHit> Hits;
+      bool Visited;
+    };
+
+    // Stable identifier of the query, suitable as a file name
+    static std::string MakeKey(const Query& query);
+
+    Common::Error Load(const std::string& path);
+    // Entries not visited since Load are considered deleted and are not saved
+    Common::Error Save(const std::string& path) const;
+
+    // Return cached record only if it's still valid for the given attributes
+    const DirRecord* FindDir(const std::string& path, std::uint64_t inode, const Timestamp& mtime);
+    const FileRecord* FindFile(const std::string& path, std::uint64_t size, const Timestamp& mtime);
+
+    void StoreDir(const std::string& path, const DirRecord& record);
+    void StoreFile(const std::string& path, const FileRecord& record);
+
+  private:
+    std::unordered_map<std::string, DirRecord> Dirs;
+    std::unordered_map<std::string, FileRecord> Files;
+  };
+} // namespace Search
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <common/error.h>
+#include <common/job_control.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace Filesys
+{
+  enum SyncAction
+  {
+    SYNC_CREATE_DIR,
+    SYNC_COPY,   // missing in destination
+    SYNC_UPDATE, // differs by size or modification time
+    SYNC_DELETE  // absent in source, or of another type there
+  };
+
+  struct SyncOptions
+  {
+    SyncOptions()
+      : DeleteExtra(false)
+      , DryRun(false)
+    {
+    }
+
+    bool DeleteExtra; // remove destination entries that source doesn't have
+    bool DryRun;      // only report what would be done
+  };
+
+  struct SyncStats
+  {
+    SyncStats()
+      : Copied(0)
+      , Updated(0)
+      , Deleted(0)
+      , Unchanged(0)
+      , Bytes(0)
+    {
+    }
+
+    std::uint64_t Copied;
+    std::uint64_t Updated;
+    std::uint64_t Deleted;
+    std::uint64_t Unchanged;
+    std::uint64_t Bytes; // copied or updated
+  };
+
+  typedef std::function<void (SyncAction, const std::string&)> SyncCallback; // path in destination
+
+  // One way mirror making destination look like source. Files are considered equal when
+  // size and modification time in whole seconds match; copies keep the source times
+  Common::Error SyncDirs(
+    const std::string& source,
+    const std::string& destination,
+    const SyncOptions& options,
+    SyncCallback callback,
+    SyncStats& stats,
+    Common::JobControl& control
+  );
+} // namespace Filesys
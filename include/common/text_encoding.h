@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Search
+{
+  enum Encoding
+  {
+    ENCODING_UTF8,
+    ENCODING_UTF16LE,
+    ENCODING_UTF16BE,
+    ENCODING_LATIN1
+  };
+
+  const std::size_t ENCODING_COUNT = 4;
+
+  // Bytes examined by DetectEncoding, callers pass at least that much when available
+  const std::size_t ENCODING_SAMPLE_SIZE = 4096;
+
+  // Byte order mark wins; otherwise UTF-16 is recognized by zero high bytes of ASCII
+  // characters and everything that isn't valid UTF-8 is taken for Latin-1
+  Encoding DetectEncoding(const char* data, std::size_t size);
+
+  // Size of the code unit, matches and line breaks are aligned to it
+  std::size_t GetUnitSize(Encoding encoding);
+
+  // Converts UTF-8 text; returns false if some character has no representation in the encoding
+  bool EncodeText(const std::string& utf8, Encoding encoding, std::string& result);
+  // Converts raw file bytes to UTF-8 for display; malformed sequences are kept as Latin-1
+  std::string DecodeText(const char* data, std::size_t size, Encoding encoding);
+
+  // Counts '\n' characters; for UTF-16 data must start at a code unit boundary
+  std::size_t CountLineBreaks(const char* data, std::size_t size, Encoding encoding);
+  // Whether a line break starts at the given position, aligned to the code unit
+  bool IsLineBreakAt(const char* data, Encoding encoding);
+} // namespace Search
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <common/content_class.h>
+#include <common/error.h>
+#include <common/job_control.h>
+#include <common/text_encoding.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Search
+{
+  struct Match
+  {
+    Match()
+      : Offset(0)
+      , Line(0)
+    {
+    }
+
+    std::string Path;
+    std::string Member;   // path inside archive when Path is an archive, empty otherwise
+    std::uint64_t Offset; // byte offset of the first matched byte
+    std::uint64_t Line;   // 1-based line number, 0 if unknown
+  };
+
+  typedef std::function<bool (const Match&)> MatchCallback; // return false to stop matching the current file
+
+  // Counts '\n' bytes in the given range, vectorized where the target supports it
+  std::size_t CountNewlines(const char* data, std::size_t size);
+  // Appends base + position of every '\n' in the given range, vectorized the same way
+  void FindNewlines(const char* data, std::size_t size, std::uint64_t base, std::vector<std::uint64_t>& offsets);
+
+  // Simple case folding of Latin-1, Latin Extended-A, Greek and Cyrillic letters along with ASCII,
+  // whose upper and lower case forms have the same UTF-8 length; other characters are returned as is
+  std::uint32_t FoldCodepoint(std::uint32_t c);
+
+  // Text in the given encoding matched as raw bytes. Case insensitive matching folds characters
+  // with FoldCodepoint: UTF-8 by character, Latin-1 and UTF-16 by code unit
+  class Needle
+  {
+  public:
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    Needle(const std::string& text, bool caseSensitive, Encoding encoding = ENCODING_UTF8);
+    std::size_t Size() const;
+    bool Empty() const;
+    // Returns position of the first occurrence inside [data, data + size) or npos. Only positions
+    // at multiples of the code unit are candidates, data must start at a code unit boundary
+    std::size_t FindIn(const char* data, std::size_t size) const;
+
+  private:
+    bool Equals(const char* data) const;
+
+    std::string Text; // already folded to lower case when search is case insensitive
+    bool CaseSensitive;
+    Encoding TextEncoding;
+    std::size_t Unit;
+    // candidates are located by one byte of the first character, which takes at most two values
+    // over the case variants of the character; every position is tried if there is no such byte
+    std::size_t Anchor;
+    char First;
+    char Alt;
+    bool ScanAll;
+  };
+
+  // Needle pre-encoded into every supported encoding, so file contents are matched
+  // as raw bytes and never decoded
+  class NeedleSet
+  {
+  public:
+    NeedleSet(const std::string& utf8Text, bool caseSensitive);
+    bool Empty() const;
+    // Returns nullptr when the text can't be represented in the encoding
+    const Needle* Get(Encoding encoding) const;
+
+  private:
+    std::vector<std::shared_ptr<const Needle>> Needles; // indexed by encoding
+  };
+
+  // Finds all needle occurrences in a regular file, reporting them in offset order.
+  // Needle is taken in the encoding detected from the beginning of the file.
+  // Line numbers are counted only over the bytes preceding each match, so small files
+  // without hits are never counted. Large files are scanned in parallel chunks on the
+  // CPU pool, so this must not be called from a CPU pool task.
+  // Content class is taken from contentClass when it's known, otherwise the file is
+  // classified by its first block and the result is stored there
+  Common::Error SearchFile(
+    const std::string& path,
+    const NeedleSet& needles,
+    MatchCallback callback,
+    Common::StopCallback stop = Common::StopCallback(),
+    BinaryMode binaryMode = BINARY_SEARCH,
+    ContentClass* contentClass = nullptr
+  );
+
+  // Incremental search over data arriving in chunks, e.g. from a decompressor.
+  // Offsets and line numbers are counted from the beginning of the stream,
+  // encoding and content class are detected from the first chunk
+  class StreamMatcher
+  {
+  public:
+    StreamMatcher(const NeedleSet& needles, const Match& base, MatchCallback callback, BinaryMode binaryMode = BINARY_SEARCH);
+    // Returns false once callback has asked to stop
+    bool Feed(const char* data, std::size_t size);
+
+  private:
+    StreamMatcher(const StreamMatcher&);
+    StreamMatcher& operator=(const StreamMatcher&);
+
+    const NeedleSet& Needles;
+    const Needle* Pattern; // chosen on the first chunk
+    Encoding StreamEncoding;
+    BinaryMode Binary;
+    bool FirstMatchOnly;
+    MatchCallback Callback;
+    Match Current;
+    std::vector<char> Window;   // last needle size - 1 bytes of the previous chunk followed by the current one
+    std::uint64_t WindowOffset; // stream offset of the window start
+    std::uint64_t Counted;      // stream offset up to which newlines are counted
+    bool Stopped;
+  };
+
+  struct LineContext
+  {
+    LineContext()
+      : FirstLine(0)
+    {
+    }
+
+    std::uint64_t FirstLine;
+    std::vector<std::string> Lines;
+  };
+
+  // Extracts lines surrounding the given byte offset, converted to UTF-8; line argument
+  // is the line number of the offset and is used only to number the returned lines
+  Common::Error ReadLineContext(
+    const std::string& path,
+    std::uint64_t offset,
+    std::uint64_t line,
+    std::size_t before,
+    std::size_t after,
+    LineContext& result
+  );
+
+  // How far from the offset context extraction may look
+  std::size_t GetContextWindow(std::size_t before, std::size_t after);
+
+  // Same as ReadLineContext over data already in memory, offset is relative to data and data
+  // starts at a code unit boundary. Data ending within the context window is treated as
+  // the end of file. Lines are converted to UTF-8
+  void ExtractLineContext(
+    const char* data,
+    std::size_t size,
+    std::size_t offset,
+    std::uint64_t line,
+    std::size_t before,
+    std::size_t after,
+    Encoding encoding,
+    LineContext& result
+  );
+} // namespace Search
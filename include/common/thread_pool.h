@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Common
+{
+  class ThreadPool
+  {
+  public:
+    typedef std::function<void ()> Task;
+
+    explicit ThreadPool(std::size_t threadCount = 0); // 0 - one thread per hardware thread
+    // Tasks not started yet are dropped. Running ones are not waited for: a task may be stuck
+    // in a call to a mount that stopped answering, its thread goes away once the call returns
+    ~ThreadPool();
+
+    void Submit(Task task);
+    std::size_t GetThreadCount() const;
+
+    // Process-wide pool shared by all file operation engines (search, copy, size calculation)
+    static ThreadPool& Io();
+    // Process-wide pool for CPU bound work like matching and decompression, one thread per core
+    static ThreadPool& Cpu();
+    // Process-wide pool of ParallelSort only. The GUI thread waits for its sorts, so they must
+    // never queue behind searches or thumbnail decoding on the CPU pool
+    static ThreadPool& Sort();
+
+  private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    // shared with the workers, outlives the pool as long as one of them runs a task
+    struct State
+    {
+      State(): Stopping(false) {}
+
+      std::deque<Task> Queue;
+      std::mutex Lock;
+      std::condition_variable HasWork;
+      bool Stopping;
+    };
+
+    static void WorkerLoop(std::shared_ptr<State> state);
+
+    std::vector<std::thread> Workers;
+    std::shared_ptr<State> Shared;
+  };
+
+  // Batch of tasks submitted to a pool that can be waited for as a whole.
+  // Destructor waits, so tasks may safely reference the owner of the group
+  class TaskGroup
+  {
+  public:
+    explicit TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    void Run(ThreadPool::Task task);
+    void Wait();
+
+  private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    ThreadPool& Pool;
+    std::size_t Pending;
+    std::mutex Lock;
+    std::condition_variable AllDone;
+  };
+} // namespace Common
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <common/thread_pool.h>
+
+#include <QGenericArgument>
+#include <QMetaObject>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace TotalFinder
+{
+  // Requests of a GUI thread cache, served on the IO pool by a few tasks at most. Items pushed
+  // to the front are served first, those over the limit are dropped from the back. Tasks hand
+  // their results to slots of the owner through queued calls, and the owner tells the queue when
+  // a key is done, which signals the owner that results are ready, batched.
+  // Nothing waits for the tasks, one may be stuck in a call to a dead mount: once the queue is
+  // gone they stop after their current item and deliver nothing more
+  template<class T>
+  class BackgroundQueue
+  {
+    struct State;
+
+  public:
+    // what a task may use while it serves an item
+    class Worker
+    {
+    public:
+      explicit Worker(const std::shared_ptr<State>& state)
+        : Shared(state)
+      {
+      }
+
+      // the owner is going away, long items should give up
+      bool IsStopping() const
+      {
+        std::lock_guard<std::mutex> lock(Shared->Lock);
+        return Shared->Stopping;
+      }
+
+      // queued call of a slot of the owner
+      void Deliver(
+        const char* member,
+        QGenericArgument a0 = QGenericArgument(),
+        QGenericArgument a1 = QGenericArgument(),
+        QGenericArgument a2 = QGenericArgument(),
+        QGenericArgument a3 = QGenericArgument()
+      ) const
+      {
+        std::lock_guard<std::mutex> lock(Shared->Lock);
+        if (Shared->Owner)
+        {
+          QMetaObject::invokeMethod(Shared->Owner, member, Qt::QueuedConnection, a0, a1, a2, a3);
+        }
+      }
+
+    private:
+      std::shared_ptr<State> Shared;
+    };
+
+    // runs on the pool and must not touch the owner, results go through the worker
+    typedef std::function<void (const QString& key, const T& item, const Worker& worker)> Handler;
+
+    // readySignal of the owner is emitted at most once per notifyMilliseconds; maxPending 0 keeps every item
+    BackgroundQueue(
+      QObject* owner,
+      const char* readySignal,
+      int notifyMilliseconds,
+      std::size_t maxTasks,
+      std::size_t maxPending,
+      const Handler& handler
+    )
+      : Shared(std::make_shared<State>())
+      , NotifyTimer(new QTimer(owner))
+      , MaxPending(maxPending)
+    {
+      Shared->Owner = owner;
+      Shared->MaxTasks = maxTasks;
+      Shared->Serve = handler;
+      NotifyTimer->setSingleShot(true);
+      NotifyTimer->setInterval(notifyMilliseconds);
+      QObject::connect(NotifyTimer, SIGNAL(timeout()), owner, readySignal);
+    }
+
+    ~BackgroundQueue()
+    {
+      std::lock_guard<std::mutex> lock(Shared->Lock);
+      Shared->Stopping = true;
+      Shared->Pending.clear();
+      Shared->Owner = nullptr;
+    }
+
+    // pending or being served
+    bool IsRequested(const QString& key) const
+    {
+      return Requested.contains(key);
+    }
+
+    void Push(const QString& key, const T& item, bool first)
+    {
+      Requested.insert(key);
+      std::lock_guard<std::mutex> lock(Shared->Lock);
+      if (first)
+      {
+        Shared->Pending.push_front(std::make_pair(key, item));
+      }
+      else
+      {
+        Shared->Pending.push_back(std::make_pair(key, item));
+      }
+      if (MaxPending && Shared->Pending.size() > MaxPending)
+      {
+        Requested.remove(Shared->Pending.back().first);
+        Shared->Pending.pop_back();
+      }
+      if (Shared->RunningTasks < Shared->MaxTasks)
+      {
+        ++Shared->RunningTasks;
+        Common::ThreadPool::Io().Submit(std::bind(&BackgroundQueue::Run, Shared));
+      }
+    }
+
+    // from the slot a result was delivered to
+    void Done(const QString& key)
+    {
+      Requested.remove(key);
+      if (!NotifyTimer->isActive())
+      {
+        NotifyTimer->start();
+      }
+    }
+
+  private:
+    // shared with the tasks, outlives the queue as long as a task runs
+    struct State
+    {
+      State()
+        : Owner(nullptr)
+        , RunningTasks(0)
+        , MaxTasks(1)
+        , Stopping(false)
+      {
+      }
+
+      std::mutex Lock;
+      QObject* Owner; // cleared when the queue goes away
+      std::deque<std::pair<QString, T> > Pending;
+      std::size_t RunningTasks;
+      std::size_t MaxTasks;
+      Handler Serve;
+      bool Stopping;
+    };
+
+    BackgroundQueue(const BackgroundQueue&);
+    BackgroundQueue& operator=(const BackgroundQueue&);
+
+    static void Run(std::shared_ptr<State> state)
+    {
+      const Worker worker(state);
+      std::unique_lock<std::mutex> lock(state->Lock);
+      while (!state->Pending.empty() && !state->Stopping)
+      {
+        const std::pair<QString, T> item = state->Pending.front();
+        state->Pending.pop_front();
+        lock.unlock();
+        state->Serve(item.first, item.second, worker);
+        lock.lock();
+      }
+      --state->RunningTasks;
+    }
+
+    std::shared_ptr<State> Shared;
+    QSet<QString> Requested; // GUI thread only
+    QTimer* NotifyTimer; // owned by the owner
+    std::size_t MaxPending;
+  };
+} // namespace TotalFinder
@@ -0,0 +1,139 @@
+#include "dir_loader.h"
+
+#include <common/thread_pool.h>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <cstring>
+#include <functional>
+
+#include <dirent.h>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    // Filters that can be applied by name and d_type only. Special files are system ones,
+    // entries of unknown type are kept and get their type with the rest of their metadata
+    bool IsFiltered(const char* name, unsigned char type, QDir::Filters filters)
+    {
+      if (std::strcmp(name, ".") == 0)
+      {
+        return filters & QDir::NoDot;
+      }
+      if (std::strcmp(name, "..") == 0)
+      {
+        return filters & QDir::NoDotDot;
+      }
+      if (name[0] == '.' && !(filters & QDir::Hidden))
+      {
+        return true;
+      }
+      switch (type)
+      {
+      case DT_FIFO:
+      case DT_CHR:
+      case DT_BLK:
+      case DT_SOCK:
+        return !(filters & QDir::System);
+      default:
+        return false;
+      }
+    }
+
+    int GetTypeFlags(unsigned char type, const char* name)
+    {
+      int flags = 0;
+      flags |= type == DT_DIR ? EntryTable::FLAG_DIR : 0;
+      flags |= type == DT_LNK ? EntryTable::FLAG_SYMLINK : 0;
+      flags |= name[0] == '.' ? EntryTable::FLAG_HIDDEN : 0;
+      return flags;
+    }
+  } // namespace
+
+  DirLoader::DirLoader(const QDir& dir, QObject* parent)
+    : QObject(parent)
+    , Dir(dir)
+    , Started(false)
+  {
+    qRegisterMetaType<EntryTable>("EntryTable");
+  }
+
+  DirLoader::~DirLoader()
+  {
+    // pool task references this object, so wait until it reaches the nearest checkpoint
+    Control.Cancel();
+    if (Started)
+    {
+      Control.WaitFinished();
+    }
+  }
+
+  void DirLoader::Start()
+  {
+    Started = true;
+    Common::ThreadPool::Io().Submit(std::bind(&DirLoader::Run, this));
+  }
+
+  void DirLoader::Cancel()
+  {
+    Control.Cancel();
+  }
+
+  bool DirLoader::IsCancelled() const
+  {
+    return Control.IsCancelled();
+  }
+
+  void DirLoader::Run()
+  {
+    QElapsedTimer timer;
+    timer.start();
+    EntryTable chunk;
+    bool first = true;
+    int total = 0;
+    // names and types only, nothing is stat'ed here: see MetadataLoader
+    DIR* dir = opendir(QFile::encodeName(Dir.absolutePath()).constData());
+    if (!dir)
+    {
+      qWarning() << "Failed to open directory" << Dir.absolutePath();
+    }
+    while (dir && Control.Checkpoint())
+    {
+      const dirent* entry = readdir(dir);
+      if (!entry)
+      {
+        break;
+      }
+      if (IsFiltered(entry->d_name, entry->d_type, Dir.filter()))
+      {
+        continue;
+      }
+      chunk.Append(QFile::decodeName(entry->d_name), GetTypeFlags(entry->d_type, entry->d_name));
+      // first rows go out as soon as there is a screenful, the rest is batched by time
+      // to keep the number of model updates per second low
+      if ((first && chunk.Size() >= FIRST_CHUNK_SIZE) || timer.elapsed() >= CHUNK_INTERVAL_MILLISECONDS)
+      {
+        total += chunk.Size();
+        emit ChunkLoaded(chunk);
+        chunk.Clear();
+        first = false;
+        timer.restart();
+      }
+    }
+    if (dir)
+    {
+      closedir(dir);
+    }
+    if (chunk.Size() && !Control.IsCancelled())
+    {
+      total += chunk.Size();
+      emit ChunkLoaded(chunk);
+    }
+    qDebug() << "Listing of" << Dir.absolutePath() << (Control.IsCancelled() ? "cancelled after" : "loaded,") << total << "entries";
+    emit Finished();
+    Control.Finish();
+  }
+} // namespace TotalFinder
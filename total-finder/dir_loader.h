@@ -0,0 +1,42 @@
+#pragma once
+
+#include "entry_table.h"
+
+#include <common/job_control.h>
+
+#include <QDir>
+#include <QObject>
+
+namespace TotalFinder
+{
+  // Reads one directory listing on the shared IO pool and hands it over in chunks,
+  // so a huge or slow directory shows its first rows right away.
+  // Entries arrive in directory order with names and types only, sorting is up to the receiver
+  class DirLoader: public QObject
+  {
+    Q_OBJECT
+    const int FIRST_CHUNK_SIZE = 256;
+    const qint64 CHUNK_INTERVAL_MILLISECONDS = 100;
+
+  public:
+    DirLoader(const QDir& dir, QObject* parent);
+    ~DirLoader() override;
+
+    void Start();
+    // returns immediately, Finished is still emitted when the pool task stops
+    void Cancel();
+    bool IsCancelled() const;
+
+  signals:
+    // emitted from the pool thread
+    void ChunkLoaded(const EntryTable& chunk);
+    void Finished();
+
+  private:
+    void Run();
+
+    QDir Dir;
+    Common::JobControl Control;
+    bool Started;
+  };
+} // namespace TotalFinder
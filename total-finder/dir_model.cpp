@@ -1,9 +1,18 @@
 #include "dir_model.h"
+#include "folder_sizes.h"
+#include "icon_cache.h"
 #include "settings.h"
+#include "thumbnail_cache.h"
 
-#include <QDateTime>
+#include <common/parallel_sort.h>
+
+#include <QColor>
 #include <QDebug>
-#include <QFileIconProvider>
+#include <QRegExp>
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
 
 namespace TotalFinder
 {
@@ -29,87 +38,762 @@ namespace TotalFinder
       COL_COUNT
     };
 
-    QPair<QString, QString> GetNameAndExtension(const QFileInfo& item)
+    // ties are broken by name, so the order is total and doesn't depend on the listing order
+    int CompareRows(const EntryTable& entries, int column, int left, int right)
     {
-      if (item.isDir() || item.completeBaseName().isEmpty())
+      int result = 0;
+      switch (column)
+      {
+        case COL_EXT:
+          result = QString::compare(entries.GetExtension(left), entries.GetExtension(right), Qt::CaseInsensitive);
+          break;
+        case COL_SIZE:
+          result = entries.GetSize(left) < entries.GetSize(right) ? -1 : entries.GetSize(left) > entries.GetSize(right);
+          break;
+        case COL_MTIME:
+          result = entries.GetModified(left) < entries.GetModified(right) ? -1 : entries.GetModified(left) > entries.GetModified(right);
+          break;
+        case COL_PERMISSIONS:
+          result = entries.GetPermissionsText(left).compare(entries.GetPermissionsText(right));
+          break;
+      }
+      if (!result)
       {
-        return QPair<QString, QString>(item.fileName(), "");
+        result = entries.GetSortKey(left).compare(entries.GetSortKey(right));
       }
-      return QPair<QString, QString>(item.completeBaseName(), item.suffix());
+      return result ? result : entries.GetFileName(left).compare(entries.GetFileName(right));
     }
 
-    QString DecodePermissions(QFile::Permissions permissions, bool isDir)
+    // directories stay on top in both directions, ".." above everything
+    class RowLess
     {
-      QString result;
-      result += isDir ? "d" : "-";
-
-      result += permissions & QFile::ReadOwner ? "r" : "-";
-      result += permissions & QFile::WriteOwner ? "w" : "-";
-      result += permissions & QFile::ExeOwner ? "x" : "-";
-
-      result += permissions & QFile::ReadGroup ? "r" : "-";
-      result += permissions & QFile::WriteGroup ? "w" : "-";
-      result += permissions & QFile::ExeGroup ? "x" : "-";
+    public:
+      RowLess(const EntryTable& entries, int column, Qt::SortOrder order)
+        : Entries(&entries)
+        , Column(column)
+        , Descending(order == Qt::DescendingOrder)
+        , ParentRow(entries.Find(".."))
+      {
+      }
 
-      result += permissions & QFile::ReadOther ? "r" : "-";
-      result += permissions & QFile::WriteOther ? "w" : "-";
-      result += permissions & QFile::ExeOther ? "x" : "-";
+      bool operator()(int left, int right) const
+      {
+        if (left == ParentRow || right == ParentRow)
+        {
+          return left == ParentRow;
+        }
+        if (Entries->IsDir(left) != Entries->IsDir(right))
+        {
+          return Entries->IsDir(left);
+        }
+        const int result = CompareRows(*Entries, Column, left, right);
+        return Descending ? result > 0 : result < 0;
+      }
 
-      return result;
-    }
+    private:
+      const EntryTable* Entries;
+      int Column;
+      bool Descending;
+      int ParentRow;
+    };
 
-    QString FormatSize(quint64 size)
+    QVector<int> GetSortOrder(const EntryTable& entries, int column, Qt::SortOrder order)
     {
-      QString result = QString::number(size);
-      int len = result.size();
-      while (len > 3)
-      {
-        result.insert(len - 3, '.');
-        len -= 3;
-      }
-      return result;
+      QVector<int> rows(entries.Size());
+      std::iota(rows.begin(), rows.end(), 0);
+      Common::ParallelSort(rows.begin(), rows.end(), RowLess(entries, column, order));
+      return rows;
     }
+
+    // bigger changes are merged in one go instead of signalling every inserted row
+    const int MAX_SINGLE_INSERTS = 1024;
   } // namespace
 
   DirModel::DirModel(QObject* parent)
     : QAbstractTableModel(parent)
-    , FileWatcher(new QFileSystemWatcher(this))
+    , Source(nullptr)
+    , SortColumn(COL_NAME)
+    , SortDirection(Qt::AscendingOrder)
+    , Thumbnails(false)
   {
     connect(&Settings::SettingsChangeMonitor::Instance(), SIGNAL(SettingsChanged()), SLOT(OnSettingsChange()));
-    // TODO: it's potentially expensive to watch every tab - maybe only visible ones
-    connect(FileWatcher, SIGNAL(directoryChanged(const QString&)), SLOT(OnDirectoryChanged()));
+    connect(&IconCache::Instance(), SIGNAL(IconsReady()), SLOT(OnIconsReady()));
+    connect(&FolderSizes::Instance(), SIGNAL(SizesReady()), SLOT(OnFolderSizesReady()));
+  }
+
+  DirModel::~DirModel()
+  {
+    ListingCache::Instance().Release(Source);
   }
 
   void DirModel::OnSettingsChange()
   {
+    if (IsHibernating())
+    {
+      // filters are applied when the model wakes up
+      RootDir.setFilter(Settings::LoadDirFilters() | (RootDir.isRoot() ? QDir::NoDotDot : QDir::AllEntries));
+      return;
+    }
     SetRoot(RootDir);
   }
 
   void DirModel::SetRoot(const QDir& dir)
   {
-    beginResetModel();
     RootDir = dir;
-    RootDir.setSorting(QDir::DirsFirst | QDir::IgnoreCase | QDir::Name);
     RootDir.setFilter(Settings::LoadDirFilters() | (RootDir.isRoot() ? QDir::NoDotDot : QDir::AllEntries));
-    if (!FileWatcher->directories().empty() && !FileWatcher->removePaths(FileWatcher->directories()).empty())
+    Attach(false);
+  }
+
+  void DirModel::Attach(bool keepFilter)
+  {
+    // acquired before the previous one is released, so reopening the same directory reuses its listing
+    Listing* previous = Source;
+    if (previous)
+    {
+      disconnect(previous, 0, this, 0);
+    }
+    Source = ListingCache::Instance().Acquire(RootDir);
+    ListingCache::Instance().Release(previous);
+    connect(Source, SIGNAL(LoadingChanged(bool)), SIGNAL(LoadingChanged(bool)));
+    connect(Source, SIGNAL(PollingChanged()), SIGNAL(PollingChanged()));
+    connect(Source, SIGNAL(MetadataChanged(const QVector<int>&)), SLOT(OnMetadataChanged()));
+    connect(Source, SIGNAL(MetadataLoaded()), SLOT(OnMetadataLoaded()));
+    connect(Source, SIGNAL(ChunkLoaded(const EntryTable&)), SLOT(OnChunkLoaded(const EntryTable&)));
+    connect(Source, SIGNAL(Loaded()), SLOT(OnListingLoaded()));
+    connect(Source, SIGNAL(Updated(const EntryTable&, const ListingDiff&)), SLOT(OnListingUpdated(const EntryTable&, const ListingDiff&)));
+
+    beginResetModel();
+    Entries = Source->GetEntries();
+    if (Source->IsComplete())
     {
-      qWarning() << "Failed to remove directories from watch";
+      Order = GetSortOrder(Entries, SortColumn, SortDirection);
     }
-    if (!FileWatcher->addPath(RootDir.absolutePath()))
+    else
     {
-      qWarning() << "Failed to add directory to watch:" << RootDir.absolutePath();
+      Order.resize(Entries.Size());
+      std::iota(Order.begin(), Order.end(), 0);
     }
+    if (!keepFilter)
+    {
+      QuickFilter.clear();
+      HibernatedSelection.clear();
+    }
+    Selection = RowSelection();
+    RestoreSelection();
+    UpdateFilteredRows();
+    UpdateRowIndex();
     endResetModel();
+
+    // a listing some other tab has open is complete right away
+    if (Source->IsComplete())
+    {
+      emit ListingChanged();
+      MeasureDirsAutomatically(Order);
+    }
+    emit LoadingChanged(Source->IsLoading());
+    emit PollingChanged();
+    emit SelectionChanged();
   }
 
-  void DirModel::OnDirectoryChanged()
+  void DirModel::Hibernate()
   {
-    qDebug() << "Directory change notification " << RootDir.absolutePath();
-    RootDir.refresh();
-    emit dataChanged(QModelIndex(), QModelIndex());
+    if (IsHibernating())
+    {
+      return;
+    }
+    disconnect(Source, 0, this, 0);
+    ListingCache::Instance().Release(Source);
+    Source = nullptr;
+
+    for (int entry: Selection.GetRows())
+    {
+      HibernatedSelection.append(Entries.GetFileName(entry));
+    }
+    Selection = RowSelection();
+
+    // assigned rather than cleared, so the memory goes as well
+    beginResetModel();
+    Entries = EntryTable();
+    Order = QVector<int>();
+    RowOfEntry = QVector<int>();
+    FilteredRows = QVector<int>();
+    FilterHistory.clear();
+    endResetModel();
+  }
+
+  void DirModel::Wake()
+  {
+    if (IsHibernating())
+    {
+      Attach(true);
+    }
+  }
+
+  bool DirModel::IsHibernating() const
+  {
+    return Source == nullptr;
+  }
+
+  bool DirModel::IsLoading() const
+  {
+    return Source && Source->IsLoading();
+  }
+
+  bool DirModel::IsPolling() const
+  {
+    return Source && Source->IsPolling();
+  }
+
+  int DirModel::GetSuppressedChanges() const
+  {
+    return Source ? Source->GetSuppressedChanges() : 0;
+  }
+
+  void DirModel::OnChunkLoaded(const EntryTable& chunk)
+  {
+    // rows arrive in listing order and go to the end, they are sorted when the listing is complete
+    const int first = Entries.Size();
+    Entries.Append(chunk);
+    QVector<int> added;
+    for (int entry = first; entry < Entries.Size(); ++entry)
+    {
+      if (!QuickFilter.isEmpty())
+      {
+        Order.append(entry);
+      }
+      if (MatchesFilter(entry))
+      {
+        added.append(entry);
+      }
+    }
+    FilterHistory.clear();
+    RowOfEntry.resize(Entries.Size());
+    std::fill(RowOfEntry.begin() + first, RowOfEntry.end(), -1);
+    if (added.empty())
+    {
+      return;
+    }
+    const int row = rowCount();
+    beginInsertRows(QModelIndex(), row, row + added.size() - 1);
+    (QuickFilter.isEmpty() ? Order : FilteredRows) += added;
+    for (int i = 0; i < added.size(); ++i)
+    {
+      RowOfEntry[added[i]] = row + i;
+    }
+    endInsertRows();
+  }
+
+  void DirModel::OnListingLoaded()
+  {
+    QModelIndexList persistent;
+    QStringList names;
+    BeginRelayout(persistent, names);
+    // same rows in the same order, but now shared with the listing instead of a copy
+    Entries = Source->GetEntries();
+    Order = GetSortOrder(Entries, SortColumn, SortDirection);
+    EndRelayout(persistent, names);
+    emit ListingChanged();
+    MeasureDirsAutomatically(Order);
+    if (!HibernatedSelection.isEmpty())
+    {
+      RestoreSelection();
+      SetSelection(Selection);
+    }
+  }
+
+  void DirModel::OnListingUpdated(const EntryTable& previous, const ListingDiff& diff)
+  {
+    Q_ASSERT(previous.Size() == Entries.Size());
+    FilterHistory.clear();
+
+    // gone and changed entries are removed first, in contiguous blocks from the bottom
+    QVector<int>& visible = QuickFilter.isEmpty() ? Order : FilteredRows;
+    for (int row = visible.size() - 1; row >= 0; --row)
+    {
+      if (diff.PreviousToCurrent[visible[row]] != -1)
+      {
+        continue;
+      }
+      int first = row;
+      while (first > 0 && diff.PreviousToCurrent[visible[first - 1]] == -1)
+      {
+        --first;
+      }
+      beginRemoveRows(QModelIndex(), first, row);
+      visible.remove(first, row - first + 1);
+      endRemoveRows();
+      row = first;
+    }
+    if (!QuickFilter.isEmpty())
+    {
+      Order.erase(std::remove_if(Order.begin(), Order.end(), [&diff](int entry) { return diff.PreviousToCurrent[entry] == -1; }), Order.end());
+    }
+
+    // rows that stay only get their numbers in the new table, nothing to signal
+    for (int& entry: Order)
+    {
+      entry = diff.PreviousToCurrent[entry];
+    }
+    for (int& entry: FilteredRows)
+    {
+      entry = diff.PreviousToCurrent[entry];
+    }
+    Entries = Source->GetEntries();
+    UpdateRowIndex();
+
+    // changed entries are new rows of the table, they stay selected by name
+    if (!Selection.IsEmpty())
+    {
+      QVector<int> selected;
+      for (int entry: Selection.GetRows())
+      {
+        const int current = diff.PreviousToCurrent[entry];
+        const int found = current != -1 ? current : Entries.Find(previous.GetFileName(entry));
+        if (found != -1)
+        {
+          selected.append(found);
+        }
+      }
+      std::sort(selected.begin(), selected.end());
+      SetSelection(RowSelection::FromSortedRows(selected));
+    }
+
+    // new and changed entries go to their places in the current order
+    InsertSorted(diff.Added);
+    MeasureDirsAutomatically(diff.Added);
+  }
+
+  void DirModel::OnMetadataChanged()
+  {
+    // rows keep their places until all metadata is there, sorting by size or mtime would make them jump
+    Entries = Source->GetEntries();
+    if (rowCount())
+    {
+      emit dataChanged(index(0, 0), index(rowCount() - 1, COL_COUNT - 1));
+    }
+  }
+
+  void DirModel::OnMetadataLoaded()
+  {
+    QModelIndexList persistent;
+    QStringList names;
+    BeginRelayout(persistent, names);
+    Order = GetSortOrder(Entries, SortColumn, SortDirection);
+    EndRelayout(persistent, names);
+  }
+
+  void DirModel::PrioritizeRows(int first, int last)
+  {
+    if (!Source || first < 0 || last < first)
+    {
+      return;
+    }
+    const int page = last - first + 1;
+    const int count = rowCount();
+    QVector<int> entries;
+    const auto addRows = [this, &entries](int from, int to)
+    {
+      for (int row = from; row < to; ++row)
+      {
+        const int entry = ToEntry(row);
+        if (Entries.IsPending(entry))
+        {
+          entries.append(entry);
+        }
+      }
+    };
+    addRows(first, qMin(last + 1, count));
+    addRows(qMin(last + 1, count), qMin(last + 1 + page, count));
+    addRows(qMax(first - page, 0), first);
+    Source->PrioritizeMetadata(entries);
+  }
+
+  void DirModel::MeasureDirs(const QModelIndexList& indexes)
+  {
+    foreach(const QModelIndex& item, indexes)
+    {
+      const int entry = item.isValid() && item.row() < rowCount() ? ToEntry(item.row()) : -1;
+      if (entry != -1 && Entries.IsDir(entry) && Entries.GetFileName(entry) != "..")
+      {
+        FolderSizes::Instance().Request(RootDir.absoluteFilePath(Entries.GetFileName(entry)), false);
+      }
+    }
+  }
+
+  void DirModel::MeasureSelectedDirs()
+  {
+    // the marks are entries, not rows of the view
+    for (int entry: Selection.GetRows())
+    {
+      if (Entries.IsDir(entry) && Entries.GetFileName(entry) != "..")
+      {
+        FolderSizes::Instance().Request(RootDir.absoluteFilePath(Entries.GetFileName(entry)), false);
+      }
+    }
+  }
+
+  void DirModel::MeasureDirsAutomatically(const QVector<int>& entries)
+  {
+    if (!Settings::LoadAutoFolderSizes())
+    {
+      return;
+    }
+    // subtrees measured before are checked by directory mtimes, which is cheap
+    foreach(int entry, entries)
+    {
+      if (Entries.IsDir(entry) && Entries.GetFileName(entry) != "..")
+      {
+        FolderSizes::Instance().Request(RootDir.absoluteFilePath(Entries.GetFileName(entry)), true);
+      }
+    }
+  }
+
+  QString DirModel::GetFolderSizeText(int entry) const
+  {
+    return Entries.GetFileName(entry) == ".."
+      ? QString()
+      : FolderSizes::Instance().GetSizeText(RootDir.absoluteFilePath(Entries.GetFileName(entry)));
+  }
+
+  void DirModel::SetThumbnails(bool thumbnails)
+  {
+    if (thumbnails == Thumbnails)
+    {
+      return;
+    }
+    Thumbnails = thumbnails;
+    // the cache opens its file on first use, tabs never switched to the grid don't touch it
+    if (Thumbnails)
+    {
+      connect(&ThumbnailCache::Instance(), SIGNAL(ThumbnailsReady()), SLOT(OnThumbnailsReady()), Qt::UniqueConnection);
+    }
+    if (rowCount())
+    {
+      emit dataChanged(index(0, COL_NAME), index(rowCount() - 1, COL_NAME), QVector<int>() << Qt::DisplayRole << Qt::DecorationRole);
+    }
+  }
+
+  QVariant DirModel::GetThumbnail(int entry) const
+  {
+    // the key needs size and mtime, pending rows get theirs later and are signalled then
+    const QString& fileName = Entries.GetFileName(entry);
+    ThumbnailCache& cache = ThumbnailCache::Instance();
+    if (Entries.IsDir(entry) || Entries.IsPending(entry) || !cache.IsImage(fileName))
+    {
+      return QVariant();
+    }
+    const QPixmap thumbnail = cache.GetThumbnail(
+      RootDir.absoluteFilePath(fileName), Entries.GetSize(entry), Entries.GetModified(entry)
+    );
+    return thumbnail.isNull() ? QVariant() : QVariant(thumbnail);
+  }
+
+  void DirModel::SelectAll()
+  {
+    SetSelection(RowSelection::Combine(Selection, GetSelectableEntries(), RowSelection::UNION));
+  }
+
+  void DirModel::DeselectAll()
+  {
+    SetSelection(RowSelection::Combine(Selection, GetSelectableEntries(), RowSelection::DIFFERENCE));
+  }
+
+  void DirModel::InvertSelection()
+  {
+    SetSelection(RowSelection::Combine(Selection, GetSelectableEntries(), RowSelection::SYMMETRIC_DIFFERENCE));
+  }
+
+  void DirModel::SelectByMask(const QString& masks)
+  {
+    QList<QRegExp> patterns;
+    for (const QString& mask: masks.split(QRegExp("[;\\s]+"), QString::SkipEmptyParts))
+    {
+      patterns << QRegExp(mask, Qt::CaseInsensitive, QRegExp::Wildcard);
+    }
+    QVector<int> matching;
+    for (int entry: GetSelectableEntries().GetRows())
+    {
+      for (const QRegExp& pattern: patterns)
+      {
+        if (pattern.exactMatch(Entries.GetFileName(entry)))
+        {
+          matching.append(entry);
+          break;
+        }
+      }
+    }
+    SetSelection(RowSelection::Combine(Selection, RowSelection::FromSortedRows(matching), RowSelection::UNION));
+  }
+
+  void DirModel::ToggleSelection(const QModelIndex& index)
+  {
+    const int entry = index.isValid() ? ToEntry(index.row()) : -1;
+    if (entry == -1 || Entries.GetFileName(entry) == "..")
+    {
+      return;
+    }
+    SetSelection(RowSelection::Combine(Selection, RowSelection(entry, entry + 1), RowSelection::SYMMETRIC_DIFFERENCE));
+  }
+
+  int DirModel::GetSelectedCount() const
+  {
+    return Selection.Count();
+  }
+
+  QStringList DirModel::GetSelectedPaths() const
+  {
+    QStringList result;
+    result.reserve(Selection.Count());
+    for (int entry: Selection.GetRows())
+    {
+      result << RootDir.absoluteFilePath(Entries.GetFileName(entry));
+    }
+    return result;
+  }
+
+  RowSelection DirModel::GetSelectableEntries() const
+  {
+    RowSelection result(0, Entries.Size());
+    if (!QuickFilter.isEmpty())
+    {
+      QVector<int> shown = FilteredRows;
+      std::sort(shown.begin(), shown.end());
+      result = RowSelection::FromSortedRows(shown);
+    }
+    const int parent = Entries.Find("..");
+    if (parent != -1)
+    {
+      result = RowSelection::Combine(result, RowSelection(parent, parent + 1), RowSelection::DIFFERENCE);
+    }
+    return result;
+  }
+
+  void DirModel::SetSelection(const RowSelection& selection)
+  {
+    Selection = selection;
+    if (rowCount())
+    {
+      emit dataChanged(index(0, 0), index(rowCount() - 1, COL_COUNT - 1), QVector<int>() << Qt::ForegroundRole);
+    }
+    emit SelectionChanged();
+  }
+
+  void DirModel::RestoreSelection()
+  {
+    // names that are not in the listing yet are tried again once it is complete
+    if (HibernatedSelection.isEmpty() || !Source->IsComplete())
+    {
+      return;
+    }
+    QVector<int> selected;
+    for (const QString& name: HibernatedSelection)
+    {
+      const int entry = Entries.Find(name);
+      if (entry != -1)
+      {
+        selected.append(entry);
+      }
+    }
+    HibernatedSelection.clear();
+    std::sort(selected.begin(), selected.end());
+    Selection = RowSelection::FromSortedRows(selected);
+  }
+
+  void DirModel::InsertSorted(const QVector<int>& added)
+  {
+    if (added.empty())
+    {
+      return;
+    }
+    const RowLess less(Entries, SortColumn, SortDirection);
+    QVector<int> sorted = added;
+    std::sort(sorted.begin(), sorted.end(), less);
+    if (sorted.size() > MAX_SINGLE_INSERTS)
+    {
+      QModelIndexList persistent;
+      QStringList names;
+      BeginRelayout(persistent, names);
+      QVector<int> merged;
+      merged.reserve(Order.size() + sorted.size());
+      std::merge(Order.begin(), Order.end(), sorted.begin(), sorted.end(), std::back_inserter(merged), less);
+      Order.swap(merged);
+      EndRelayout(persistent, names);
+      return;
+    }
+    for (int entry: sorted)
+    {
+      if (!QuickFilter.isEmpty())
+      {
+        Order.insert(std::upper_bound(Order.begin(), Order.end(), entry, less), entry);
+        if (!MatchesFilter(entry))
+        {
+          continue;
+        }
+      }
+      QVector<int>& visible = QuickFilter.isEmpty() ? Order : FilteredRows;
+      const int row = std::upper_bound(visible.begin(), visible.end(), entry, less) - visible.begin();
+      beginInsertRows(QModelIndex(), row, row);
+      visible.insert(row, entry);
+      endInsertRows();
+    }
+    UpdateRowIndex();
+  }
+
+  void DirModel::SetQuickFilter(const QString& text)
+  {
+    if (text == QuickFilter)
+    {
+      return;
+    }
+    beginResetModel();
+    // matches of shorter texts are kept, so deleting characters is as cheap as typing them
+    if (!QuickFilter.isEmpty() && text.contains(QuickFilter, Qt::CaseInsensitive))
+    {
+      FilterHistory.append(qMakePair(QuickFilter, FilteredRows));
+    }
+    while (!FilterHistory.isEmpty() && !text.contains(FilterHistory.last().first, Qt::CaseInsensitive))
+    {
+      FilterHistory.removeLast();
+    }
+    QuickFilter = text;
+    if (FilterHistory.isEmpty())
+    {
+      UpdateFilteredRows();
+    }
+    else if (FilterHistory.last().first.compare(text, Qt::CaseInsensitive) == 0)
+    {
+      FilteredRows = FilterHistory.takeLast().second;
+    }
+    else
+    {
+      // anything matching the longer text matched the shorter one, only its matches are checked
+      FilteredRows.clear();
+      foreach(int entry, FilterHistory.last().second)
+      {
+        if (MatchesFilter(entry))
+        {
+          FilteredRows.append(entry);
+        }
+      }
+    }
+    UpdateRowIndex();
+    endResetModel();
+  }
+
+  QString DirModel::GetQuickFilter() const
+  {
+    return QuickFilter;
+  }
+
+  bool DirModel::MatchesFilter(int entry) const
+  {
+    return QuickFilter.isEmpty() || Entries.GetFileName(entry).contains(QuickFilter, Qt::CaseInsensitive);
+  }
+
+  void DirModel::UpdateFilteredRows()
+  {
+    FilteredRows.clear();
+    FilterHistory.clear();
+    if (QuickFilter.isEmpty())
+    {
+      return;
+    }
+    foreach(int entry, Order)
+    {
+      if (MatchesFilter(entry))
+      {
+        FilteredRows.append(entry);
+      }
+    }
+  }
+
+  void DirModel::UpdateRowIndex()
+  {
+    RowOfEntry.fill(-1, Entries.Size());
+    const QVector<int>& visible = GetVisibleRows();
+    for (int row = 0; row < visible.size(); ++row)
+    {
+      RowOfEntry[visible[row]] = row;
+    }
+  }
+
+  const QVector<int>& DirModel::GetVisibleRows() const
+  {
+    return QuickFilter.isEmpty() ? Order : FilteredRows;
+  }
+
+  int DirModel::ToEntry(int row) const
+  {
+    return GetVisibleRows()[row];
+  }
+
+  int DirModel::FromEntry(int entry) const
+  {
+    return entry < 0 || entry >= RowOfEntry.size() ? -1 : RowOfEntry[entry];
+  }
+
+  void DirModel::sort(int column, Qt::SortOrder order)
+  {
+    // rows that are still loading are sorted when the listing is complete
+    SortColumn = column;
+    SortDirection = order;
+    QModelIndexList persistent;
+    QStringList names;
+    BeginRelayout(persistent, names);
+    Order = GetSortOrder(Entries, SortColumn, SortDirection);
+    EndRelayout(persistent, names);
+  }
+
+  void DirModel::BeginRelayout(QModelIndexList& persistent, QStringList& names)
+  {
+    // rows move when the listing is sorted or replaced, persistent indexes (selection, current item) follow their names
+    emit layoutAboutToBeChanged();
+    persistent = persistentIndexList();
+    foreach(const QModelIndex& item, persistent)
+    {
+      names << (item.row() < rowCount() ? Entries.GetFileName(ToEntry(item.row())) : QString());
+    }
+  }
+
+  void DirModel::EndRelayout(const QModelIndexList& persistent, const QStringList& names)
+  {
+    UpdateFilteredRows();
+    UpdateRowIndex();
+    QModelIndexList moved;
+    for (int i = 0; i < persistent.size(); ++i)
+    {
+      const int row = FromEntry(Entries.Find(names[i]));
+      moved << (row == -1 ? QModelIndex() : index(row, persistent[i].column()));
+    }
+    changePersistentIndexList(persistent, moved);
     emit layoutChanged();
   }
 
+  void DirModel::OnIconsReady()
+  {
+    // views repaint only the visible part of the range
+    if (rowCount())
+    {
+      emit dataChanged(index(0, COL_NAME), index(rowCount() - 1, COL_NAME), QVector<int>() << Qt::DecorationRole);
+    }
+  }
+
+  void DirModel::OnFolderSizesReady()
+  {
+    if (rowCount())
+    {
+      emit dataChanged(index(0, COL_SIZE), index(rowCount() - 1, COL_SIZE), QVector<int>() << Qt::DisplayRole << Qt::TextAlignmentRole);
+    }
+  }
+
+  void DirModel::OnThumbnailsReady()
+  {
+    if (Thumbnails && rowCount())
+    {
+      emit dataChanged(index(0, COL_NAME), index(rowCount() - 1, COL_NAME), QVector<int>() << Qt::DecorationRole);
+    }
+  }
+
   QDir DirModel::GetRoot() const
   {
     return RootDir;
@@ -117,16 +801,25 @@ namespace TotalFinder
 
   QFileInfo DirModel::GetItem(const QModelIndex& index) const
   {
-    if (!index.isValid())
+    if (!index.isValid() || index.row() >= rowCount())
     {
       return QFileInfo();
     }
-    return RootDir.entryInfoList()[index.row()];
+    return QFileInfo(RootDir, Entries.GetFileName(ToEntry(index.row())));
+  }
+
+  bool DirModel::IsDir(const QModelIndex& index) const
+  {
+    if (!index.isValid() || index.row() >= rowCount())
+    {
+      return false;
+    }
+    return Entries.IsDir(ToEntry(index.row()));
   }
 
   QModelIndex DirModel::GetIndex(const QFileInfo& file) const
   {
-    const int indexRow = RootDir.entryList().indexOf(file.fileName());
+    const int indexRow = FromEntry(Entries.Find(file.fileName()));
     if (indexRow == -1 && !IsParentDir(RootDir, file))
     {
       return QModelIndex();
@@ -140,57 +833,79 @@ namespace TotalFinder
     {
       return QModelIndex();
     }
-    return index(RootDir.entryList().indexOf(dir.dirName()), 0);
+    return index(FromEntry(Entries.Find(dir.dirName())), 0);
   }
 
   QModelIndexList DirModel::Search(const QString& search) const
   {
-    QStringList nameFilters;
-    nameFilters << search;
+    // same matching as QDir name filters, but over the loaded listing
+    const QRegExp mask(search, Qt::CaseInsensitive, QRegExp::Wildcard);
     QModelIndexList result;
-    foreach(const QFileInfo& entry, RootDir.entryInfoList(nameFilters))
+    for (int row = 0; row < rowCount(); ++row)
     {
-      result << GetIndex(entry);
+      if (mask.exactMatch(Entries.GetFileName(ToEntry(row))))
+      {
+        result << index(row, 0);
+      }
     }
     return result;
   }
 
   QVariant DirModel::data(const QModelIndex& index, int role) const
   {
-    if (!index.isValid() || RootDir.path().isEmpty())
+    if (!index.isValid() || index.row() >= rowCount())
     {
       return QVariant();
     }
-    const QFileInfo currentItem = RootDir.entryInfoList()[index.row()];
+    const int row = ToEntry(index.row());
 
     if (role == Qt::DisplayRole)
     {
       switch (index.column())
       {
         case COL_NAME:
-          return GetNameAndExtension(currentItem).first;
+          return Thumbnails ? Entries.GetFileName(row) : Entries.GetName(row);
         case COL_EXT:
-          return GetNameAndExtension(currentItem).second;
+          return Entries.GetExtension(row);
         case COL_SIZE:
-          return currentItem.isDir() ? "--" : FormatSize(currentItem.size());
+          if (Entries.IsDir(row))
+          {
+            const QString folderSize = GetFolderSizeText(row);
+            return folderSize.isEmpty() ? Entries.GetSizeText(row) : folderSize;
+          }
+          return Entries.GetSizeText(row);
         case COL_MTIME:
-          return currentItem.lastModified();
+          return Entries.GetModifiedText(row);
         case COL_PERMISSIONS:
-          return DecodePermissions(currentItem.permissions(), currentItem.isDir());
+          return Entries.GetPermissionsText(row);
       }
       return QVariant();
     }
-    if (role == Qt::DecorationRole && index.column() == 0)
+    if (role == Qt::DecorationRole && index.column() == COL_NAME)
+    {
+      if (Thumbnails)
+      {
+        const QVariant thumbnail = GetThumbnail(row);
+        if (thumbnail.isValid())
+        {
+          return thumbnail;
+        }
+      }
+      return IconCache::Instance().GetIcon(RootDir, Entries.GetFileName(row), Entries.GetFlags(row));
+    }
+    if (role == Qt::ForegroundRole && Selection.Contains(row))
     {
-      QFileIconProvider icons;
-      return icons.icon(currentItem);
+      return QColor(Qt::red);
     }
     if (role == Qt::TextAlignmentRole)
     {
       switch (index.column())
       {
         case COL_SIZE:
-          return static_cast<int>(Qt::AlignVCenter | (currentItem.isDir() ? Qt::AlignLeft : Qt::AlignRight));
+          // calculated folder sizes line up with file sizes
+          return static_cast<int>(
+            Qt::AlignVCenter | (Entries.IsDir(row) && GetFolderSizeText(row).isEmpty() ? Qt::AlignLeft : Qt::AlignRight)
+          );
       }
       return QVariant();
     }
@@ -220,7 +935,7 @@ namespace TotalFinder
 
   int DirModel::rowCount(const QModelIndex& /*parent*/) const
   {
-    return RootDir.entryList().size();
+    return GetVisibleRows().size();
   }
 
   int DirModel::columnCount(const QModelIndex& /*parent*/) const
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "entry_table.h"
+#include "listing_cache.h"
+#include "row_selection.h"
+
 #include <QAbstractTableModel>
-#include <QFileSystemWatcher>
 #include <QDir>
 
 namespace TotalFinder
@@ -11,23 +14,102 @@ namespace TotalFinder
     Q_OBJECT
   public:
     DirModel(QObject* parent);
+    ~DirModel() override;
     void SetRoot(const QDir& dir);
     QDir GetRoot() const;
     QFileInfo GetItem(const QModelIndex& index) const;
+    // from the listing, without a stat; symlinks count once their metadata is read
+    bool IsDir(const QModelIndex& index) const;
     QModelIndex GetIndex(const QFileInfo& info) const;
     QModelIndex GetIndex(const QDir& dir) const;
     QModelIndexList Search(const QString& search) const;
+    bool IsLoading() const;
+    // releases the listing and every row, keeping only the root and the quick filter
+    void Hibernate();
+    // gets the listing back, rows are signalled the same way as after SetRoot
+    void Wake();
+    bool IsHibernating() const;
+    // see Listing::IsPolling
+    bool IsPolling() const;
+    int GetSuppressedChanges() const;
+    // rows shown in the view get their size, mtime and permissions first, then a page below and one above
+    void PrioritizeRows(int first, int last);
+    // recursive sizes of the directories among the rows are shown in the Size column once calculated
+    void MeasureDirs(const QModelIndexList& indexes);
+    void MeasureSelectedDirs();
+    // images show their thumbnails instead of icons and names keep their extensions, for the grid view
+    void SetThumbnails(bool thumbnails);
+    // rows marked for batch operations, apart from the current row of the view. Kept by entry, so sorting
+    // and filtering leave them as they are; only rows passing the quick filter are marked or unmarked
+    void SelectAll();
+    void DeselectAll();
+    void InvertSelection();
+    // masks separated by ';' or spaces, with shell wildcards, case insensitive
+    void SelectByMask(const QString& masks);
+    void ToggleSelection(const QModelIndex& index);
+    int GetSelectedCount() const;
+    QStringList GetSelectedPaths() const;
+    // only rows with names containing the text are shown, case insensitive; empty text shows all
+    void SetQuickFilter(const QString& text);
+    QString GetQuickFilter() const;
 
     virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
     virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
     virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
     virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+    // in memory, by any column with natural order of numbers in names; directories stay on top
+    virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+  signals:
+    // rows keep arriving while loading, they are sorted once the listing is complete
+    void LoadingChanged(bool loading);
+    // rows have been replaced or reordered as a whole; views restore their selection
+    void ListingChanged();
+    void PollingChanged();
+    void SelectionChanged();
   private slots:
     void OnSettingsChange();
-    void OnDirectoryChanged();
+    void OnChunkLoaded(const EntryTable& chunk);
+    void OnListingLoaded();
+    void OnListingUpdated(const EntryTable& previous, const ListingDiff& diff);
+    void OnMetadataChanged();
+    void OnMetadataLoaded();
+    void OnIconsReady();
+    void OnFolderSizesReady();
+    void OnThumbnailsReady();
   private:
+    void Attach(bool keepFilter);
+    void BeginRelayout(QModelIndexList& persistent, QStringList& names);
+    void EndRelayout(const QModelIndexList& persistent, const QStringList& names);
+    void InsertSorted(const QVector<int>& added);
+    void UpdateFilteredRows();
+    void UpdateRowIndex();
+    bool MatchesFilter(int entry) const;
+    // with automatic folder sizes on, see Settings::LoadAutoFolderSizes
+    void MeasureDirsAutomatically(const QVector<int>& entries);
+    QString GetFolderSizeText(int entry) const;
+    // entries shown, without ".."
+    RowSelection GetSelectableEntries() const;
+    void SetSelection(const RowSelection& selection);
+    void RestoreSelection();
+    QVariant GetThumbnail(int entry) const;
+    const QVector<int>& GetVisibleRows() const;
+    // model rows and entry table rows differ: the table is in listing order and shared with other models
+    int ToEntry(int row) const;
+    int FromEntry(int entry) const;
+
     QDir RootDir;
-    QFileSystemWatcher *FileWatcher;
+    Listing* Source;
+    EntryTable Entries;
+    QVector<int> Order; // entry rows in display order
+    QVector<int> RowOfEntry; // visible row of every entry, -1 if filtered out
+    int SortColumn;
+    Qt::SortOrder SortDirection;
+    bool Thumbnails;
+    QString QuickFilter;
+    QVector<int> FilteredRows; // entry rows shown while filtering, in display order
+    QList<QPair<QString, QVector<int> > > FilterHistory; // shorter texts the current one refines
+    RowSelection Selection; // entry rows
+    QStringList HibernatedSelection; // names of the selected entries, selected again once the listing is back
   };
 
   bool IsParentDir(const QDir& parent, const QDir& child);
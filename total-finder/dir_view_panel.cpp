@@ -6,17 +6,25 @@
 #include "edit_file.h"
 #include "event_filters.h"
 #include "find_in_files.h"
+#include "fs_access.h"
 #include "settings.h"
 #include "shell_utils.h"
+#include "thumbnail_cache.h"
 
 #include <common/filesystem.h>
 
 #include <QDebug>
 #include <QDesktopServices>
+#include <QHeaderView>
+#include <QInputDialog>
 #include <QMenu>
+#include <QMessageBox>
 #include <QProcess>
+#include <QScrollBar>
+#include <QSignalBlocker>
 #include <QUrl>
 
+#include <cerrno>
 #include <functional>
 
 namespace TotalFinder
@@ -31,15 +39,10 @@ namespace TotalFinder
       qApp->postEvent(widget, releaseEvent);
     }
 
-    void EnsureFileExists(const QString& filePath)
-    {
-      QFile f(filePath);
-      if (!f.exists())
-      {
-        f.open(QIODevice::ReadWrite);
-        f.close();
-      }
-    }
+    const int LOADING_INDICATOR_DELAY_MILLISECONDS = 300;
+    const int THUMBNAIL_SPACING = 12;
+    const int THUMBNAIL_TEXT_LINES = 2;
+    const int MILLISECONDS_PER_SECOND = 1000;
   } // namespace
 
 #include "dir_view_panel.moc"
@@ -47,39 +50,102 @@ namespace TotalFinder
   DirViewPanel::DirViewPanel(const TabContext& context, QWidget* parent)
     : BasePanel(parent)
     , Model(new DirModel(this))
+    , ViewportChangeDelay(new QTimer(this))
+    , LoadingIndicatorDelay(new QTimer(this))
+    , HibernationDelay(new QTimer(this))
+    , RestoreScrollPosition(-1)
+    , ShowsPollingStatus(false)
+    , ShowsSelectionStatus(false)
+    , ShowsMountStatus(false)
+    , ThumbnailMode(false)
     , CurrentRow(0)
     , Context(context)
   {
     Ui = new Ui_DirViewPanel();
     Ui->setupUi(this);
     Ui->SearchEdit->hide();
+    Ui->LoadingIndicator->hide();
+    Ui->ThumbnailView->hide();
+
+    // typing in the list opens the quick filter, navigation keys typed there still move in the list
+    KeyPressFilter* quickFilterKeys = new KeyPressFilter(this);
+    quickFilterKeys->InterceptKey(Qt::Key_Up);
+    quickFilterKeys->InterceptKey(Qt::Key_Down);
+    quickFilterKeys->InterceptKey(Qt::Key_PageUp);
+    quickFilterKeys->InterceptKey(Qt::Key_PageDown);
+    quickFilterKeys->InterceptKey(Qt::Key_Return);
+    quickFilterKeys->InterceptKey(Qt::Key_Escape);
+    connect(quickFilterKeys, SIGNAL(KeyPressed(QKeyEvent)), SLOT(OnQuickFilterKey(QKeyEvent)));
+    Ui->SearchEdit->installEventFilter(quickFilterKeys);
+    connect(Ui->SearchEdit, SIGNAL(textChanged(const QString&)), SLOT(OnQuickFilterChanged(const QString&)));
+
+    LoadingIndicatorDelay->setSingleShot(true);
+    LoadingIndicatorDelay->setInterval(LOADING_INDICATOR_DELAY_MILLISECONDS);
+    connect(LoadingIndicatorDelay, SIGNAL(timeout()), SLOT(OnShowLoadingIndicator()));
+    connect(Model, SIGNAL(LoadingChanged(bool)), SLOT(OnLoadingChanged(bool)));
+    connect(Model, SIGNAL(PollingChanged()), SLOT(OnPollingChanged()));
+    connect(Model, SIGNAL(SelectionChanged()), SLOT(OnSelectionCountChanged()));
+    connect(&FsAccess::Instance(), SIGNAL(MountStateChanged(const QString&, bool)), SLOT(OnMountStateChanged()));
+
+    HibernationDelay->setSingleShot(true);
+    connect(HibernationDelay, SIGNAL(timeout()), SLOT(OnHibernate()));
 
     // TODO: move in settings
     setFont(QFont("Menlo Regular", 11));
 
     Model->SetRoot(QDir("/"));
     Ui->DirView->setModel(Model);
-    connect(Model, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)), this, SLOT(OnDirModelChange()));
+    connect(Model, SIGNAL(ListingChanged()), SLOT(OnDirModelChange()));
     connect(
       Ui->DirView->selectionModel(),
       SIGNAL(currentChanged(const QModelIndex, const QModelIndex&)),
       SLOT(OnSelectionChanged(const QModelIndex&, const QModelIndex&))
     );
-
-    connect(Ui->DirView->horizontalHeader(), SIGNAL(sectionResized(int, int, int)), SLOT(OnHeaderGeometryChanged()));
-    Ui->DirView->horizontalHeader()->restoreState(Settings::LoadViewHeaderState());
-
-    Ui->DirView->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(Ui->DirView, SIGNAL(customContextMenuRequested(const QPoint&)), SLOT(OnShowViewContextMenu(const QPoint&)));
+    // both views show the same rows with the same current one, only one of them is visible
+    Ui->ThumbnailView->setModel(Model);
+    Ui->ThumbnailView->setSelectionModel(Ui->DirView->selectionModel());
+    const QList<QAbstractItemView*> views = QList<QAbstractItemView*>() << Ui->DirView << Ui->ThumbnailView;
+
+    QHeaderView* header = Ui->DirView->horizontalHeader();
+    header->restoreState(Settings::LoadViewHeaderState());
+    if (!header->isSortIndicatorShown())
+    {
+      // nothing saved since sorting by header has been introduced
+      header->setSortIndicator(0, Qt::AscendingOrder);
+    }
+    // model sorts in memory, clicking a header never rereads the directory
+    Ui->DirView->setSortingEnabled(true);
+    connect(header, SIGNAL(sectionResized(int, int, int)), SLOT(OnHeaderGeometryChanged()));
+    connect(header, SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), SLOT(OnHeaderGeometryChanged()));
+
+    ViewportChangeDelay->setSingleShot(true);
+    ViewportChangeDelay->setInterval(0);
+    connect(ViewportChangeDelay, SIGNAL(timeout()), SLOT(OnViewportChanged()));
+    for (QAbstractItemView* view: views)
+    {
+      QScrollBar* scrollBar = view->verticalScrollBar();
+      connect(scrollBar, SIGNAL(valueChanged(int)), ViewportChangeDelay, SLOT(start()));
+      connect(scrollBar, SIGNAL(rangeChanged(int, int)), ViewportChangeDelay, SLOT(start()));
+    }
+    connect(Model, SIGNAL(layoutChanged()), ViewportChangeDelay, SLOT(start()));
+    connect(Model, SIGNAL(modelReset()), ViewportChangeDelay, SLOT(start()));
+    connect(Model, SIGNAL(LoadingChanged(bool)), ViewportChangeDelay, SLOT(start()));
 
     FocusFilter* focusDetector = new FocusFilter(this);
     connect(focusDetector, SIGNAL(GotFocusEvent(QFocusEvent)), SLOT(OnFocusEvent(QFocusEvent)));
-    Ui->DirView->installEventFilter(focusDetector);
-
-    connect(Ui->DirView, SIGNAL(activated(const QModelIndex&)), SLOT(OnItemActivated(const QModelIndex&)));
+    for (QAbstractItemView* view: views)
+    {
+      view->setContextMenuPolicy(Qt::CustomContextMenu);
+      connect(view, SIGNAL(customContextMenuRequested(const QPoint&)), SLOT(OnShowViewContextMenu(const QPoint&)));
+      view->installEventFilter(focusDetector);
+      connect(view, SIGNAL(activated(const QModelIndex&)), SLOT(OnItemActivated(const QModelIndex&)));
+    }
     connect(Ui->AddressBar, SIGNAL(returnPressed()), SLOT(OnAddressBarEnter()));
 
-    BasePanel::InstallKeyEventFilter(QWidgetList() << Ui->DirView << Ui->AddressBar);
+    BasePanel::InstallKeyEventFilter(QWidgetList() << Ui->DirView << Ui->ThumbnailView << Ui->AddressBar);
+
+    // restored tabs behind the current one are never shown, so never hidden either
+    StartHibernationDelay();
   }
 
   QString DirViewPanel::GetName() const
@@ -101,7 +167,7 @@ namespace TotalFinder
     QAction* openTerminalAction = menu.addAction("Open Terminal");
     connect(openTerminalAction, SIGNAL(triggered(bool)), SLOT(OnOpenTerminal()));
 
-    menu.exec(Ui->DirView->viewport()->mapToGlobal(point));
+    menu.exec(GetView()->viewport()->mapToGlobal(point));
   }
 
   void DirViewPanel::OnRevealInFinder()
@@ -129,7 +195,7 @@ namespace TotalFinder
     if (!currentIndex.isValid())
     {
       currentIndex = Model->index(0, 0);
-      if (Model->rowCount() >= CurrentRow)
+      if (CurrentRow > 0 && Model->rowCount() >= CurrentRow)
       {
         // case when item has been deleted
         currentIndex = Model->index(CurrentRow - 1, 0);
@@ -142,6 +208,200 @@ namespace TotalFinder
 
     CurrentRow = currentIndex.row();
     CurrentSelection = Model->GetItem(currentIndex);
+
+    if (RestoreScrollPosition != -1)
+    {
+      GetView()->verticalScrollBar()->setValue(RestoreScrollPosition);
+      RestoreScrollPosition = -1;
+    }
+  }
+
+  void DirViewPanel::OnLoadingChanged(bool loading)
+  {
+    if (loading)
+    {
+      LoadingIndicatorDelay->start();
+      return;
+    }
+    LoadingIndicatorDelay->stop();
+    Ui->LoadingIndicator->hide();
+    // selection has been restored by OnDirModelChange once rows got their final order
+    GetView()->scrollTo(GetView()->selectionModel()->currentIndex());
+  }
+
+  void DirViewPanel::OnShowLoadingIndicator()
+  {
+    if (Model->IsLoading())
+    {
+      Ui->LoadingIndicator->show();
+    }
+  }
+
+  void DirViewPanel::showEvent(QShowEvent* event)
+  {
+    BasePanel::showEvent(event);
+    if (event->spontaneous())
+    {
+      return;
+    }
+    HibernationDelay->stop();
+    // selection and scroll position are restored by OnDirModelChange, at once if the listing has been kept
+    Model->Wake();
+    OnPollingChanged();
+    OnMountStateChanged();
+  }
+
+  void DirViewPanel::hideEvent(QHideEvent* event)
+  {
+    BasePanel::hideEvent(event);
+    // minimized windows keep their tabs
+    if (!event->spontaneous())
+    {
+      OnPollingChanged();
+      OnMountStateChanged();
+      StartHibernationDelay();
+    }
+  }
+
+  void DirViewPanel::OnViewportChanged()
+  {
+    if (ThumbnailMode)
+    {
+      // whole grid cells in view and the partly visible ones around them
+      const QSize grid = Ui->ThumbnailView->gridSize();
+      const QSize area = Ui->ThumbnailView->viewport()->size();
+      const QModelIndex first = Ui->ThumbnailView->indexAt(QPoint(grid.width() / 2, grid.height() / 2));
+      const int cells = qMax(1, area.width() / grid.width()) * (area.height() / grid.height() + 2);
+      const int firstRow = first.isValid() ? first.row() : 0;
+      Model->PrioritizeRows(firstRow, qMin(firstRow + cells, Model->rowCount()) - 1);
+      return;
+    }
+    const int first = Ui->DirView->rowAt(0);
+    const int last = Ui->DirView->rowAt(Ui->DirView->viewport()->height() - 1);
+    Model->PrioritizeRows(first, last == -1 ? Model->rowCount() - 1 : last);
+  }
+
+  QAbstractItemView* DirViewPanel::GetView() const
+  {
+    if (ThumbnailMode)
+    {
+      return Ui->ThumbnailView;
+    }
+    return Ui->DirView;
+  }
+
+  void DirViewPanel::SetThumbnailMode(bool thumbnails)
+  {
+    ThumbnailMode = thumbnails;
+    if (ThumbnailMode)
+    {
+      const int size = ThumbnailCache::Instance().GetThumbnailSize();
+      Ui->ThumbnailView->setIconSize(QSize(size, size));
+      Ui->ThumbnailView->setGridSize(
+        QSize(size + THUMBNAIL_SPACING, size + fontMetrics().height() * THUMBNAIL_TEXT_LINES + THUMBNAIL_SPACING)
+      );
+    }
+    Model->SetThumbnails(ThumbnailMode);
+    Ui->DirView->setVisible(!ThumbnailMode);
+    Ui->ThumbnailView->setVisible(ThumbnailMode);
+    GetView()->setFocus();
+    GetView()->scrollTo(GetView()->currentIndex());
+    ViewportChangeDelay->start();
+  }
+
+  void DirViewPanel::OnPollingChanged()
+  {
+    if (Model->IsPolling() && isVisible())
+    {
+      emit UpdateStatusTextRequest(
+        QString("%1 changes too often, polling; %2 notifications skipped")
+          .arg(Model->GetRoot().absolutePath())
+          .arg(Model->GetSuppressedChanges())
+      );
+      ShowsPollingStatus = true;
+    }
+    else if (ShowsPollingStatus)
+    {
+      emit UpdateStatusTextRequest(QString());
+      ShowsPollingStatus = false;
+    }
+  }
+
+  void DirViewPanel::StartHibernationDelay()
+  {
+    const int seconds = Settings::LoadTabHibernationDelay();
+    if (seconds > 0)
+    {
+      HibernationDelay->start(seconds * MILLISECONDS_PER_SECOND);
+    }
+  }
+
+  void DirViewPanel::OnHibernate()
+  {
+    if (isVisible() || Model->IsHibernating())
+    {
+      return;
+    }
+    qDebug() << "Hibernate tab" << Model->GetRoot().absolutePath();
+    RestoreScrollPosition = GetView()->verticalScrollBar()->value();
+    LoadingIndicatorDelay->stop();
+    Ui->LoadingIndicator->hide();
+    Model->Hibernate();
+  }
+
+  void DirViewPanel::OpenQuickFilter(const QString& text)
+  {
+    Ui->SearchEdit->setText(Ui->SearchEdit->isVisible() ? Ui->SearchEdit->text() + text : text);
+    Ui->SearchEdit->show();
+    Ui->SearchEdit->setFocus();
+  }
+
+  void DirViewPanel::CloseQuickFilter()
+  {
+    // model drops its filter on its own when the root changes
+    const QSignalBlocker blocker(Ui->SearchEdit);
+    Ui->SearchEdit->clear();
+    Ui->SearchEdit->hide();
+  }
+
+  void DirViewPanel::OnQuickFilterChanged(const QString& text)
+  {
+    if (text.isEmpty())
+    {
+      Model->SetQuickFilter(QString());
+      CloseQuickFilter();
+      GetView()->setFocus();
+    }
+    else
+    {
+      Model->SetQuickFilter(text);
+    }
+    // keep the selected item while it matches, otherwise take the first match
+    const QModelIndex& index = Model->GetIndex(CurrentSelection);
+    Ui->DirView->setCurrentIndex(index.isValid() ? index : Model->index(0, 0));
+    GetView()->scrollTo(GetView()->currentIndex());
+  }
+
+  void DirViewPanel::OnQuickFilterKey(QKeyEvent event)
+  {
+    switch (event.key())
+    {
+    case Qt::Key_Up:
+    case Qt::Key_Down:
+    case Qt::Key_PageUp:
+    case Qt::Key_PageDown:
+      PostKeyEvent(GetView(), event);
+      break;
+    case Qt::Key_Return:
+      GetView()->setFocus();
+      HandleItemSelection(CurrentSelection);
+      break;
+    case Qt::Key_Escape:
+      Ui->SearchEdit->clear();
+      break;
+    default:
+      break;
+    }
   }
 
   void DirViewPanel::OnSelectionChanged(const QModelIndex& current, const QModelIndex& /*previous*/)
@@ -174,7 +434,7 @@ namespace TotalFinder
 
   void DirViewPanel::SetFocus()
   {
-    Ui->DirView->setFocus();
+    GetView()->setFocus();
   }
 
   void DirViewPanel::OnFocusEvent(QFocusEvent event)
@@ -193,7 +453,7 @@ namespace TotalFinder
   void DirViewPanel::OnAddressBarEnter()
   {
     HandleItemSelection(QFileInfo(Ui->AddressBar->text()));
-    Ui->DirView->setFocus();
+    GetView()->setFocus();
   }
 
   void DirViewPanel::KeyHandler(Qt::KeyboardModifiers modifiers, Qt::Key key, const QString& text)
@@ -206,13 +466,43 @@ namespace TotalFinder
       }
       else if (key == Qt::Key_F4)
       {
+        if (Model->GetSelectedCount())
+        {
+          Shell::OpenEditorForFiles(Model->GetSelectedPaths());
+          return;
+        }
         qDebug() << "Request to edit file detected:" << CurrentSelection.absoluteFilePath();
         Shell::OpenEditorForFile(CurrentSelection.absoluteFilePath());
       }
+      else if (key == Qt::Key_F3 && !Model->IsDir(GetView()->currentIndex()))
+      {
+        const QString path = CurrentSelection.absoluteFilePath();
+        qDebug() << "Request to view file:" << path;
+        // the viewer maps the file right away
+        if (FsAccess::Instance().IsQuarantined(path))
+        {
+          ShowFsError(path, EHOSTDOWN);
+          return;
+        }
+        Context.OpenViewer(this, path);
+      }
       else if (key == Qt::Key_Delete) // Fn + Backspace
       {
-        qDebug() << "Request to delete item, path is" << CurrentSelection.absoluteFilePath();
-        Filesys::RemoveDirRecursive(Filesys::Dir(CurrentSelection.absoluteFilePath().toStdWString()));
+        const QStringList paths = GetOperationPaths();
+        qDebug() << "Request to delete" << paths.size() << "items";
+        // a single item goes without asking, as it always has
+        if (paths.size() > 1 && QMessageBox::question(
+          this, "Delete", QString("Delete %1 selected items?").arg(paths.size())) != QMessageBox::Yes)
+        {
+          return;
+        }
+        StartFileOperation(FileOperationJob::Remove, paths, QString());
+      }
+      else if (key == Qt::Key_Insert)
+      {
+        const QModelIndex current = GetView()->currentIndex();
+        Model->ToggleSelection(current);
+        GetView()->setCurrentIndex(Model->index(qMin(current.row() + 1, Model->rowCount() - 1), 0));
       }
       else if (key == Qt::Key_F7)
       {
@@ -222,7 +512,13 @@ namespace TotalFinder
 
         newDirPath += dlg->GetDirName();
         qDebug() << "Request to create directory, path is" << newDirPath;
-        Filesys::CreateDir(newDirPath.toStdWString());
+        FsAccess::Instance().MakeDir(newDirPath, this, [this, newDirPath](const FsResult& result)
+        {
+          if (result.Error)
+          {
+            ShowFsError(newDirPath, result.Error);
+          }
+        });
       }
       else if (key == Qt::Key_F5)
       {
@@ -232,16 +528,35 @@ namespace TotalFinder
           return;
         }
         const QDir& dest = Context.GetOppositeTabRootDir(this);
-        qDebug() << "Request to copy file or dir" << CurrentSelection.absoluteFilePath() << "to" << dest.absolutePath();
-        Filesys::Copy(
-          Filesys::FileInfo(CurrentSelection.absoluteFilePath().toStdWString()),
-          Filesys::FileInfo(dest.absolutePath().toStdWString())
-        );
+        const QStringList paths = GetOperationPaths();
+        qDebug() << "Request to copy" << paths.size() << "items to" << dest.absolutePath();
+        StartFileOperation(FileOperationJob::Copy, paths, dest.absolutePath());
       }
-      else if (!text.isEmpty() && !(key == Qt::Key_Return || key == Qt::Key_Tab))
+      else if (key == Qt::Key_Space && GetView()->hasFocus())
       {
-        // this means that some alphanumeric key has been pressed
-        // leaving this for later possible use
+        // marked rows, or the current one, as for every batch operation
+        if (Model->GetSelectedCount())
+        {
+          Model->MeasureSelectedDirs();
+        }
+        else
+        {
+          Model->MeasureDirs(QModelIndexList() << GetView()->currentIndex());
+        }
+      }
+      else if (key == Qt::Key_Escape && GetView()->hasFocus() && !FileOperations.isEmpty())
+      {
+        // jobs stop after the item they are busy with, Finished reports how far they got
+        foreach(FileOperationJob* job, FileOperations)
+        {
+          job->Cancel();
+        }
+        emit UpdateStatusTextRequest("Cancelling...");
+      }
+      else if (!text.isEmpty() && text[0].isPrint() && GetView()->hasFocus())
+      {
+        // some alphanumeric key has been pressed in the list
+        OpenQuickFilter(text);
       }
     }
     else if (modifiers == Qt::ShiftModifier)
@@ -254,8 +569,20 @@ namespace TotalFinder
 
         filePath += dlg->GetFileName();
         qDebug() << "Request to edit file by entered name, full path is" << filePath;
-        EnsureFileExists(filePath);
-        Shell::OpenEditorForFile(filePath);
+        // an existing file is left as it is
+        FsAccess::Instance().CreateFile(filePath, this, [this, filePath](const FsResult& result)
+        {
+          if (result.Error)
+          {
+            ShowFsError(filePath, result.Error);
+            return;
+          }
+          Shell::OpenEditorForFile(filePath);
+        });
+      }
+      else if (!text.isEmpty() && text[0].isPrint() && GetView()->hasFocus())
+      {
+        OpenQuickFilter(text);
       }
     }
     else if (modifiers == Qt::ControlModifier)
@@ -267,6 +594,29 @@ namespace TotalFinder
         FindInFilesDialog dlg(Filesys::Dir(searchRoot.toStdWString()), this);
         dlg.exec();
       }
+      else if (key == Qt::Key_A)
+      {
+        Model->SelectAll();
+      }
+      else if (key == Qt::Key_D)
+      {
+        Model->DeselectAll();
+      }
+      else if (key == Qt::Key_I)
+      {
+        Model->InvertSelection();
+      }
+      else if (key == Qt::Key_M)
+      {
+        bool ok = false;
+        const QString masks = QInputDialog::getText(
+          this, "Select by mask", "Masks, separated by ';':", QLineEdit::Normal, "*.*", &ok
+        );
+        if (ok)
+        {
+          Model->SelectByMask(masks);
+        }
+      }
     }
     else if (modifiers == Qt::MetaModifier)
     {
@@ -275,16 +625,21 @@ namespace TotalFinder
         qDebug() << "Open terminal request";
         Shell::OpenTerminal(Model->GetRoot().absolutePath());
       }
+      else if (key == Qt::Key_T)
+      {
+        SetThumbnailMode(!ThumbnailMode);
+      }
     }
     else if (modifiers == (Qt::KeypadModifier | Qt::ControlModifier))
     {
       if (key == Qt::Key_Up)
       {
         qDebug() << "Go to parent dir request";
-        QDir currentRoot = GetRootDir();
-        if (currentRoot.cdUp())
+        // by the path alone, QDir::cdUp would stat the parent on the GUI thread
+        const QDir currentRoot = GetRootDir();
+        if (!currentRoot.isRoot())
         {
-          HandleDirSelection(currentRoot);
+          HandleDirSelection(QDir::cleanPath(currentRoot.absoluteFilePath("..")));
         }
       }
       else if (key == Qt::Key_Down)
@@ -294,28 +649,128 @@ namespace TotalFinder
     }
   }
 
-  void DirViewPanel::HandleItemSelection(const QFileInfo& item)
+  QStringList DirViewPanel::GetOperationPaths() const
+  {
+    if (Model->GetSelectedCount())
+    {
+      return Model->GetSelectedPaths();
+    }
+    if (CurrentSelection.fileName() == "..")
+    {
+      return QStringList();
+    }
+    return QStringList() << CurrentSelection.absoluteFilePath();
+  }
+
+  void DirViewPanel::StartFileOperation(FileOperationJob::Operation operation, const QStringList& paths, const QString& destination)
   {
-    if (item.isDir())
+    if (paths.isEmpty())
     {
-      HandleDirSelection(item.absoluteFilePath());
       return;
     }
+    FileOperationJob* job = new FileOperationJob(operation, paths, destination);
+    connect(job, SIGNAL(Progress(int, int)), SLOT(OnFileOperationProgress(int, int)));
+    connect(job, SIGNAL(Finished(int, const QStringList&)), SLOT(OnFileOperationFinished(int, const QStringList&)));
+    FileOperations << job;
+    emit UpdateStatusTextRequest(job->GetTitle() + "... Esc to cancel");
+    job->Start();
+    // marks are done with once the job has them, the directory watch shows the outcome
+    Model->DeselectAll();
+  }
 
-    QDesktopServices::openUrl(QUrl::fromLocalFile(item.absoluteFilePath()));
+  void DirViewPanel::OnFileOperationProgress(int processed, int total)
+  {
+    const FileOperationJob* job = qobject_cast<const FileOperationJob*>(sender());
+    emit UpdateStatusTextRequest(QString("%1: %2 of %3, Esc to cancel").arg(job->GetTitle()).arg(processed).arg(total));
+  }
+
+  void DirViewPanel::OnFileOperationFinished(int processed, const QStringList& errors)
+  {
+    FileOperationJob* job = qobject_cast<FileOperationJob*>(sender());
+    FileOperations.removeAll(job);
+    if (errors.isEmpty())
+    {
+      const QString outcome = job->IsCancelled() ? "cancelled" : "done";
+      emit UpdateStatusTextRequest(QString("%1: %2, %3 processed").arg(job->GetTitle()).arg(outcome).arg(processed));
+      return;
+    }
+    emit UpdateStatusTextRequest(
+      QString("%1: %2 of %3 failed, %4").arg(job->GetTitle()).arg(errors.size()).arg(processed).arg(errors.first())
+    );
+  }
+
+  void DirViewPanel::OnSelectionCountChanged()
+  {
+    if (Model->GetSelectedCount() && isVisible())
+    {
+      emit UpdateStatusTextRequest(QString("%1 of %2 selected").arg(Model->GetSelectedCount()).arg(Model->rowCount()));
+      ShowsSelectionStatus = true;
+    }
+    else if (ShowsSelectionStatus)
+    {
+      emit UpdateStatusTextRequest(QString());
+      ShowsSelectionStatus = false;
+    }
+  }
+
+  void DirViewPanel::OnMountStateChanged()
+  {
+    const QString root = Model->GetRoot().absolutePath();
+    if (FsAccess::Instance().IsQuarantined(root) && isVisible())
+    {
+      emit UpdateStatusTextRequest(
+        QString("%1 is not responding, access suspended").arg(FsAccess::Instance().GetMountPoint(root))
+      );
+      ShowsMountStatus = true;
+    }
+    else if (ShowsMountStatus)
+    {
+      emit UpdateStatusTextRequest(QString());
+      ShowsMountStatus = false;
+    }
+  }
+
+  void DirViewPanel::ShowFsError(const QString& path, int error)
+  {
+    emit UpdateStatusTextRequest(QString("%1: %2").arg(path).arg(FsAccess::GetErrorText(error)));
+  }
+
+  void DirViewPanel::HandleItemSelection(const QFileInfo& item)
+  {
+    const QString path = item.absoluteFilePath();
+    const QString root = Model->GetRoot().absolutePath();
+    FsAccess::Instance().Stat(path, this, [this, path, root](const FsResult& result)
+    {
+      // navigated elsewhere while waiting for the answer
+      if (Model->GetRoot().absolutePath() != root)
+      {
+        return;
+      }
+      if (result.Error)
+      {
+        ShowFsError(path, result.Error);
+        return;
+      }
+      if (result.IsDir)
+      {
+        HandleDirSelection(path);
+        return;
+      }
+      QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+    });
   }
 
   void DirViewPanel::HandleDirSelection(const QDir& dir)
   {
     qDebug() << "Set dir in view:" << dir.absolutePath();
-    const QDir& previousDir = Model->GetRoot();
+    CloseQuickFilter();
+    // listing arrives asynchronously; the dir we came from gets selected once it is loaded
+    CurrentSelection = QFileInfo(Model->GetRoot().absolutePath());
+    CurrentRow = 0;
+    RestoreScrollPosition = -1;
     Model->SetRoot(dir);
     Ui->AddressBar->setText(Model->GetRoot().absolutePath());
-
-    const QModelIndex& index = Model->GetIndex(previousDir);
-    Ui->DirView->setCurrentIndex(index.isValid() ? index : Model->index(0,0));
-
-    Ui->DirView->scrollTo(Ui->DirView->selectionModel()->currentIndex());
+    OnMountStateChanged();
 
     emit TitleChanged(GetName());
   }
@@ -1,11 +1,16 @@
 #pragma once
 
 #include "base_panel.h"
+#include "file_operation_job.h"
 #include "tab_context.h"
 
+#include <QAbstractItemView>
 #include <QDir>
 #include <QFocusEvent>
+#include <QHideEvent>
 #include <QKeyEvent>
+#include <QShowEvent>
+#include <QTimer>
 #include <QWidget>
 
 class Ui_DirViewPanel;
@@ -28,29 +33,71 @@ namespace TotalFinder
     void SetFocus() override;
     QString GetName() const override;
 
+  protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
   private slots:
     void OnHeaderGeometryChanged();
     void OnItemActivated(const QModelIndex& index);
     void OnAddressBarEnter();
     void OnFocusEvent(QFocusEvent event);
     void OnDirModelChange();
+    void OnLoadingChanged(bool loading);
+    void OnShowLoadingIndicator();
+    void OnHibernate();
+    void OnPollingChanged();
+    void OnViewportChanged();
+    void OnSelectionCountChanged();
+    void OnMountStateChanged();
+    void OnFileOperationProgress(int processed, int total);
+    void OnFileOperationFinished(int processed, const QStringList& errors);
+    void OnQuickFilterChanged(const QString& text);
+    void OnQuickFilterKey(QKeyEvent event);
     void OnSelectionChanged(const QModelIndex& current, const QModelIndex& previous);
     void OnShowViewContextMenu(const QPoint& point);
     void OnRevealInFinder();
     void OnOpenTerminal();
 
   private:
+    // the item is stat'ed through FsAccess, the panel stays responsive while its mount doesn't answer
     void HandleItemSelection(const QFileInfo& item);
     void HandleDirSelection(const QDir& dir);
+    void OpenQuickFilter(const QString& text);
+    void CloseQuickFilter();
+    void StartHibernationDelay();
+    // list or thumbnail grid, whichever is shown
+    QAbstractItemView* GetView() const;
+    void SetThumbnailMode(bool thumbnails);
+    // selected items, or the current one if none is selected
+    QStringList GetOperationPaths() const;
+    void StartFileOperation(FileOperationJob::Operation operation, const QStringList& paths, const QString& destination);
+    void ShowFsError(const QString& path, int error);
 
     void KeyHandler(Qt::KeyboardModifiers modifier, Qt::Key key, const QString& text) override;
 
     Ui_DirViewPanel* Ui;
 
     DirModel* Model;
+    // coalesces scrolling, resizing and model changes into one metadata request for the rows in view
+    QTimer* ViewportChangeDelay;
+    // fast listings finish before the indicator is shown, so it doesn't flicker on every navigation
+    QTimer* LoadingIndicatorDelay;
+    // tabs hidden for long enough drop their rows and watch, see Settings::LoadTabHibernationDelay
+    QTimer* HibernationDelay;
+    // scroll position from before hibernation, applied once rows are back; -1 if none
+    int RestoreScrollPosition;
+    // status bar holds the polling message of this tab and has to be cleared when it is over
+    bool ShowsPollingStatus;
+    bool ShowsSelectionStatus;
+    bool ShowsMountStatus;
+    // images are shown as a grid of thumbnails instead of the list, see ThumbnailCache
+    bool ThumbnailMode;
 
     QFileInfo CurrentSelection;
     int CurrentRow;
+    // running jobs started from this tab, Escape cancels them
+    QList<FileOperationJob*> FileOperations;
     TabContext Context;
   };
 } // namespace TotalFinder
@@ -0,0 +1,296 @@
+#include "entry_table.h"
+
+#include <QDateTime>
+#include <QLocale>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    const QString DIR_SIZE_TEXT = "--";
+
+    QString DecodePermissions(QFile::Permissions permissions, bool isDir)
+    {
+      QString result;
+      result += isDir ? "d" : "-";
+
+      result += permissions & QFile::ReadOwner ? "r" : "-";
+      result += permissions & QFile::WriteOwner ? "w" : "-";
+      result += permissions & QFile::ExeOwner ? "x" : "-";
+
+      result += permissions & QFile::ReadGroup ? "r" : "-";
+      result += permissions & QFile::WriteGroup ? "w" : "-";
+      result += permissions & QFile::ExeGroup ? "x" : "-";
+
+      result += permissions & QFile::ReadOther ? "r" : "-";
+      result += permissions & QFile::WriteOther ? "w" : "-";
+      result += permissions & QFile::ExeOther ? "x" : "-";
+
+      return result;
+    }
+
+    // Digit runs become a marker, the run length without leading zeros and the digits,
+    // so plain comparison of keys orders numbers by value and before letters
+    QString MakeSortKey(const QString& name)
+    {
+      const QString folded = name.toCaseFolded();
+      QString result;
+      result.reserve(folded.size() + 4);
+      for (int pos = 0; pos < folded.size();)
+      {
+        if (!folded[pos].isDigit())
+        {
+          result += folded[pos++];
+          continue;
+        }
+        int end = pos;
+        while (end < folded.size() && folded[end].isDigit())
+        {
+          ++end;
+        }
+        while (pos < end - 1 && folded[pos] == '0')
+        {
+          ++pos;
+        }
+        result += QChar('0');
+        result += QChar(static_cast<ushort>(end - pos));
+        result += folded.midRef(pos, end - pos);
+        pos = end;
+      }
+      return result;
+    }
+
+    // only columns that really change are written, others stay shared with copies of the table
+    template<class T>
+    void Assign(QVector<T>& column, int row, const T& value)
+    {
+      if (column.at(row) != value)
+      {
+        column[row] = value;
+      }
+    }
+  } // namespace
+
+  QString FormatSize(quint64 size)
+  {
+    QString result = QString::number(size);
+    int len = result.size();
+    while (len > 3)
+    {
+      result.insert(len - 3, '.');
+      len -= 3;
+    }
+    return result;
+  }
+
+  void EntryTable::Clear()
+  {
+    FileNames.clear();
+    Names.clear();
+    Extensions.clear();
+    SortKeys.clear();
+    Sizes.clear();
+    SizeTexts.clear();
+    Modified.clear();
+    ModifiedTexts.clear();
+    PermissionTexts.clear();
+    EntryFlags.clear();
+    RowByName.clear();
+  }
+
+  void EntryTable::Reserve(int count)
+  {
+    FileNames.reserve(count);
+    Names.reserve(count);
+    Extensions.reserve(count);
+    SortKeys.reserve(count);
+    Sizes.reserve(count);
+    SizeTexts.reserve(count);
+    Modified.reserve(count);
+    ModifiedTexts.reserve(count);
+    PermissionTexts.reserve(count);
+    EntryFlags.reserve(count);
+    RowByName.reserve(count);
+  }
+
+  void EntryTable::Append(const QFileInfo& info)
+  {
+    const bool isDir = info.isDir();
+    const QString fileName = info.fileName();
+    RowByName.insert(fileName, FileNames.size());
+    FileNames.append(fileName);
+    if (isDir || info.completeBaseName().isEmpty())
+    {
+      Names.append(fileName);
+      Extensions.append(QString());
+    }
+    else
+    {
+      Names.append(info.completeBaseName());
+      Extensions.append(info.suffix());
+    }
+    SortKeys.append(MakeSortKey(fileName));
+
+    const qint64 size = isDir ? 0 : info.size();
+    Sizes.append(size);
+    SizeTexts.append(isDir ? DIR_SIZE_TEXT : FormatSize(size));
+
+    // same text the view's delegate would produce for a QDateTime
+    const QDateTime modified = info.lastModified();
+    Modified.append(modified.toMSecsSinceEpoch());
+    ModifiedTexts.append(QLocale().toString(modified, QLocale::ShortFormat));
+
+    PermissionTexts.append(InternPermissions(info.permissions(), isDir));
+
+    quint8 flags = 0;
+    flags |= isDir ? FLAG_DIR : 0;
+    flags |= info.isSymLink() ? FLAG_SYMLINK : 0;
+    flags |= info.isHidden() ? FLAG_HIDDEN : 0;
+    flags |= !isDir && info.isExecutable() ? FLAG_EXECUTABLE : 0;
+    EntryFlags.append(flags);
+  }
+
+  void EntryTable::Append(const QString& fileName, int flags)
+  {
+    const bool isDir = flags & FLAG_DIR;
+    RowByName.insert(fileName, FileNames.size());
+    FileNames.append(fileName);
+    // same split as QFileInfo::completeBaseName and QFileInfo::suffix
+    const int dot = fileName.lastIndexOf('.');
+    if (isDir || dot <= 0)
+    {
+      Names.append(fileName);
+      Extensions.append(QString());
+    }
+    else
+    {
+      Names.append(fileName.left(dot));
+      Extensions.append(fileName.mid(dot + 1));
+    }
+    SortKeys.append(MakeSortKey(fileName));
+    Sizes.append(0);
+    SizeTexts.append(isDir ? DIR_SIZE_TEXT : QString());
+    Modified.append(0);
+    ModifiedTexts.append(QString());
+    PermissionTexts.append(QString());
+    EntryFlags.append(flags | FLAG_PENDING);
+  }
+
+  void EntryTable::Append(const EntryTable& other)
+  {
+    RowByName.reserve(FileNames.size() + other.FileNames.size());
+    for (int row = 0; row < other.FileNames.size(); ++row)
+    {
+      RowByName.insert(other.FileNames[row], FileNames.size() + row);
+    }
+    FileNames += other.FileNames;
+    Names += other.Names;
+    Extensions += other.Extensions;
+    SortKeys += other.SortKeys;
+    Sizes += other.Sizes;
+    SizeTexts += other.SizeTexts;
+    Modified += other.Modified;
+    ModifiedTexts += other.ModifiedTexts;
+    PermissionTexts += other.PermissionTexts;
+    EntryFlags += other.EntryFlags;
+  }
+
+  int EntryTable::Size() const
+  {
+    return FileNames.size();
+  }
+
+  const QString& EntryTable::GetFileName(int row) const
+  {
+    return FileNames[row];
+  }
+
+  const QString& EntryTable::GetName(int row) const
+  {
+    return Names[row];
+  }
+
+  const QString& EntryTable::GetExtension(int row) const
+  {
+    return Extensions[row];
+  }
+
+  const QString& EntryTable::GetSortKey(int row) const
+  {
+    return SortKeys[row];
+  }
+
+  qint64 EntryTable::GetSize(int row) const
+  {
+    return Sizes[row];
+  }
+
+  const QString& EntryTable::GetSizeText(int row) const
+  {
+    return SizeTexts[row];
+  }
+
+  qint64 EntryTable::GetModified(int row) const
+  {
+    return Modified[row];
+  }
+
+  const QString& EntryTable::GetModifiedText(int row) const
+  {
+    return ModifiedTexts[row];
+  }
+
+  const QString& EntryTable::GetPermissionsText(int row) const
+  {
+    return PermissionTexts[row];
+  }
+
+  bool EntryTable::IsDir(int row) const
+  {
+    return EntryFlags[row] & FLAG_DIR;
+  }
+
+  int EntryTable::GetFlags(int row) const
+  {
+    return EntryFlags[row];
+  }
+
+  bool EntryTable::IsPending(int row) const
+  {
+    return EntryFlags[row] & FLAG_PENDING;
+  }
+
+  void EntryTable::SetMetadata(int row, const EntryTable& source, int sourceRow)
+  {
+    // a symlink turns out to be a directory only once it is read, which changes the name split
+    Assign(Names, row, source.Names[sourceRow]);
+    Assign(Extensions, row, source.Extensions[sourceRow]);
+    Assign(Sizes, row, source.Sizes[sourceRow]);
+    Assign(SizeTexts, row, source.SizeTexts[sourceRow]);
+    Assign(Modified, row, source.Modified[sourceRow]);
+    Assign(ModifiedTexts, row, source.ModifiedTexts[sourceRow]);
+    Assign(PermissionTexts, row, source.PermissionTexts[sourceRow]);
+    Assign(EntryFlags, row, source.EntryFlags[sourceRow]);
+  }
+
+  void EntryTable::SetPending(int row)
+  {
+    EntryFlags[row] |= FLAG_PENDING;
+  }
+
+  int EntryTable::Find(const QString& fileName) const
+  {
+    return RowByName.value(fileName, -1);
+  }
+
+  const QString& EntryTable::InternPermissions(QFile::Permissions permissions, bool isDir)
+  {
+    const int key = (static_cast<int>(permissions) << 1) | (isDir ? 1 : 0);
+    QHash<int, QString>::iterator it = PermissionNames.find(key);
+    if (it == PermissionNames.end())
+    {
+      it = PermissionNames.insert(key, DecodePermissions(permissions, isDir));
+    }
+    return it.value();
+  }
+} // namespace TotalFinder
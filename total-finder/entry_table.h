@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+namespace TotalFinder
+{
+  // Listing of one directory kept as parallel arrays, one element per row.
+  // Everything the view paints is formatted once when the entry is added, so
+  // DirModel::data is an array lookup regardless of the directory size
+  class EntryTable
+  {
+  public:
+    enum Flags
+    {
+      FLAG_DIR = 1,
+      FLAG_SYMLINK = 2,
+      FLAG_HIDDEN = 4,
+      FLAG_EXECUTABLE = 8,
+      // only name and type are known, size, mtime and permissions are to be read
+      FLAG_PENDING = 16
+    };
+
+    void Clear();
+    void Reserve(int count);
+    void Append(const QFileInfo& info);
+    // row without metadata, FLAG_PENDING is added to the flags
+    void Append(const QString& fileName, int flags);
+    void Append(const EntryTable& other);
+    int Size() const;
+
+    const QString& GetFileName(int row) const;
+    // file name without extension for files, full name for directories
+    const QString& GetName(int row) const;
+    const QString& GetExtension(int row) const;
+    // case folded name with numbers made comparable by value: "file9" < "File10"
+    const QString& GetSortKey(int row) const;
+    qint64 GetSize(int row) const;
+    const QString& GetSizeText(int row) const;
+    qint64 GetModified(int row) const; // milliseconds since epoch
+    const QString& GetModifiedText(int row) const;
+    const QString& GetPermissionsText(int row) const;
+    bool IsDir(int row) const;
+    int GetFlags(int row) const;
+    bool IsPending(int row) const;
+
+    // everything but the name is taken from a row of another table, flags included
+    void SetMetadata(int row, const EntryTable& source, int sourceRow);
+    void SetPending(int row);
+
+    // -1 if there is no such name; constant time, the index follows every change of the table
+    int Find(const QString& fileName) const;
+
+  private:
+    const QString& InternPermissions(QFile::Permissions permissions, bool isDir);
+
+    QVector<QString> FileNames;
+    QVector<QString> Names;
+    QVector<QString> Extensions;
+    QVector<QString> SortKeys;
+    QVector<qint64> Sizes;
+    QVector<QString> SizeTexts;
+    QVector<qint64> Modified;
+    QVector<QString> ModifiedTexts;
+    QVector<QString> PermissionTexts;
+    QVector<quint8> EntryFlags;
+
+    QHash<QString, int> RowByName;
+
+    // there are only a handful of distinct permission strings in a directory,
+    // rows share them instead of holding a copy each
+    QHash<int, QString> PermissionNames;
+  };
+
+  // thousands separated by dots, as the Size column shows them
+  QString FormatSize(quint64 size);
+} // namespace TotalFinder
+
+Q_DECLARE_METATYPE(TotalFinder::EntryTable)
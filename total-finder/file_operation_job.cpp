@@ -0,0 +1,84 @@
+#include "file_operation_job.h"
+
+#include <common/filesystem.h>
+#include <common/thread_pool.h>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <functional>
+
+namespace TotalFinder
+{
+  FileOperationJob::FileOperationJob(Operation operation, const QStringList& paths, const QString& destination)
+    : QObject()
+    , CurrentOperation(operation)
+    , Paths(paths)
+    , Destination(destination)
+    , Started(false)
+  {
+  }
+
+  FileOperationJob::~FileOperationJob()
+  {
+    Control.Cancel();
+    if (Started)
+    {
+      Control.WaitFinished();
+    }
+  }
+
+  void FileOperationJob::Start()
+  {
+    Started = true;
+    connect(this, SIGNAL(Finished(int, const QStringList&)), SLOT(deleteLater()), Qt::QueuedConnection);
+    Common::ThreadPool::Io().Submit(std::bind(&FileOperationJob::Run, this));
+  }
+
+  void FileOperationJob::Cancel()
+  {
+    Control.Cancel();
+  }
+
+  bool FileOperationJob::IsCancelled() const
+  {
+    return Control.IsCancelled();
+  }
+
+  QString FileOperationJob::GetTitle() const
+  {
+    const QString items = Paths.size() == 1 ? Paths.first() : QString("%1 items").arg(Paths.size());
+    return CurrentOperation == Copy ? QString("Copy %1 to %2").arg(items).arg(Destination) : QString("Delete %1").arg(items);
+  }
+
+  void FileOperationJob::Run()
+  {
+    QElapsedTimer timer;
+    timer.start();
+    QStringList errors;
+    int processed = 0;
+    for (const QString& path: Paths)
+    {
+      if (!Control.Checkpoint())
+      {
+        break;
+      }
+      const Common::Error error = CurrentOperation == Copy
+        ? Filesys::Copy(Filesys::FileInfo(path.toStdWString()), Filesys::FileInfo(Destination.toStdWString()))
+        : Filesys::RemoveDirRecursive(Filesys::Dir(path.toStdWString()));
+      if (error)
+      {
+        errors << QString::fromStdWString(Common::Error::Format(error));
+      }
+      ++processed;
+      if (timer.elapsed() >= PROGRESS_INTERVAL_MILLISECONDS)
+      {
+        emit Progress(processed, Paths.size());
+        timer.restart();
+      }
+    }
+    qDebug() << GetTitle() << "done:" << processed << "processed," << errors.size() << "failed";
+    emit Finished(processed, errors);
+    Control.Finish();
+  }
+} // namespace TotalFinder
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <common/job_control.h>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+namespace TotalFinder
+{
+  // Copy or delete of a whole selection as one job on the IO pool. Items are processed one
+  // after another, a failed item doesn't stop the rest. The job deletes itself when it is over,
+  // so the tab that started it may be closed meanwhile
+  class FileOperationJob: public QObject
+  {
+    Q_OBJECT
+    const qint64 PROGRESS_INTERVAL_MILLISECONDS = 250;
+
+  public:
+    enum Operation
+    {
+      Copy,
+      Remove
+    };
+
+    // destination is the directory copies go to, unused for Remove
+    FileOperationJob(Operation operation, const QStringList& paths, const QString& destination);
+    ~FileOperationJob() override;
+
+    void Start();
+    // returns immediately, the item being processed is finished first
+    void Cancel();
+    bool IsCancelled() const;
+    // "Copy 3 items to /tmp" and alike
+    QString GetTitle() const;
+
+  signals:
+    // emitted from the pool thread
+    void Progress(int processed, int total);
+    void Finished(int processed, const QStringList& errors);
+
+  private:
+    void Run();
+
+    const Operation CurrentOperation;
+    const QStringList Paths;
+    const QString Destination;
+    Common::JobControl Control;
+    bool Started;
+  };
+} // namespace TotalFinder
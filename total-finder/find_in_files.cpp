@@ -1,297 +1,180 @@
 #include "find_in_files.h"
 #include "ui_find_in_files.h"
-#include "settings.h"
+#include "search_job.h"
 #include "shell_utils.h"
 
-
 #include <QDebug>
-#include <QThread>
-#include <QElapsedTimer>
-
-#include <string>
-#include <functional>
 
 namespace TotalFinder
 {
-  class Worker: public QThread
+  FindInFilesDialog::FindInFilesDialog(const Filesys::Dir& startDir, QWidget* parent)
+    : QDialog(parent)
+    , Ui(new Ui_FindInFilesDialog)
   {
-    Q_OBJECT
-  public:
-    Worker(QObject* parent);
-    void StartSearch(const QString& where, const QString& what, const QString& content);
-    void Cancel();
-  protected:
-    virtual void run();
-  signals:
-    void GotResult(const QString& item);
-    void Progress(const QString& currentFolder);
-    void Complete();
-  private:
-    bool FilterCallback(const std::string& filename, Filesys::FileObjectType ftype);
-
-    bool CancelFlag;
-    QString Where;
-    QRegExp What;
-    QString Content;
-    QDir::Filters DirFilters;
-  };
+    Ui->setupUi(this);
+    Ui->SearchInEdit->setText(QString::fromStdWString(startDir.GetPath()));
+    Ui->ResultTabs->setTabsClosable(true);
+    connect(Ui->ResultTabs, SIGNAL(currentChanged(int)), SLOT(OnCurrentTabChanged(int)));
+    connect(Ui->ResultTabs, SIGNAL(tabCloseRequested(int)), SLOT(OnTabCloseRequested(int)));
+    connect(Ui->PauseButton, SIGNAL(clicked()), SLOT(OnPauseClicked()));
+    connect(Ui->StopButton, SIGNAL(clicked()), SLOT(OnStopClicked()));
+
+    // searches started earlier keep running in background between dialog invocations
+    for (SearchJob* job: SearchJobManager::Instance().GetJobs())
+    {
+      AddJobTab(job);
+    }
+    UpdateControls();
+    Ui->FilenameMaskEdit->setFocus();
+  }
 
-  class SearchResultModel: public QAbstractListModel
+  FindInFilesDialog::~FindInFilesDialog()
   {
-    Q_OBJECT
-    const qint64 MODEL_UPDATE_INTERVAL_MILLISECONDS = 1000;
-
-  public:
-    SearchResultModel(QObject* parent);
-    void AddItem(const QString& item);
-    void FlushResults();
-    void Clear();
-    virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
-    virtual QVariant data(const QModelIndex& index = QModelIndex(), int role = Qt::DisplayRole) const;
-  private:
-    void FlushReadyToInsertRows();
+    delete Ui;
+  }
 
-    QStringList ModelData;
-    QStringList RowsReadyToInsert;
-    QElapsedTimer RefreshTimer;
-  };
+  void FindInFilesDialog::AddJobTab(SearchJob* job)
+  {
+    QListView* view = new QListView(Ui->ResultTabs);
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setModel(job->GetModel());
+    view->setLayoutMode(QListView::Batched);
+    view->setBatchSize(10);
+    connect(view, SIGNAL(activated(const QModelIndex&)), SLOT(OnResultItemActivated(const QModelIndex&)));
+    connect(
+      view->selectionModel(),
+      SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)),
+      SLOT(OnCurrentResultChanged(const QModelIndex&, const QModelIndex&))
+    );
+    connect(
+      job->GetModel(),
+      SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&, const QVector<int>&)),
+      SLOT(OnResultDataChanged(const QModelIndex&, const QModelIndex&))
+    );
+    connect(job, SIGNAL(StatusChanged()), SLOT(OnJobStatusChanged()));
 
- #include "find_in_files.moc"
+    JobByTab.insert(view, job);
+    Ui->ResultTabs->setCurrentIndex(Ui->ResultTabs->addTab(view, job->GetTitle()));
+  }
 
-  Worker::Worker(QObject* parent)
-    : QThread(parent)
-    , CancelFlag(false)
-    , DirFilters(Settings::LoadDirFilters())
+  SearchJob* FindInFilesDialog::GetCurrentJob() const
   {
+    return JobByTab.value(Ui->ResultTabs->currentWidget(), nullptr);
   }
 
-  void Worker::StartSearch(const QString& where, const QString& what, const QString& content)
+  void FindInFilesDialog::UpdateControls()
   {
-    Where = where;
-    What = QRegExp(what);
-    What.setCaseSensitivity(Qt::CaseInsensitive);
-    What.setPatternSyntax(QRegExp::Wildcard);
-    Content = content;
-    qDebug() << "Search started; where:" << where << ", content:" << Content;
-    start();
+    SearchJob* job = GetCurrentJob();
+    const bool active = job && (job->GetStatus() == SearchJob::Running || job->GetStatus() == SearchJob::Paused);
+    Ui->PauseButton->setEnabled(active);
+    Ui->StopButton->setEnabled(active);
+    Ui->PauseButton->setText(job && job->GetStatus() == SearchJob::Paused ? "Resume" : "Pause");
+    Ui->ProgressLabel->setText(job ? job->GetStatusText() : QString());
   }
 
-  void Worker::Cancel()
+  void FindInFilesDialog::OnResultItemActivated(const QModelIndex& item)
   {
-    if (!isRunning())
+    if (!item.data(SearchResultModel::MemberRole).toString().isEmpty())
     {
+      // members are never extracted, so show the archive itself
+      Shell::RevealInFinder(item.data(SearchResultModel::PathRole).toString());
       return;
     }
-    CancelFlag = true;
-    QThread::wait();
-    qDebug() << "Search canceled";
+    Shell::OpenEditorForFile(
+      item.data(SearchResultModel::PathRole).toString(),
+      item.data(SearchResultModel::LineRole).toULongLong()
+    );
   }
 
-  void Worker::run()
+  void FindInFilesDialog::OnCurrentResultChanged(const QModelIndex& current, const QModelIndex& /*previous*/)
   {
-    qDebug() << "Start search";
-
-    Filesys::WalkDir(
-      Filesys::Dir(Where.toStdWString()),
-      std::bind(
-        &Worker::FilterCallback,
-        this,
-        std::placeholders::_1,
-        std::placeholders::_2
-      ),
-      false
-    );
-
-    emit Complete();
+    Ui->PreviewView->setPlainText(current.data(SearchResultModel::ContextRole).toString());
   }
 
-  bool Worker::FilterCallback(const std::string& filename, Filesys::FileObjectType ftype)
+  void FindInFilesDialog::OnResultDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
   {
-    if (CancelFlag)
-    {
-      QThread::terminate();
-      return false;
-    }
-
-    const QString& fullPath = QString::fromStdString(filename);
-    const int lastSep = fullPath.lastIndexOf(Filesys::PATH_SEPARATOR);
-    const QString& folder = fullPath.right(fullPath.size() - lastSep - 1);
-
-    if (ftype == Filesys::FILE_DIRECTORY)
+    // context of the current row has been read in background
+    const QListView* view = qobject_cast<const QListView*>(Ui->ResultTabs->currentWidget());
+    if (!view || view->model() != topLeft.model())
     {
-      // TODO: use actual file attributes
-      if (folder.startsWith(".") && !(DirFilters & QDir::Hidden))
-      {
-        qDebug() << "exclude from search" << folder;
-        return false;
-      }
-      emit Progress(QString::fromStdString(filename));
+      return;
     }
-
-    const QStringList& items = fullPath.split(Filesys::PATH_SEPARATOR);
-    if (items.empty())
+    const QModelIndex current = view->currentIndex();
+    if (current.isValid() && current.row() >= topLeft.row() && current.row() <= bottomRight.row())
     {
-      return true;
+      Ui->PreviewView->setPlainText(current.data(SearchResultModel::ContextRole).toString());
     }
-    const QString& item = items.last();
-
-    if (What.exactMatch(item))
-    {
-      if (Content.isEmpty())
-      {
-        emit GotResult(fullPath);
-        return true;
-      }
-
-      if (ftype == Filesys::FILE_REGULAR)
-      {
-        QFile f(fullPath);
-        f.open(QIODevice::ReadOnly);
-        QString chunk;
-        do
-        {
-          if (CancelFlag)
-          {
-            QThread::terminate();
-          }
+  }
 
-          chunk = f.read(1024);
-          if (chunk.indexOf(Content, Qt::CaseInsensitive) != -1)
-          {
-            emit GotResult(fullPath);
-            return true;
-          }
-        }
-        while (!chunk.isEmpty());
-        f.close();
-      }
-    }
-    return true;
+  void FindInFilesDialog::OnCurrentTabChanged(int /*index*/)
+  {
+    Ui->PreviewView->clear();
+    UpdateControls();
   }
 
-  SearchResultModel::SearchResultModel(QObject* parent)
-    : QAbstractListModel(parent)
+  void FindInFilesDialog::OnTabCloseRequested(int index)
   {
+    QWidget* tab = Ui->ResultTabs->widget(index);
+    SearchJob* job = JobByTab.take(tab);
+    Ui->ResultTabs->removeTab(index);
+    tab->deleteLater();
+    if (job)
+    {
+      job->Cancel();
+      SearchJobManager::Instance().RemoveJob(job);
+    }
   }
 
-  void SearchResultModel::FlushReadyToInsertRows()
+  void FindInFilesDialog::OnJobStatusChanged()
   {
-    const QModelIndex parent = QModelIndex();
-    const int rows = rowCount(parent);
-    QAbstractListModel::beginInsertRows(parent, rows, rows);
-    ModelData << RowsReadyToInsert;
-    QAbstractListModel::endInsertRows();
-    RefreshTimer.invalidate();
+    SearchJob* job = qobject_cast<SearchJob*>(sender());
+    if (job && job == GetCurrentJob())
+    {
+      UpdateControls();
+    }
   }
 
-  void SearchResultModel::AddItem(const QString& item)
+  void FindInFilesDialog::OnPauseClicked()
   {
-    if (!RefreshTimer.isValid())
+    SearchJob* job = GetCurrentJob();
+    if (!job)
     {
-      RefreshTimer.start();
+      return;
     }
-    if (RefreshTimer.elapsed() < MODEL_UPDATE_INTERVAL_MILLISECONDS)
+    if (job->GetStatus() == SearchJob::Paused)
     {
-      RowsReadyToInsert << item;
+      job->Resume();
     }
     else
     {
-      FlushReadyToInsertRows();
-      RefreshTimer.start();
+      job->Pause();
     }
   }
 
-  void SearchResultModel::FlushResults()
-  {
-    FlushReadyToInsertRows();
-    RowsReadyToInsert.clear();
-  }
-
-  void SearchResultModel::Clear()
-  {
-    const QModelIndex parent = QModelIndex();
-    QAbstractListModel::beginRemoveRows(parent, 0, rowCount() - 1);
-    RowsReadyToInsert.clear();
-    ModelData.clear();
-    QAbstractListModel::endRemoveRows();
-  }
-
-  int SearchResultModel::rowCount(const QModelIndex& parent) const
-  {
-    return ModelData.size();
-  }
-
-  QVariant SearchResultModel::data(const QModelIndex& index, int role) const
+  void FindInFilesDialog::OnStopClicked()
   {
-    if (!index.isValid())
+    SearchJob* job = GetCurrentJob();
+    if (job)
     {
-      return QVariant();
+      job->Cancel();
     }
-
-    const QString& currentItem = ModelData[index.row()];
-
-   if (role == Qt::DisplayRole)
-   {
-     return currentItem;
-   }
-
-   return QVariant();
-  }
-
-  FindInFilesDialog::FindInFilesDialog(const Filesys::Dir& startDir, QWidget* parent)
-    : QDialog(parent)
-    , Ui(new Ui_FindInFilesDialog)
-    , Searcher(new Worker(this))
-    , Model(new SearchResultModel(this))
-  {
-    Ui->setupUi(this);
-    Ui->SearchInEdit->setText(QString::fromStdWString(startDir.GetPath()));
-    connect(Ui->ResultView, SIGNAL(activated(const QModelIndex&)), SLOT(OnResultItemActivated(const QModelIndex&)));
-    Ui->ResultView->setModel(Model);
-    Ui->ResultView->setLayoutMode(QListView::Batched);
-    Ui->ResultView->setBatchSize(10);
-    connect(Searcher, SIGNAL(GotResult(const QString&)), SLOT(OnGotResult(const QString&)));
-    connect(Searcher, SIGNAL(Progress(const QString&)), SLOT(OnProgress(const QString&)));
-    connect(Searcher, SIGNAL(Complete()), SLOT(OnComplete()));
-    Ui->FilenameMaskEdit->setFocus();
-  }
-
-  FindInFilesDialog::~FindInFilesDialog()
-  {
-    Searcher->Cancel();
-  }
-
-  void FindInFilesDialog::OnResultItemActivated(const QModelIndex& item)
-  {
-    Shell::OpenEditorForFile(Model->data(item, Qt::DisplayRole).toString());
   }
 
   void FindInFilesDialog::StartSearch()
   {
-    Model->Clear();
-    Searcher->StartSearch(
+    Ui->PreviewView->clear();
+    SearchOptions options;
+    options.SearchArchives = Ui->SearchArchivesBox->isChecked();
+    options.UseIgnoreFiles = Ui->UseIgnoreFilesBox->isChecked();
+    options.BinaryFiles = Ui->SearchBinaryFilesBox->isChecked() ? Search::BINARY_FIRST_MATCH : Search::BINARY_SKIP;
+    SearchJob* job = SearchJobManager::Instance().StartJob(
       Ui->SearchInEdit->text(),
       Ui->FilenameMaskEdit->lineEdit()->text(),
-      Ui->FindTextEdit->lineEdit()->text()
+      Ui->FindTextEdit->lineEdit()->text(),
+      options
     );
-  }
-
-  void FindInFilesDialog::OnGotResult(const QString& result)
-  {
-    Model->AddItem(result);
-  }
-
-  void FindInFilesDialog::OnProgress(const QString& folder)
-  {
-    Ui->ProgressLabel->setText(folder);
-  }
-
-  void FindInFilesDialog::OnComplete()
-  {
-    Model->FlushResults();
-    Ui->ResultView->setFocus();
-    qDebug() << "search complete, found" << Model->rowCount() << "items";
-    Ui->ProgressLabel->setText(QString("Search complete, %1 items found").arg(Model->rowCount()));
+    AddJobTab(job);
+    UpdateControls();
   }
 
   void FindInFilesDialog::keyPressEvent(QKeyEvent* event)
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <QDialog>
+#include <QHash>
 #include <QKeyEvent>
-#include <QListWidget>
+#include <QListView>
 
 #include <common/filesystem.h>
 
@@ -10,8 +11,7 @@ class  Ui_FindInFilesDialog;
 
 namespace TotalFinder
 {
-  class Worker;
-  class SearchResultModel;
+  class SearchJob;
 
   class FindInFilesDialog: public QDialog
   {
@@ -23,14 +23,20 @@ namespace TotalFinder
     void keyPressEvent(QKeyEvent* event) override;
   private slots:
     void OnResultItemActivated(const QModelIndex& item);
-    void OnGotResult(const QString& item);
-    void OnProgress(const QString& folder);
-    void OnComplete();
+    void OnCurrentResultChanged(const QModelIndex& current, const QModelIndex& previous);
+    void OnResultDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+    void OnCurrentTabChanged(int index);
+    void OnTabCloseRequested(int index);
+    void OnJobStatusChanged();
+    void OnPauseClicked();
+    void OnStopClicked();
   private:
     void StartSearch();
+    void AddJobTab(SearchJob* job);
+    SearchJob* GetCurrentJob() const;
+    void UpdateControls();
 
     Ui_FindInFilesDialog* Ui;
-    Worker* Searcher;
-    SearchResultModel* Model;
+    QHash<QWidget*, SearchJob*> JobByTab;
   };
 } // namespace TotalFinder
@@ -0,0 +1,183 @@
+#include "folder_sizes.h"
+#include "entry_table.h"
+#include "fs_access.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    // sizes of subtrees automatic requests have given up on, they are not tried automatically again
+    const qint64 GAVE_UP = -1;
+
+    qint64 GetModified(const struct stat& st)
+    {
+#if defined(__APPLE__)
+      return static_cast<qint64>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+      return static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    QByteArray JoinPath(const QByteArray& dir, const QByteArray& name)
+    {
+      return dir.endsWith('/') ? dir + name : dir + '/' + name;
+    }
+
+    // files directly in the directory are summed, subdirectories are listed for the caller to walk
+    void ReadDir(const QByteArray& path, qint64& fileBytes, QList<QByteArray>& subdirs)
+    {
+      fileBytes = 0;
+      DIR* dir = opendir(path.constData());
+      if (!dir)
+      {
+        return;
+      }
+      while (const dirent* entry = readdir(dir))
+      {
+        if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+        {
+          continue;
+        }
+        if (entry->d_type == DT_DIR)
+        {
+          subdirs.append(entry->d_name);
+          continue;
+        }
+        struct stat st;
+        if (lstat(JoinPath(path, entry->d_name).constData(), &st) != 0)
+        {
+          continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+          subdirs.append(entry->d_name);
+        }
+        else
+        {
+          fileBytes += st.st_size;
+        }
+      }
+      closedir(dir);
+    }
+  } // namespace
+
+  FolderSizes& FolderSizes::Instance()
+  {
+    static FolderSizes sizes;
+    return sizes;
+  }
+
+  FolderSizes::FolderSizes()
+    : QObject()
+    , Measurers(
+      this, SIGNAL(SizesReady()), NOTIFY_INTERVAL_MILLISECONDS, 1, 0, Measurer(AUTOMATIC_BUDGET_MILLISECONDS, MAX_RECORDS)
+    )
+  {
+  }
+
+  FolderSizes::~FolderSizes()
+  {
+  }
+
+  QString FolderSizes::GetSizeText(const QString& path) const
+  {
+    const qint64 size = Sizes.value(path, GAVE_UP);
+    return size == GAVE_UP ? QString() : FormatSize(size);
+  }
+
+  void FolderSizes::Request(const QString& path, bool automatic)
+  {
+    if (automatic && (Measurers.IsRequested(path) || Sizes.value(path) == GAVE_UP))
+    {
+      return;
+    }
+    // the measurer would get stuck in the first directory of it
+    if (FsAccess::Instance().IsQuarantined(path))
+    {
+      return;
+    }
+    // explicit requests go first
+    Measurers.Push(path, automatic, !automatic);
+  }
+
+  FolderSizes::Measurer::Measurer(int automaticBudget, int maxRecords)
+    : AutomaticBudget(automaticBudget)
+    , MaxRecords(maxRecords)
+  {
+  }
+
+  void FolderSizes::Measurer::operator()(const QString& path, bool automatic, const MeasureQueue::Worker& worker)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray encoded = QFile::encodeName(path);
+    // mount points below are not followed, like du -x
+    struct stat st;
+    qint64 size = 0;
+    const bool measured = lstat(encoded.constData(), &st) == 0
+      && Measure(encoded, st.st_dev, timer, automatic ? AutomaticBudget : 0, worker, size);
+    if (Records.size() > MaxRecords)
+    {
+      Records.clear();
+    }
+    worker.Deliver("OnMeasured", Q_ARG(QString, path), Q_ARG(qint64, measured ? size : GAVE_UP));
+  }
+
+  bool FolderSizes::Measurer::Measure(
+    const QByteArray& path,
+    quint64 device,
+    const QElapsedTimer& timer,
+    int budget,
+    const MeasureQueue::Worker& worker,
+    qint64& size
+  )
+  {
+    size = 0;
+    if (worker.IsStopping() || (budget && timer.hasExpired(budget)))
+    {
+      return false;
+    }
+    struct stat st;
+    if (lstat(path.constData(), &st) != 0 || !S_ISDIR(st.st_mode) || static_cast<quint64>(st.st_dev) != device)
+    {
+      return true;
+    }
+    const qint64 modified = GetModified(st);
+    QHash<QByteArray, DirRecord>::iterator it = Records.find(path);
+    if (it == Records.end() || it->Modified != modified)
+    {
+      DirRecord record;
+      record.Modified = modified;
+      ReadDir(path, record.FileBytes, record.Subdirs);
+      it = Records.insert(path, record);
+    }
+    // copied, walking the subdirectories inserts into the hash
+    const DirRecord record = *it;
+    size = record.FileBytes;
+    foreach(const QByteArray& subdir, record.Subdirs)
+    {
+      qint64 subdirSize = 0;
+      if (!Measure(JoinPath(path, subdir), device, timer, budget, worker, subdirSize))
+      {
+        return false;
+      }
+      size += subdirSize;
+    }
+    return true;
+  }
+
+  void FolderSizes::OnMeasured(const QString& path, qint64 size)
+  {
+    Sizes.insert(path, size);
+    Measurers.Done(path);
+  }
+} // namespace TotalFinder
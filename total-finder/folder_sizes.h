@@ -0,0 +1,85 @@
+#pragma once
+
+#include "background_queue.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QElapsedTimer;
+
+namespace TotalFinder
+{
+  // Recursive sizes of directories, measured on the IO pool one directory at a time.
+  // Every directory walked is remembered with its mtime, the sizes of the files directly in it
+  // and its subdirectories, so measuring a subtree again only stats the directories whose mtime
+  // hasn't changed. Files changed in place keep the size they had when their directory was read
+  class FolderSizes: public QObject
+  {
+    Q_OBJECT
+    // automatic requests give up on subtrees that take longer than this
+    const int AUTOMATIC_BUDGET_MILLISECONDS = 250;
+    const int MAX_RECORDS = 256 * 1024;
+    const int NOTIFY_INTERVAL_MILLISECONDS = 100;
+
+  public:
+    static FolderSizes& Instance();
+    ~FolderSizes() override;
+
+    // empty if the size is not known
+    QString GetSizeText(const QString& path) const;
+    // automatic requests go after explicit ones, are dropped for subtrees
+    // that took too long before and are given up when over the budget
+    void Request(const QString& path, bool automatic);
+
+  signals:
+    // GetSizeText has something new to say about one or more of the requested directories
+    void SizesReady();
+
+  private slots:
+    void OnMeasured(const QString& path, qint64 size);
+
+  private:
+    // items tell whether the request is automatic
+    typedef BackgroundQueue<bool> MeasureQueue;
+
+    // walks the requested directories on the IO pool, owns what it has learnt about them
+    class Measurer
+    {
+    public:
+      Measurer(int automaticBudget, int maxRecords);
+
+      void operator()(const QString& path, bool automatic, const MeasureQueue::Worker& worker);
+
+    private:
+      struct DirRecord
+      {
+        qint64 Modified;
+        qint64 FileBytes;
+        QList<QByteArray> Subdirs;
+      };
+
+      // false if stopped or over the budget
+      bool Measure(
+        const QByteArray& path,
+        quint64 device,
+        const QElapsedTimer& timer,
+        int budget,
+        const MeasureQueue::Worker& worker,
+        qint64& size
+      );
+
+      int AutomaticBudget;
+      int MaxRecords;
+      QHash<QByteArray, DirRecord> Records;
+    };
+
+    FolderSizes();
+
+    QHash<QString, qint64> Sizes; // by absolute path, GUI thread only
+    // by path; declared last, so no measurer delivers to a half destroyed object
+    MeasureQueue Measurers;
+  };
+} // namespace TotalFinder
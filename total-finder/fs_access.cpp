@@ -0,0 +1,410 @@
+#include "fs_access.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QMetaObject>
+#include <QStringList>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    const char FAULTS_VARIABLE[] = "TF_FS_FAULTS";
+
+    // errors of the mount rather than of the path, they count towards quarantine as timeouts do
+    bool IsMountFailure(int error)
+    {
+      return error == ETIMEDOUT || error == EIO || error == ENOTCONN || error == ESTALE
+        || error == EHOSTDOWN || error == EHOSTUNREACH;
+    }
+
+    bool IsLongerPath(const MountPoint& left, const MountPoint& right)
+    {
+      return left.Path.size() > right.Path.size();
+    }
+  } // namespace
+
+  FsAccess& FsAccess::Instance()
+  {
+    static FsAccess access;
+    return access;
+  }
+
+  FsAccess::FsAccess()
+    : QObject()
+    , Shared(std::make_shared<Delivery>())
+    , NextId(0)
+    , QuarantinedMounts(0)
+    , CheckTimer(new QTimer(this))
+  {
+    qRegisterMetaType<FsResult>("TotalFinder::FsResult");
+    const QString faults = QString::fromLocal8Bit(qgetenv(FAULTS_VARIABLE));
+    if (faults.isEmpty())
+    {
+      Shared->Backend = std::make_shared<PosixBackend>();
+    }
+    else
+    {
+      Shared->Backend = std::make_shared<FaultInjectingBackend>(std::unique_ptr<FsBackend>(new PosixBackend()), faults);
+    }
+    Shared->Owner = this;
+    Clock.start();
+    UpdateMountTable();
+    CheckTimer->setInterval(CHECK_INTERVAL_MILLISECONDS);
+    connect(CheckTimer, SIGNAL(timeout()), SLOT(OnCheckTimer()));
+  }
+
+  FsAccess::~FsAccess()
+  {
+    // threads stuck in calls are left behind, they find nobody to deliver to once they return
+    {
+      std::lock_guard<std::mutex> lock(Shared->Lock);
+      Shared->Owner = nullptr;
+    }
+    foreach(const Mount& mount, Mounts)
+    {
+      std::lock_guard<std::mutex> lock(mount.Queue->Lock);
+      mount.Queue->Queue.clear();
+    }
+  }
+
+  void FsAccess::Stat(const QString& path, QObject* context, const Callback& callback)
+  {
+    Submit(STAT, path, context, callback);
+  }
+
+  void FsAccess::MakeDir(const QString& path, QObject* context, const Callback& callback)
+  {
+    Submit(MAKE_DIR, path, context, callback);
+  }
+
+  void FsAccess::CreateFile(const QString& path, QObject* context, const Callback& callback)
+  {
+    Submit(CREATE_FILE, path, context, callback);
+  }
+
+  bool FsAccess::IsQuarantined(const QString& path)
+  {
+    // asked for every row painted, nearly always with nothing quarantined
+    if (!QuarantinedMounts)
+    {
+      return false;
+    }
+    return GetMount(path).Quarantined;
+  }
+
+  QString FsAccess::GetMountPoint(const QString& path)
+  {
+    return GetMount(path).Path;
+  }
+
+  QString FsAccess::GetErrorText(int error)
+  {
+    if (error == ETIMEDOUT)
+    {
+      return "not responding";
+    }
+    if (error == EHOSTDOWN)
+    {
+      return "not responding, access suspended";
+    }
+    return QString::fromLocal8Bit(std::strerror(error));
+  }
+
+  void FsAccess::Submit(Operation operation, const QString& path, QObject* context, const Callback& callback)
+  {
+    const QString cleanPath = QDir::cleanPath(path);
+    Mount& mount = GetMount(cleanPath);
+    const qint64 now = Clock.elapsed();
+    const quint64 id = NextId++;
+    Request& request = Requests[id];
+    request.MountPath = mount.Path;
+    request.Context = context;
+    request.Done = callback;
+    request.Timeout = mount.Network ? NETWORK_TIMEOUT_MILLISECONDS : LOCAL_TIMEOUT_MILLISECONDS;
+    request.Deadline = -1;
+    request.Probe = false;
+    request.Rejected = false;
+    if (mount.Quarantined)
+    {
+      // with every thread stuck a probe would only wait in the queue
+      if (mount.Probing || now < mount.RetryAt || mount.Stuck >= MAX_THREADS_PER_MOUNT)
+      {
+        Reject(id, request);
+        return;
+      }
+      // half open: this call decides whether the mount is back
+      mount.Probing = true;
+      request.Probe = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mount.Queue->Lock);
+      mount.Queue->Queue.push_back(Job{id, operation, cleanPath});
+      if (mount.Queue->Threads < MAX_THREADS_PER_MOUNT)
+      {
+        // own threads rather than the shared pools: a hung call keeps its thread forever
+        ++mount.Queue->Threads;
+        std::thread(&FsAccess::RunLane, Shared, mount.Queue).detach();
+      }
+    }
+    if (!CheckTimer->isActive())
+    {
+      CheckTimer->start();
+    }
+  }
+
+  void FsAccess::Reject(quint64 id, Request& request)
+  {
+    request.Rejected = true;
+    FsResult result;
+    result.Error = EHOSTDOWN;
+    // callers never get their callback from inside their own call
+    QMetaObject::invokeMethod(
+      this, "OnCompleted", Qt::QueuedConnection, Q_ARG(quint64, id), Q_ARG(TotalFinder::FsResult, result)
+    );
+  }
+
+  void FsAccess::RunLane(std::shared_ptr<Delivery> delivery, std::shared_ptr<Lane> lane)
+  {
+    std::unique_lock<std::mutex> lock(lane->Lock);
+    while (!lane->Queue.empty())
+    {
+      const Job job = lane->Queue.front();
+      lane->Queue.pop_front();
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> ownerLock(delivery->Lock);
+        if (delivery->Owner)
+        {
+          // queued ahead of the result, so it always arrives first
+          QMetaObject::invokeMethod(delivery->Owner, "OnStarted", Qt::QueuedConnection, Q_ARG(quint64, job.Id));
+        }
+      }
+      FsResult result;
+      switch (job.Op)
+      {
+      case STAT:
+        result.Error = delivery->Backend->Stat(job.Path, result);
+        break;
+      case MAKE_DIR:
+        result.Error = delivery->Backend->MakeDir(job.Path);
+        break;
+      case CREATE_FILE:
+        result.Error = delivery->Backend->CreateFile(job.Path);
+        break;
+      }
+      {
+        std::lock_guard<std::mutex> ownerLock(delivery->Lock);
+        if (delivery->Owner)
+        {
+          QMetaObject::invokeMethod(
+            delivery->Owner, "OnCompleted", Qt::QueuedConnection,
+            Q_ARG(quint64, job.Id), Q_ARG(TotalFinder::FsResult, result)
+          );
+        }
+      }
+      lock.lock();
+    }
+    --lane->Threads;
+  }
+
+  void FsAccess::OnStarted(quint64 id)
+  {
+    QHash<quint64, Request>::iterator it = Requests.find(id);
+    if (it != Requests.end() && !it->Rejected)
+    {
+      it->Deadline = Clock.elapsed() + it->Timeout;
+    }
+  }
+
+  void FsAccess::OnCompleted(quint64 id, const FsResult& result)
+  {
+    QHash<quint64, Request>::iterator it = Requests.find(id);
+    if (it == Requests.end())
+    {
+      // answered after its deadline, the caller has had its ETIMEDOUT already
+      const QHash<quint64, QString>::iterator abandoned = Abandoned.find(id);
+      if (abandoned != Abandoned.end())
+      {
+        --Mounts[abandoned.value()].Stuck;
+        Abandoned.erase(abandoned);
+      }
+      return;
+    }
+    const Request request = it.value();
+    Requests.erase(it);
+    if (!request.Rejected)
+    {
+      Mount& mount = Mounts[request.MountPath];
+      if (IsMountFailure(result.Error))
+      {
+        OnMountFailed(mount, request.Probe);
+      }
+      else
+      {
+        OnMountAnswered(mount, request.Probe);
+      }
+    }
+    if (request.Done && request.Context)
+    {
+      request.Done(result);
+    }
+  }
+
+  void FsAccess::OnCheckTimer()
+  {
+    const qint64 now = Clock.elapsed();
+    QList<quint64> expired;
+    for (QHash<quint64, Request>::const_iterator it = Requests.constBegin(); it != Requests.constEnd(); ++it)
+    {
+      if (!it.value().Rejected && it.value().Deadline != -1 && it.value().Deadline <= now)
+      {
+        expired.append(it.key());
+      }
+    }
+    FsResult timeout;
+    timeout.Error = ETIMEDOUT;
+    foreach(quint64 id, expired)
+    {
+      // rejected meanwhile by the quarantine an earlier one of them has started
+      const QHash<quint64, Request>::const_iterator it = Requests.constFind(id);
+      if (it == Requests.constEnd() || it->Rejected)
+      {
+        continue;
+      }
+      const Request request = Requests.take(id);
+      Mount& mount = Mounts[request.MountPath];
+      ++mount.Stuck;
+      Abandoned.insert(id, request.MountPath);
+      OnMountFailed(mount, request.Probe);
+      if (request.Done && request.Context)
+      {
+        request.Done(timeout);
+      }
+    }
+
+    // quarantined mounts are probed on their own, so they come back even if nobody asks for them
+    QStringList probes;
+    foreach(const Mount& mount, Mounts)
+    {
+      if (mount.Quarantined && !mount.Probing && mount.RetryAt <= now && mount.Stuck < MAX_THREADS_PER_MOUNT)
+      {
+        probes.append(mount.Path);
+      }
+    }
+    foreach(const QString& path, probes)
+    {
+      Submit(STAT, path, this, Callback());
+    }
+
+    if (Requests.isEmpty() && !QuarantinedMounts)
+    {
+      CheckTimer->stop();
+    }
+  }
+
+  FsAccess::Mount& FsAccess::GetMount(const QString& path)
+  {
+    if (MountTableAge.hasExpired(MOUNT_TABLE_MAX_AGE_MILLISECONDS))
+    {
+      UpdateMountTable();
+    }
+    MountPoint point{"/", false};
+    foreach(const MountPoint& candidate, MountTable)
+    {
+      if (IsUnderPath(path, candidate.Path))
+      {
+        point = candidate;
+        break;
+      }
+    }
+    QHash<QString, Mount>::iterator it = Mounts.find(point.Path);
+    if (it == Mounts.end())
+    {
+      const Mount mount{
+        point.Path, point.Network, 0, false, 0, MIN_QUARANTINE_MILLISECONDS, false, 0, std::make_shared<Lane>()
+      };
+      it = Mounts.insert(point.Path, mount);
+    }
+    it->Network = point.Network;
+    return it.value();
+  }
+
+  void FsAccess::UpdateMountTable()
+  {
+    // the table is read from the kernel, it never waits for the mounts themselves
+    MountTable = Shared->Backend->GetMountPoints();
+    std::stable_sort(MountTable.begin(), MountTable.end(), IsLongerPath);
+    MountTableAge.start();
+  }
+
+  void FsAccess::OnMountAnswered(Mount& mount, bool probe)
+  {
+    mount.Failures = 0;
+    if (probe)
+    {
+      mount.Probing = false;
+    }
+    if (!mount.Quarantined)
+    {
+      return;
+    }
+    // a late answer of a call from before the quarantine is as good as the probe's
+    qDebug() << "Mount responds again:" << mount.Path;
+    mount.Quarantined = false;
+    mount.Probing = false;
+    mount.QuarantineMilliseconds = MIN_QUARANTINE_MILLISECONDS;
+    --QuarantinedMounts;
+    emit MountStateChanged(mount.Path, false);
+  }
+
+  void FsAccess::OnMountFailed(Mount& mount, bool probe)
+  {
+    if (probe)
+    {
+      mount.Probing = false;
+    }
+    if (mount.Quarantined)
+    {
+      if (probe)
+      {
+        mount.QuarantineMilliseconds = qMin(2 * mount.QuarantineMilliseconds, MAX_QUARANTINE_MILLISECONDS);
+        mount.RetryAt = Clock.elapsed() + mount.QuarantineMilliseconds;
+      }
+      return;
+    }
+    // with all its threads stuck nothing queued for the mount would ever run
+    if (++mount.Failures >= FAILURES_TO_QUARANTINE || mount.Stuck >= MAX_THREADS_PER_MOUNT)
+    {
+      Quarantine(mount);
+    }
+  }
+
+  void FsAccess::Quarantine(Mount& mount)
+  {
+    qWarning() << "Mount is not responding, quarantined for" << mount.QuarantineMilliseconds << "ms:" << mount.Path;
+    mount.Quarantined = true;
+    mount.RetryAt = Clock.elapsed() + mount.QuarantineMilliseconds;
+    ++QuarantinedMounts;
+    // calls queued behind the stuck ones would only time out one by one
+    std::deque<Job> queued;
+    {
+      std::lock_guard<std::mutex> lock(mount.Queue->Lock);
+      queued.swap(mount.Queue->Queue);
+    }
+    for (const Job& job: queued)
+    {
+      QHash<quint64, Request>::iterator it = Requests.find(job.Id);
+      if (it != Requests.end() && !it->Rejected)
+      {
+        Reject(job.Id, it.value());
+      }
+    }
+    emit MountStateChanged(mount.Path, true);
+  }
+} // namespace TotalFinder
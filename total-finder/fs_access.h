@@ -0,0 +1,149 @@
+#pragma once
+
+#include "fs_backend.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace TotalFinder
+{
+  // Filesystem calls of the GUI go through here instead of blocking it. Every call runs on a thread
+  // of the mount it targets and comes back on the GUI thread, with ETIMEDOUT if the mount doesn't answer
+  // in time once the call has started. Mounts that keep timing out, or have all their threads stuck, are
+  // quarantined: calls to them fail at once with EHOSTDOWN and a single probe is let through now and then,
+  // waiting twice as long after each failed one.
+  // Setting TF_FS_FAULTS puts a FaultInjectingBackend in front of the calls made here. The background
+  // readers (DirLoader, MetadataLoader, FolderSizes, the thumbnail and icon caches) don't go through it,
+  // they only ask IsQuarantined before they start
+  class FsAccess: public QObject
+  {
+    Q_OBJECT
+    const int LOCAL_TIMEOUT_MILLISECONDS = 10000;
+    const int NETWORK_TIMEOUT_MILLISECONDS = 3000;
+    // consecutive timeouts or failed calls that quarantine a mount, only calls that have started count
+    const int FAILURES_TO_QUARANTINE = 3;
+    const int MIN_QUARANTINE_MILLISECONDS = 10000;
+    const int MAX_QUARANTINE_MILLISECONDS = 5 * 60 * 1000;
+    // threads a mount may have stuck in calls; more calls wait in its queue
+    const int MAX_THREADS_PER_MOUNT = 2;
+    const int MOUNT_TABLE_MAX_AGE_MILLISECONDS = 5000;
+    const int CHECK_INTERVAL_MILLISECONDS = 250;
+
+  public:
+    typedef std::function<void (const FsResult&)> Callback;
+
+    static FsAccess& Instance();
+    ~FsAccess() override;
+
+    // the callback runs on the GUI thread, always after the call has returned, and not at all
+    // if the context is gone by then
+    void Stat(const QString& path, QObject* context, const Callback& callback);
+    void MakeDir(const QString& path, QObject* context, const Callback& callback);
+    void CreateFile(const QString& path, QObject* context, const Callback& callback);
+    // without touching the disk, for background work that would only get stuck there
+    bool IsQuarantined(const QString& path);
+    // mount point the path belongs to, from the cached mount table
+    QString GetMountPoint(const QString& path);
+    // for the status bar, timeouts and quarantine read as the mount not responding
+    static QString GetErrorText(int error);
+
+  signals:
+    void MountStateChanged(const QString& mountPoint, bool quarantined);
+
+  private slots:
+    void OnStarted(quint64 id);
+    void OnCompleted(quint64 id, const TotalFinder::FsResult& result);
+    void OnCheckTimer();
+
+  private:
+    enum Operation
+    {
+      STAT,
+      MAKE_DIR,
+      CREATE_FILE
+    };
+
+    struct Job
+    {
+      quint64 Id;
+      Operation Op;
+      QString Path;
+    };
+
+    // worker side of a mount, outlives FsAccess as long as a thread of it is stuck
+    struct Lane
+    {
+      Lane(): Threads(0) {}
+
+      std::mutex Lock;
+      std::deque<Job> Queue;
+      int Threads;
+    };
+
+    // what worker threads deliver results through; Owner is cleared before FsAccess goes away
+    struct Delivery
+    {
+      Delivery(): Owner(nullptr) {}
+
+      std::mutex Lock;
+      FsAccess* Owner;
+      std::shared_ptr<FsBackend> Backend;
+    };
+
+    struct Mount
+    {
+      QString Path;
+      bool Network;
+      int Failures; // consecutive
+      bool Quarantined;
+      qint64 RetryAt; // when the next probe may go while quarantined
+      int QuarantineMilliseconds;
+      bool Probing;
+      int Stuck; // threads still in calls that have timed out, the mount runs nothing once all are
+      std::shared_ptr<Lane> Queue;
+    };
+
+    struct Request
+    {
+      QString MountPath;
+      QPointer<QObject> Context;
+      Callback Done;
+      int Timeout;
+      qint64 Deadline; // -1 while waiting in the queue, the wait there is not the mount's fault
+      bool Probe;
+      bool Rejected; // failed fast by quarantine, not an answer of the mount
+    };
+
+    FsAccess();
+
+    void Submit(Operation operation, const QString& path, QObject* context, const Callback& callback);
+    void Reject(quint64 id, Request& request);
+    Mount& GetMount(const QString& path);
+    void UpdateMountTable();
+    void OnMountAnswered(Mount& mount, bool probe);
+    void OnMountFailed(Mount& mount, bool probe);
+    void Quarantine(Mount& mount);
+    static void RunLane(std::shared_ptr<Delivery> delivery, std::shared_ptr<Lane> lane);
+
+    std::shared_ptr<Delivery> Shared;
+    QList<MountPoint> MountTable; // longest paths first
+    QElapsedTimer MountTableAge;
+    QHash<QString, Mount> Mounts; // by mount point, state is kept across updates of the table
+    QHash<quint64, Request> Requests; // waiting for their results
+    QHash<quint64, QString> Abandoned; // mount paths of the timed out calls, until their threads return
+    quint64 NextId;
+    int QuarantinedMounts;
+    QElapsedTimer Clock;
+    QTimer* CheckTimer; // deadlines of the requests and probes of the quarantined mounts
+  };
+} // namespace TotalFinder
@@ -0,0 +1,201 @@
+#include "fs_backend.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <sys/mount.h>
+#include <sys/param.h>
+#else
+#include <mntent.h>
+#include <stdio.h>
+#endif
+
+namespace TotalFinder
+{
+  namespace
+  {
+    const unsigned long HANG_SLEEP_SECONDS = 3600;
+
+    // file system types served by another machine or a user space process
+    bool IsNetworkType(const QString& type)
+    {
+      static const QStringList types = QStringList()
+        << "nfs" << "nfs4" << "smbfs" << "cifs" << "smb3" << "afpfs" << "webdav" << "9p" << "afs" << "ceph"
+        << "glusterfs" << "sshfs" << "osxfuse" << "macfuse";
+      return types.contains(type) || type.startsWith("fuse");
+    }
+
+    qint64 GetModifiedMilliseconds(const struct stat& st)
+    {
+#if defined(__APPLE__)
+      return static_cast<qint64>(st.st_mtimespec.tv_sec) * 1000 + st.st_mtimespec.tv_nsec / 1000000;
+#else
+      return static_cast<qint64>(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+#endif
+    }
+  } // namespace
+
+  FsResult::FsResult()
+    : Error(0)
+    , IsDir(false)
+    , Size(0)
+    , Modified(0)
+  {
+  }
+
+  bool IsUnderPath(const QString& path, const QString& dir)
+  {
+    if (dir == "/")
+    {
+      return path.startsWith('/');
+    }
+    return path.startsWith(dir) && (path.size() == dir.size() || path[dir.size()] == '/');
+  }
+
+  FsBackend::~FsBackend()
+  {
+  }
+
+  int PosixBackend::Stat(const QString& path, FsResult& result)
+  {
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+    {
+      return errno;
+    }
+    result.IsDir = S_ISDIR(st.st_mode);
+    result.Size = st.st_size;
+    result.Modified = GetModifiedMilliseconds(st);
+    return 0;
+  }
+
+  int PosixBackend::MakeDir(const QString& path)
+  {
+    if (::mkdir(QFile::encodeName(path).constData(), 0755) != 0)
+    {
+      return errno;
+    }
+    return 0;
+  }
+
+  int PosixBackend::CreateFile(const QString& path)
+  {
+    const int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CREAT, 0666);
+    if (fd == -1)
+    {
+      return errno;
+    }
+    ::close(fd);
+    return 0;
+  }
+
+  QList<MountPoint> PosixBackend::GetMountPoints()
+  {
+    QList<MountPoint> result;
+#if defined(__APPLE__)
+    // cached statistics, MNT_WAIT would ask every file system and hang on the very mounts this is about
+    struct statfs* mounts = nullptr;
+    const int count = getmntinfo(&mounts, MNT_NOWAIT);
+    for (int i = 0; i < count; ++i)
+    {
+      const bool network = !(mounts[i].f_flags & MNT_LOCAL) || IsNetworkType(mounts[i].f_fstypename);
+      result.append(MountPoint{QFile::decodeName(mounts[i].f_mntonname), network});
+    }
+#else
+    FILE* table = setmntent("/proc/self/mounts", "r");
+    if (!table)
+    {
+      return result;
+    }
+    while (const struct mntent* mount = getmntent(table))
+    {
+      result.append(MountPoint{QFile::decodeName(mount->mnt_dir), IsNetworkType(mount->mnt_type)});
+    }
+    endmntent(table);
+#endif
+    return result;
+  }
+
+  FaultInjectingBackend::FaultInjectingBackend(std::unique_ptr<FsBackend> backend, const QString& rules)
+    : Backend(std::move(backend))
+  {
+    foreach(const QString& rule, rules.split(';', QString::SkipEmptyParts))
+    {
+      const int separator = rule.lastIndexOf('=');
+      if (separator <= 0)
+      {
+        qWarning() << "Skip malformed file system fault:" << rule;
+        continue;
+      }
+      const QString value = rule.mid(separator + 1).trimmed();
+      bool ok = value == "hang";
+      const int delay = ok ? -1 : value.toInt(&ok);
+      if (!ok)
+      {
+        qWarning() << "Skip malformed file system fault:" << rule;
+        continue;
+      }
+      Faults.append(Fault{rule.left(separator).trimmed(), delay});
+      qDebug() << "File system fault injected under" << Faults.last().Path << "delay" << delay;
+    }
+  }
+
+  int FaultInjectingBackend::Stat(const QString& path, FsResult& result)
+  {
+    Inject(path);
+    return Backend->Stat(path, result);
+  }
+
+  int FaultInjectingBackend::MakeDir(const QString& path)
+  {
+    Inject(path);
+    return Backend->MakeDir(path);
+  }
+
+  int FaultInjectingBackend::CreateFile(const QString& path)
+  {
+    Inject(path);
+    return Backend->CreateFile(path);
+  }
+
+  QList<MountPoint> FaultInjectingBackend::GetMountPoints()
+  {
+    QList<MountPoint> result = Backend->GetMountPoints();
+    foreach(const Fault& fault, Faults)
+    {
+      result.append(MountPoint{fault.Path, true});
+    }
+    return result;
+  }
+
+  void FaultInjectingBackend::Inject(const QString& path) const
+  {
+    foreach(const Fault& fault, Faults)
+    {
+      if (!IsUnderPath(path, fault.Path))
+      {
+        continue;
+      }
+      if (fault.DelayMilliseconds >= 0)
+      {
+        QThread::msleep(fault.DelayMilliseconds);
+        return;
+      }
+      // as a dead NFS server does: the call never comes back
+      for (;;)
+      {
+        QThread::sleep(HANG_SLEEP_SECONDS);
+      }
+    }
+  }
+} // namespace TotalFinder
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+#include <memory>
+
+namespace TotalFinder
+{
+  // Outcome of one call of FsAccess
+  struct FsResult
+  {
+    FsResult();
+
+    int Error; // errno, 0 on success
+    // Stat only
+    bool IsDir;
+    qint64 Size;
+    qint64 Modified; // milliseconds since epoch
+  };
+
+  struct MountPoint
+  {
+    QString Path;
+    // remote or user space file systems, which stop answering far more often than disks
+    bool Network;
+  };
+
+  // What actually touches the file system. Calls run on threads of FsAccess and may block
+  // for as long as the file system wants; they return errno, 0 on success
+  class FsBackend
+  {
+  public:
+    virtual ~FsBackend();
+
+    virtual int Stat(const QString& path, FsResult& result) = 0;
+    virtual int MakeDir(const QString& path) = 0;
+    // creates an empty file if there is none, an existing one is left as it is
+    virtual int CreateFile(const QString& path) = 0;
+    // from the kernel's mount table, without touching the mounts themselves
+    virtual QList<MountPoint> GetMountPoints() = 0;
+  };
+
+  class PosixBackend: public FsBackend
+  {
+  public:
+    int Stat(const QString& path, FsResult& result) override;
+    int MakeDir(const QString& path) override;
+    int CreateFile(const QString& path) override;
+    QList<MountPoint> GetMountPoints() override;
+  };
+
+  // Stand-in for a misbehaving server: calls under the configured paths are delayed or never return.
+  // Each of these paths is a mount point of its own, so isolation can be tried on a local directory.
+  // Rules are "path=milliseconds" or "path=hang", separated by ';'
+  class FaultInjectingBackend: public FsBackend
+  {
+  public:
+    FaultInjectingBackend(std::unique_ptr<FsBackend> backend, const QString& rules);
+
+    int Stat(const QString& path, FsResult& result) override;
+    int MakeDir(const QString& path) override;
+    int CreateFile(const QString& path) override;
+    QList<MountPoint> GetMountPoints() override;
+
+  private:
+    struct Fault
+    {
+      QString Path;
+      int DelayMilliseconds; // -1 hangs
+    };
+
+    void Inject(const QString& path) const;
+
+    std::unique_ptr<FsBackend> Backend;
+    QList<Fault> Faults;
+  };
+
+  // true if the path is the directory itself or anything below it
+  bool IsUnderPath(const QString& path, const QString& dir);
+} // namespace TotalFinder
+
+Q_DECLARE_METATYPE(TotalFinder::FsResult)
@@ -0,0 +1,107 @@
+#include "icon_cache.h"
+#include "entry_table.h"
+#include "fs_access.h"
+
+#include <QFileIconProvider>
+#include <QFileInfo>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    // like QFileInfo::suffix, but without touching the disk; names starting with a dot have none
+    QString GetExtension(const QString& fileName)
+    {
+      const int dot = fileName.lastIndexOf('.');
+      return dot > 0 ? fileName.mid(dot + 1).toLower() : QString();
+    }
+
+    void Resolve(const QString& key, const QString& path, const BackgroundQueue<QString>::Worker& worker)
+    {
+      // QFileSystemModel resolves icons off the GUI thread the same way
+      QFileIconProvider provider;
+      const QIcon icon = provider.icon(QFileInfo(path));
+      worker.Deliver("OnResolved", Q_ARG(QString, key), Q_ARG(QIcon, icon));
+    }
+  } // namespace
+
+  IconCache& IconCache::Instance()
+  {
+    static IconCache cache;
+    return cache;
+  }
+
+  IconCache::IconCache()
+    : QObject()
+    , FileIcons(MAX_FILE_ICONS)
+    , Resolver(this, SIGNAL(IconsReady()), NOTIFY_INTERVAL_MILLISECONDS, 1, MAX_PENDING, Resolve)
+  {
+    QFileIconProvider provider;
+    FolderIcon = provider.icon(QFileIconProvider::Folder);
+    FileIcon = provider.icon(QFileIconProvider::File);
+  }
+
+  IconCache::~IconCache()
+  {
+  }
+
+  QIcon IconCache::GetIcon(const QDir& dir, const QString& fileName, int flags)
+  {
+    const QString extension = GetExtension(fileName);
+    if (flags & EntryTable::FLAG_DIR)
+    {
+      // bundles (.app, .framework) are directories with an icon of their own
+      if (extension.isEmpty())
+      {
+        return FolderIcon;
+      }
+      const QString path = dir.absoluteFilePath(fileName);
+      return Request(path, path, FolderIcon);
+    }
+    if (flags & EntryTable::FLAG_EXECUTABLE)
+    {
+      const QString path = dir.absoluteFilePath(fileName);
+      return Request(path, path, FileIcon);
+    }
+    if (extension.isEmpty())
+    {
+      return FileIcon;
+    }
+    // the first file of a type stands for all of them
+    const QString key = "." + extension;
+    const QHash<QString, QIcon>::const_iterator it = TypeIcons.find(key);
+    if (it != TypeIcons.end())
+    {
+      return it.value();
+    }
+    return Request(key, dir.absoluteFilePath(fileName), FileIcon);
+  }
+
+  QIcon IconCache::Request(const QString& key, const QString& path, const QIcon& placeholder)
+  {
+    if (const QIcon* icon = FileIcons.object(key))
+    {
+      return *icon;
+    }
+    if (Resolver.IsRequested(key) || FsAccess::Instance().IsQuarantined(path))
+    {
+      return placeholder;
+    }
+    // latest requests first, they come from rows that are on screen now
+    Resolver.Push(key, path, true);
+    return placeholder;
+  }
+
+  void IconCache::OnResolved(const QString& key, const QIcon& icon)
+  {
+    if (key.startsWith('.'))
+    {
+      TypeIcons.insert(key, icon);
+    }
+    else
+    {
+      FileIcons.insert(key, new QIcon(icon));
+    }
+    Resolver.Done(key);
+  }
+} // namespace TotalFinder
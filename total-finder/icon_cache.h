@@ -0,0 +1,51 @@
+#pragma once
+
+#include "background_queue.h"
+
+#include <QCache>
+#include <QDir>
+#include <QHash>
+#include <QIcon>
+#include <QObject>
+#include <QString>
+
+namespace TotalFinder
+{
+  // Icons for directory rows. Most entries get an icon shared by their type (folder, extension);
+  // only bundles and executables have icons of their own. Everything that needs the platform
+  // to look at a file is resolved on the IO pool, until then a generic placeholder is returned
+  class IconCache: public QObject
+  {
+    Q_OBJECT
+    const int MAX_FILE_ICONS = 2048;
+    // rows scrolled out of view long ago are not worth resolving
+    const std::size_t MAX_PENDING = 512;
+    const int NOTIFY_INTERVAL_MILLISECONDS = 50;
+
+  public:
+    static IconCache& Instance();
+    ~IconCache() override;
+
+    // flags are EntryTable::Flags of the entry
+    QIcon GetIcon(const QDir& dir, const QString& fileName, int flags);
+
+  signals:
+    // some icons returned as placeholders are available now, batched
+    void IconsReady();
+
+  private slots:
+    void OnResolved(const QString& key, const QIcon& icon);
+
+  private:
+    IconCache();
+
+    QIcon Request(const QString& key, const QString& path, const QIcon& placeholder);
+
+    QIcon FolderIcon;
+    QIcon FileIcon;
+    QHash<QString, QIcon> TypeIcons; // by lower case extension, "." prefixed
+    QCache<QString, QIcon> FileIcons; // by absolute path
+    // path of the file to ask the platform about by key; declared last, it goes first
+    BackgroundQueue<QString> Resolver;
+  };
+} // namespace TotalFinder
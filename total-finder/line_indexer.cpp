@@ -0,0 +1,99 @@
+#include "line_indexer.h"
+
+#include <common/text_search.h>
+#include <common/thread_pool.h>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <functional>
+#include <vector>
+
+namespace TotalFinder
+{
+  LineIndexer::LineIndexer(const ViewedFile::Ptr& file, qint64 from, qint64 lines, QObject* parent)
+    : QObject(parent)
+    , File(file)
+    , From(from)
+    , Lines(lines)
+    , Started(false)
+  {
+    qRegisterMetaType<QVector<LineCheckpoint> >("QVector<LineCheckpoint>");
+  }
+
+  LineIndexer::~LineIndexer()
+  {
+    // pool task references this object, so wait until it reaches the nearest checkpoint
+    Control.Cancel();
+    if (Started)
+    {
+      Control.WaitFinished();
+    }
+  }
+
+  void LineIndexer::Start()
+  {
+    Started = true;
+    Common::ThreadPool::Io().Submit(std::bind(&LineIndexer::Run, this));
+  }
+
+  void LineIndexer::Cancel()
+  {
+    Control.Cancel();
+  }
+
+  void LineIndexer::Run()
+  {
+    QElapsedTimer timer;
+    timer.start();
+    QVector<LineCheckpoint> checkpoints;
+    std::vector<std::uint64_t> newlines;
+    std::vector<char> block(BLOCK_SIZE);
+    qint64 offset = From;
+    qint64 lines = Lines;
+    // the viewer's last checkpoint is at most that far before From, so gaps stay within twice the distance
+    qint64 last = From;
+    while (offset < File->GetSize() && Control.Checkpoint())
+    {
+      const qint64 size = File->Read(offset, BLOCK_SIZE, &block.front());
+      if (!size)
+      {
+        // truncated since it was opened, nothing more to index
+        emit ChunkIndexed(checkpoints, offset, lines);
+        break;
+      }
+      newlines.clear();
+      Search::FindNewlines(&block.front(), size, offset, newlines);
+      for (std::uint64_t newline: newlines)
+      {
+        const qint64 next = static_cast<qint64>(newline) + 1;
+        // inside a long line, before the line break
+        while (next - last > MAX_CHECKPOINT_DISTANCE)
+        {
+          last += MAX_CHECKPOINT_DISTANCE;
+          checkpoints.append(LineCheckpoint{last, lines});
+        }
+        if (++lines % LINES_PER_CHECKPOINT == 0)
+        {
+          last = next;
+          checkpoints.append(LineCheckpoint{last, lines});
+        }
+      }
+      offset += size;
+      while (offset - last > MAX_CHECKPOINT_DISTANCE)
+      {
+        last += MAX_CHECKPOINT_DISTANCE;
+        checkpoints.append(LineCheckpoint{last, lines});
+      }
+      if (timer.elapsed() >= CHUNK_INTERVAL_MILLISECONDS || offset == File->GetSize())
+      {
+        emit ChunkIndexed(checkpoints, offset, lines);
+        checkpoints.clear();
+        timer.restart();
+      }
+    }
+    qDebug() << "Line index" << (Control.IsCancelled() ? "cancelled at" : "built up to") << offset << "bytes," << lines << "lines";
+    emit Finished();
+    Control.Finish();
+  }
+} // namespace TotalFinder
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "viewed_file.h"
+
+#include <common/job_control.h>
+
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+namespace TotalFinder
+{
+  // Position in a viewed file with the number of line breaks before it
+  struct LineCheckpoint
+  {
+    qint64 Offset;
+    qint64 Line; // 0 based number of the line the offset is in
+  };
+
+  // Counts lines of a viewed file on the shared IO pool, handing the result over in chunks.
+  // Only a checkpoint every LINES_PER_CHECKPOINT lines or MAX_CHECKPOINT_DISTANCE bytes is kept:
+  // any line or offset is found from the nearest checkpoint with a short scan, even in files with
+  // next to no line breaks, and the index of a multi-GB log stays a few megabytes
+  class LineIndexer: public QObject
+  {
+    Q_OBJECT
+    const qint64 BLOCK_SIZE = 4 * 1024 * 1024;
+    const qint64 CHUNK_INTERVAL_MILLISECONDS = 100;
+    const qint64 LINES_PER_CHECKPOINT = 64;
+    // checkpoints inside long lines are not line starts
+    const qint64 MAX_CHECKPOINT_DISTANCE = 1024 * 1024;
+
+  public:
+
+    // continues an index built up to the offset from, which is the start of line number lines (0 based)
+    LineIndexer(const ViewedFile::Ptr& file, qint64 from, qint64 lines, QObject* parent);
+    ~LineIndexer() override;
+
+    void Start();
+    // returns immediately, Finished is still emitted when the pool task stops
+    void Cancel();
+
+  signals:
+    // emitted from the pool thread with the checkpoints found in this chunk, in order;
+    // lines is the count of line breaks before indexedSize
+    void ChunkIndexed(const QVector<LineCheckpoint>& checkpoints, qint64 indexedSize, qint64 lines);
+    void Finished();
+
+  private:
+    void Run();
+
+    ViewedFile::Ptr File;
+    qint64 From;
+    qint64 Lines;
+    Common::JobControl Control;
+    bool Started;
+  };
+} // namespace TotalFinder
+
+Q_DECLARE_METATYPE(TotalFinder::LineCheckpoint)
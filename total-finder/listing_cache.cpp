@@ -0,0 +1,609 @@
+#include "listing_cache.h"
+#include "dir_loader.h"
+#include "fs_access.h"
+#include "metadata_loader.h"
+
+#include <QDebug>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    bool IsSameEntry(const EntryTable& left, int leftRow, const EntryTable& right, int rightRow)
+    {
+      return left.GetSize(leftRow) == right.GetSize(rightRow)
+        && left.GetModified(leftRow) == right.GetModified(rightRow)
+        && left.GetFlags(leftRow) == right.GetFlags(rightRow)
+        && left.GetPermissionsText(leftRow) == right.GetPermissionsText(rightRow);
+    }
+
+    // rows without metadata yet are compared by type, a symlink reads as a directory only once it is stat'ed
+    bool IsSameType(const EntryTable& previous, int previousRow, const EntryTable& current, int currentRow)
+    {
+      if (current.GetFlags(currentRow) & EntryTable::FLAG_SYMLINK)
+      {
+        return previous.GetFlags(previousRow) & EntryTable::FLAG_SYMLINK;
+      }
+      return previous.IsDir(previousRow) == current.IsDir(currentRow);
+    }
+
+    // returns false if the snapshots are the same. Rows of the current table that have no metadata yet
+    // take the previous one and are read again, so a change of an existing file is an in place update
+    bool Compare(const EntryTable& previous, EntryTable& current, ListingDiff& diff)
+    {
+      diff.PreviousToCurrent.fill(-1, previous.Size());
+      int kept = 0;
+      for (int row = 0; row < current.Size(); ++row)
+      {
+        const int previousRow = previous.Find(current.GetFileName(row));
+        if (previousRow != -1 && current.IsPending(row) && IsSameType(previous, previousRow, current, row))
+        {
+          current.SetMetadata(row, previous, previousRow);
+          current.SetPending(row);
+          diff.PreviousToCurrent[previousRow] = row;
+          ++kept;
+        }
+        else if (previousRow != -1 && IsSameEntry(previous, previousRow, current, row))
+        {
+          diff.PreviousToCurrent[previousRow] = row;
+          ++kept;
+        }
+        else
+        {
+          diff.Added.append(row);
+        }
+      }
+      return !diff.Added.empty() || kept != previous.Size();
+    }
+
+    QString MakeKey(const QString& path, QDir::Filters filters)
+    {
+      return QString("%1|%2").arg(path).arg(static_cast<int>(filters));
+    }
+
+    // rows of listings nobody holds, kept for tabs that come back from hibernation
+    const int MAX_PARKED_ENTRIES = 256 * 1024;
+
+    // quiet time after the last change before the trailing refresh
+    const int DEBOUNCE_MILLISECONDS = 100;
+    // refreshes of big directories are spread wider, so rereading takes a small share of the time
+    const int MIN_REFRESH_INTERVAL_MILLISECONDS = 250;
+    const int REFRESH_INTERVAL_PER_LOAD_TIME = 4;
+    // directories changing faster than this are polled
+    const int HOT_CHANGES_PER_SECOND = 10;
+    const int MILLISECONDS_PER_SECOND = 1000;
+    const int POLL_INTERVAL_MILLISECONDS = 2000;
+  } // namespace
+
+  Listing::Listing(const QDir& dir, QObject* parent)
+    : QObject(parent)
+    , Dir(dir)
+    , Loader(nullptr)
+    , Metadata(nullptr)
+    , Probing(false)
+    , Probes(0)
+    , Refreshing(false)
+    , Complete(false)
+    , References(0)
+    , DirModified(0)
+    , PendingDirModified(0)
+    , RefreshTimer(new QTimer(this))
+    , LastLoadMilliseconds(0)
+    , ChangePending(false)
+    , PeriodChanges(0)
+    , Polling(false)
+    , SuppressedChanges(0)
+  {
+    RefreshTimer->setSingleShot(true);
+    connect(RefreshTimer, SIGNAL(timeout()), SLOT(OnRefreshTimer()));
+    ChangePeriod.start();
+  }
+
+  Listing::~Listing()
+  {
+    StopLoading();
+  }
+
+  const QDir& Listing::GetDir() const
+  {
+    return Dir;
+  }
+
+  const EntryTable& Listing::GetEntries() const
+  {
+    return Entries;
+  }
+
+  bool Listing::IsComplete() const
+  {
+    return Complete;
+  }
+
+  bool Listing::IsLoading() const
+  {
+    return Loader != nullptr || Probing;
+  }
+
+  bool Listing::IsPolling() const
+  {
+    return Polling;
+  }
+
+  int Listing::GetSuppressedChanges() const
+  {
+    return SuppressedChanges;
+  }
+
+  void Listing::PrioritizeMetadata(const QVector<int>& rows)
+  {
+    if (Metadata)
+    {
+      Metadata->Prioritize(rows);
+    }
+  }
+
+  void Listing::Refresh()
+  {
+    // rows already read stay until the new listing is complete, even if the first load is not over yet
+    ChangePending = false;
+    StopLoading();
+    StartLoading(true);
+  }
+
+  void Listing::Revalidate()
+  {
+    const int probe = ++Probes;
+    FsAccess::Instance().Stat(Dir.absolutePath(), this, [this, probe](const FsResult& result)
+    {
+      // released again, or a refresh has started in the meantime
+      if (probe != Probes || !References || IsLoading())
+      {
+        return;
+      }
+      if (!Complete || result.Error || result.Modified != DirModified)
+      {
+        Refresh();
+      }
+      else
+      {
+        // parking interrupts reading metadata
+        StartMetadata();
+      }
+    });
+  }
+
+  void Listing::StartLoading(bool refresh)
+  {
+    Refreshing = refresh;
+    PendingEntries.Clear();
+    LoadTime.start();
+    Probing = true;
+    const int probe = ++Probes;
+    FsAccess::Instance().Stat(Dir.absolutePath(), this, [this, probe](const FsResult& result)
+    {
+      OnDirProbed(probe, result);
+    });
+    emit LoadingChanged(true);
+  }
+
+  void Listing::OnDirProbed(int probe, const FsResult& result)
+  {
+    if (probe != Probes || !Probing)
+    {
+      return;
+    }
+    Probing = false;
+    if (result.Error)
+    {
+      qWarning() << "Failed to read directory" << Dir.absolutePath() << FsAccess::GetErrorText(result.Error);
+      // a refresh keeps the rows it has, a first load ends empty; the directory is read again
+      // once the mount answers, see ListingCache::OnMountStateChanged
+      if (!Complete)
+      {
+        Complete = true;
+        emit Loaded();
+      }
+      emit LoadingChanged(false);
+      return;
+    }
+    // taken before reading, a change during the load makes the snapshot outdated rather than the other way round
+    PendingDirModified = result.Modified;
+    Loader = new DirLoader(Dir, this);
+    connect(Loader, SIGNAL(ChunkLoaded(const EntryTable&)), SLOT(OnChunkLoaded(const EntryTable&)), Qt::QueuedConnection);
+    connect(Loader, SIGNAL(Finished()), SLOT(OnLoadFinished()), Qt::QueuedConnection);
+    connect(Loader, SIGNAL(Finished()), Loader, SLOT(deleteLater()), Qt::QueuedConnection);
+    Loader->Start();
+  }
+
+  void Listing::StopLoading()
+  {
+    StopMetadata();
+    Probing = false;
+    if (!Loader)
+    {
+      return;
+    }
+    // the loader deletes itself once its pool task notices the cancellation, even if this listing is gone by then
+    disconnect(Loader, 0, this, 0);
+    Loader->setParent(nullptr);
+    Loader->Cancel();
+    Loader = nullptr;
+  }
+
+  void Listing::StartMetadata()
+  {
+    StopMetadata();
+    // pool threads stuck in a dead mount are lost to every other tab
+    if (FsAccess::Instance().IsQuarantined(Dir.absolutePath()))
+    {
+      return;
+    }
+    QVector<int> rows;
+    for (int row = 0; row < Entries.Size(); ++row)
+    {
+      if (Entries.IsPending(row))
+      {
+        rows.append(row);
+      }
+    }
+    if (rows.empty())
+    {
+      return;
+    }
+    Metadata = new MetadataLoader(Dir, Entries, rows, this);
+    connect(
+      Metadata, SIGNAL(BatchLoaded(const EntryTable&, const QVector<int>&)),
+      SLOT(OnMetadataBatch(const EntryTable&, const QVector<int>&)), Qt::QueuedConnection
+    );
+    connect(Metadata, SIGNAL(Finished()), SLOT(OnMetadataFinished()), Qt::QueuedConnection);
+    connect(Metadata, SIGNAL(Finished()), Metadata, SLOT(deleteLater()), Qt::QueuedConnection);
+    Metadata->Start();
+  }
+
+  void Listing::StopMetadata()
+  {
+    if (!Metadata)
+    {
+      return;
+    }
+    // same as the listing loader, it goes away on its own once its pool task is over
+    disconnect(Metadata, 0, this, 0);
+    Metadata->setParent(nullptr);
+    Metadata->Cancel();
+    Metadata = nullptr;
+  }
+
+  void Listing::OnMetadataBatch(const EntryTable& batch, const QVector<int>& rows)
+  {
+    if (sender() != Metadata)
+    {
+      return;
+    }
+    for (int i = 0; i < rows.size(); ++i)
+    {
+      Entries.SetMetadata(rows[i], batch, i);
+    }
+    emit MetadataChanged(rows);
+  }
+
+  void Listing::OnMetadataFinished()
+  {
+    if (sender() != Metadata)
+    {
+      return;
+    }
+    Metadata = nullptr;
+    emit MetadataLoaded();
+  }
+
+  void Listing::OnChunkLoaded(const EntryTable& chunk)
+  {
+    // chunks queued before the loader was cancelled are still delivered
+    if (sender() != Loader)
+    {
+      return;
+    }
+    if (Refreshing)
+    {
+      PendingEntries.Append(chunk);
+      return;
+    }
+    Entries.Append(chunk);
+    emit ChunkLoaded(chunk);
+  }
+
+  void Listing::OnLoadFinished()
+  {
+    if (sender() != Loader)
+    {
+      return;
+    }
+    Loader = nullptr;
+    DirModified = PendingDirModified;
+    LastLoadMilliseconds = LoadTime.elapsed();
+    if (Refreshing)
+    {
+      ListingDiff diff;
+      if (Compare(Entries, PendingEntries, diff))
+      {
+        const EntryTable previous = Entries;
+        Entries = PendingEntries;
+        emit Updated(previous, diff);
+      }
+      else
+      {
+        // same names, but files might have been changed in place: every row is read again
+        for (int row = 0; row < Entries.Size(); ++row)
+        {
+          Entries.SetPending(row);
+        }
+      }
+      PendingEntries.Clear();
+    }
+    if (!Complete)
+    {
+      Complete = true;
+      emit Loaded();
+    }
+    emit LoadingChanged(false);
+    StartMetadata();
+    // running loads are never interrupted by changes, they are followed by one more instead
+    if (ChangePending && !Polling)
+    {
+      ScheduleRefresh();
+    }
+  }
+
+  void Listing::OnDirectoryChanged()
+  {
+    if (!Polling && ChangePeriod.hasExpired(MILLISECONDS_PER_SECOND))
+    {
+      ChangePeriod.start();
+      PeriodChanges = 0;
+    }
+    ++PeriodChanges;
+    ChangePending = true;
+    if (Polling)
+    {
+      ++SuppressedChanges;
+      return;
+    }
+    if (PeriodChanges > HOT_CHANGES_PER_SECOND)
+    {
+      qDebug() << "Directory changes too often, polling" << Dir.absolutePath();
+      Polling = true;
+      SuppressedChanges = 0;
+      ChangePeriod.start();
+      PeriodChanges = 0;
+      RefreshTimer->start(qMax<qint64>(POLL_INTERVAL_MILLISECONDS, GetRefreshInterval()));
+      emit PollingChanged();
+      return;
+    }
+    ScheduleRefresh();
+  }
+
+  void Listing::ScheduleRefresh()
+  {
+    const qint64 wait = GetRefreshInterval() - (LoadTime.isValid() ? LoadTime.elapsed() : 0);
+    if (wait <= 0 && !IsLoading() && !RefreshTimer->isActive())
+    {
+      Refresh();
+      return;
+    }
+    // restarted by every change, so it fires once they calm down but not before the interval is over
+    RefreshTimer->start(qMax<qint64>(DEBOUNCE_MILLISECONDS, wait));
+  }
+
+  void Listing::OnRefreshTimer()
+  {
+    if (Polling)
+    {
+      Poll();
+    }
+    else if (ChangePending && !IsLoading())
+    {
+      Refresh();
+    }
+  }
+
+  void Listing::Poll()
+  {
+    // back to notifications once the rate over the last period is below the threshold
+    const bool cooled = PeriodChanges * MILLISECONDS_PER_SECOND < HOT_CHANGES_PER_SECOND * ChangePeriod.elapsed();
+    ChangePeriod.start();
+    PeriodChanges = 0;
+    if (ChangePending && !IsLoading())
+    {
+      Refresh();
+    }
+    if (cooled)
+    {
+      qDebug() << "Directory calmed down, stop polling" << Dir.absolutePath();
+      Polling = false;
+      SuppressedChanges = 0;
+    }
+    else
+    {
+      RefreshTimer->start(qMax<qint64>(POLL_INTERVAL_MILLISECONDS, GetRefreshInterval()));
+    }
+    emit PollingChanged();
+  }
+
+  void Listing::ResetChangeTracking()
+  {
+    RefreshTimer->stop();
+    ChangePending = false;
+    ChangePeriod.start();
+    PeriodChanges = 0;
+    if (Polling)
+    {
+      Polling = false;
+      SuppressedChanges = 0;
+      emit PollingChanged();
+    }
+  }
+
+  qint64 Listing::GetRefreshInterval() const
+  {
+    return qMax<qint64>(MIN_REFRESH_INTERVAL_MILLISECONDS, REFRESH_INTERVAL_PER_LOAD_TIME * LastLoadMilliseconds);
+  }
+
+  ListingCache& ListingCache::Instance()
+  {
+    static ListingCache cache;
+    return cache;
+  }
+
+  ListingCache::ListingCache()
+    : QObject()
+    , FileWatcher(new QFileSystemWatcher(this))
+    , ParkedEntries(0)
+  {
+    connect(FileWatcher, SIGNAL(directoryChanged(const QString&)), SLOT(OnDirectoryChanged(const QString&)));
+    connect(
+      &FsAccess::Instance(), SIGNAL(MountStateChanged(const QString&, bool)),
+      SLOT(OnMountStateChanged(const QString&, bool))
+    );
+  }
+
+  Listing* ListingCache::Acquire(const QDir& dir)
+  {
+    const QString path = QDir::cleanPath(dir.absolutePath());
+    const QString key = MakeKey(path, dir.filter());
+    Listing*& listing = Listings[key];
+    if (!listing)
+    {
+      QDir listingDir(path);
+      listingDir.setFilter(dir.filter());
+      listing = new Listing(listingDir, this);
+      Watch(path);
+      listing->StartLoading(false);
+    }
+    else if (!listing->References)
+    {
+      Unpark(listing);
+      Watch(path);
+      // nothing has been watching it, the directory mtime tells whether the rows are still good
+      listing->Revalidate();
+    }
+    ++listing->References;
+    return listing;
+  }
+
+  void ListingCache::Release(Listing* listing)
+  {
+    if (!listing || --listing->References)
+    {
+      return;
+    }
+    Unwatch(listing->Dir.absolutePath());
+    listing->ResetChangeTracking();
+    // an interrupted refresh leaves the previous snapshot, which is complete but older than the directory
+    listing->StopLoading();
+    if (listing->IsComplete())
+    {
+      Park(listing);
+    }
+    else
+    {
+      Drop(listing);
+    }
+  }
+
+  bool ListingCache::IsHeld(const QString& path) const
+  {
+    // same directory might be held with other filters
+    foreach(const Listing* listing, Listings)
+    {
+      if (listing->References && listing->Dir.absolutePath() == path)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void ListingCache::Watch(const QString& path)
+  {
+    FsAccess::Instance().Stat(path, this, [this, path](const FsResult& result)
+    {
+      if (result.Error || !IsHeld(path) || FileWatcher->directories().contains(path))
+      {
+        return;
+      }
+      if (!FileWatcher->addPath(path))
+      {
+        qWarning() << "Failed to add directory to watch:" << path;
+      }
+    });
+  }
+
+  void ListingCache::Unwatch(const QString& path)
+  {
+    if (IsHeld(path))
+    {
+      return;
+    }
+    if (FileWatcher->directories().contains(path) && !FileWatcher->removePath(path))
+    {
+      qWarning() << "Failed to remove directory from watch:" << path;
+    }
+  }
+
+  void ListingCache::Park(Listing* listing)
+  {
+    Parked.append(listing);
+    ParkedEntries += listing->Entries.Size();
+    while (ParkedEntries > MAX_PARKED_ENTRIES)
+    {
+      Listing* oldest = Parked.takeFirst();
+      ParkedEntries -= oldest->Entries.Size();
+      Drop(oldest);
+    }
+  }
+
+  void ListingCache::Unpark(Listing* listing)
+  {
+    Parked.removeOne(listing);
+    ParkedEntries -= listing->Entries.Size();
+  }
+
+  void ListingCache::Drop(Listing* listing)
+  {
+    Listings.remove(MakeKey(listing->Dir.absolutePath(), listing->Dir.filter()));
+    // might be releasing from inside one of the listing's own signals
+    listing->deleteLater();
+  }
+
+  void ListingCache::OnDirectoryChanged(const QString& path)
+  {
+    qDebug() << "Directory change notification" << path;
+    foreach(Listing* listing, Listings)
+    {
+      // parked listings are checked by mtime when somebody comes back for them
+      if (listing->References && listing->Dir.absolutePath() == path)
+      {
+        listing->OnDirectoryChanged();
+      }
+    }
+  }
+
+  void ListingCache::OnMountStateChanged(const QString& mountPoint, bool quarantined)
+  {
+    if (quarantined)
+    {
+      return;
+    }
+    FsAccess& access = FsAccess::Instance();
+    foreach(Listing* listing, Listings)
+    {
+      const QString path = listing->Dir.absolutePath();
+      if (listing->References && access.GetMountPoint(path) == mountPoint)
+      {
+        qDebug() << "Mount responds again, reread" << path;
+        Watch(path);
+        listing->Refresh();
+      }
+    }
+  }
+} // namespace TotalFinder
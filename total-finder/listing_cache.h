@@ -0,0 +1,154 @@
+#pragma once
+
+#include "entry_table.h"
+#include "fs_backend.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+namespace TotalFinder
+{
+  class DirLoader;
+  class MetadataLoader;
+
+  // What changed between two snapshots of a listing
+  struct ListingDiff
+  {
+    // row in the new table for every row of the previous one, -1 if the entry is gone or has changed
+    QVector<int> PreviousToCurrent;
+    // rows of the new table that are new or have changed
+    QVector<int> Added;
+  };
+
+  // One directory listing shared by every model showing the directory.
+  // Snapshot is replaced as a whole on change; after it is complete only metadata of its rows
+  // is filled in, so subscribers may keep copies of it and take the listing's one again on MetadataChanged
+  class Listing: public QObject
+  {
+    Q_OBJECT
+    friend class ListingCache;
+
+  public:
+    const QDir& GetDir() const;
+    // the complete snapshot, or rows read so far while the first load is running.
+    // Rows come with names and types, the rest of their metadata is filled in afterwards
+    const EntryTable& GetEntries() const;
+    bool IsComplete() const;
+    bool IsLoading() const;
+    // rows to read metadata of before the others, most wanted first; replaces the previous request
+    void PrioritizeMetadata(const QVector<int>& rows);
+    // directory changes too often to follow every notification, it is reread periodically instead
+    bool IsPolling() const;
+    // notifications received since polling has started
+    int GetSuppressedChanges() const;
+
+  signals:
+    void LoadingChanged(bool loading);
+    // first load only, rows are appended to GetEntries in the same order
+    void ChunkLoaded(const EntryTable& chunk);
+    void Loaded();
+    // GetEntries already returns the new snapshot
+    void Updated(const EntryTable& previous, const ListingDiff& diff);
+    // polling has started or stopped, or the count of suppressed changes has grown
+    void PollingChanged();
+    // rows of GetEntries got their metadata; the snapshot is modified in place, its rows stay where they are
+    void MetadataChanged(const QVector<int>& rows);
+    // every row of the snapshot has its metadata
+    void MetadataLoaded();
+
+  private slots:
+    void OnChunkLoaded(const EntryTable& chunk);
+    void OnLoadFinished();
+    void OnRefreshTimer();
+    void OnMetadataBatch(const EntryTable& batch, const QVector<int>& rows);
+    void OnMetadataFinished();
+
+  private:
+    Listing(const QDir& dir, QObject* parent);
+    ~Listing() override;
+
+    void Refresh();
+    // refreshes unless the directory mtime is the one of the snapshot; changes of file
+    // metadata inside the directory are not seen this way
+    void Revalidate();
+    // the directory is stat'ed through FsAccess first, a mount that doesn't answer never gets a loader stuck in it
+    void StartLoading(bool refresh);
+    void OnDirProbed(int probe, const FsResult& result);
+    void StopLoading();
+    void StartMetadata();
+    void StopMetadata();
+    // change notifications are coalesced: the first one refreshes at once, the following ones
+    // once they calm down, no more often than the last refresh time allows
+    void OnDirectoryChanged();
+    void ScheduleRefresh();
+    void Poll();
+    void ResetChangeTracking();
+    qint64 GetRefreshInterval() const;
+
+    QDir Dir;
+    EntryTable Entries;
+    // a refresh is collected here and replaces Entries only when complete
+    EntryTable PendingEntries;
+    DirLoader* Loader;
+    MetadataLoader* Metadata;
+    bool Probing; // waiting for the stat that comes before the loader
+    int Probes; // results of stats that have been superseded are dropped
+    bool Refreshing;
+    bool Complete;
+    int References;
+    // directory mtime when the snapshot in Entries has been read, and when the running load has started
+    qint64 DirModified;
+    qint64 PendingDirModified;
+
+    QTimer* RefreshTimer; // trailing refresh, or the next poll
+    QElapsedTimer LoadTime; // since the last load has started
+    qint64 LastLoadMilliseconds;
+    bool ChangePending;
+    QElapsedTimer ChangePeriod;
+    int PeriodChanges;
+    bool Polling;
+    int SuppressedChanges;
+  };
+
+  // Process-wide, keyed by absolute path and filters: one snapshot and one watch per directory
+  // however many tabs show it. Only listings somebody holds are watched. Complete listings nobody holds
+  // are parked unwatched for a while, bounded by their total rows, so a tab woken from hibernation
+  // gets its rows back after a single stat of the directory. Paths are not resolved on the GUI thread,
+  // a directory reached through a symlink has a listing of its own
+  class ListingCache: public QObject
+  {
+    Q_OBJECT
+  public:
+    static ListingCache& Instance();
+
+    // starts loading if nobody has the directory open yet
+    Listing* Acquire(const QDir& dir);
+    void Release(Listing* listing);
+
+  private slots:
+    void OnDirectoryChanged(const QString& path);
+    // listings held on a mount that answers again are reread
+    void OnMountStateChanged(const QString& mountPoint, bool quarantined);
+
+  private:
+    ListingCache();
+    bool IsHeld(const QString& path) const;
+    // adding a watch stats the directory, so it waits until the directory has answered a stat of FsAccess
+    void Watch(const QString& path);
+    void Unwatch(const QString& path);
+    void Park(Listing* listing);
+    void Unpark(Listing* listing);
+    void Drop(Listing* listing);
+
+    QHash<QString, Listing*> Listings;
+    QFileSystemWatcher* FileWatcher;
+    QList<Listing*> Parked; // least recently released first
+    int ParkedEntries;
+  };
+} // namespace TotalFinder
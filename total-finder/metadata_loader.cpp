@@ -0,0 +1,107 @@
+#include "metadata_loader.h"
+
+#include <common/thread_pool.h>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <functional>
+
+namespace TotalFinder
+{
+  MetadataLoader::MetadataLoader(const QDir& dir, const EntryTable& entries, const QVector<int>& rows, QObject* parent)
+    : QObject(parent)
+    , Dir(dir)
+    , Entries(entries)
+    , Rows(rows)
+    , NextRow(0)
+    , Done(entries.Size(), false)
+    , Started(false)
+  {
+    qRegisterMetaType<EntryTable>("EntryTable");
+    qRegisterMetaType<QVector<int> >("QVector<int>");
+  }
+
+  MetadataLoader::~MetadataLoader()
+  {
+    // pool task references this object, so wait until it reaches the nearest checkpoint
+    Control.Cancel();
+    if (Started)
+    {
+      Control.WaitFinished();
+    }
+  }
+
+  void MetadataLoader::Start()
+  {
+    Started = true;
+    Common::ThreadPool::Io().Submit(std::bind(&MetadataLoader::Run, this));
+  }
+
+  void MetadataLoader::Cancel()
+  {
+    Control.Cancel();
+  }
+
+  void MetadataLoader::Prioritize(const QVector<int>& rows)
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    Priority = rows;
+  }
+
+  int MetadataLoader::TakeNext()
+  {
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      while (!Priority.isEmpty())
+      {
+        const int row = Priority.takeFirst();
+        if (row >= 0 && row < Done.size() && !Done[row])
+        {
+          return row;
+        }
+      }
+    }
+    while (NextRow < Rows.size())
+    {
+      const int row = Rows[NextRow++];
+      if (!Done[row])
+      {
+        return row;
+      }
+    }
+    return -1;
+  }
+
+  void MetadataLoader::Run()
+  {
+    QElapsedTimer timer;
+    timer.start();
+    EntryTable batch;
+    QVector<int> batchRows;
+    int total = 0;
+    for (int row = TakeNext(); row != -1 && Control.Checkpoint(); row = TakeNext())
+    {
+      Done[row] = true;
+      batch.Append(QFileInfo(Dir, Entries.GetFileName(row)));
+      batchRows.append(row);
+      if (timer.elapsed() >= BATCH_INTERVAL_MILLISECONDS)
+      {
+        total += batch.Size();
+        emit BatchLoaded(batch, batchRows);
+        batch.Clear();
+        batchRows.clear();
+        timer.restart();
+      }
+    }
+    if (batch.Size() && !Control.IsCancelled())
+    {
+      total += batch.Size();
+      emit BatchLoaded(batch, batchRows);
+    }
+    qDebug() << "Metadata of" << Dir.absolutePath() << (Control.IsCancelled() ? "cancelled after" : "loaded,") << total << "entries";
+    emit Finished();
+    Control.Finish();
+  }
+} // namespace TotalFinder
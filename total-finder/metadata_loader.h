@@ -0,0 +1,53 @@
+#pragma once
+
+#include "entry_table.h"
+
+#include <common/job_control.h>
+
+#include <QDir>
+#include <QObject>
+#include <QVector>
+
+#include <mutex>
+
+namespace TotalFinder
+{
+  // Reads size, mtime and permissions of listed rows on the shared IO pool.
+  // Rows asked for with Prioritize go first, the rest follows in listing order
+  class MetadataLoader: public QObject
+  {
+    Q_OBJECT
+    const qint64 BATCH_INTERVAL_MILLISECONDS = 100;
+
+  public:
+    // rows refer to entries, only their names are used
+    MetadataLoader(const QDir& dir, const EntryTable& entries, const QVector<int>& rows, QObject* parent);
+    ~MetadataLoader() override;
+
+    void Start();
+    // returns immediately, Finished is still emitted when the pool task stops
+    void Cancel();
+    // replaces the previous request, rows already read are skipped
+    void Prioritize(const QVector<int>& rows);
+
+  signals:
+    // emitted from the pool thread; rows of the batch, in order, are those of the listing given in rows
+    void BatchLoaded(const EntryTable& batch, const QVector<int>& rows);
+    void Finished();
+
+  private:
+    void Run();
+    // -1 when there is nothing left
+    int TakeNext();
+
+    QDir Dir;
+    EntryTable Entries;
+    QVector<int> Rows;
+    int NextRow; // position in Rows
+    QVector<bool> Done; // by entry row, pool thread only
+    std::mutex Lock;
+    QVector<int> Priority;
+    Common::JobControl Control;
+    bool Started;
+  };
+} // namespace TotalFinder
@@ -0,0 +1,142 @@
+#include "row_selection.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace TotalFinder
+{
+  RowSelection::RowSelection()
+    : Rows(0)
+  {
+  }
+
+  RowSelection::RowSelection(int first, int last)
+    : Rows(0)
+  {
+    if (first < last)
+    {
+      Append(first, last);
+    }
+  }
+
+  RowSelection RowSelection::FromSortedRows(const QVector<int>& rows)
+  {
+    RowSelection result;
+    for (int i = 0; i < rows.size();)
+    {
+      int end = i + 1;
+      while (end < rows.size() && rows[end] <= rows[end - 1] + 1)
+      {
+        ++end;
+      }
+      result.Append(rows[i], rows[end - 1] + 1);
+      i = end;
+    }
+    return result;
+  }
+
+  RowSelection RowSelection::Combine(const RowSelection& left, const RowSelection& right, Operation operation)
+  {
+    // sweep over the range boundaries of both sets, membership flips at each of them
+    RowSelection result;
+    const int leftBounds = left.Ranges.size() * 2;
+    const int rightBounds = right.Ranges.size() * 2;
+    const auto bound = [](const QVector<Range>& ranges, int i) { return i % 2 ? ranges[i / 2].Last : ranges[i / 2].First; };
+    int leftPos = 0;
+    int rightPos = 0;
+    bool included = false;
+    int start = 0;
+    while (leftPos < leftBounds || rightPos < rightBounds)
+    {
+      const int leftNext = leftPos < leftBounds ? bound(left.Ranges, leftPos) : INT_MAX;
+      const int rightNext = rightPos < rightBounds ? bound(right.Ranges, rightPos) : INT_MAX;
+      const int point = std::min(leftNext, rightNext);
+      if (leftNext == point)
+      {
+        ++leftPos;
+      }
+      if (rightNext == point)
+      {
+        ++rightPos;
+      }
+      // inside a set after an odd number of its bounds
+      const bool inLeft = leftPos % 2;
+      const bool inRight = rightPos % 2;
+      bool inResult = false;
+      switch (operation)
+      {
+      case UNION:
+        inResult = inLeft || inRight;
+        break;
+      case DIFFERENCE:
+        inResult = inLeft && !inRight;
+        break;
+      case SYMMETRIC_DIFFERENCE:
+        inResult = inLeft != inRight;
+        break;
+      }
+      if (inResult != included)
+      {
+        if (inResult)
+        {
+          start = point;
+        }
+        else
+        {
+          result.Append(start, point);
+        }
+        included = inResult;
+      }
+    }
+    return result;
+  }
+
+  bool RowSelection::IsEmpty() const
+  {
+    return Ranges.isEmpty();
+  }
+
+  int RowSelection::Count() const
+  {
+    return Rows;
+  }
+
+  int RowSelection::GetRangeCount() const
+  {
+    return Ranges.size();
+  }
+
+  bool RowSelection::Contains(int row) const
+  {
+    const auto it = std::upper_bound(
+      Ranges.begin(), Ranges.end(), row, [](int value, const Range& range) { return value < range.Last; }
+    );
+    return it != Ranges.end() && it->First <= row;
+  }
+
+  QVector<int> RowSelection::GetRows() const
+  {
+    QVector<int> result;
+    result.reserve(Rows);
+    for (const Range& range: Ranges)
+    {
+      for (int row = range.First; row < range.Last; ++row)
+      {
+        result.append(row);
+      }
+    }
+    return result;
+  }
+
+  void RowSelection::Append(int first, int last)
+  {
+    if (!Ranges.isEmpty() && Ranges.last().Last >= first)
+    {
+      Rows += last - Ranges.last().Last;
+      Ranges.last().Last = last;
+      return;
+    }
+    Ranges.append(Range{first, last});
+    Rows += last - first;
+  }
+} // namespace TotalFinder
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QVector>
+
+namespace TotalFinder
+{
+  // Set of rows stored as sorted, disjoint and non-adjacent ranges. Selecting everything,
+  // inverting or combining sets costs in proportion to the number of ranges, not rows
+  class RowSelection
+  {
+  public:
+    enum Operation
+    {
+      UNION,
+      DIFFERENCE, // rows of the left set that are not in the right one
+      SYMMETRIC_DIFFERENCE
+    };
+
+    RowSelection();
+    // rows [first, last)
+    RowSelection(int first, int last);
+    // rows have to be sorted
+    static RowSelection FromSortedRows(const QVector<int>& rows);
+    static RowSelection Combine(const RowSelection& left, const RowSelection& right, Operation operation);
+
+    bool IsEmpty() const;
+    int Count() const;
+    int GetRangeCount() const;
+    bool Contains(int row) const;
+    QVector<int> GetRows() const;
+
+  private:
+    struct Range
+    {
+      int First;
+      int Last; // past the end
+    };
+
+    void Append(int first, int last);
+
+    QVector<Range> Ranges;
+    int Rows;
+  };
+} // namespace TotalFinder
@@ -0,0 +1,440 @@
+#include "search_job.h"
+#include "settings.h"
+
+#include <common/search_cache.h>
+#include <common/thread_pool.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMetaObject>
+#include <QStandardPaths>
+
+#include <functional>
+#include <thread>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    // protects result list from searches like single letter in a huge log
+    const int MAX_HITS_PER_FILE = 10000;
+    const std::size_t PREVIEW_CONTEXT_LINES = 3;
+
+    QString GetCacheDir()
+    {
+      return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/search";
+    }
+
+    // preview text of a hit, the match line is marked
+    QString ReadContext(const SearchHit& hit)
+    {
+      Search::Match match;
+      match.Path = hit.Path.toStdString();
+      match.Member = hit.Member.toStdString();
+      match.Offset = hit.Offset;
+      match.Line = hit.Line;
+      Search::LineContext context;
+      const Common::Error err = Search::ReadMatchContext(match, PREVIEW_CONTEXT_LINES, PREVIEW_CONTEXT_LINES, context);
+      if (err)
+      {
+        return QString::fromStdWString(Common::Error::Format(err));
+      }
+
+      QString result;
+      quint64 line = context.FirstLine;
+      for (const std::string& text: context.Lines)
+      {
+        result += QString("%1%2: %3\n")
+          .arg(QChar(line == hit.Line ? '>' : ' '))
+          .arg(line, 6)
+          .arg(QString::fromUtf8(text.data(), static_cast<int>(text.size())));
+        ++line;
+      }
+      return result;
+    }
+  } // namespace
+
+  SearchResultModel::SearchResultModel(QObject* parent)
+    : QAbstractListModel(parent)
+    , NextContextRequest(0)
+    , Delivery(std::make_shared<ContextDelivery>())
+  {
+    Delivery->Owner = this;
+  }
+
+  SearchResultModel::~SearchResultModel()
+  {
+    // reads still running find nobody to deliver to
+    std::lock_guard<std::mutex> lock(Delivery->Lock);
+    Delivery->Owner = nullptr;
+  }
+
+  void SearchResultModel::FlushReadyToInsertRows()
+  {
+    if (RowsReadyToInsert.isEmpty())
+    {
+      return;
+    }
+    const QModelIndex parent = QModelIndex();
+    const int rows = rowCount(parent);
+    QAbstractListModel::beginInsertRows(parent, rows, rows + RowsReadyToInsert.size() - 1);
+    ModelData << RowsReadyToInsert;
+    RowsReadyToInsert.clear();
+    QAbstractListModel::endInsertRows();
+    RefreshTimer.invalidate();
+  }
+
+  void SearchResultModel::AddItem(const SearchHit& item)
+  {
+    if (!RefreshTimer.isValid())
+    {
+      RefreshTimer.start();
+    }
+    RowsReadyToInsert << item;
+    if (RefreshTimer.elapsed() >= MODEL_UPDATE_INTERVAL_MILLISECONDS)
+    {
+      FlushReadyToInsertRows();
+      RefreshTimer.start();
+    }
+  }
+
+  void SearchResultModel::FlushResults()
+  {
+    FlushReadyToInsertRows();
+    RowsReadyToInsert.clear();
+  }
+
+  void SearchResultModel::Clear()
+  {
+    const QModelIndex parent = QModelIndex();
+    RowsReadyToInsert.clear();
+    if (ModelData.isEmpty())
+    {
+      return;
+    }
+    QAbstractListModel::beginRemoveRows(parent, 0, rowCount() - 1);
+    ModelData.clear();
+    ContextCache.clear();
+    ContextRequests.clear();
+    QAbstractListModel::endRemoveRows();
+  }
+
+  int SearchResultModel::rowCount(const QModelIndex& parent) const
+  {
+    return ModelData.size();
+  }
+
+  QVariant SearchResultModel::data(const QModelIndex& index, int role) const
+  {
+    if (!index.isValid())
+    {
+      return QVariant();
+    }
+
+    const SearchHit& currentItem = ModelData[index.row()];
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+      {
+        const QString path = currentItem.Member.isEmpty() ? currentItem.Path : currentItem.Path + "/" + currentItem.Member;
+        if (currentItem.Line == 0)
+        {
+          return path;
+        }
+        return QString("%1:%2").arg(path).arg(currentItem.Line);
+      }
+    case PathRole:
+      return currentItem.Path;
+    case MemberRole:
+      return currentItem.Member;
+    case LineRole:
+      return currentItem.Line;
+    case ContextRole:
+      return GetContext(index.row());
+    }
+    return QVariant();
+  }
+
+  QString SearchResultModel::GetContext(int row) const
+  {
+    QHash<int, QString>::const_iterator cached = ContextCache.find(row);
+    if (cached != ContextCache.end())
+    {
+      return cached.value();
+    }
+
+    const SearchHit& hit = ModelData[row];
+    if (hit.Line == 0)
+    {
+      return QString();
+    }
+    // only the row shown last is read, rows passed on the way are skipped
+    const quint64 request = ++NextContextRequest;
+    ContextRequests.insert(row, request);
+    Delivery->Latest = request;
+    std::shared_ptr<ContextDelivery> delivery = Delivery;
+    Common::ThreadPool::Io().Submit([delivery, hit, row, request]()
+    {
+      if (delivery->Latest != request)
+      {
+        return;
+      }
+      const QString text = ReadContext(hit);
+      std::lock_guard<std::mutex> lock(delivery->Lock);
+      if (delivery->Owner)
+      {
+        QMetaObject::invokeMethod(
+          delivery->Owner, "OnContextRead", Qt::QueuedConnection,
+          Q_ARG(int, row), Q_ARG(quint64, request), Q_ARG(QString, text)
+        );
+      }
+    });
+    return "Loading...";
+  }
+
+  void SearchResultModel::OnContextRead(int row, quint64 request, const QString& text)
+  {
+    // results are cleared or the row asked again meanwhile
+    if (ContextRequests.value(row) != request)
+    {
+      return;
+    }
+    ContextRequests.remove(row);
+    ContextCache.insert(row, text);
+    const QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, QVector<int>() << ContextRole);
+  }
+
+  SearchJob::SearchJob(const QString& where, const QString& what, const QString& content, const SearchOptions& options, QObject* parent)
+    : QObject(parent)
+    , Started(false)
+    , Stopped(false)
+    , Released(false)
+    , CurrentStatus(Running)
+    , Model(new SearchResultModel(this))
+  {
+    qRegisterMetaType<SearchHit>("SearchHit");
+    CurrentQuery.Root = where.toStdString();
+    CurrentQuery.NameMask = what.toStdString();
+    CurrentQuery.Content = content.toStdString();
+    CurrentQuery.IncludeHidden = Settings::LoadDirFilters() & QDir::Hidden;
+    CurrentQuery.MaxHitsPerFile = MAX_HITS_PER_FILE;
+    CurrentQuery.SearchArchives = options.SearchArchives;
+    CurrentQuery.UseIgnoreFiles = options.UseIgnoreFiles;
+    CurrentQuery.BinaryFiles = options.BinaryFiles;
+    for (const QString& pattern: Settings::LoadSearchExcludePatterns())
+    {
+      CurrentQuery.ExcludePatterns.push_back(pattern.toStdString());
+    }
+    connect(this, SIGNAL(GotResult(const SearchHit&)), SLOT(OnGotResult(const SearchHit&)), Qt::QueuedConnection);
+    connect(this, SIGNAL(Progress(const QString&)), SLOT(OnProgress(const QString&)), Qt::QueuedConnection);
+    connect(this, SIGNAL(Finished()), SLOT(OnFinished()), Qt::QueuedConnection);
+  }
+
+  SearchJob::~SearchJob()
+  {
+    // only deleted through Release, once the thread has stopped referencing this object
+    Control.Cancel();
+  }
+
+  void SearchJob::Start()
+  {
+    qDebug() << "Search started; where:" << CurrentQuery.Root.c_str() << ", content:" << CurrentQuery.Content.c_str();
+    Started = true;
+    // not the IO pool: a search may run for minutes or sit paused, and directory loading must not wait for it
+    std::thread(&SearchJob::Run, this).detach();
+  }
+
+  void SearchJob::Release()
+  {
+    Released = true;
+    Control.Cancel();
+    if (!Started || Stopped)
+    {
+      deleteLater();
+    }
+    // otherwise OnFinished deletes it, the thread might be stuck in a syscall for a while
+  }
+
+  void SearchJob::Pause()
+  {
+    if (CurrentStatus != Running)
+    {
+      return;
+    }
+    Control.Pause();
+    CurrentStatus = Paused;
+    Model->FlushResults();
+    emit StatusChanged();
+  }
+
+  void SearchJob::Resume()
+  {
+    if (CurrentStatus != Paused)
+    {
+      return;
+    }
+    Control.Resume();
+    CurrentStatus = Running;
+    emit StatusChanged();
+  }
+
+  void SearchJob::Cancel()
+  {
+    if (CurrentStatus != Running && CurrentStatus != Paused)
+    {
+      return;
+    }
+    // status changes when the pool task confirms it has stopped
+    Control.Cancel();
+    qDebug() << "Search cancel requested";
+  }
+
+  SearchJob::Status SearchJob::GetStatus() const
+  {
+    return CurrentStatus;
+  }
+
+  QString SearchJob::GetTitle() const
+  {
+    const QString mask = QString::fromStdString(CurrentQuery.NameMask);
+    if (CurrentQuery.Content.empty())
+    {
+      return mask;
+    }
+    return QString("%1: %2").arg(mask, QString::fromStdString(CurrentQuery.Content));
+  }
+
+  QString SearchJob::GetStatusText() const
+  {
+    switch (CurrentStatus)
+    {
+    case Running:
+      return CurrentFolder;
+    case Paused:
+      return QString("Paused, %1 items found so far").arg(Model->rowCount());
+    case Cancelled:
+      return QString("Search cancelled, %1 items found").arg(Model->rowCount());
+    case Complete:
+      return QString("Search complete, %1 items found").arg(Model->rowCount());
+    }
+    return QString();
+  }
+
+  SearchResultModel* SearchJob::GetModel() const
+  {
+    return Model;
+  }
+
+  void SearchJob::OnGotResult(const SearchHit& item)
+  {
+    Model->AddItem(item);
+  }
+
+  void SearchJob::OnProgress(const QString& currentFolder)
+  {
+    CurrentFolder = currentFolder;
+    emit StatusChanged();
+  }
+
+  void SearchJob::OnFinished()
+  {
+    Stopped = true;
+    if (Released)
+    {
+      deleteLater();
+      return;
+    }
+    Model->FlushResults();
+    CurrentStatus = Control.IsCancelled() ? Cancelled : Complete;
+    qDebug() << "search finished, found" << Model->rowCount() << "items";
+    emit StatusChanged();
+  }
+
+  void SearchJob::Run()
+  {
+    // repeated queries reuse results for directories and files unchanged since the previous run
+    const QString cacheDir = GetCacheDir();
+    const std::string cachePath = (cacheDir + "/").toStdString() + Search::ResultCache::MakeKey(CurrentQuery);
+    Search::ResultCache cache;
+    Common::Error err = cache.Load(cachePath);
+    if (err)
+    {
+      qDebug() << "search cache is ignored:" << QString::fromStdWString(Common::Error::Format(err));
+    }
+
+    Search::Callbacks callbacks;
+    callbacks.OnMatch = std::bind(&SearchJob::OnMatch, this, std::placeholders::_1);
+    callbacks.OnDirectory = [this](const std::string& path) { emit Progress(QString::fromStdString(path)); };
+    err = Search::Run(CurrentQuery, callbacks, Control, &cache);
+    if (err)
+    {
+      qDebug() << "search failed:" << QString::fromStdWString(Common::Error::Format(err));
+    }
+    else if (!Control.IsCancelled() && QDir().mkpath(cacheDir))
+    {
+      err = cache.Save(cachePath);
+      if (err)
+      {
+        qDebug() << "failed to save search cache:" << QString::fromStdWString(Common::Error::Format(err));
+      }
+    }
+
+    Control.Finish();
+    // the job may be deleted as soon as this is delivered, nothing follows it
+    emit Finished();
+  }
+
+  bool SearchJob::OnMatch(const Search::Match& match)
+  {
+    emit GotResult(SearchHit(
+      QString::fromStdString(match.Path),
+      QString::fromStdString(match.Member),
+      match.Offset,
+      match.Line
+    ));
+    return true;
+  }
+
+  SearchJobManager::SearchJobManager(QObject* parent)
+    : QObject(parent)
+  {
+  }
+
+  SearchJobManager& SearchJobManager::Instance()
+  {
+    // parented to the application, so running jobs are cancelled when it goes away
+    static SearchJobManager* manager = new SearchJobManager(qApp);
+    return *manager;
+  }
+
+  SearchJobManager::~SearchJobManager()
+  {
+    // jobs still running at exit are left to their threads rather than deleted under them
+    for (SearchJob* job: Jobs)
+    {
+      job->Release();
+    }
+  }
+
+  SearchJob* SearchJobManager::StartJob(const QString& where, const QString& what, const QString& content, const SearchOptions& options)
+  {
+    // not parented to the manager, a running job is never deleted before its thread has stopped
+    SearchJob* job = new SearchJob(where, what, content, options, nullptr);
+    Jobs << job;
+    job->Start();
+    return job;
+  }
+
+  void SearchJobManager::RemoveJob(SearchJob* job)
+  {
+    Jobs.removeAll(job);
+    job->Release();
+  }
+
+  QList<SearchJob*> SearchJobManager::GetJobs() const
+  {
+    return Jobs;
+  }
+} // namespace TotalFinder
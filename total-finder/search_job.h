@@ -0,0 +1,180 @@
+#pragma once
+
+#include <common/job_control.h>
+#include <common/search.h>
+
+#include <QAbstractListModel>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace TotalFinder
+{
+  struct SearchHit
+  {
+    SearchHit()
+      : Offset(0)
+      , Line(0)
+    {
+    }
+
+    SearchHit(const QString& path, const QString& member, quint64 offset, quint64 line)
+      : Path(path)
+      , Member(member)
+      , Offset(offset)
+      , Line(line)
+    {
+    }
+
+    QString Path;
+    QString Member; // path inside archive, empty for plain files
+    quint64 Offset; // byte offset of the match, meaningful only when Line is not 0
+    quint64 Line;   // 0 for hits by file name only
+  };
+
+  struct SearchOptions
+  {
+    SearchOptions()
+      : SearchArchives(false)
+      , UseIgnoreFiles(true)
+      , BinaryFiles(Search::BINARY_SKIP)
+    {
+    }
+
+    bool SearchArchives;
+    bool UseIgnoreFiles;
+    Search::BinaryMode BinaryFiles;
+  };
+
+  class SearchResultModel: public QAbstractListModel
+  {
+    Q_OBJECT
+    const qint64 MODEL_UPDATE_INTERVAL_MILLISECONDS = 1000;
+
+  public:
+    enum Roles
+    {
+      PathRole = Qt::UserRole + 1,
+      MemberRole,
+      LineRole,
+      ContextRole
+    };
+
+    SearchResultModel(QObject* parent);
+    ~SearchResultModel() override;
+    void AddItem(const SearchHit& item);
+    void FlushResults();
+    void Clear();
+    virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex& index = QModelIndex(), int role = Qt::DisplayRole) const;
+  private slots:
+    void OnContextRead(int row, quint64 request, const QString& text);
+  private:
+    // what IO pool tasks deliver context through; Owner is cleared before the model goes away
+    struct ContextDelivery
+    {
+      ContextDelivery(): Owner(nullptr), Latest(0) {}
+
+      std::mutex Lock;
+      SearchResultModel* Owner;
+      std::atomic<quint64> Latest; // requests older than it are skipped before they touch the disk
+    };
+
+    void FlushReadyToInsertRows();
+    QString GetContext(int row) const;
+
+    QVector<SearchHit> ModelData;
+    QVector<SearchHit> RowsReadyToInsert;
+    QElapsedTimer RefreshTimer;
+    // context lines are read from disk only for rows that have been shown in the preview,
+    // on the IO pool: an archive member is decompressed up to the match for them
+    mutable QHash<int, QString> ContextCache;
+    mutable QHash<int, quint64> ContextRequests; // rows being read, by the id of their request
+    mutable quint64 NextContextRequest;
+    std::shared_ptr<ContextDelivery> Delivery;
+  };
+
+  // One find-in-files request. Runs on a thread of its own, so a paused or long search never holds
+  // a pool thread the panels need; owns its results and outlives the dialog that started it
+  class SearchJob: public QObject
+  {
+    Q_OBJECT
+  public:
+    enum Status
+    {
+      Running,
+      Paused,
+      Cancelled,
+      Complete
+    };
+
+    SearchJob(const QString& where, const QString& what, const QString& content, const SearchOptions& options, QObject* parent);
+    ~SearchJob() override;
+
+    void Start();
+    void Pause();
+    void Resume();
+    void Cancel();
+    // cancels and deletes the job once its thread has stopped, instead of waiting for it
+    void Release();
+
+    Status GetStatus() const;
+    QString GetTitle() const;
+    QString GetStatusText() const;
+    SearchResultModel* GetModel() const;
+
+  signals:
+    void StatusChanged();
+
+    // emitted from the pool thread, delivered to the job in the GUI thread
+    void GotResult(const SearchHit& item);
+    void Progress(const QString& currentFolder);
+    void Finished();
+
+  private slots:
+    void OnGotResult(const SearchHit& item);
+    void OnProgress(const QString& currentFolder);
+    void OnFinished();
+
+  private:
+    void Run();
+    bool OnMatch(const Search::Match& match);
+
+    Search::Query CurrentQuery;
+
+    Common::JobControl Control;
+    bool Started;
+    bool Stopped; // the thread has delivered Finished
+    bool Released;
+    Status CurrentStatus;
+    QString CurrentFolder;
+    SearchResultModel* Model;
+  };
+
+  class SearchJobManager: public QObject
+  {
+    Q_OBJECT
+  public:
+    static SearchJobManager& Instance();
+
+    SearchJob* StartJob(const QString& where, const QString& what, const QString& content, const SearchOptions& options);
+    void RemoveJob(SearchJob* job);
+    QList<SearchJob*> GetJobs() const;
+
+  private:
+    SearchJobManager(QObject* parent);
+    ~SearchJobManager() override;
+
+    QList<SearchJob*> Jobs;
+  };
+} // namespace TotalFinder
+
+Q_DECLARE_METATYPE(TotalFinder::SearchHit)
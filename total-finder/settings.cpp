@@ -36,6 +36,13 @@ namespace TotalFinder
       const char VIEW_HEADER_STATE[] = "view_header_state";
 
       const char TABS_STATE[] = "tabs_state";
+
+      const char KEY_SEARCH_EXCLUDE_PATTERNS[] = "search_exclude_patterns";
+
+      const char KEY_TAB_HIBERNATION_DELAY[] = "tab_hibernation_delay";
+      const int DEFAULT_TAB_HIBERNATION_DELAY = 300;
+
+      const char KEY_AUTO_FOLDER_SIZES[] = "auto_folder_sizes";
     } // namespace
 
     void SaveMainWindowGeometry(const QByteArray& geometry)
@@ -82,6 +89,38 @@ namespace TotalFinder
       return QJsonDocument::fromBinaryData(LoadValue(TABS_STATE).toByteArray());
     }
 
+    void SaveSearchExcludePatterns(const QStringList& patterns)
+    {
+      // read by every search when it starts, nothing to reload
+      SaveValue(KEY_SEARCH_EXCLUDE_PATTERNS, patterns, false);
+    }
+
+    QStringList LoadSearchExcludePatterns()
+    {
+      return LoadValue(KEY_SEARCH_EXCLUDE_PATTERNS).toStringList();
+    }
+
+    void SaveTabHibernationDelay(int seconds)
+    {
+      // read by tabs whenever they get hidden, nothing to reload
+      SaveValue(KEY_TAB_HIBERNATION_DELAY, seconds, false);
+    }
+
+    int LoadTabHibernationDelay()
+    {
+      return LoadValue(KEY_TAB_HIBERNATION_DELAY, DEFAULT_TAB_HIBERNATION_DELAY).toInt();
+    }
+
+    void SaveAutoFolderSizes(bool enabled)
+    {
+      SaveValue(KEY_AUTO_FOLDER_SIZES, enabled);
+    }
+
+    bool LoadAutoFolderSizes()
+    {
+      return LoadValue(KEY_AUTO_FOLDER_SIZES, false).toBool();
+    }
+
     SettingsModel::SettingsModel(QObject* parent)
       : QAbstractTableModel(parent)
     {
@@ -4,6 +4,7 @@
 #include <QByteArray>
 #include <QDir>
 #include <QJsonDocument>
+#include <QStringList>
 
 namespace TotalFinder
 {
@@ -44,5 +45,17 @@ namespace TotalFinder
 
     void SaveTabs(const QJsonDocument& data);
     QJsonDocument LoadTabs();
+
+    // gitignore-style patterns excluded from every search, on top of git global excludes
+    void SaveSearchExcludePatterns(const QStringList& patterns);
+    QStringList LoadSearchExcludePatterns();
+
+    // hidden tabs release their listing after this many seconds, 0 keeps them loaded
+    void SaveTabHibernationDelay(int seconds);
+    int LoadTabHibernationDelay();
+
+    // folder sizes of small subtrees are calculated as soon as a listing is loaded, not only on request
+    void SaveAutoFolderSizes(bool enabled);
+    bool LoadAutoFolderSizes();
   } // namespace Settings
 } // namespace TotalFinder
@@ -5,6 +5,11 @@
 
 namespace TotalFinder
 {
+  namespace
+  {
+    const int SECONDS_PER_MINUTE = 60;
+  } // namespace
+
   SettingsDialog::SettingsDialog(QWidget* parent)
     : QDialog(parent)
     , Ui(new Ui_SettingsDialog)
@@ -22,6 +27,15 @@ namespace TotalFinder
 
     Ui->ShowSystemFilesBox->setChecked(dirFilters & QDir::System);
     connect(Ui->ShowSystemFilesBox, SIGNAL(stateChanged(int)), SLOT(OnShowSystemFilesStateChanged(int)));
+
+    Ui->AutoFolderSizesBox->setChecked(Settings::LoadAutoFolderSizes());
+    connect(Ui->AutoFolderSizesBox, SIGNAL(stateChanged(int)), SLOT(OnAutoFolderSizesStateChanged(int)));
+
+    Ui->TabHibernationDelayBox->setValue(Settings::LoadTabHibernationDelay() / SECONDS_PER_MINUTE);
+    connect(Ui->TabHibernationDelayBox, SIGNAL(valueChanged(int)), SLOT(OnTabHibernationDelayChanged(int)));
+
+    Ui->ExcludePatternsEdit->setPlainText(Settings::LoadSearchExcludePatterns().join('\n'));
+    connect(Ui->ExcludePatternsEdit, SIGNAL(textChanged()), SLOT(OnExcludePatternsChanged()));
   }
 
   void SettingsDialog::OnShowHiddenFilesStateChanged(int state)
@@ -35,4 +49,28 @@ namespace TotalFinder
     const QDir::Filters dirFilters = Settings::LoadDirFilters();
     Settings::SaveDirFilters(state == Qt::Checked ? dirFilters | QDir::System : dirFilters & ~QDir::System);
   }
+
+  void SettingsDialog::OnAutoFolderSizesStateChanged(int state)
+  {
+    Settings::SaveAutoFolderSizes(state == Qt::Checked);
+  }
+
+  void SettingsDialog::OnTabHibernationDelayChanged(int minutes)
+  {
+    Settings::SaveTabHibernationDelay(minutes * SECONDS_PER_MINUTE);
+  }
+
+  void SettingsDialog::OnExcludePatternsChanged()
+  {
+    QStringList patterns;
+    foreach(const QString& line, Ui->ExcludePatternsEdit->toPlainText().split('\n'))
+    {
+      // trailing spaces are significant in gitignore, only blank lines are dropped
+      if (!line.trimmed().isEmpty())
+      {
+        patterns << line;
+      }
+    }
+    Settings::SaveSearchExcludePatterns(patterns);
+  }
 } // namespace TotalFinder
@@ -14,6 +14,9 @@ namespace TotalFinder
   private slots:
     void OnShowHiddenFilesStateChanged(int state);
     void OnShowSystemFilesStateChanged(int state);
+    void OnTabHibernationDelayChanged(int minutes);
+    void OnAutoFolderSizesStateChanged(int state);
+    void OnExcludePatternsChanged();
   private:
     void Init();
 
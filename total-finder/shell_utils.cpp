@@ -1,6 +1,7 @@
 #include "shell_utils.h"
 
 #include <QDebug>
+#include <QFileInfo>
 #include <QProcess>
 #include <QStringList>
 
@@ -8,14 +9,37 @@ namespace TotalFinder
 {
   namespace Shell
   {
-    void OpenEditorForFile(const QString& file)
+    namespace
     {
+      // command line helper shipped with the editor, understands file:line arguments
+      const char EDITOR_CLI_PATH[] = "/Applications/Sublime Text.app/Contents/SharedSupport/bin/subl";
+    } // namespace
+
+    void OpenEditorForFile(const QString& file, quint64 line)
+    {
+      if (line > 0 && QFileInfo::exists(EDITOR_CLI_PATH))
+      {
+        QStringList args;
+        args << QString("%1:%2").arg(file).arg(line);
+        qDebug() << "Open editor for file at line with args " << args;
+        QProcess::startDetached(EDITOR_CLI_PATH, args);
+        return;
+      }
+
       QStringList args;
       args << "-a" << "Sublime Text" << file;
       qDebug() << "Open editor for file with args " << args;
       QProcess::startDetached("open", args);
     }
 
+    void OpenEditorForFiles(const QStringList& files)
+    {
+      QStringList args;
+      args << "-a" << "Sublime Text" << files;
+      qDebug() << "Open editor for" << files.size() << "files";
+      QProcess::startDetached("open", args);
+    }
+
     void OpenTerminal(const QString& path)
     {
       QStringList args;
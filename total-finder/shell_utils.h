@@ -1,12 +1,15 @@
 #pragma once
 
 #include <QString>
+#include <QStringList>
 
 namespace TotalFinder
 {
   namespace Shell
   {
-    void OpenEditorForFile(const QString& file);
+    void OpenEditorForFile(const QString& file, quint64 line = 0);
+    // one editor window for all of them
+    void OpenEditorForFiles(const QStringList& files);
     void OpenTerminal(const QString& path);
     void RevealInFinder(const QString& path);
   } // namespace Shell
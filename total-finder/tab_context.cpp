@@ -37,4 +37,9 @@ namespace TotalFinder
   {
     Tabs->OnChangeSideRequest(force);
   }
+
+  void TabContext::OpenViewer(DirViewPanel* currentTab, const QString& path)
+  {
+    Tabs->AddViewerPanel(currentTab, path);
+  }
 } // namespace TotalFinder
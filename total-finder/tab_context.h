@@ -17,6 +17,8 @@ namespace TotalFinder
     QFileInfo GetOppositeTabSelection(DirViewPanel* currentTab) const;
     QDir GetOppositeTabRootDir(DirViewPanel* currentTab) const;
     void ChangeSide(bool force = false);
+    // next to the current tab, on the same side
+    void OpenViewer(DirViewPanel* currentTab, const QString& path);
   private:
     TabManager* Tabs;
   };
@@ -4,6 +4,7 @@
 #include "dir_view_panel.h"
 #include "help_panel.h"
 #include "settings.h"
+#include "viewer_panel.h"
 
 #include <QDebug>
 #include <QJsonArray>
@@ -85,9 +86,15 @@ namespace TotalFinder
     {
       QJsonObject result;
       QJsonArray tabs;
+      int activeIndex = 0;
       for (int i = 0; i < side.Container->count(); ++i)
       {
         DirViewPanel* tab = qobject_cast<DirViewPanel*>(side.Container->widget(i));
+        if (i == side.Container->currentIndex())
+        {
+          // counted among the saved tabs only; a viewer or help tab gives way to the directory tab before it
+          activeIndex = qMax(0, tab ? tabs.size() : tabs.size() - 1);
+        }
         if (tab)
         {
           QJsonObject obj;
@@ -96,7 +103,7 @@ namespace TotalFinder
         }
       }
       result["tabs"] = tabs;
-      result["active_index"] = side.Container->currentIndex();
+      result["active_index"] = activeIndex;
       result["active"] = side.Active;
       return result;
     }
@@ -173,6 +180,20 @@ namespace TotalFinder
     AddTab(this, tab, *side);
   }
 
+  void TabManager::AddViewerPanel(BasePanel* current, const QString& path)
+  {
+    const SideContext* side = FindSideForTab(current);
+    if (!side)
+    {
+      return;
+    }
+
+    // not saved with the context, only directory tabs are restored
+    ViewerPanel* tab = new ViewerPanel(path, TabContext(this));
+    AddTab(this, tab, *side, side->Container->indexOf(current) + 1);
+    tab->SetFocus();
+  }
+
   void TabManager::RestoreContext()
   {
     const QJsonDocument data = Settings::LoadTabs();
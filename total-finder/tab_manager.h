@@ -43,6 +43,7 @@ namespace TotalFinder
     );
     BasePanel* GetOppositeTab(BasePanel* current) const;
     void AddHelpPanel();
+    void AddViewerPanel(BasePanel* current, const QString& path);
 
   public slots:
     void OnChangeSideRequest(bool force);
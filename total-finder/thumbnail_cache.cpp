@@ -0,0 +1,138 @@
+#include "thumbnail_cache.h"
+#include "fs_access.h"
+
+#include <common/thread_pool.h>
+
+#include <QDebug>
+#include <QDir>
+#include <QImageReader>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <functional>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    QString GetStorePath()
+    {
+      const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+      QDir().mkpath(dir);
+      return dir + "/thumbnails";
+    }
+
+    // decoders read the files themselves, and a read from a dead mount never returns. They run on
+    // the IO pool, which is sized for threads blocked that way, and no more of them than half of
+    // the cores, so a stuck mount never takes the CPU pool and decoding leaves cores to the rest
+    std::size_t GetMaxDecoders()
+    {
+      return std::max<std::size_t>(1, Common::ThreadPool::Cpu().GetThreadCount() / 2);
+    }
+
+    QImage Decode(const QString& path, int size)
+    {
+      QImageReader reader(path);
+      reader.setAutoTransform(true);
+      const QSize original = reader.size();
+      // JPEG and a few other formats decode straight at the smaller size, which is most of the saving
+      if (original.isValid() && (original.width() > size || original.height() > size))
+      {
+        reader.setScaledSize(original.scaled(size, size, Qt::KeepAspectRatio));
+      }
+      QImage image = reader.read();
+      if (image.isNull())
+      {
+        qDebug() << "Failed to decode thumbnail of" << path << reader.errorString();
+        return image;
+      }
+      if (image.width() > size || image.height() > size)
+      {
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+      }
+      return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+  } // namespace
+
+  ThumbnailCache& ThumbnailCache::Instance()
+  {
+    static ThumbnailCache cache;
+    return cache;
+  }
+
+  ThumbnailCache::ThumbnailCache()
+    : QObject()
+    , Store(GetStorePath(), THUMBNAIL_SIZE)
+    , Pixmaps(MAX_PIXMAPS)
+    , Decoders(
+      this, SIGNAL(ThumbnailsReady()), NOTIFY_INTERVAL_MILLISECONDS, GetMaxDecoders(), MAX_PENDING,
+      std::bind(
+        &ThumbnailCache::DecodeRequest, THUMBNAIL_SIZE, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3
+      )
+    )
+  {
+    for (const QByteArray& format: QImageReader::supportedImageFormats())
+    {
+      Extensions.insert(QString::fromLatin1(format).toLower());
+    }
+  }
+
+  ThumbnailCache::~ThumbnailCache()
+  {
+  }
+
+  int ThumbnailCache::GetThumbnailSize() const
+  {
+    return THUMBNAIL_SIZE;
+  }
+
+  bool ThumbnailCache::IsImage(const QString& fileName) const
+  {
+    const int dot = fileName.lastIndexOf('.');
+    return dot > 0 && Extensions.contains(fileName.mid(dot + 1).toLower());
+  }
+
+  QPixmap ThumbnailCache::GetThumbnail(const QString& path, qint64 size, qint64 modified)
+  {
+    const Thumbnail* thumbnail = Pixmaps.object(path);
+    if (thumbnail && thumbnail->Size == size && thumbnail->Modified == modified)
+    {
+      return thumbnail->Pixmap;
+    }
+    QImage image;
+    if (Store.Find(path, size, modified, image))
+    {
+      // pixels are copied out of the mapping here, it is never painted from directly
+      const QPixmap pixmap = QPixmap::fromImage(image);
+      Pixmaps.insert(path, new Thumbnail{pixmap, size, modified});
+      return pixmap;
+    }
+    // not remembered as requested, the row asks again once the mount is back
+    if (Decoders.IsRequested(path) || FsAccess::Instance().IsQuarantined(path))
+    {
+      return QPixmap();
+    }
+    // the rows painted last are decoded first
+    Decoders.Push(path, Request{size, modified}, true);
+    return QPixmap();
+  }
+
+  void ThumbnailCache::DecodeRequest(
+    int thumbnailSize, const QString& path, const Request& request, const BackgroundQueue<Request>::Worker& worker
+  )
+  {
+    const QImage image = Decode(path, thumbnailSize);
+    worker.Deliver(
+      "OnDecoded",
+      Q_ARG(QString, path), Q_ARG(qint64, request.Size), Q_ARG(qint64, request.Modified), Q_ARG(QImage, image)
+    );
+  }
+
+  void ThumbnailCache::OnDecoded(const QString& path, qint64 size, qint64 modified, const QImage& image)
+  {
+    // undecodable files are remembered too, so they are not read again on every visit
+    Store.Insert(path, size, modified, image);
+    Pixmaps.insert(path, new Thumbnail{QPixmap::fromImage(image), size, modified});
+    Decoders.Done(path);
+  }
+} // namespace TotalFinder
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "background_queue.h"
+#include "thumbnail_store.h"
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <QString>
+
+namespace TotalFinder
+{
+  // Thumbnails of images for the grid mode of directory tabs. Images are read, decoded and scaled
+  // on the IO pool, latest requests first, which are the rows painted last. Results go to
+  // a ThumbnailStore, so a directory seen before paints from the store without decoding
+  class ThumbnailCache: public QObject
+  {
+    Q_OBJECT
+    const int THUMBNAIL_SIZE = 96;
+    const int MAX_PIXMAPS = 1024;
+    // requests from rows scrolled out of view long ago are dropped
+    const std::size_t MAX_PENDING = 512;
+    const int NOTIFY_INTERVAL_MILLISECONDS = 50;
+
+  public:
+    static ThumbnailCache& Instance();
+    ~ThumbnailCache() override;
+
+    int GetThumbnailSize() const;
+    // by the extension, for formats the installed image plugins read
+    bool IsImage(const QString& fileName) const;
+    // null while decoding, ThumbnailsReady follows; also null for files that can't be decoded
+    QPixmap GetThumbnail(const QString& path, qint64 size, qint64 modified);
+
+  signals:
+    // one or more of the thumbnails GetThumbnail returned null for can be painted
+    void ThumbnailsReady();
+
+  private slots:
+    void OnDecoded(const QString& path, qint64 size, qint64 modified, const QImage& image);
+
+  private:
+    // of the file as the row saw it, the decoded thumbnail is stored under it
+    struct Request
+    {
+      qint64 Size;
+      qint64 Modified;
+    };
+
+    struct Thumbnail
+    {
+      QPixmap Pixmap;
+      qint64 Size;
+      qint64 Modified;
+    };
+
+    ThumbnailCache();
+
+    // on the IO pool, never touches the cache
+    static void DecodeRequest(
+      int thumbnailSize, const QString& path, const Request& request, const BackgroundQueue<Request>::Worker& worker
+    );
+
+    QSet<QString> Extensions; // lower case
+    ThumbnailStore Store;
+    QCache<QString, Thumbnail> Pixmaps; // by path, GUI thread only as any QPixmap
+    // by path; declared last, so no decoder delivers to a half destroyed cache
+    BackgroundQueue<Request> Decoders;
+  };
+} // namespace TotalFinder
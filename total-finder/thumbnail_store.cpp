@@ -0,0 +1,255 @@
+#include "thumbnail_store.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    const quint32 STORE_MAGIC = 0x54465448; // "TFTH"
+    const quint32 STORE_VERSION = 1;
+    // header takes a page of its own, slots follow
+    const qint64 HEADER_BYTES = 4096;
+    const qint64 SLOT_HEADER_BYTES = 64;
+    const int BYTES_PER_PIXEL = 4;
+
+    struct StoreHeader
+    {
+      quint32 Magic;
+      quint32 Version;
+      quint32 ThumbnailSize;
+      quint32 SlotCount;
+      quint64 Clock; // last use stamp given to a slot
+    };
+
+    struct SlotHeader
+    {
+      quint64 PathHash; // 0 for an empty slot
+      qint64 Size;
+      qint64 Modified;
+      quint64 Stamp;
+      quint16 Width; // 0 for a file that failed to decode
+      quint16 Height;
+    };
+
+    // FNV-1a, stable across runs unlike qHash
+    quint64 HashPath(const QString& path)
+    {
+      const QByteArray bytes = path.toUtf8();
+      quint64 hash = 14695981039346656037ULL;
+      for (const char c: bytes)
+      {
+        hash ^= static_cast<uchar>(c);
+        hash *= 1099511628211ULL;
+      }
+      return hash ? hash : 1;
+    }
+  } // namespace
+
+  ThumbnailStore::ThumbnailStore(const QString& path, int thumbnailSize)
+    : ThumbnailSize(thumbnailSize)
+    , File(-1)
+    , Data(nullptr)
+    , Clock(0)
+  {
+    const int fd = open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1)
+    {
+      qWarning() << "Failed to open thumbnail cache" << path << std::strerror(errno);
+      return;
+    }
+    // another running instance owns the file
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || !Map(fd, path))
+    {
+      close(fd);
+      return;
+    }
+    File = fd;
+  }
+
+  ThumbnailStore::~ThumbnailStore()
+  {
+    if (Data)
+    {
+      munmap(const_cast<char*>(Data), GetFileBytes());
+    }
+    if (File != -1)
+    {
+      close(File);
+    }
+  }
+
+  bool ThumbnailStore::IsOpen() const
+  {
+    return Data != nullptr;
+  }
+
+  bool ThumbnailStore::Map(int fd, const QString& path)
+  {
+    StoreHeader expected;
+    std::memset(&expected, 0, sizeof(expected));
+    expected.Magic = STORE_MAGIC;
+    expected.Version = STORE_VERSION;
+    expected.ThumbnailSize = ThumbnailSize;
+    expected.SlotCount = SLOT_COUNT;
+
+    StoreHeader header;
+    struct stat st;
+    const bool valid = fstat(fd, &st) == 0 && st.st_size == GetFileBytes()
+      && pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+      && header.Magic == expected.Magic && header.Version == expected.Version
+      && header.ThumbnailSize == expected.ThumbnailSize && header.SlotCount == expected.SlotCount;
+    if (!valid)
+    {
+      // the file is sparse, slots take disk space only once written
+      qDebug() << "Create thumbnail cache" << path;
+      if (ftruncate(fd, 0) != 0 || ftruncate(fd, GetFileBytes()) != 0
+        || pwrite(fd, &expected, sizeof(expected), 0) != static_cast<ssize_t>(sizeof(expected)))
+      {
+        qWarning() << "Failed to create thumbnail cache" << path << std::strerror(errno);
+        return false;
+      }
+    }
+    // holes of the sparse file read as zeros, which are empty slots
+    void* data = mmap(nullptr, GetFileBytes(), PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      qWarning() << "Failed to map thumbnail cache" << path << std::strerror(errno);
+      return false;
+    }
+    Data = static_cast<const char*>(data);
+    Clock = reinterpret_cast<const StoreHeader*>(Data)->Clock;
+    return true;
+  }
+
+  bool ThumbnailStore::Find(const QString& path, qint64 size, qint64 modified, QImage& image)
+  {
+    if (!Data)
+    {
+      return false;
+    }
+    const quint64 hash = HashPath(path);
+    const quint32 first = hash % (SLOT_COUNT / SLOTS_PER_SET) * SLOTS_PER_SET;
+    for (quint32 index = first; index < first + SLOTS_PER_SET; ++index)
+    {
+      const char* slot = GetSlot(index);
+      const SlotHeader* slotHeader = reinterpret_cast<const SlotHeader*>(slot);
+      if (slotHeader->PathHash != hash || slotHeader->Size != size || slotHeader->Modified != modified)
+      {
+        continue;
+      }
+      // a damaged slot would make the image read past its pixels
+      if (slotHeader->Width > ThumbnailSize || slotHeader->Height > ThumbnailSize)
+      {
+        continue;
+      }
+      SetStamp(index);
+      image = slotHeader->Width
+        ? QImage(
+            reinterpret_cast<const uchar*>(slot + SLOT_HEADER_BYTES), slotHeader->Width, slotHeader->Height,
+            slotHeader->Width * BYTES_PER_PIXEL, QImage::Format_ARGB32_Premultiplied
+          )
+        : QImage();
+      return true;
+    }
+    return false;
+  }
+
+  void ThumbnailStore::Insert(const QString& path, qint64 size, qint64 modified, const QImage& image)
+  {
+    if (!Data || image.width() > ThumbnailSize || image.height() > ThumbnailSize)
+    {
+      return;
+    }
+    const quint64 hash = HashPath(path);
+    const quint32 first = hash % (SLOT_COUNT / SLOTS_PER_SET) * SLOTS_PER_SET;
+    // the same file in another version, or else the least recently used slot; empty ones have stamp 0
+    quint32 victim = first;
+    for (quint32 index = first; index < first + SLOTS_PER_SET; ++index)
+    {
+      const SlotHeader* slotHeader = reinterpret_cast<const SlotHeader*>(GetSlot(index));
+      if (slotHeader->PathHash == hash)
+      {
+        victim = index;
+        break;
+      }
+      if (slotHeader->Stamp < reinterpret_cast<const SlotHeader*>(GetSlot(victim))->Stamp)
+      {
+        victim = index;
+      }
+    }
+
+    const qint64 offset = GetSlotOffset(victim);
+    // a slot caught half written by a crash must not match, so the key goes last
+    const quint64 noHash = 0;
+    if (!Write(offset + offsetof(SlotHeader, PathHash), &noHash, sizeof(noHash)))
+    {
+      return;
+    }
+    const QImage pixels = image.isNull() ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    // rows of 32 bit pixels are never padded, so they are written in one go
+    if (!Write(offset + SLOT_HEADER_BYTES, pixels.constBits(), static_cast<qint64>(pixels.width()) * pixels.height() * BYTES_PER_PIXEL))
+    {
+      return;
+    }
+    SlotHeader slotHeader;
+    std::memset(&slotHeader, 0, sizeof(slotHeader));
+    slotHeader.Size = size;
+    slotHeader.Modified = modified;
+    slotHeader.Stamp = ++Clock;
+    slotHeader.Width = static_cast<quint16>(pixels.width());
+    slotHeader.Height = static_cast<quint16>(pixels.height());
+    slotHeader.PathHash = hash;
+    Write(offset, &slotHeader, sizeof(slotHeader));
+    Write(offsetof(StoreHeader, Clock), &Clock, sizeof(Clock));
+  }
+
+  bool ThumbnailStore::Write(qint64 offset, const void* data, qint64 size)
+  {
+    if (pwrite(File, data, size, offset) == size)
+    {
+      return true;
+    }
+    // most likely a full disk, the slot stays empty and the thumbnail is decoded again next time
+    qWarning() << "Failed to write thumbnail cache" << std::strerror(errno);
+    return false;
+  }
+
+  void ThumbnailStore::SetStamp(quint32 index)
+  {
+    ++Clock;
+    Write(GetSlotOffset(index) + offsetof(SlotHeader, Stamp), &Clock, sizeof(Clock));
+    Write(offsetof(StoreHeader, Clock), &Clock, sizeof(Clock));
+  }
+
+  qint64 ThumbnailStore::GetSlotOffset(quint32 index) const
+  {
+    return HEADER_BYTES + index * GetSlotBytes();
+  }
+
+  const char* ThumbnailStore::GetSlot(quint32 index) const
+  {
+    return Data + GetSlotOffset(index);
+  }
+
+  qint64 ThumbnailStore::GetSlotBytes() const
+  {
+    return SLOT_HEADER_BYTES + static_cast<qint64>(ThumbnailSize) * ThumbnailSize * BYTES_PER_PIXEL;
+  }
+
+  qint64 ThumbnailStore::GetFileBytes() const
+  {
+    return HEADER_BYTES + SLOT_COUNT * GetSlotBytes();
+  }
+} // namespace TotalFinder
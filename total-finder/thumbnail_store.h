@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+
+namespace TotalFinder
+{
+  // Persistent thumbnails in one file of fixed size slots, kept across runs. The file is read through
+  // a read-only mapping and written with pwrite: it is sparse, and a store into an unallocated page of
+  // a shared mapping faults with SIGBUS when the disk is full, where pwrite just fails.
+  // A thumbnail is found by the hash of its path together with the size and mtime of the file,
+  // so an edited image simply misses. Slots are grouped in small sets by the path hash, the least
+  // recently used slot of the set is overwritten. Only the instance that locked the file uses it,
+  // others work without the persistent cache
+  class ThumbnailStore
+  {
+    const quint32 SLOT_COUNT = 32 * 1024;
+    const quint32 SLOTS_PER_SET = 4;
+
+  public:
+    // thumbnails are at most thumbnailSize pixels wide and high
+    ThumbnailStore(const QString& path, int thumbnailSize);
+    ~ThumbnailStore();
+    bool IsOpen() const;
+
+    // false if nothing has been stored for this version of the file. A null image means
+    // the file has been found undecodable. Pixels are not copied and stay valid until the next Insert
+    bool Find(const QString& path, qint64 size, qint64 modified, QImage& image);
+    // a null image marks the file undecodable
+    void Insert(const QString& path, qint64 size, qint64 modified, const QImage& image);
+
+  private:
+    ThumbnailStore(const ThumbnailStore&);
+    ThumbnailStore& operator=(const ThumbnailStore&);
+
+    bool Map(int fd, const QString& path);
+    bool Write(qint64 offset, const void* data, qint64 size);
+    void SetStamp(quint32 index);
+    qint64 GetSlotOffset(quint32 index) const;
+    const char* GetSlot(quint32 index) const;
+    qint64 GetSlotBytes() const;
+    qint64 GetFileBytes() const;
+
+    const int ThumbnailSize;
+    int File;
+    const char* Data;
+    quint64 Clock; // last use stamp given to a slot, mirrored in the file header
+  };
+} // namespace TotalFinder
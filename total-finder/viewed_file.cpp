@@ -0,0 +1,68 @@
+#include "viewed_file.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace TotalFinder
+{
+  ViewedFile::Ptr ViewedFile::Open(const QString& path)
+  {
+    const int fd = open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd == -1)
+    {
+      qWarning() << "Failed to open file" << path << std::strerror(errno);
+      return Ptr();
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+      qWarning() << "Not a regular file:" << path;
+      close(fd);
+      return Ptr();
+    }
+    return Ptr(new ViewedFile(fd, st.st_size));
+  }
+
+  ViewedFile::ViewedFile(int fd, qint64 size)
+    : Fd(fd)
+    , Size(size)
+  {
+  }
+
+  ViewedFile::~ViewedFile()
+  {
+    close(Fd);
+  }
+
+  qint64 ViewedFile::GetSize() const
+  {
+    return Size;
+  }
+
+  qint64 ViewedFile::Read(qint64 offset, qint64 size, char* buffer) const
+  {
+    size = qMin(size, Size - offset);
+    qint64 done = 0;
+    while (done < size)
+    {
+      const ssize_t got = pread(Fd, buffer + done, size - done, offset + done);
+      if (got < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (got <= 0)
+      {
+        break;
+      }
+      done += got;
+    }
+    return done;
+  }
+} // namespace TotalFinder
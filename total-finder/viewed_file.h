@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QString>
+
+#include <memory>
+
+namespace TotalFinder
+{
+  // File open for the viewer, read with pread at any offset. The size is taken when the file is
+  // opened. Shared between the viewer and its indexing task, so reopening a growing file never
+  // closes it under a running scan. Not mapped: a file truncated while an mmap is read faults with
+  // SIGBUS, while reads past its new end here just come back short
+  class ViewedFile
+  {
+  public:
+    typedef std::shared_ptr<const ViewedFile> Ptr;
+
+    // nullptr if the file can't be opened
+    static Ptr Open(const QString& path);
+    ~ViewedFile();
+
+    qint64 GetSize() const;
+    // Reads up to size bytes at the offset, clipped to GetSize. Returns the number of bytes read,
+    // fewer if the file has shrunk since it was opened, 0 on errors
+    qint64 Read(qint64 offset, qint64 size, char* buffer) const;
+
+  private:
+    ViewedFile(int fd, qint64 size);
+    ViewedFile(const ViewedFile&);
+    ViewedFile& operator=(const ViewedFile&);
+
+    int Fd;
+    qint64 Size;
+  };
+} // namespace TotalFinder
@@ -0,0 +1,689 @@
+#include "viewer_panel.h"
+#include "entry_table.h"
+#include "event_filters.h"
+#include "fs_access.h"
+
+#include <common/text_search.h>
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QPainter>
+#include <QScrollBar>
+#include <QStringList>
+#include <QVBoxLayout>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace TotalFinder
+{
+  namespace
+  {
+    const int ROW_MARGIN = 4;
+    const int TAB_WIDTH = 4;
+    const int WHEEL_DELTA_PER_NOTCH = 120;
+    const qint64 SCAN_BLOCK_SIZE = 64 * 1024;
+
+    // Start of the line count line breaks after the offset, or of the last line if the file has
+    // fewer of them; skipped is the number of line breaks passed
+    qint64 SkipLines(const ViewedFile& file, qint64 offset, qint64 count, qint64& skipped)
+    {
+      std::vector<char> block(SCAN_BLOCK_SIZE);
+      qint64 lineStart = offset;
+      skipped = 0;
+      for (qint64 pos = offset; skipped < count && pos < file.GetSize();)
+      {
+        const qint64 size = file.Read(pos, SCAN_BLOCK_SIZE, &block.front());
+        if (!size)
+        {
+          break;
+        }
+        const char* data = &block.front();
+        const char* next = data;
+        while (skipped < count)
+        {
+          const char* newline = static_cast<const char*>(std::memchr(next, '\n', data + size - next));
+          if (!newline)
+          {
+            break;
+          }
+          next = newline + 1;
+          lineStart = pos + (next - data);
+          ++skipped;
+        }
+        pos += size;
+      }
+      return lineStart;
+    }
+
+    qint64 CountLineBreaks(const ViewedFile& file, qint64 begin, qint64 end)
+    {
+      std::vector<char> block(SCAN_BLOCK_SIZE);
+      qint64 count = 0;
+      while (begin < end)
+      {
+        const qint64 size = file.Read(begin, qMin(SCAN_BLOCK_SIZE, end - begin), &block.front());
+        if (!size)
+        {
+          break;
+        }
+        count += Search::CountNewlines(&block.front(), size);
+        begin += size;
+      }
+      return count;
+    }
+  } // namespace
+
+  FileView::FileView(QWidget* parent)
+    : QAbstractScrollArea(parent)
+    , CacheStart(0)
+    , Top(0)
+    , Hex(false)
+    , UpdatingScrollBar(false)
+  {
+    setFocusPolicy(Qt::StrongFocus);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(OnScrollBarMoved(int)));
+  }
+
+  void FileView::SetFile(const ViewedFile::Ptr& file)
+  {
+    File = file;
+    Cache.clear();
+    CacheStart = 0;
+    Top = File && Top < File->GetSize() ? GetRowStart(Top) : 0;
+    UpdateScrollBar();
+    viewport()->update();
+    emit TopChanged();
+  }
+
+  void FileView::SetHexMode(bool hex)
+  {
+    Hex = hex;
+    SetFile(File);
+  }
+
+  bool FileView::IsHexMode() const
+  {
+    return Hex;
+  }
+
+  qint64 FileView::GetTop() const
+  {
+    return Top;
+  }
+
+  void FileView::ScrollTo(qint64 offset)
+  {
+    SetTop(qMin(GetRowStart(offset), GetLastTop()));
+  }
+
+  void FileView::ScrollRows(int rows)
+  {
+    qint64 top = Top;
+    if (rows > 0)
+    {
+      const qint64 last = GetLastTop();
+      for (int row = 0; row < rows && top < last; ++row)
+      {
+        top = GetNextRow(top);
+      }
+      top = qMin(top, last);
+    }
+    for (int row = 0; row < -rows && top > 0; ++row)
+    {
+      top = GetPreviousRow(top);
+    }
+    SetTop(top);
+  }
+
+  void FileView::ScrollToEnd()
+  {
+    SetTop(GetLastTop());
+  }
+
+  int FileView::GetPageRows() const
+  {
+    return qMax(1, viewport()->height() / fontMetrics().height());
+  }
+
+  const char* FileView::GetBytes(qint64 begin, qint64& end) const
+  {
+    if (begin >= CacheStart && end <= CacheStart + Cache.size())
+    {
+      return Cache.constData() + (begin - CacheStart);
+    }
+    // rows before the offset are looked for as often as the ones after it
+    CacheStart = qMax<qint64>(0, begin - MAX_ROW_BYTES);
+    Cache.resize(static_cast<int>(qMax(CACHE_SIZE, end - CacheStart)));
+    Cache.resize(static_cast<int>(File->Read(CacheStart, Cache.size(), Cache.data())));
+    end = qMax(begin, qMin(end, CacheStart + Cache.size()));
+    return Cache.constData() + qMin<qint64>(begin - CacheStart, Cache.size());
+  }
+
+  qint64 FileView::GetRowStart(qint64 offset) const
+  {
+    if (!File || offset <= 0)
+    {
+      return 0;
+    }
+    offset = qMin(offset, File->GetSize());
+    if (Hex)
+    {
+      return offset - offset % HEX_ROW_BYTES;
+    }
+    // lines longer than a row are cut counting from here, which might differ from the cut of the forward scan
+    const qint64 limit = qMax<qint64>(0, offset - MAX_ROW_BYTES);
+    qint64 end = offset;
+    const char* data = GetBytes(limit, end);
+    for (qint64 pos = end - 1; pos >= limit; --pos)
+    {
+      if (data[pos - limit] == '\n')
+      {
+        return pos + 1;
+      }
+    }
+    return limit;
+  }
+
+  qint64 FileView::GetNextRow(qint64 offset) const
+  {
+    const qint64 size = File ? File->GetSize() : 0;
+    if (offset >= size)
+    {
+      return size;
+    }
+    if (Hex)
+    {
+      return qMin(size, offset + HEX_ROW_BYTES);
+    }
+    qint64 end = qMin(size, offset + MAX_ROW_BYTES);
+    const char* data = GetBytes(offset, end);
+    if (end == offset)
+    {
+      // truncated since it was opened, the rest is shown as gone
+      return size;
+    }
+    const char* newline = static_cast<const char*>(std::memchr(data, '\n', end - offset));
+    return newline ? offset + (newline - data) + 1 : end;
+  }
+
+  qint64 FileView::GetPreviousRow(qint64 offset) const
+  {
+    return offset <= 0 ? 0 : GetRowStart(offset - 1);
+  }
+
+  qint64 FileView::GetLastTop() const
+  {
+    if (!File || !File->GetSize())
+    {
+      return 0;
+    }
+    // the last row is at the bottom of the view, not at the top
+    qint64 top = GetRowStart(File->GetSize() - 1);
+    for (int row = 1; row < GetPageRows() && top > 0; ++row)
+    {
+      top = GetPreviousRow(top);
+    }
+    return top;
+  }
+
+  QString FileView::GetRowText(qint64 offset, qint64 end) const
+  {
+    const char* data = GetBytes(offset, end);
+    const int length = static_cast<int>(end - offset);
+    if (Hex)
+    {
+      QString bytes = QString("%1  ").arg(offset, 10, 16, QChar('0'));
+      QString text;
+      for (int i = 0; i < HEX_ROW_BYTES; ++i)
+      {
+        if (i < length)
+        {
+          const uchar byte = static_cast<uchar>(data[i]);
+          bytes += QString("%1 ").arg(static_cast<uint>(byte), 2, 16, QChar('0'));
+          text += byte >= 0x20 && byte < 0x7f ? QChar(byte) : QChar('.');
+        }
+        else
+        {
+          bytes += "   ";
+        }
+        if (i == HEX_ROW_BYTES / 2 - 1)
+        {
+          bytes += ' ';
+        }
+      }
+      return bytes + ' ' + text;
+    }
+    int trimmed = length;
+    while (trimmed > 0 && (data[trimmed - 1] == '\n' || data[trimmed - 1] == '\r'))
+    {
+      --trimmed;
+    }
+    QString text = QString::fromUtf8(data, trimmed);
+    text.replace('\t', QString(TAB_WIDTH, ' '));
+    return text;
+  }
+
+  void FileView::SetTop(qint64 offset)
+  {
+    if (offset == Top)
+    {
+      return;
+    }
+    Top = offset;
+    UpdateScrollBar();
+    viewport()->update();
+    emit TopChanged();
+  }
+
+  void FileView::UpdateScrollBar()
+  {
+    const qint64 size = File ? File->GetSize() : 0;
+    const qint64 range = qMin(size, MAX_SCROLL_RANGE);
+    qint64 pageEnd = Top;
+    for (int row = 0; row < GetPageRows() && pageEnd < size; ++row)
+    {
+      pageEnd = GetNextRow(pageEnd);
+    }
+    UpdatingScrollBar = true;
+    QScrollBar* scrollBar = verticalScrollBar();
+    scrollBar->setRange(0, static_cast<int>(range));
+    scrollBar->setPageStep(size ? qMax(1, static_cast<int>(static_cast<double>(pageEnd - Top) / size * range)) : 1);
+    scrollBar->setValue(size ? static_cast<int>(static_cast<double>(Top) / size * range) : 0);
+    UpdatingScrollBar = false;
+  }
+
+  void FileView::OnScrollBarMoved(int value)
+  {
+    const qint64 size = File ? File->GetSize() : 0;
+    const int range = verticalScrollBar()->maximum();
+    if (UpdatingScrollBar || !range)
+    {
+      return;
+    }
+    ScrollTo(static_cast<qint64>(static_cast<double>(value) / range * size));
+  }
+
+  void FileView::paintEvent(QPaintEvent* /*event*/)
+  {
+    if (!File)
+    {
+      return;
+    }
+    QPainter painter(viewport());
+    painter.setPen(palette().color(QPalette::Text));
+    const QFontMetrics metrics = fontMetrics();
+    int y = metrics.ascent();
+    qint64 offset = Top;
+    // one more row for the partly visible one at the bottom
+    for (int row = 0; row <= GetPageRows() && offset < File->GetSize(); ++row)
+    {
+      const qint64 next = GetNextRow(offset);
+      painter.drawText(ROW_MARGIN, y, GetRowText(offset, next));
+      y += metrics.height();
+      offset = next;
+    }
+  }
+
+  void FileView::resizeEvent(QResizeEvent* event)
+  {
+    QAbstractScrollArea::resizeEvent(event);
+    UpdateScrollBar();
+  }
+
+  void FileView::wheelEvent(QWheelEvent* event)
+  {
+    // the scroll bar is far too coarse to step through a big file by rows
+    ScrollRows(-event->angleDelta().y() * WHEEL_ROWS / WHEEL_DELTA_PER_NOTCH);
+    event->accept();
+  }
+
+  void FileView::keyPressEvent(QKeyEvent* event)
+  {
+    event->ignore();
+  }
+
+  ViewerPanel::ViewerPanel(const QString& path, const TabContext& context, QWidget* parent)
+    : BasePanel(parent)
+    , Path(path)
+    , File(ViewedFile::Open(path))
+    , View(new FileView(this))
+    , JumpEdit(new QLineEdit(this))
+    , StatusLabel(new QLabel(this))
+    , FollowTimer(new QTimer(this))
+    , Indexer(nullptr)
+    , IndexedSize(0)
+    , IndexedLines(0)
+    , PendingLine(0)
+    , FollowStatPending(false)
+    , Context(context)
+  {
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(View);
+    layout->addWidget(JumpEdit);
+    layout->addWidget(StatusLabel);
+    setFont(QFont("Menlo Regular", 11));
+
+    JumpEdit->setPlaceholderText("Line number, or percent followed by %");
+    JumpEdit->hide();
+    connect(JumpEdit, SIGNAL(returnPressed()), SLOT(OnJumpEntered()));
+    KeyPressFilter* jumpKeys = new KeyPressFilter(this);
+    jumpKeys->InterceptKey(Qt::Key_Escape);
+    connect(jumpKeys, SIGNAL(KeyPressed(QKeyEvent)), SLOT(OnJumpKey(QKeyEvent)));
+    JumpEdit->installEventFilter(jumpKeys);
+
+    FollowTimer->setInterval(FOLLOW_INTERVAL_MILLISECONDS);
+    connect(FollowTimer, SIGNAL(timeout()), SLOT(OnFollowTimer()));
+
+    View->SetFile(File);
+    connect(View, SIGNAL(TopChanged()), SLOT(UpdateStatus()));
+
+    Checkpoints.append(LineCheckpoint{0, 0});
+    StartIndexing();
+    UpdateStatus();
+
+    BasePanel::InstallKeyEventFilter(QWidgetList() << View);
+  }
+
+  ViewerPanel::~ViewerPanel()
+  {
+    StopIndexing();
+  }
+
+  void ViewerPanel::SetFocus()
+  {
+    View->setFocus();
+  }
+
+  QString ViewerPanel::GetName() const
+  {
+    return QFileInfo(Path).fileName();
+  }
+
+  void ViewerPanel::StartIndexing()
+  {
+    if (!File || IndexedSize >= File->GetSize())
+    {
+      return;
+    }
+    Indexer = new LineIndexer(File, IndexedSize, IndexedLines, this);
+    connect(
+      Indexer, SIGNAL(ChunkIndexed(const QVector<LineCheckpoint>&, qint64, qint64)),
+      SLOT(OnChunkIndexed(const QVector<LineCheckpoint>&, qint64, qint64)), Qt::QueuedConnection
+    );
+    connect(Indexer, SIGNAL(Finished()), SLOT(OnIndexFinished()), Qt::QueuedConnection);
+    connect(Indexer, SIGNAL(Finished()), Indexer, SLOT(deleteLater()), Qt::QueuedConnection);
+    Indexer->Start();
+  }
+
+  void ViewerPanel::StopIndexing()
+  {
+    if (!Indexer)
+    {
+      return;
+    }
+    // the indexer deletes itself once its pool task notices the cancellation, the file stays open until then
+    disconnect(Indexer, 0, this, 0);
+    Indexer->setParent(nullptr);
+    Indexer->Cancel();
+    Indexer = nullptr;
+  }
+
+  void ViewerPanel::OnChunkIndexed(const QVector<LineCheckpoint>& checkpoints, qint64 indexedSize, qint64 lines)
+  {
+    if (sender() != Indexer)
+    {
+      return;
+    }
+    Checkpoints += checkpoints;
+    IndexedSize = indexedSize;
+    IndexedLines = lines;
+    if (PendingLine && JumpToLine(PendingLine))
+    {
+      PendingLine = 0;
+    }
+    UpdateStatus();
+  }
+
+  void ViewerPanel::OnIndexFinished()
+  {
+    if (sender() != Indexer)
+    {
+      return;
+    }
+    Indexer = nullptr;
+    if (PendingLine)
+    {
+      // past the last line
+      JumpToLine(PendingLine);
+      PendingLine = 0;
+    }
+    UpdateStatus();
+  }
+
+  bool ViewerPanel::JumpToLine(qint64 line)
+  {
+    if (!File || (line - 1 > IndexedLines && Indexer))
+    {
+      return false;
+    }
+    // the last checkpoint before the line break ending the previous line; past the last line
+    // that is the last checkpoint, and the scan stops at the end of the file
+    const QVector<LineCheckpoint>::const_iterator next = std::lower_bound(
+      Checkpoints.begin(), Checkpoints.end(), line - 1,
+      [](const LineCheckpoint& checkpoint, qint64 breaks) { return checkpoint.Line < breaks; }
+    );
+    const LineCheckpoint& start = next == Checkpoints.begin() ? *next : *(next - 1);
+    const qint64 skip = line - 1 - start.Line;
+    qint64 skipped = 0;
+    const qint64 offset = SkipLines(*File, start.Offset, skip, skipped);
+    if (skipped < skip && Indexer)
+    {
+      return false;
+    }
+    View->ScrollTo(offset);
+    return true;
+  }
+
+  qint64 ViewerPanel::GetLineNumber(qint64 offset) const
+  {
+    if (!File || offset > IndexedSize)
+    {
+      return 0;
+    }
+    const QVector<LineCheckpoint>::const_iterator next = std::upper_bound(
+      Checkpoints.begin(), Checkpoints.end(), offset,
+      [](qint64 position, const LineCheckpoint& checkpoint) { return position < checkpoint.Offset; }
+    );
+    const LineCheckpoint& start = *(next - 1);
+    return start.Line + CountLineBreaks(*File, start.Offset, offset) + 1;
+  }
+
+  void ViewerPanel::UpdateStatus()
+  {
+    if (!File)
+    {
+      StatusLabel->setText(QString("Can't open %1").arg(Path));
+      return;
+    }
+    const qint64 size = File->GetSize();
+    const qint64 top = View->GetTop();
+    const qint64 line = GetLineNumber(top);
+    QStringList parts;
+    if (Indexer)
+    {
+      const QString indexing = QString("indexing %1%").arg(IndexedSize * 100 / size);
+      parts << (line ? QString("Line %1, %2").arg(line).arg(indexing) : indexing);
+    }
+    else
+    {
+      // the last line has no line break after it unless the file ends with one
+      char last = '\n';
+      const qint64 lines = IndexedLines + (size && File->Read(size - 1, 1, &last) && last != '\n' ? 1 : 0);
+      parts << QString("Line %1 of %2").arg(line).arg(lines);
+    }
+    parts << QString("%1%").arg(size ? top * 100 / size : 100);
+    parts << FormatSize(size) + " bytes";
+    if (View->IsHexMode())
+    {
+      parts << "hex";
+    }
+    if (FollowTimer->isActive())
+    {
+      parts << "following";
+    }
+    StatusLabel->setText(parts.join("  |  "));
+  }
+
+  void ViewerPanel::OnJumpEntered()
+  {
+    const QString text = JumpEdit->text().trimmed();
+    JumpEdit->clear();
+    JumpEdit->hide();
+    View->setFocus();
+    if (!File)
+    {
+      return;
+    }
+    SetFollowing(false);
+    bool ok = false;
+    if (text.endsWith('%'))
+    {
+      const double percent = text.left(text.size() - 1).toDouble(&ok);
+      if (ok)
+      {
+        View->ScrollTo(static_cast<qint64>(File->GetSize() * qBound(0.0, percent, 100.0) / 100));
+      }
+      return;
+    }
+    const qint64 line = text.toLongLong(&ok);
+    PendingLine = 0;
+    if (ok && line > 0 && !JumpToLine(line))
+    {
+      // taken as soon as the index gets there
+      PendingLine = line;
+    }
+  }
+
+  void ViewerPanel::OnJumpKey(QKeyEvent event)
+  {
+    if (event.key() == Qt::Key_Escape)
+    {
+      JumpEdit->clear();
+      JumpEdit->hide();
+      View->setFocus();
+    }
+  }
+
+  void ViewerPanel::SetFollowing(bool follow)
+  {
+    if (follow == FollowTimer->isActive())
+    {
+      return;
+    }
+    if (follow)
+    {
+      FollowTimer->start();
+      View->ScrollToEnd();
+    }
+    else
+    {
+      FollowTimer->stop();
+    }
+    UpdateStatus();
+  }
+
+  void ViewerPanel::OnFollowTimer()
+  {
+    // a mount that stopped answering takes longer than the interval
+    if (FollowStatPending)
+    {
+      return;
+    }
+    FollowStatPending = true;
+    FsAccess::Instance().Stat(Path, this, [this](const FsResult& result)
+    {
+      FollowStatPending = false;
+      if (!result.Error && FollowTimer->isActive() && (!File || result.Size != File->GetSize()))
+      {
+        Reopen();
+      }
+    });
+  }
+
+  void ViewerPanel::Reopen()
+  {
+    const ViewedFile::Ptr file = ViewedFile::Open(Path);
+    if (!file)
+    {
+      return;
+    }
+    // lines indexed so far stay, unless the file has been truncated or replaced by a shorter one
+    StopIndexing();
+    if (file->GetSize() < IndexedSize)
+    {
+      Checkpoints.resize(1);
+      IndexedSize = 0;
+      IndexedLines = 0;
+    }
+    File = file;
+    View->SetFile(File);
+    View->ScrollToEnd();
+    StartIndexing();
+    UpdateStatus();
+  }
+
+  void ViewerPanel::KeyHandler(Qt::KeyboardModifiers modifiers, Qt::Key key, const QString& /*text*/)
+  {
+    if (modifiers != Qt::NoModifier && modifiers != Qt::KeypadModifier)
+    {
+      return;
+    }
+    switch (key)
+    {
+    case Qt::Key_Down:
+      View->ScrollRows(1);
+      break;
+    case Qt::Key_PageDown:
+      View->ScrollRows(qMax(1, View->GetPageRows() - 1));
+      break;
+    case Qt::Key_End:
+      View->ScrollToEnd();
+      break;
+    case Qt::Key_Up:
+      SetFollowing(false);
+      View->ScrollRows(-1);
+      break;
+    case Qt::Key_PageUp:
+      SetFollowing(false);
+      View->ScrollRows(-qMax(1, View->GetPageRows() - 1));
+      break;
+    case Qt::Key_Home:
+      SetFollowing(false);
+      View->ScrollTo(0);
+      break;
+    case Qt::Key_G:
+      JumpEdit->show();
+      JumpEdit->setFocus();
+      break;
+    case Qt::Key_H:
+      View->SetHexMode(!View->IsHexMode());
+      UpdateStatus();
+      break;
+    case Qt::Key_F:
+      SetFollowing(!FollowTimer->isActive());
+      break;
+    case Qt::Key_Escape:
+    case Qt::Key_F3:
+    case Qt::Key_Q:
+      emit CloseTabRequest();
+      break;
+    default:
+      break;
+    }
+  }
+} // namespace TotalFinder
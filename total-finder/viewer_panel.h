@@ -0,0 +1,128 @@
+#pragma once
+
+#include "base_panel.h"
+#include "line_indexer.h"
+#include "tab_context.h"
+#include "viewed_file.h"
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTimer>
+#include <QVector>
+
+namespace TotalFinder
+{
+  // Paints only the rows in view, read from the file around the top offset, rows are found by
+  // scanning there. Nothing depends on the line index, so any file opens at once
+  class FileView: public QAbstractScrollArea
+  {
+    Q_OBJECT
+    // longer lines are cut into rows of that many bytes
+    const qint64 MAX_ROW_BYTES = 4096;
+    const int HEX_ROW_BYTES = 16;
+    // scroll bar positions are proportional to offsets, the range fits an int for any file size
+    const qint64 MAX_SCROLL_RANGE = 1 << 24;
+    const int WHEEL_ROWS = 3;
+    // bytes read at once around the rows asked for, painting and scrolling read the same ones over and over
+    const qint64 CACHE_SIZE = 64 * 1024;
+
+  public:
+    explicit FileView(QWidget* parent);
+
+    // keeps the position if it is still inside the file
+    void SetFile(const ViewedFile::Ptr& file);
+    void SetHexMode(bool hex);
+    bool IsHexMode() const;
+    qint64 GetTop() const;
+    // to the start of the row holding the offset
+    void ScrollTo(qint64 offset);
+    void ScrollRows(int rows);
+    void ScrollToEnd();
+    int GetPageRows() const;
+
+  signals:
+    void TopChanged();
+
+  protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    // keys are handled by the panel
+    void keyPressEvent(QKeyEvent* event) override;
+
+  private slots:
+    void OnScrollBarMoved(int value);
+
+  private:
+    // bytes of [begin, end) of the file, end is lowered to what the file still has
+    const char* GetBytes(qint64 begin, qint64& end) const;
+    qint64 GetRowStart(qint64 offset) const;
+    qint64 GetNextRow(qint64 offset) const;
+    qint64 GetPreviousRow(qint64 offset) const;
+    qint64 GetLastTop() const;
+    QString GetRowText(qint64 offset, qint64 end) const;
+    void SetTop(qint64 offset);
+    void UpdateScrollBar();
+
+    ViewedFile::Ptr File;
+    mutable QByteArray Cache;
+    mutable qint64 CacheStart;
+    qint64 Top;
+    bool Hex;
+    bool UpdatingScrollBar;
+  };
+
+  // F3 lister: text or hex view of a file of any size, jumps to a line or a percentage,
+  // and follows a growing file like tail -f
+  class ViewerPanel: public BasePanel
+  {
+    Q_OBJECT
+    const int FOLLOW_INTERVAL_MILLISECONDS = 500;
+
+  public:
+    ViewerPanel(const QString& path, const TabContext& context, QWidget* parent = nullptr);
+    ~ViewerPanel() override;
+    void SetFocus() override;
+    QString GetName() const override;
+
+  private slots:
+    void OnChunkIndexed(const QVector<LineCheckpoint>& checkpoints, qint64 indexedSize, qint64 lines);
+    void OnIndexFinished();
+    void OnJumpEntered();
+    void OnJumpKey(QKeyEvent event);
+    void OnFollowTimer();
+    void UpdateStatus();
+
+  private:
+    void KeyHandler(Qt::KeyboardModifiers modifier, Qt::Key key, const QString& text) override;
+
+    void StartIndexing();
+    void StopIndexing();
+    // false if the line is past the indexed part of the file
+    bool JumpToLine(qint64 line);
+    // 1 based, 0 if the offset is past the indexed part
+    qint64 GetLineNumber(qint64 offset) const;
+    void SetFollowing(bool follow);
+    // after the followed file has changed its size
+    void Reopen();
+
+    QString Path;
+    ViewedFile::Ptr File;
+    FileView* View;
+    QLineEdit* JumpEdit;
+    QLabel* StatusLabel;
+    QTimer* FollowTimer;
+
+    LineIndexer* Indexer;
+    // by offset, the first one is the start of the file
+    QVector<LineCheckpoint> Checkpoints;
+    qint64 IndexedSize;
+    qint64 IndexedLines; // line breaks before IndexedSize
+    // line asked for before the index has reached it, 0 if none
+    qint64 PendingLine;
+    bool FollowStatPending;
+    TabContext Context;
+  };
+} // namespace TotalFinder